@@ -7,6 +7,7 @@
 
 #include "event.h"
 #include "event_handler.h"
+#include "engine/private/profiler.h"
 
 namespace engine {
 
@@ -28,6 +29,7 @@ class EventDispatcher {
   }
 
   void Offer(std::unique_ptr<Event>& event) {
+    ENGINE_PROFILE_SCOPE("EventDispatcher::Offer");
 
     // We want to use find here so we don't create a handler for this current level.
     auto subscribers = _subscribers.find(event->type);
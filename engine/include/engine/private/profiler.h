@@ -0,0 +1,273 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Scoped cpu zones, on by default in debug builds and compiled out in
+// release builds. -DENGINE_PROFILE=1 or 0 overrides the default.
+#ifndef ENGINE_PROFILE
+  #ifdef NDEBUG
+    #define ENGINE_PROFILE 0
+  #else
+    #define ENGINE_PROFILE 1
+  #endif
+#endif
+
+#define ENGINE_PROFILE_CONCAT_IMPL(a, b) a##b
+#define ENGINE_PROFILE_CONCAT(a, b) ENGINE_PROFILE_CONCAT_IMPL(a, b)
+
+#if ENGINE_PROFILE
+  // name has to outlive the profiler, e.g. a string literal.
+  #define ENGINE_PROFILE_SCOPE(name) ::engine::profiler::Zone ENGINE_PROFILE_CONCAT(engine_profile_zone_, __LINE__)(name)
+  #define ENGINE_PROFILE_FUNCTION() ENGINE_PROFILE_SCOPE(__func__)
+  #define ENGINE_PROFILE_THREAD(name) ::engine::profiler::SetThreadName(name)
+  #define ENGINE_PROFILE_WRITE(path) ::engine::profiler::WriteChromeTrace(path)
+#else
+  #define ENGINE_PROFILE_SCOPE(name)
+  #define ENGINE_PROFILE_FUNCTION()
+  #define ENGINE_PROFILE_THREAD(name)
+  #define ENGINE_PROFILE_WRITE(path) (static_cast<void>(path), false)
+#endif
+
+namespace engine::profiler {
+
+// events kept per thread, later zones are dropped (and counted).
+constexpr size_t MAX_EVENTS_PER_THREAD = 1 << 20;
+
+struct Event {
+  const char* name;
+  // nanoseconds since the profiler started.
+  uint64_t start;
+  uint64_t duration;
+};
+
+/**
+ * @brief Events of one thread. Only the owning thread appends, without
+ * locks: an event is written before the chunk's count is published, so a
+ * reader on another thread sees complete events up to the count it loads.
+ * Chunks are never moved or freed while the process runs.
+ */
+class ThreadBuffer {
+ public:
+  static constexpr size_t CHUNK_SIZE = 4096;
+
+  struct Chunk {
+    std::array<Event, CHUNK_SIZE> events;
+    std::atomic<size_t> count{0};
+    std::atomic<Chunk*> next{nullptr};
+  };
+
+  ThreadBuffer(uint32_t id): id_(id), head_(new Chunk()), tail_(head_) {}
+
+  ~ThreadBuffer() {
+    Chunk* chunk = head_;
+    while (chunk != nullptr) {
+      Chunk* next = chunk->next.load(std::memory_order_relaxed);
+      delete chunk;
+      chunk = next;
+    }
+  }
+
+  ThreadBuffer(const ThreadBuffer&) = delete;
+  ThreadBuffer& operator=(const ThreadBuffer&) = delete;
+
+  void Push(const Event& event) {
+    size_t count = tail_->count.load(std::memory_order_relaxed);
+    if (count == CHUNK_SIZE) {
+      if (written_ >= MAX_EVENTS_PER_THREAD) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      Chunk* chunk = new Chunk();
+      tail_->next.store(chunk, std::memory_order_release);
+      tail_ = chunk;
+      count = 0;
+    }
+    tail_->events[count] = event;
+    tail_->count.store(count + 1, std::memory_order_release);
+    written_++;
+  }
+
+  /**
+   * @brief Calls fn for every published event, from any thread.
+   */
+  template<class Fn>
+  void ForEach(Fn fn) const {
+    for (const Chunk* chunk = head_; chunk != nullptr; chunk = chunk->next.load(std::memory_order_acquire)) {
+      size_t count = chunk->count.load(std::memory_order_acquire);
+      for (size_t i = 0; i < count; i++) {
+        fn(chunk->events[i]);
+      }
+    }
+  }
+
+  uint32_t GetId() const {
+    return id_;
+  }
+
+  size_t GetDroppedCount() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  const uint32_t id_;
+  Chunk* const head_;
+  // owning thread only.
+  Chunk* tail_;
+  size_t written_ = 0;
+  std::atomic<size_t> dropped_{0};
+};
+
+/**
+ * @brief Every thread that recorded a zone. Locked when a thread records its
+ * first zone and on export, never per zone.
+ */
+class Registry {
+ public:
+  Registry(): epoch_(std::chrono::steady_clock::now()) {}
+
+  ThreadBuffer* Register() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    threads_.push_back(std::make_unique<ThreadBuffer>(static_cast<uint32_t>(threads_.size() + 1)));
+    names_.emplace_back();
+    return threads_.back().get();
+  }
+
+  void SetThreadName(const ThreadBuffer* thread, const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    names_[thread->GetId() - 1] = name;
+  }
+
+  uint64_t Now() const {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch_).count());
+  }
+
+  bool IsEnabled() const {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  void SetEnabled(bool enabled) {
+    enabled_.store(enabled, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Chrome trace event format ("X" complete events in microseconds),
+   * open it in chrome://tracing or Perfetto.
+   */
+  bool WriteChromeTrace(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ofstream file(path, std::ios::trunc);
+    file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    auto separator = [&file, &first]() {
+      file << (first ? "\n" : ",\n");
+      first = false;
+    };
+    size_t dropped = 0;
+    for (size_t i = 0; i < threads_.size(); i++) {
+      const ThreadBuffer& thread = *threads_[i];
+      if (!names_[i].empty()) {
+        separator();
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread.GetId()
+             << ",\"args\":{\"name\":\"" << names_[i] << "\"}}";
+      }
+      thread.ForEach([&](const Event& event) {
+        separator();
+        // fixed point microseconds, keeps the nanoseconds.
+        file << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread.GetId()
+             << ",\"ts\":" << event.start / 1000 << "." << pad_nanoseconds(event.start % 1000)
+             << ",\"dur\":" << event.duration / 1000 << "." << pad_nanoseconds(event.duration % 1000) << "}";
+      });
+      dropped += thread.GetDroppedCount();
+    }
+    file << "\n],\"otherData\":{\"dropped_events\":" << dropped << "}}\n";
+    return static_cast<bool>(file);
+  }
+
+  size_t GetDroppedCount() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t dropped = 0;
+    for (const auto& thread : threads_) {
+      dropped += thread->GetDroppedCount();
+    }
+    return dropped;
+  }
+
+ private:
+  static std::string pad_nanoseconds(uint64_t nanoseconds) {
+    std::string digits = std::to_string(nanoseconds);
+    return std::string(3 - digits.size(), '0') + digits;
+  }
+
+  const std::chrono::steady_clock::time_point epoch_;
+  std::atomic<bool> enabled_{true};
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<ThreadBuffer>> threads_;
+  std::vector<std::string> names_;
+};
+
+inline Registry& GetRegistry() {
+  static Registry registry;
+  return registry;
+}
+
+inline ThreadBuffer* GetThreadBuffer() {
+  thread_local ThreadBuffer* buffer = GetRegistry().Register();
+  return buffer;
+}
+
+/**
+ * @brief Names the calling thread in the trace.
+ */
+inline void SetThreadName(const std::string& name) {
+  GetRegistry().SetThreadName(GetThreadBuffer(), name);
+}
+
+/**
+ * @brief Stops or resumes recording zones, e.g. to capture a few frames.
+ */
+inline void SetEnabled(bool enabled) {
+  GetRegistry().SetEnabled(enabled);
+}
+
+inline bool WriteChromeTrace(const std::string& path) {
+  return GetRegistry().WriteChromeTrace(path);
+}
+
+/**
+ * @brief Records the time from construction to destruction under name.
+ */
+class Zone {
+ public:
+  Zone(const char* name): name_(name) {
+    Registry& registry = GetRegistry();
+    if (registry.IsEnabled()) {
+      start_ = registry.Now();
+    }
+  }
+
+  ~Zone() {
+    if (start_ == NOT_RECORDED) {
+      return;
+    }
+    uint64_t end = GetRegistry().Now();
+    GetThreadBuffer()->Push(Event{name_, start_, end - start_});
+  }
+
+  Zone(const Zone&) = delete;
+  Zone& operator=(const Zone&) = delete;
+
+ private:
+  static constexpr uint64_t NOT_RECORDED = ~0ull;
+
+  const char* name_;
+  uint64_t start_ = NOT_RECORDED;
+};
+
+} // namespace engine::profiler
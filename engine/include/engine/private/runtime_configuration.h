@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <string>
 
 #include "log.h"
 
@@ -11,9 +12,13 @@ namespace engine {
 struct RuntimeConfiguration {
   const std::shared_ptr<engine::monitor::ILog> client_logger;
   const std::shared_ptr<engine::monitor::ILog> core_logger;
-  RuntimeConfiguration(LoggerPointer client_logger, LoggerPointer core_logger): 
+  // where the cpu profiler zones are written as a Chrome trace on exit,
+  // nothing is written when empty.
+  const std::string trace_path;
+  RuntimeConfiguration(LoggerPointer client_logger, LoggerPointer core_logger, const std::string& trace_path = ""): 
     client_logger(client_logger),
-    core_logger(core_logger) {}
+    core_logger(core_logger),
+    trace_path(trace_path) {}
 };
 
 } // namespace engine
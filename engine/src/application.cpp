@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include <iostream>
 #include <memory>
 
@@ -8,6 +9,7 @@
 #include "engine/private/events/window.h"
 #include "engine/private/application.h"
 #include "engine/private/log.h"
+#include "engine/private/profiler.h"
 #include "engine/private/runtime_configuration.h"
 #include "core.h"
 #include "imgui_controller.h"
@@ -36,7 +38,9 @@ Application::Application() {
   auto core_logger = engine::monitor::Create(engine::monitor::LoggerType::CoreLogger, core_options);
   core_logger->Warn("Created Core Logger!");
 
-  runtime_configuration_.reset(new engine::RuntimeConfiguration(client_logger, core_logger));
+  // ENGINE_TRACE=trace.json opts in to writing the cpu trace on exit.
+  const char* trace_path = std::getenv("ENGINE_TRACE");
+  runtime_configuration_.reset(new engine::RuntimeConfiguration(client_logger, core_logger, trace_path ? trace_path : ""));
 
   window_controller_.reset(engine::IWindowController::Create());
 
@@ -91,13 +95,22 @@ void Application::Run() {
   unsigned int indices[3] = { 0, 1, 2 };
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
+  ENGINE_PROFILE_THREAD("main");
   while (application_state->running) {
+    ENGINE_PROFILE_SCOPE("Application::Run frame");
     glBindVertexArray(vertex_array);
     glDrawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, nullptr);
     window_controller_->OnUpdate(window_);
-    imgui->Start();
-    imgui->OnUpdate(window_);
-    imgui->End();
+    {
+      ENGINE_PROFILE_SCOPE("ImGui");
+      imgui->Start();
+      imgui->OnUpdate(window_);
+      imgui->End();
+    }
+  }
+  const std::string& trace_path = runtime_configuration->trace_path;
+  if (!trace_path.empty() && ENGINE_PROFILE_WRITE(trace_path)) {
+    runtime_configuration->core_logger->Info("Wrote " + trace_path);
   }
 }
 
@@ -2,6 +2,7 @@
 #include "engine/private/events/key_event.h"
 #include "engine/private/events/mouse_event.h"
 #include "engine/private/window.h"
+#include "engine/private/profiler.h"
 #include "linux_window.h"
 #include "core.h"
 
@@ -124,6 +125,7 @@ GLFWwindow* WindowController::create_glfw_window(const engine::WindowOptions& op
 }
 
 void WindowController::OnUpdate(std::unique_ptr<engine::Window>& window) {
+  ENGINE_PROFILE_SCOPE("WindowController::OnUpdate");
   glfwPollEvents();
   auto platform_window = static_cast<engine::p_linux::Window*>(window.get());
   auto opengl_window = static_cast<GLFWwindow*>(platform_window->window);
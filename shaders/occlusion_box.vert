@@ -0,0 +1,27 @@
+#version 450
+
+// A cube from -1 to 1 around a bounding sphere, drawn with an occlusion
+// query (see occlusion_queries.h). Its 36 vertices come from gl_VertexIndex.
+layout(push_constant) uniform Box {
+  // box space to clip space.
+  mat4 box_to_clip;
+} box;
+
+const vec3 corners[8] = vec3[](
+  vec3(-1.0, -1.0, -1.0), vec3(1.0, -1.0, -1.0), vec3(-1.0, 1.0, -1.0), vec3(1.0, 1.0, -1.0),
+  vec3(-1.0, -1.0, 1.0), vec3(1.0, -1.0, 1.0), vec3(-1.0, 1.0, 1.0), vec3(1.0, 1.0, 1.0)
+);
+
+// two triangles per face, both sides are rasterized.
+const int indices[36] = int[](
+  0, 2, 1, 1, 2, 3,
+  4, 5, 6, 5, 7, 6,
+  0, 1, 4, 1, 5, 4,
+  2, 6, 3, 3, 6, 7,
+  0, 4, 2, 2, 4, 6,
+  1, 3, 5, 3, 7, 5
+);
+
+void main() {
+  gl_Position = box.box_to_clip * vec4(corners[indices[gl_VertexIndex]], 1.0);
+}
@@ -13,11 +13,14 @@ layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
 
+// Instance attributes, the per instance model matrix (binding 1)
+layout(location = 3) in mat4 inModel;
+
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
 
 void main() {
-  gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+  gl_Position = ubo.proj * ubo.view * ubo.model * inModel * vec4(inPosition, 1.0);
   fragColor = inColor;
   fragTexCoord = inTexCoord;
 }
\ No newline at end of file
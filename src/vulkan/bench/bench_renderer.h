@@ -0,0 +1,480 @@
+// Headless scene renderer shared by the renderer benchmarks: a grid of
+// instances of the viking room model or of a generated sphere, seen from a
+// camera that orbits it once over the measured frames, so every run renders
+// the same images. Run the benchmarks from the repository root, the texture
+// and model are loaded from build/textures and models like demo_main.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../vulkan.h"
+#include "../command_pool.h"
+#include "../constants.h"
+#include "../frame_pacing.h"
+#include "../frame_scheduler.h"
+#include "../frustum_culling.h"
+#include "../gpu_culler.h"
+#include "../gpu_profiler.h"
+#include "../indices.h"
+#include "../model.h"
+#include "../parallel_recorder.h"
+#include "../scene.h"
+#include "../software_occlusion.h"
+#include "../swapchain_manager.h"
+#include "../texture_image.h"
+#include "../uniform_buffer_object.h"
+#include "../vertex.h"
+
+namespace bench {
+
+struct TimeStats {
+  double min;
+  double avg;
+  double p50;
+  double p95;
+  double p99;
+  double max;
+};
+
+TimeStats compute_stats(std::vector<double> samples) {
+  std::sort(samples.begin(), samples.end());
+  double total = 0.0;
+  for (double sample : samples) {
+    total += sample;
+  }
+  auto percentile = [&samples](double p) {
+    return samples[std::min(samples.size() - 1, static_cast<size_t>(samples.size() * p))];
+  };
+  return TimeStats{samples.front(), total / samples.size(), percentile(0.50), percentile(0.95), percentile(0.99), samples.back()};
+}
+
+std::string to_json(const TimeStats& stats) {
+  std::ostringstream json;
+  json << "{\"min\": " << stats.min << ", \"avg\": " << stats.avg << ", \"p50\": " << stats.p50
+       << ", \"p95\": " << stats.p95 << ", \"p99\": " << stats.p99 << ", \"max\": " << stats.max << "}";
+  return json.str();
+}
+
+double time_ms(const std::chrono::high_resolution_clock::time_point& start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+uint32_t parse_uint(const std::string& value) {
+  return static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+}
+
+// A uv sphere of radius 0.5 around the origin with z up, roughly the size of
+// the viking room.
+std::unique_ptr<VT::Model> make_sphere(uint32_t rings, uint32_t segments) {
+  const float pi = 3.14159265358979f;
+  std::vector<VT::Vertex> vertices;
+  std::vector<uint32_t> indices;
+  for (uint32_t ring = 0; ring <= rings; ring++) {
+    float v = static_cast<float>(ring) / rings;
+    float theta = v * pi;
+    for (uint32_t segment = 0; segment <= segments; segment++) {
+      float u = static_cast<float>(segment) / segments;
+      float phi = u * 2.0f * pi;
+      glm::vec3 normal(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta));
+      vertices.push_back(VT::Vertex{normal * 0.5f, normal * 0.5f + 0.5f, glm::vec2(u, v)});
+    }
+  }
+  for (uint32_t ring = 0; ring < rings; ring++) {
+    for (uint32_t segment = 0; segment < segments; segment++) {
+      uint32_t a = ring * (segments + 1) + segment;
+      uint32_t b = a + segments + 1;
+      indices.insert(indices.end(), {a, b, a + 1, a + 1, b, b + 1});
+    }
+  }
+  return std::make_unique<VT::Model>(std::move(vertices), std::move(indices));
+}
+
+/**
+ * @brief Instances of one mesh on a square grid in the xy plane and a
+ * camera orbiting it once over frame_count frames. Depends only on the
+ * frame, not on time.
+ */
+class GridScene {
+  VT::Scene _scene;
+  float _radius;
+
+public:
+  GridScene(uint32_t instances, const VT::SceneMesh& mesh) {
+    VT::MeshHandle handle = _scene.AddMesh(mesh);
+    const float spacing = 1.5f;
+    uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(instances))));
+    float half = (side - 1) * spacing * 0.5f;
+    for (uint32_t i = 0; i < instances; i++) {
+      _scene.AddInstance(handle, glm::vec3((i % side) * spacing - half, (i / side) * spacing - half, 0.0f));
+    }
+    _radius = half * 1.5f + 3.0f;
+  }
+
+  const VT::Scene& GetScene() const {
+    return _scene;
+  }
+
+  // view and projection of the frame, model is the identity.
+  VT::UniformBufferObject ComputeCamera(uint32_t frame, uint32_t frame_count, VkExtent2D extent) const {
+    float angle = 2.0f * 3.14159265358979f * frame / frame_count;
+    glm::vec3 eye(std::cos(angle) * _radius, std::sin(angle) * _radius, _radius * 0.6f);
+
+    VT::UniformBufferObject ubo{};
+    ubo.model = glm::mat4(1.0f);
+    ubo.view = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    ubo.proj = glm::perspective(glm::radians(45.0f), extent.width / (float) extent.height, 0.1f, _radius * 4.0f);
+    ubo.proj[1][1] *= -1;
+    return ubo;
+  }
+
+  // the camera with the model matrix of each visible instance, for drawing
+  // without instancing.
+  void ComputeObjects(const VT::UniformBufferObject& camera, const std::vector<uint32_t>& visible, std::vector<VT::UniformBufferObject>& objects) const {
+    VT::UniformBufferObject ubo = camera;
+    objects.resize(visible.size());
+    for (size_t i = 0; i < visible.size(); i++) {
+      ubo.model = _scene.GetModelMatrix(visible[i]);
+      objects[i] = ubo;
+    }
+  }
+};
+
+struct BenchRendererOptions {
+  uint32_t instances;
+  // "viking" or "sphere".
+  std::string mesh;
+  VkExtent2D extent;
+  VT::FramePacingPolicy pacing;
+  // samples the gpu profiler keeps per scope.
+  size_t gpu_window;
+  // one instanced draw for all instances, or a draw with its own uniform
+  // data per instance (at most 4096, the uniform ring's capacity).
+  bool instanced = true;
+  // only draw the instances in the view frustum.
+  bool cull = true;
+  // cull in a compute shader and draw with indirect draws instead, takes
+  // precedence over instanced and cull.
+  bool gpu_cull = false;
+  // also cull the instances hidden behind others against a depth pyramid
+  // (two phase), implies gpu_cull.
+  bool occlusion = false;
+  // after frustum culling, also drop the instances hidden behind others by
+  // rasterizing the model's largest triangles on the cpu. Ignored when
+  // culling on the gpu.
+  bool software_occlusion = false;
+  // after frustum culling, skip the instances whose proxy box had no
+  // samples in an occlusion query. Implies instanced, ignored when culling
+  // on the gpu.
+  bool occlusion_queries = false;
+};
+
+struct FrameTimes {
+  // wall time of the whole frame.
+  double frame_ms;
+  // without waiting for a frame slot.
+  double cpu_ms;
+  // recording the render pass, on one or on all worker threads.
+  double record_ms;
+  // frustum culling the instances, 0 when culling is off. Recording the
+  // compute pass when culling on the gpu.
+  double cull_ms;
+  // the two steps of software occlusion culling, 0 when it is off.
+  double occlusion_rasterize_ms = 0.0;
+  double occlusion_test_ms = 0.0;
+};
+
+/**
+ * @brief The headless demo renderer reduced to what the benchmarks need.
+ */
+class BenchRenderer {
+  BenchRendererOptions _options;
+  std::shared_ptr<VT::Vulkan> _instance;
+  std::unique_ptr<VT::FrameScheduler> _frame_scheduler;
+  std::unique_ptr<VT::GpuProfiler> _gpu_profiler;
+  std::unique_ptr<VT::CommandPool> _command_pool;
+  std::unique_ptr<VT::TextureView> _texture_image;
+  std::unique_ptr<phx::Window> _window;
+  std::unique_ptr<VT::SwapchainManager> _swapchain_manager;
+
+  std::unique_ptr<VT::Model> _model;
+  VkBuffer _vertex_buffer;
+  VT::Allocation _vertex_buffer_memory;
+  VT::IndexBuffer _index_buffer;
+
+  std::unique_ptr<GridScene> _scene;
+  VT::FrustumCuller _frustum_culler;
+  std::unique_ptr<VT::GpuCuller> _gpu_culler;
+  std::unique_ptr<VT::SoftwareOcclusionCuller> _occlusion_culler;
+  // every instance, when culling is off.
+  std::vector<uint32_t> _all_instances;
+  std::vector<VT::UniformBufferObject> _objects;
+  // draws and triangles of the last frame.
+  uint32_t _draw_count = 0;
+  uint64_t _triangle_count = 0;
+  size_t _visible_count = 0;
+  // what the gpu culled in the last frame, when culling on the gpu.
+  VT::GpuCullStats _gpu_cull_stats{};
+  VT::OcclusionQueryStats _occlusion_query_stats{0, 0};
+
+public:
+  BenchRenderer(const BenchRendererOptions& options): _options(options) {
+    VT::VulkanOptions vulkan_options(nullptr, "renderer_bench", "townsend engine", true);
+    _instance = VT::CreateInstance(vulkan_options);
+    VkDevice device = _instance->GetVkDevice();
+    VkPhysicalDevice physical_device = _instance->GetVkPhysicalDevice();
+    uint32_t frames_in_flight = options.pacing.frames_in_flight;
+
+    VT::FrameSchedulerOptions scheduler_options{device, frames_in_flight, _instance->SupportsTimelineSemaphores()};
+    _frame_scheduler = std::make_unique<VT::FrameScheduler>(scheduler_options);
+    VT::GpuProfilerOptions profiler_options{device, physical_device, _instance->GetQueueFamilyIndices().graphicsFamily.value(), frames_in_flight};
+    profiler_options.window = options.gpu_window;
+    _gpu_profiler = std::make_unique<VT::GpuProfiler>(profiler_options);
+
+    _command_pool = std::make_unique<VT::CommandPool>(_instance, frames_in_flight);
+    _texture_image = std::make_unique<VT::TextureView>(_instance, _command_pool);
+    _swapchain_manager = std::make_unique<VT::SwapchainManager>(_instance, _texture_image, _window, options.pacing, options.extent);
+
+    if (options.mesh == "sphere") {
+      _model = make_sphere(64, 128);
+    } else {
+      VT::LoadModelOptions model_options{VT::MODEL_PATH, VT::MODEL_CACHE_PATH};
+      _model = VT::LoadModel(model_options);
+    }
+
+    auto quantization = VT::ComputeMeshQuantization(_model->GetVertices(), _model->GetVertexCount());
+    VT::CreateVertexBufferOptions vertex_options{device, physical_device, &_command_pool->GetUploadQueue(), _model->GetVertices(), _model->GetVertexCount(), quantization};
+    VT::CreateVertexBuffer(vertex_options, _vertex_buffer, _vertex_buffer_memory);
+    VT::CreateIndexBufferOptions index_options{device, physical_device, &_command_pool->GetUploadQueue()};
+    VT::CreateIndexBuffer(index_options, _model->GetIndices(), _model->GetIndexCount(), _model->GetVertexCount(), _index_buffer);
+    _command_pool->GetUploadQueue().Flush();
+
+    VT::SceneMesh mesh{0, _index_buffer.index_count, 0, VT::GetMeshVertexTransform(quantization), _model->GetBounds()};
+    _scene = std::make_unique<GridScene>(options.instances, mesh);
+    for (uint32_t i = 0; i < options.instances; i++) {
+      _all_instances.push_back(i);
+    }
+    if (options.gpu_cull || options.occlusion) {
+      _gpu_culler = std::make_unique<VT::GpuCuller>(_instance, frames_in_flight);
+      _gpu_culler->UploadScene(_scene->GetScene(), _command_pool->GetUploadQueue());
+      _command_pool->GetUploadQueue().Flush();
+    } else if (options.software_occlusion) {
+      _occlusion_culler = std::make_unique<VT::SoftwareOcclusionCuller>();
+      _occlusion_culler->SetOccluder(0, VT::BuildOccluderProxy(_model->GetVertices(), _model->GetVertexCount(), _model->GetIndices(), _model->GetIndexCount(), 256));
+    }
+  }
+
+  ~BenchRenderer() {
+    _frame_scheduler->WaitIdle();
+    VkDevice device = _instance->GetVkDevice();
+    VT::DestroyBuffer(device, _index_buffer.buffer, _index_buffer.memory);
+    VT::DestroyBuffer(device, _vertex_buffer, _vertex_buffer_memory);
+  }
+
+  BenchRenderer(const BenchRenderer&) = delete;
+  BenchRenderer& operator=(const BenchRenderer&) = delete;
+
+  /**
+   * @brief Renders frame path_frame of a path_frames long camera path. The
+   * draws are recorded inline when recorder is null.
+   */
+  FrameTimes RenderFrame(uint32_t path_frame, uint32_t path_frames, VT::ParallelCommandRecorder* recorder = nullptr) {
+    auto frame_start = std::chrono::high_resolution_clock::now();
+    _frame_scheduler->BeginFrame();
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+    uint32_t slot = _frame_scheduler->GetFrameIndex();
+    _command_pool->GetUploadQueue().Collect();
+
+    VT::UniformBufferObject camera = _scene->ComputeCamera(path_frame, path_frames, _options.extent);
+    if (_gpu_culler) {
+      return render_gpu_culled_frame(frame_start, cpu_start, slot, camera);
+    }
+
+    const std::vector<uint32_t>* visible = &_all_instances;
+    glm::mat4 view_proj = camera.proj * camera.view * camera.model;
+    FrameTimes times{0.0, 0.0, 0.0, 0.0};
+    if (_options.cull) {
+      visible = &_frustum_culler.Cull(_scene->GetScene().GetBounds(), view_proj);
+      times.cull_ms = _frustum_culler.GetStats().cull_ms;
+    }
+    if (_occlusion_culler) {
+      visible = &_occlusion_culler->Cull(_scene->GetScene(), view_proj, *visible);
+      times.occlusion_rasterize_ms = _occlusion_culler->GetStats().rasterize_ms;
+      times.occlusion_test_ms = _occlusion_culler->GetStats().test_ms;
+    }
+    if (_options.occlusion_queries) {
+      VT::OcclusionQueries& queries = _swapchain_manager->GetOcclusionQueries();
+      visible = &queries.Update(*_frame_scheduler, _scene->GetScene(), view_proj, *visible);
+      _occlusion_query_stats = queries.GetStats();
+    }
+    _visible_count = visible->size();
+    if (_options.instanced || _options.occlusion_queries) {
+      _swapchain_manager->UpdateScene(slot, camera, _scene->GetScene(), visible);
+    } else {
+      _scene->ComputeObjects(camera, *visible, _objects);
+      _swapchain_manager->UpdateUniformBuffers(slot, _objects, _scene->GetScene().GetMesh(0));
+    }
+
+    auto record_start = std::chrono::high_resolution_clock::now();
+    VkCommandBuffer command_buffer = begin_command_buffer(slot);
+    _gpu_profiler->BeginFrame(command_buffer, slot);
+    {
+      VT::GpuScope frameScope(_gpu_profiler.get(), command_buffer, "frame");
+      // headless frame slot i renders into offscreen image i.
+      if (_options.occlusion_queries) {
+        _swapchain_manager->CompleteRenderPassQueries(command_buffer, slot, slot, _vertex_buffer, _index_buffer, _gpu_profiler.get());
+      } else if (recorder != nullptr) {
+        _swapchain_manager->CompleteRenderPassParallel(command_buffer, slot, slot, _vertex_buffer, _index_buffer, *recorder, _gpu_profiler.get());
+      } else {
+        _swapchain_manager->CompleteRenderPass(command_buffer, slot, slot, _vertex_buffer, _index_buffer, _gpu_profiler.get());
+      }
+    }
+    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+      throw std::runtime_error("failed to record command buffer!");
+    }
+    times.record_ms = time_ms(record_start);
+    _draw_count = _swapchain_manager->GetDrawCount(slot);
+    _triangle_count = _swapchain_manager->GetTriangleCount(slot);
+
+    submit(command_buffer);
+    times.frame_ms = time_ms(frame_start);
+    times.cpu_ms = time_ms(cpu_start);
+    return times;
+  }
+
+  void WaitIdle() {
+    _frame_scheduler->WaitIdle();
+  }
+
+  /**
+   * @brief A recorder for this renderer's queue and frames in flight. Call
+   * WaitIdle before destroying it, and destroy it before the renderer.
+   */
+  std::unique_ptr<VT::ParallelCommandRecorder> CreateRecorder(unsigned thread_count) {
+    VT::ParallelRecorderOptions options{_instance->GetVkDevice(), _instance->GetQueueFamilyIndices().graphicsFamily.value(), _options.pacing.frames_in_flight, thread_count};
+    return std::make_unique<VT::ParallelCommandRecorder>(options);
+  }
+
+  const std::shared_ptr<VT::Vulkan>& GetInstance() const {
+    return _instance;
+  }
+
+  VT::GpuProfiler& GetGpuProfiler() {
+    return *_gpu_profiler;
+  }
+
+  uint32_t GetDrawCount() const {
+    return _draw_count;
+  }
+
+  uint64_t GetTriangleCount() const {
+    return _triangle_count;
+  }
+
+  // instances left after culling in the last frame.
+  size_t GetVisibleCount() const {
+    return _visible_count;
+  }
+
+  std::string GetDeviceName() const {
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(_instance->GetVkPhysicalDevice(), &properties);
+    return properties.deviceName;
+  }
+
+  const VT::GpuCullStats& GetGpuCullStats() const {
+    return _gpu_cull_stats;
+  }
+
+  const VT::OcclusionQueryStats& GetOcclusionQueryStats() const {
+    return _occlusion_query_stats;
+  }
+
+  bool UsesConditionalRendering() const {
+    return _instance->SupportsConditionalRendering();
+  }
+
+  // null unless culling on the gpu.
+  const VT::GpuCuller* GetGpuCuller() const {
+    return _gpu_culler.get();
+  }
+
+private:
+  VkCommandBuffer begin_command_buffer(uint32_t slot) {
+    VkCommandBuffer command_buffer = _command_pool->GetCommandBuffer(slot);
+    vkResetCommandBuffer(command_buffer, 0);
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (vkBeginCommandBuffer(command_buffer, &beginInfo) != VK_SUCCESS) {
+      throw std::runtime_error("failed to begin recording command buffer!");
+    }
+    return command_buffer;
+  }
+
+  void submit(VkCommandBuffer command_buffer) {
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &command_buffer;
+    _command_pool->GetUploadQueue().Flush();
+    if (_frame_scheduler->Submit(_instance->GetGraphicsQueue(), submitInfo) != VK_SUCCESS) {
+      throw std::runtime_error("failed to submit draw command buffer!");
+    }
+  }
+
+  // the cpu only uploads the camera and records a fixed number of commands.
+  // The counts are read back from the slot's previous frame, which just
+  // completed, so they lag frames_in_flight frames behind.
+  FrameTimes render_gpu_culled_frame(
+      const std::chrono::high_resolution_clock::time_point& frame_start,
+      const std::chrono::high_resolution_clock::time_point& cpu_start,
+      uint32_t slot,
+      const VT::UniformBufferObject& camera) {
+    _gpu_cull_stats = _gpu_culler->ReadStats(slot);
+    _visible_count = _gpu_cull_stats.visible_instances;
+    _draw_count = _gpu_cull_stats.draws;
+    _triangle_count = _gpu_cull_stats.triangles;
+    _swapchain_manager->UpdateUniformBuffer(slot, camera);
+
+    auto record_start = std::chrono::high_resolution_clock::now();
+    VkCommandBuffer command_buffer = begin_command_buffer(slot);
+    _gpu_profiler->BeginFrame(command_buffer, slot);
+    double cull_ms = 0.0;
+    {
+      VT::GpuScope frameScope(_gpu_profiler.get(), command_buffer, "frame");
+      {
+        auto cull_start = std::chrono::high_resolution_clock::now();
+        VT::GpuScope cullScope(_gpu_profiler.get(), command_buffer, "gpu_cull");
+        VT::DepthPyramid* pyramid = _options.occlusion ? &_swapchain_manager->GetDepthPyramid() : nullptr;
+        _gpu_culler->RecordCull(command_buffer, slot, camera.proj * camera.view * camera.model, pyramid);
+        cull_ms = time_ms(cull_start);
+      }
+      if (_options.occlusion) {
+        _swapchain_manager->CompleteRenderPassOcclusion(command_buffer, slot, slot, _vertex_buffer, _index_buffer, *_gpu_culler, _gpu_profiler.get());
+      } else {
+        _swapchain_manager->CompleteRenderPassIndirect(command_buffer, slot, slot, _vertex_buffer, _index_buffer, *_gpu_culler, _gpu_profiler.get());
+      }
+    }
+    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+      throw std::runtime_error("failed to record command buffer!");
+    }
+    double record_ms = time_ms(record_start);
+
+    submit(command_buffer);
+    return FrameTimes{time_ms(frame_start), time_ms(cpu_start), record_ms, cull_ms};
+  }
+};
+} // bench
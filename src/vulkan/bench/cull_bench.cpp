@@ -0,0 +1,124 @@
+// Benchmarks the scalar, SSE and AVX2 paths of VT::CullSpheres on a large
+// random field of bounding spheres around a camera, and checks that every
+// path keeps exactly the same spheres. Also checks VT::Scene bounds and
+// batching with culling on a small scene. Needs no gpu.
+//
+// usage: cull_bench [instances] [iterations]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../frustum_culling.h"
+#include "../scene.h"
+
+namespace {
+
+double time_ms(const std::chrono::high_resolution_clock::time_point& start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// camera at the origin looking down +x with z up, the field is a cube around
+// it so roughly a tenth of the spheres end up in view.
+glm::mat4 make_view_proj() {
+  glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+  glm::mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 500.0f);
+  proj[1][1] *= -1;
+  return proj * view;
+}
+
+VT::BoundingSpheres make_spheres(size_t count) {
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+  std::uniform_real_distribution<float> radius(0.5f, 4.0f);
+  VT::BoundingSpheres spheres;
+  for (size_t i = 0; i < count; i++) {
+    spheres.push_back(glm::vec3(position(rng), position(rng), position(rng)), radius(rng));
+  }
+  return spheres;
+}
+
+bool run_path(VT::CullPath path, const VT::Frustum& frustum, const VT::BoundingSpheres& spheres, uint32_t iterations,
+              const std::vector<uint32_t>& reference, double scalar_ms, double& best_ms) {
+  std::vector<uint32_t> visible(spheres.size());
+  size_t count = VT::CullSpheres(frustum, spheres, visible.data(), path);
+
+  best_ms = 0.0;
+  double total_ms = 0.0;
+  for (uint32_t i = 0; i < iterations; i++) {
+    auto start = std::chrono::high_resolution_clock::now();
+    count = VT::CullSpheres(frustum, spheres, visible.data(), path);
+    double ms = time_ms(start);
+    best_ms = i == 0 ? ms : std::min(best_ms, ms);
+    total_ms += ms;
+  }
+  visible.resize(count);
+
+  bool identical = reference.empty() || visible == reference;
+  std::cout << "  " << VT::GetCullPathName(path) << ": best " << best_ms << " ms, avg " << total_ms / iterations
+            << " ms, " << best_ms * 1e6 / spheres.size() << " ns/instance";
+  if (scalar_ms > 0.0) {
+    std::cout << " (" << scalar_ms / best_ms << "x scalar)";
+  }
+  std::cout << ", " << count << " visible" << (identical ? "" : " MISMATCH") << std::endl;
+  return identical;
+}
+
+// two meshes, one instance of each in view and one behind the camera.
+bool check_scene_culling() {
+  VT::MeshBounds box{glm::vec3(-1.0f), glm::vec3(1.0f), glm::vec3(0.0f), std::sqrt(3.0f)};
+  VT::Scene scene;
+  VT::MeshHandle a = scene.AddMesh(VT::SceneMesh{0, 36, 0, glm::mat4(1.0f), box});
+  VT::MeshHandle b = scene.AddMesh(VT::SceneMesh{36, 36, 8, glm::mat4(1.0f), box});
+  scene.AddInstance(a, glm::vec3(20.0f, 0.0f, 0.0f));
+  scene.AddInstance(b, glm::vec3(-20.0f, 0.0f, 0.0f));
+  scene.AddInstance(b, glm::vec3(30.0f, 2.0f, 0.0f));
+  uint32_t moved = scene.AddInstance(a, glm::vec3(40.0f, 0.0f, 0.0f));
+  scene.SetPosition(moved, glm::vec3(-40.0f, 0.0f, 0.0f));
+
+  VT::FrustumCuller culler(VT::CullPath::Scalar);
+  const auto& visible = culler.Cull(scene.GetBounds(), make_view_proj());
+  std::vector<VT::InstanceData> instances(visible.size());
+  std::vector<VT::DrawBatch> batches;
+  scene.BuildBatches(instances.data(), batches, &visible);
+
+  bool ok = visible == std::vector<uint32_t>{0, 2} &&
+            batches.size() == 2 &&
+            batches[0].mesh == a && batches[0].first_instance == 0 && batches[0].instance_count == 1 &&
+            batches[1].mesh == b && batches[1].first_instance == 1 && batches[1].instance_count == 1;
+  std::cout << "scene culling: " << (ok ? "ok" : "FAILED") << std::endl;
+  return ok;
+}
+} // namespace
+
+int main(int argc, char** argv) {
+  size_t instances = argc > 1 ? static_cast<size_t>(std::atoll(argv[1])) : 1000000;
+  uint32_t iterations = argc > 2 ? static_cast<uint32_t>(std::atoi(argv[2])) : 50;
+  iterations = std::max(iterations, 1u);
+
+  bool ok = check_scene_culling();
+
+  VT::BoundingSpheres spheres = make_spheres(instances);
+  VT::Frustum frustum = VT::ExtractFrustum(make_view_proj());
+  std::cout << instances << " instances, " << iterations << " iterations, default path "
+            << VT::GetCullPathName(VT::GetDefaultCullPath()) << std::endl;
+
+  std::vector<uint32_t> reference(instances);
+  reference.resize(VT::CullSpheres(frustum, spheres, reference.data(), VT::CullPath::Scalar));
+
+  double scalar_ms = 0.0;
+  ok &= run_path(VT::CullPath::Scalar, frustum, spheres, iterations, reference, 0.0, scalar_ms);
+  for (VT::CullPath path : {VT::CullPath::SSE, VT::CullPath::AVX2}) {
+    if (!VT::IsCullPathSupported(path)) {
+      std::cout << "  " << VT::GetCullPathName(path) << ": not supported" << std::endl;
+      continue;
+    }
+    double best_ms = 0.0;
+    ok &= run_path(path, frustum, spheres, iterations, reference, scalar_ms, best_ms);
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,321 @@
+// Runs VT::MemoryAllocator against a fake device and checks the
+// sub-allocation rules: offsets honor the requested alignment, buddies are
+// split and merged back on free, linear and optimal resources never share a
+// memory object, requests that do not fit a block get dedicated memory, and
+// empty blocks are released except for the last one of a pool. Then times
+// allocating and freeing a mix of resource sizes. Needs no gpu.
+//
+// usage: memory_bench [allocations] [iterations]
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../memory_allocator.h"
+
+namespace {
+
+const VkDeviceSize MiB = 1024 * 1024;
+
+/**
+ * @brief What the fake device holds, outlives the allocator that owns the
+ * backend.
+ */
+struct FakeDevice {
+  struct Memory {
+    uint32_t heap;
+    VkDeviceSize size;
+    std::vector<char> storage;
+    bool mapped;
+  };
+
+  VkPhysicalDeviceMemoryProperties properties;
+  std::map<VkDeviceMemory, Memory> live;
+  std::vector<VkDeviceSize> heap_used;
+  size_t allocate_calls = 0;
+  // Map on mapped memory, Unmap on unmapped memory or Free while mapped.
+  size_t map_errors = 0;
+  uint64_t next_handle = 1;
+};
+
+/**
+ * @brief Hands out fake memory objects, fails like a driver once a heap is
+ * full. Mapped memory is real host memory.
+ */
+class FakeMemoryBackend : public VT::DeviceMemoryBackend {
+  FakeDevice& _device;
+
+public:
+  FakeMemoryBackend(FakeDevice& device): _device(device) {}
+
+  VkResult Allocate(uint32_t memory_type_index, VkDeviceSize size, VkDeviceMemory& memory) override {
+    _device.allocate_calls++;
+    uint32_t heap = _device.properties.memoryTypes[memory_type_index].heapIndex;
+    if (_device.heap_used[heap] + size > _device.properties.memoryHeaps[heap].size) {
+      return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    }
+    _device.heap_used[heap] += size;
+    memory = (VkDeviceMemory) _device.next_handle++;
+    _device.live[memory] = FakeDevice::Memory{heap, size, {}, false};
+    return VK_SUCCESS;
+  }
+
+  void Free(VkDeviceMemory memory) override {
+    auto found = _device.live.find(memory);
+    if (found == _device.live.end()) {
+      throw std::runtime_error("freed unknown memory!");
+    }
+    _device.map_errors += found->second.mapped ? 1 : 0;
+    _device.heap_used[found->second.heap] -= found->second.size;
+    _device.live.erase(found);
+  }
+
+  VkResult Map(VkDeviceMemory memory, void** data) override {
+    FakeDevice::Memory& entry = _device.live.at(memory);
+    _device.map_errors += entry.mapped ? 1 : 0;
+    entry.mapped = true;
+    entry.storage.resize(entry.size);
+    *data = entry.storage.data();
+    return VK_SUCCESS;
+  }
+
+  void Unmap(VkDeviceMemory memory) override {
+    FakeDevice::Memory& entry = _device.live.at(memory);
+    _device.map_errors += entry.mapped ? 0 : 1;
+    entry.mapped = false;
+  }
+};
+
+// a device local heap, by default 64 MiB (8 MiB blocks, below the 16 MiB
+// dedicated threshold), and a 256 MiB host visible one (the default 64 MiB
+// blocks cap to 32 MiB).
+VkPhysicalDeviceMemoryProperties make_properties(VkDeviceSize device_heap = 64 * MiB) {
+  VkPhysicalDeviceMemoryProperties properties{};
+  properties.memoryHeapCount = 2;
+  properties.memoryHeaps[0].size = device_heap;
+  properties.memoryHeaps[0].flags = VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+  properties.memoryHeaps[1].size = 256 * MiB;
+  properties.memoryTypeCount = 2;
+  properties.memoryTypes[0].propertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  properties.memoryTypes[0].heapIndex = 0;
+  properties.memoryTypes[1].propertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  properties.memoryTypes[1].heapIndex = 1;
+  return properties;
+}
+
+const VkMemoryPropertyFlags DEVICE_LOCAL = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+const VkMemoryPropertyFlags HOST_VISIBLE = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+const VkDeviceSize DEVICE_BLOCK_SIZE = 8 * MiB;
+
+VkMemoryRequirements requirements(VkDeviceSize size, VkDeviceSize alignment) {
+  return VkMemoryRequirements{size, alignment, 0x3};
+}
+
+struct Fixture {
+  FakeDevice device;
+  std::unique_ptr<VT::MemoryAllocator> allocator;
+
+  Fixture(const VkPhysicalDeviceMemoryProperties& properties = make_properties()) {
+    device.properties = properties;
+    device.heap_used.resize(properties.memoryHeapCount, 0);
+    VT::MemoryAllocatorOptions options{};
+    options.memory_properties = properties;
+    allocator = std::make_unique<VT::MemoryAllocator>(std::make_unique<FakeMemoryBackend>(device), options);
+  }
+};
+
+bool report(const std::string& name, bool ok) {
+  std::cout << name << ": " << (ok ? "ok" : "FAILED") << std::endl;
+  return ok;
+}
+
+// offsets are multiples of the alignment and live allocations of a memory
+// object never overlap.
+bool check_alignment() {
+  Fixture fixture;
+  std::mt19937 rng(1234);
+  std::vector<VT::Allocation> allocations;
+  bool ok = true;
+  for (int i = 0; i < 200; i++) {
+    VkDeviceSize size = 1 + rng() % (64 * 1024);
+    VkDeviceSize alignment = VkDeviceSize(1) << (rng() % 17);
+    allocations.push_back(fixture.allocator->Allocate(requirements(size, alignment), DEVICE_LOCAL, VT::MemoryResourceKind::LINEAR));
+    ok &= allocations.back().offset % alignment == 0 && allocations.back().size == size;
+  }
+
+  std::sort(allocations.begin(), allocations.end(), [](const VT::Allocation& a, const VT::Allocation& b) {
+    return a.memory != b.memory ? a.memory < b.memory : a.offset < b.offset;
+  });
+  for (size_t i = 1; i < allocations.size(); i++) {
+    if (allocations[i].memory == allocations[i - 1].memory) {
+      ok &= allocations[i - 1].offset + allocations[i - 1].size <= allocations[i].offset;
+    }
+  }
+  for (VT::Allocation& allocation : allocations) {
+    fixture.allocator->Free(allocation);
+  }
+  return report("alignment", ok);
+}
+
+// two minimum size allocations are buddies of a split block, freed they
+// merge back so the whole block can be handed out again.
+bool check_buddy_merge() {
+  Fixture fixture;
+  VT::MemoryAllocator& allocator = *fixture.allocator;
+  VT::Allocation a = allocator.Allocate(requirements(100, 4), DEVICE_LOCAL, VT::MemoryResourceKind::LINEAR);
+  VT::Allocation b = allocator.Allocate(requirements(100, 4), DEVICE_LOCAL, VT::MemoryResourceKind::LINEAR);
+  VkDeviceMemory memory = a.memory;
+  bool ok = b.memory == memory && a.offset == 0 && b.offset == VT::MIN_MEMORY_ALLOCATION_SIZE;
+  ok &= allocator.GetStats().bytes_used == 2 * VT::MIN_MEMORY_ALLOCATION_SIZE;
+
+  // a freed piece is handed out again before anything is split further.
+  allocator.Free(a);
+  VT::Allocation c = allocator.Allocate(requirements(VT::MIN_MEMORY_ALLOCATION_SIZE, 4), DEVICE_LOCAL, VT::MemoryResourceKind::LINEAR);
+  ok &= c.memory == memory && c.offset == 0;
+  allocator.Free(b);
+  allocator.Free(c);
+  ok &= allocator.GetStats().bytes_used == 0;
+
+  VT::Allocation whole = allocator.Allocate(requirements(DEVICE_BLOCK_SIZE, 4), DEVICE_LOCAL, VT::MemoryResourceKind::LINEAR);
+  ok &= whole.block != nullptr && whole.memory == memory && whole.offset == 0;
+  ok &= allocator.GetStats().block_count == 1 && fixture.device.allocate_calls == 1;
+  allocator.Free(whole);
+  return report("buddy split and merge", ok);
+}
+
+// buffers and optimally tiled images of the same memory type come from
+// different memory objects, so bufferImageGranularity never applies.
+bool check_resource_kinds() {
+  Fixture fixture;
+  VT::MemoryAllocator& allocator = *fixture.allocator;
+  VT::Allocation buffer = allocator.Allocate(requirements(4096, 256), DEVICE_LOCAL, VT::MemoryResourceKind::LINEAR);
+  VT::Allocation image = allocator.Allocate(requirements(4096, 256), DEVICE_LOCAL, VT::MemoryResourceKind::OPTIMAL);
+  VT::Allocation other_buffer = allocator.Allocate(requirements(4096, 256), DEVICE_LOCAL, VT::MemoryResourceKind::LINEAR);
+  bool ok = buffer.memory != image.memory && buffer.memory == other_buffer.memory;
+  ok &= allocator.GetStats().block_count == 2;
+  allocator.Free(buffer);
+  allocator.Free(image);
+  allocator.Free(other_buffer);
+  return report("linear and optimal resources", ok);
+}
+
+// a request bigger than the block of a small heap but below the dedicated
+// threshold, one above the threshold, and one whose alignment exceeds the
+// block, all get their own memory object. Dedicated memory still in use is
+// freed with the allocator.
+bool check_dedicated() {
+  Fixture fixture;
+  VT::MemoryAllocator& allocator = *fixture.allocator;
+  VT::Allocation over_block = allocator.Allocate(requirements(12 * MiB, 256), DEVICE_LOCAL, VT::MemoryResourceKind::LINEAR);
+  VT::Allocation over_threshold = allocator.Allocate(requirements(20 * MiB, 256), HOST_VISIBLE, VT::MemoryResourceKind::LINEAR);
+  VT::Allocation over_alignment = allocator.Allocate(requirements(4096, 2 * DEVICE_BLOCK_SIZE), DEVICE_LOCAL, VT::MemoryResourceKind::OPTIMAL);
+  bool ok = over_block.block == nullptr && over_block.offset == 0 && over_block.size == 12 * MiB;
+  ok &= over_threshold.block == nullptr && over_threshold.mapped != nullptr;
+  ok &= over_alignment.block == nullptr;
+  VT::MemoryAllocatorStats stats = allocator.GetStats();
+  ok &= stats.dedicated_count == 3 && stats.block_count == 0 && fixture.device.live.size() == 3;
+
+  allocator.Free(over_block);
+  allocator.Free(over_threshold);
+  allocator.Free(over_alignment);
+  ok &= allocator.GetStats().dedicated_count == 0 && fixture.device.live.empty();
+
+  allocator.Allocate(requirements(20 * MiB, 256), HOST_VISIBLE, VT::MemoryResourceKind::LINEAR);
+  fixture.allocator.reset();
+  ok &= fixture.device.live.empty() && fixture.device.map_errors == 0;
+  return report("dedicated fallback", ok);
+}
+
+// a second block is created when the first is full and released once it is
+// empty, the last block of the pool stays until the allocator goes. Host
+// visible blocks are mapped once and every allocation points into the
+// mapping.
+bool check_block_release() {
+  Fixture fixture;
+  VT::MemoryAllocator& allocator = *fixture.allocator;
+  VT::Allocation first = allocator.Allocate(requirements(DEVICE_BLOCK_SIZE, 256), DEVICE_LOCAL, VT::MemoryResourceKind::LINEAR);
+  VT::Allocation second = allocator.Allocate(requirements(1024, 256), DEVICE_LOCAL, VT::MemoryResourceKind::LINEAR);
+  VT::Allocation third = allocator.Allocate(requirements(1024, 256), DEVICE_LOCAL, VT::MemoryResourceKind::LINEAR);
+  bool ok = first.block != nullptr && first.memory != second.memory && second.memory == third.memory;
+  ok &= allocator.GetStats().block_count == 2 && fixture.device.live.size() == 2;
+
+  allocator.Free(second);
+  ok &= allocator.GetStats().block_count == 2;
+  allocator.Free(third);
+  ok &= allocator.GetStats().block_count == 1 && fixture.device.live.count(first.memory) == 1;
+  VkDeviceMemory last = first.memory;
+  allocator.Free(first);
+  ok &= allocator.GetStats().block_count == 1 && fixture.device.live.count(last) == 1;
+
+  VT::Allocation a = allocator.Allocate(requirements(1024, 256), HOST_VISIBLE, VT::MemoryResourceKind::LINEAR);
+  VT::Allocation b = allocator.Allocate(requirements(1024, 256), HOST_VISIBLE, VT::MemoryResourceKind::LINEAR);
+  ok &= a.mapped != nullptr && b.mapped == static_cast<char*>(a.mapped) + b.offset - a.offset;
+  std::memset(b.mapped, 0xab, b.size);
+  allocator.Free(a);
+  allocator.Free(b);
+
+  // unmapped and freed with the allocator.
+  fixture.allocator.reset();
+  ok &= fixture.device.live.empty() && fixture.device.map_errors == 0;
+  return report("empty block release", ok);
+}
+
+double time_ms(const std::chrono::high_resolution_clock::time_point& start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+} // namespace
+
+int main(int argc, char** argv) {
+  size_t count = argc > 1 ? static_cast<size_t>(std::atoll(argv[1])) : 10000;
+  uint32_t iterations = argc > 2 ? static_cast<uint32_t>(std::atoi(argv[2])) : 20;
+  iterations = std::max(iterations, 1u);
+
+  bool ok = check_alignment();
+  ok &= check_buddy_merge();
+  ok &= check_resource_kinds();
+  ok &= check_dedicated();
+  ok &= check_block_release();
+
+  // uniform and vertex buffers, textures: mostly small with a few large.
+  std::mt19937 rng(4321);
+  std::vector<VkMemoryRequirements> sizes(count);
+  for (auto& size : sizes) {
+    size = requirements(rng() % 8 == 0 ? 64 * 1024 + rng() % (1024 * 1024) : 256 + rng() % 16384, 256);
+  }
+
+  Fixture fixture(make_properties(64 * 1024 * MiB));
+  std::vector<VT::Allocation> allocations(count);
+  double best_allocate = 0.0, best_free = 0.0;
+  for (uint32_t i = 0; i < iterations; i++) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t j = 0; j < count; j++) {
+      allocations[j] = fixture.allocator->Allocate(sizes[j], DEVICE_LOCAL, VT::MemoryResourceKind::LINEAR);
+    }
+    double allocate_ms = time_ms(start);
+    if (i == 0) {
+      VT::MemoryAllocatorStats stats = fixture.allocator->GetStats();
+      std::cout << count << " allocations in " << stats.block_count << " blocks and " << stats.dedicated_count
+                << " dedicated, " << stats.bytes_used / MiB << " of " << stats.bytes_reserved / MiB << " MiB used" << std::endl;
+    }
+    // free in a different order than allocated, merging out of order.
+    std::shuffle(allocations.begin(), allocations.end(), rng);
+    start = std::chrono::high_resolution_clock::now();
+    for (VT::Allocation& allocation : allocations) {
+      fixture.allocator->Free(allocation);
+    }
+    double free_ms = time_ms(start);
+    best_allocate = i == 0 ? allocate_ms : std::min(best_allocate, allocate_ms);
+    best_free = i == 0 ? free_ms : std::min(best_free, free_ms);
+  }
+  ok &= report("all freed", fixture.allocator->GetStats().allocation_count == 0 && fixture.allocator->GetStats().bytes_used == 0);
+  std::cout << "allocate best " << best_allocate << " ms, free best " << best_free << " ms, "
+            << fixture.device.allocate_calls << " backend allocations over " << iterations << " iterations" << std::endl;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,181 @@
+// Benchmarks the serial and parallel vertex deduplication paths of
+// VT::LoadModel and the mesh optimization pass on the viking room model and
+// on a synthetic grid mesh. It also checks that VT::PackedVertex round trips
+// every vertex within the precision bounds of its formats, and that index
+// buffers switch to 16 bit exactly up to 65536 vertices.
+//
+// usage: mesh_bench [model_path] [grid_size] [thread_count]
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../buffer.h"
+#include "../constants.h"
+#include "../indices.h"
+#include "../mesh_optimizer.h"
+#include "../model.h"
+#include "../vertex_dedup.h"
+
+namespace {
+
+double time_ms(const std::chrono::high_resolution_clock::time_point& start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// grid_size x grid_size quads, two triangles each, with every quad emitting
+// its own corners so shared grid points have to be deduplicated. Positions
+// are integer aligned which is the worst case for the xor-shift std::hash.
+void make_grid_corners(uint32_t grid_size, std::vector<VT::Vertex>& corners) {
+  corners.clear();
+  corners.reserve(static_cast<size_t>(grid_size) * grid_size * 6);
+  auto corner = [grid_size](uint32_t x, uint32_t y) {
+    VT::Vertex vertex{};
+    vertex.pos = {static_cast<float>(x), static_cast<float>(y), 0.0f};
+    vertex.color = {1.0f, 1.0f, 1.0f};
+    vertex.texCoord = {static_cast<float>(x) / grid_size, static_cast<float>(y) / grid_size};
+    return vertex;
+  };
+  for (uint32_t y = 0; y < grid_size; y++) {
+    for (uint32_t x = 0; x < grid_size; x++) {
+      corners.push_back(corner(x, y));
+      corners.push_back(corner(x + 1, y));
+      corners.push_back(corner(x + 1, y + 1));
+      corners.push_back(corner(x, y));
+      corners.push_back(corner(x + 1, y + 1));
+      corners.push_back(corner(x, y + 1));
+    }
+  }
+}
+
+// Encodes and decodes every vertex and checks the error against the
+// precision of each format: half a 16 bit step of the bounding box for
+// positions, half a half float ulp for uvs and half an 8 bit step for colors.
+bool check_packed_precision(const std::vector<VT::Vertex>& vertices) {
+  auto quantization = VT::ComputeMeshQuantization(vertices.data(), vertices.size());
+  const float slack = 1e-6f;
+  glm::vec3 pos_bound = quantization.scale * (0.5f / 65535.0f);
+  float max_pos_error = 0.0f, max_uv_error = 0.0f, max_color_error = 0.0f;
+  bool ok = true;
+
+  for (const auto& vertex : vertices) {
+    VT::Vertex decoded = VT::DecodePackedVertex(VT::EncodePackedVertex(vertex, quantization), quantization);
+    for (int axis = 0; axis < 3; axis++) {
+      float pos_error = std::fabs(decoded.pos[axis] - vertex.pos[axis]);
+      // the box offset and size are floats too, allow for their rounding.
+      float pos_slack = slack * std::max(1.0f, std::fabs(vertex.pos[axis]));
+      ok &= pos_error <= pos_bound[axis] + pos_slack;
+      max_pos_error = std::max(max_pos_error, pos_error);
+
+      float color_error = std::fabs(decoded.color[axis] - vertex.color[axis]);
+      ok &= color_error <= 0.5f / 255.0f + slack;
+      max_color_error = std::max(max_color_error, color_error);
+    }
+    for (int axis = 0; axis < 2; axis++) {
+      float uv_error = std::fabs(decoded.texCoord[axis] - vertex.texCoord[axis]);
+      // 10 explicit mantissa bits, values below the smallest normal half
+      // are stored with a fixed step of 2^-24.
+      float uv_bound = std::max(std::fabs(vertex.texCoord[axis]) * std::ldexp(1.0f, -11), std::ldexp(1.0f, -25));
+      ok &= uv_error <= uv_bound;
+      max_uv_error = std::max(max_uv_error, uv_error);
+    }
+  }
+
+  std::cout << "  packed vertices: " << vertices.size() * sizeof(VT::Vertex) << " -> "
+            << vertices.size() * sizeof(VT::PackedVertex) << " bytes, max error pos "
+            << max_pos_error << ", uv " << max_uv_error << ", color " << max_color_error
+            << (ok ? " (within bounds)" : " (OUT OF BOUNDS)") << std::endl;
+  return ok;
+}
+
+// 65536 vertices is the largest mesh whose indices (0..65535) fit in 16 bits.
+bool check_index_type_boundary() {
+  bool ok = VT::ChooseIndexType(0) == VK_INDEX_TYPE_UINT16 &&
+            VT::ChooseIndexType(65535) == VK_INDEX_TYPE_UINT16 &&
+            VT::ChooseIndexType(65536) == VK_INDEX_TYPE_UINT16 &&
+            VT::ChooseIndexType(65537) == VK_INDEX_TYPE_UINT32;
+
+  std::vector<uint32_t> indices = {0, 1, 65534, 65535};
+  std::vector<uint16_t> narrow(indices.size());
+  VT::WriteIndices(indices.data(), indices.size(), VK_INDEX_TYPE_UINT16, narrow.data());
+  for (size_t i = 0; i < indices.size(); i++) {
+    ok &= narrow[i] == indices[i];
+  }
+
+  std::vector<uint32_t> wide(indices.size());
+  indices.back() = 65536;
+  VT::WriteIndices(indices.data(), indices.size(), VK_INDEX_TYPE_UINT32, wide.data());
+  ok &= wide == indices;
+
+  std::cout << "index type boundary: " << (ok ? "ok" : "FAILED") << std::endl;
+  return ok;
+}
+
+bool run_dedup(const std::string& name, const std::vector<VT::Vertex>& corners, unsigned thread_count) {
+  std::vector<VT::Vertex> serial_vertices, parallel_vertices;
+  std::vector<uint32_t> serial_indices, parallel_indices;
+
+  auto start = std::chrono::high_resolution_clock::now();
+  VT::DedupVertices(corners, serial_vertices, serial_indices);
+  double serial_ms = time_ms(start);
+
+  start = std::chrono::high_resolution_clock::now();
+  VT::DedupVerticesParallel(corners, parallel_vertices, parallel_indices, thread_count);
+  double parallel_ms = time_ms(start);
+
+  bool identical = serial_vertices == parallel_vertices && serial_indices == parallel_indices;
+  std::cout << name << ": " << corners.size() / 3 << " triangles, "
+            << serial_vertices.size() << " unique vertices" << std::endl;
+  std::cout << "  serial:   " << serial_ms << " ms" << std::endl;
+  std::cout << "  parallel: " << parallel_ms << " ms (" << thread_count << " threads, "
+            << serial_ms / parallel_ms << "x)" << std::endl;
+  std::cout << "  output " << (identical ? "identical" : "MISMATCH") << std::endl;
+  bool packed_ok = check_packed_precision(serial_vertices);
+  auto index_type = VT::ChooseIndexType(serial_vertices.size());
+  std::cout << "  index buffer: " << (index_type == VK_INDEX_TYPE_UINT16 ? "uint16, " : "uint32, ")
+            << serial_indices.size() * VT::GetIndexSize(index_type) << " bytes" << std::endl;
+
+  auto before = VT::AnalyzeVertexCache(serial_indices.data(), serial_indices.size(), serial_vertices.size());
+  start = std::chrono::high_resolution_clock::now();
+  VT::OptimizeMesh(serial_vertices, serial_indices);
+  double optimize_ms = time_ms(start);
+  auto after = VT::AnalyzeVertexCache(serial_indices.data(), serial_indices.size(), serial_vertices.size());
+  std::cout << "  optimize: " << optimize_ms << " ms" << std::endl;
+  std::cout << "    ACMR " << before.acmr << " -> " << after.acmr
+            << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+  return identical && packed_ok;
+}
+} // namespace
+
+int main(int argc, char** argv) {
+  std::string model_path = argc > 1 ? argv[1] : VT::MODEL_PATH;
+  uint32_t grid_size = argc > 2 ? static_cast<uint32_t>(std::atoi(argv[2])) : 1024;
+  unsigned thread_count = argc > 3 ? static_cast<unsigned>(std::atoi(argv[3])) : VT::DefaultThreadCount();
+
+  bool ok = check_index_type_boundary();
+  try {
+    std::vector<VT::Vertex> corners;
+    auto start = std::chrono::high_resolution_clock::now();
+    VT::LoadObjCorners(corners, model_path.c_str());
+    std::cout << "obj parse " << model_path << ": " << time_ms(start) << " ms" << std::endl;
+    ok &= run_dedup(model_path, corners, thread_count);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    ok = false;
+  }
+
+  std::vector<VT::Vertex> grid;
+  make_grid_corners(grid_size, grid);
+  ok &= run_dedup("grid " + std::to_string(grid_size) + "x" + std::to_string(grid_size), grid, thread_count);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,174 @@
+// Benchmarks VT::SoftwareOcclusionCuller: rasterizing occluder proxies into
+// the occlusion buffer and testing instances against it, for the scalar, SSE
+// and AVX2 paths and a growing number of threads, and checks that every path
+// and thread count keeps exactly the same instances. Also checks that an
+// instance behind a wall is culled and the ones in front of and beside it
+// are not. Needs no gpu.
+//
+// usage: occlusion_bench [instances] [iterations] [max_threads]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../frustum_culling.h"
+#include "../scene.h"
+#include "../software_occlusion.h"
+
+namespace {
+
+// camera at the origin looking down +x with z up, as in cull_bench.
+glm::mat4 make_view_proj() {
+  glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+  glm::mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 500.0f);
+  proj[1][1] *= -1;
+  return proj * view;
+}
+
+// an axis aligned box around the origin, 12 triangles.
+void make_box(const glm::vec3& half, std::vector<VT::Vertex>& vertices, std::vector<uint32_t>& indices) {
+  vertices.clear();
+  for (int i = 0; i < 8; i++) {
+    glm::vec3 corner((i & 1) ? half.x : -half.x, (i & 2) ? half.y : -half.y, (i & 4) ? half.z : -half.z);
+    vertices.push_back(VT::Vertex{corner, glm::vec3(1.0f), glm::vec2(0.0f)});
+  }
+  indices = {
+    0, 2, 1, 1, 2, 3, // -z
+    4, 5, 6, 5, 7, 6, // +z
+    0, 1, 4, 1, 5, 4, // -y
+    2, 6, 3, 3, 6, 7, // +y
+    0, 4, 2, 2, 4, 6, // -x
+    1, 3, 5, 3, 7, 5, // +x
+  };
+}
+
+std::vector<VT::CullPath> supported_paths() {
+  std::vector<VT::CullPath> paths;
+  for (VT::CullPath path : {VT::CullPath::Scalar, VT::CullPath::SSE, VT::CullPath::AVX2}) {
+    if (VT::IsCullPathSupported(path)) {
+      paths.push_back(path);
+    }
+  }
+  return paths;
+}
+
+// a wall in front of the camera, one small box behind it, one behind its
+// edge, one in front of it and one beside it.
+bool check_occlusion() {
+  std::vector<VT::Vertex> wall_vertices, box_vertices;
+  std::vector<uint32_t> wall_indices, box_indices;
+  make_box(glm::vec3(0.5f, 10.0f, 10.0f), wall_vertices, wall_indices);
+  make_box(glm::vec3(1.0f), box_vertices, box_indices);
+
+  VT::Scene scene;
+  VT::MeshHandle wall = scene.AddMesh(VT::SceneMesh{0, 36, 0, glm::mat4(1.0f), VT::ComputeMeshBounds(wall_vertices.data(), wall_vertices.size())});
+  VT::MeshHandle box = scene.AddMesh(VT::SceneMesh{36, 36, 8, glm::mat4(1.0f), VT::ComputeMeshBounds(box_vertices.data(), box_vertices.size())});
+  scene.AddInstance(wall, glm::vec3(20.0f, 0.0f, 0.0f));
+  scene.AddInstance(box, glm::vec3(40.0f, 0.0f, 0.0f));
+  scene.AddInstance(box, glm::vec3(40.0f, 15.0f, 0.0f));
+  scene.AddInstance(box, glm::vec3(10.0f, 0.0f, 0.0f));
+  scene.AddInstance(box, glm::vec3(40.0f, 30.0f, 0.0f));
+  std::vector<uint32_t> candidates = {0, 1, 2, 3, 4};
+  const std::vector<uint32_t> expected = {0, 3, 4};
+
+  // the two 20x20 faces, the largest triangles of the wall.
+  VT::OccluderProxy proxy = VT::BuildOccluderProxy(wall_vertices.data(), wall_vertices.size(), wall_indices.data(), wall_indices.size(), 4);
+  bool ok = proxy.indices.size() == 12 && proxy.positions.size() == 8;
+
+  for (VT::CullPath path : supported_paths()) {
+    for (unsigned threads : {1u, 3u}) {
+      VT::SoftwareOcclusionCuller culler({320, 192, threads, path});
+      culler.SetOccluder(wall, proxy);
+      const auto& visible = culler.Cull(scene, make_view_proj(), candidates);
+      ok &= visible == expected && culler.GetStats().occluders == 1 && culler.GetStats().occluded == 2;
+    }
+  }
+  std::cout << "occlusion: " << (ok ? "ok" : "FAILED") << std::endl;
+  return ok;
+}
+
+// rows of tall walls in front of the camera and a random field of small
+// boxes around it, like cull_bench.
+VT::Scene make_scene(size_t instances, VT::MeshHandle& wall) {
+  std::vector<VT::Vertex> vertices;
+  std::vector<uint32_t> indices;
+  VT::Scene scene;
+  make_box(glm::vec3(0.5f, 3.0f, 40.0f), vertices, indices);
+  wall = scene.AddMesh(VT::SceneMesh{0, 36, 0, glm::mat4(1.0f), VT::ComputeMeshBounds(vertices.data(), vertices.size())});
+  make_box(glm::vec3(1.0f), vertices, indices);
+  VT::MeshHandle box = scene.AddMesh(VT::SceneMesh{36, 36, 8, glm::mat4(1.0f), VT::ComputeMeshBounds(vertices.data(), vertices.size())});
+
+  for (int k = 0; k < 64; k++) {
+    scene.AddInstance(wall, glm::vec3(20.0f + 10.0f * (k / 16), -60.0f + 8.0f * (k % 16), 0.0f));
+  }
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+  for (size_t i = 0; i < instances; i++) {
+    scene.AddInstance(box, glm::vec3(position(rng), position(rng), position(rng)));
+  }
+  return scene;
+}
+
+double time_ms(const std::chrono::high_resolution_clock::time_point& start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+} // namespace
+
+int main(int argc, char** argv) {
+  size_t instances = argc > 1 ? static_cast<size_t>(std::atoll(argv[1])) : 100000;
+  uint32_t iterations = argc > 2 ? static_cast<uint32_t>(std::atoi(argv[2])) : 50;
+  unsigned max_threads = argc > 3 ? static_cast<unsigned>(std::atoi(argv[3])) : VT::DefaultThreadCount();
+  iterations = std::max(iterations, 1u);
+  max_threads = std::max(max_threads, 1u);
+
+  bool ok = check_occlusion();
+
+  VT::MeshHandle wall = 0;
+  VT::Scene scene = make_scene(instances, wall);
+  std::vector<VT::Vertex> vertices;
+  std::vector<uint32_t> indices;
+  make_box(glm::vec3(0.5f, 3.0f, 40.0f), vertices, indices);
+  VT::OccluderProxy proxy = VT::BuildOccluderProxy(vertices.data(), vertices.size(), indices.data(), indices.size(), 12);
+
+  glm::mat4 view_proj = make_view_proj();
+  VT::FrustumCuller frustum_culler;
+  auto start = std::chrono::high_resolution_clock::now();
+  std::vector<uint32_t> candidates = frustum_culler.Cull(scene.GetBounds(), view_proj);
+  std::cout << scene.GetInstanceCount() << " instances, " << candidates.size() << " in the frustum ("
+            << time_ms(start) << " ms), " << iterations << " iterations" << std::endl;
+
+  std::vector<uint32_t> reference;
+  for (VT::CullPath path : supported_paths()) {
+    for (unsigned threads = 1; threads <= max_threads; threads = threads < max_threads ? std::min(threads * 2, max_threads) : threads + 1) {
+      VT::SoftwareOcclusionCuller culler({320, 192, threads, path});
+      culler.SetOccluder(wall, proxy);
+      std::vector<uint32_t> visible = culler.Cull(scene, view_proj, candidates);
+
+      double best_rasterize = 0.0, best_test = 0.0, total_rasterize = 0.0, total_test = 0.0;
+      for (uint32_t i = 0; i < iterations; i++) {
+        culler.Cull(scene, view_proj, candidates);
+        const VT::SoftwareOcclusionStats& stats = culler.GetStats();
+        best_rasterize = i == 0 ? stats.rasterize_ms : std::min(best_rasterize, stats.rasterize_ms);
+        best_test = i == 0 ? stats.test_ms : std::min(best_test, stats.test_ms);
+        total_rasterize += stats.rasterize_ms;
+        total_test += stats.test_ms;
+      }
+
+      if (reference.empty()) {
+        reference = visible;
+      }
+      bool identical = visible == reference;
+      ok &= identical;
+      const VT::SoftwareOcclusionStats& stats = culler.GetStats();
+      std::cout << "  " << VT::GetCullPathName(path) << ", " << threads << " threads: rasterize best " << best_rasterize
+                << " ms avg " << total_rasterize / iterations << " ms (" << stats.triangles << " triangles), test best "
+                << best_test << " ms avg " << total_test / iterations << " ms, " << stats.occluded << " of "
+                << stats.tested << " occluded" << (identical ? "" : " MISMATCH") << std::endl;
+    }
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
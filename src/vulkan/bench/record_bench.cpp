@@ -0,0 +1,72 @@
+// Measures how recording the draws of a frame scales with the number of
+// recording threads: inline on the main thread, then into secondary command
+// buffers on 1, 2, 4, ... up to the core count worker threads. Every run
+// renders the same headless scene as renderer_bench with a draw per instance
+// and no culling (instancing would leave a single draw to record, culling a
+// varying number of them), only the time spent
+// recording the render pass is reported, as a table and as JSON.
+//
+// usage: record_bench [instances] [frames] [max_threads]
+#include <fstream>
+#include <thread>
+
+#include "bench_renderer.h"
+
+namespace {
+
+const uint32_t WARMUP_FRAMES = 30;
+
+bench::TimeStats measure(bench::BenchRenderer& renderer, VT::ParallelCommandRecorder* recorder, uint32_t frames) {
+  std::vector<double> record_ms;
+  for (uint32_t frame = 0; frame < WARMUP_FRAMES + frames; frame++) {
+    bool measured = frame >= WARMUP_FRAMES;
+    bench::FrameTimes times = renderer.RenderFrame(measured ? frame - WARMUP_FRAMES : frame, frames, recorder);
+    if (measured) {
+      record_ms.push_back(times.record_ms);
+    }
+  }
+  renderer.WaitIdle();
+  return bench::compute_stats(record_ms);
+}
+}
+
+int main(int argc, char** argv) {
+  uint32_t instances = argc > 1 ? static_cast<uint32_t>(std::atoi(argv[1])) : 4096;
+  uint32_t frames = argc > 2 ? static_cast<uint32_t>(std::atoi(argv[2])) : 300;
+  unsigned cores = std::thread::hardware_concurrency();
+  uint32_t max_threads = argc > 3 ? static_cast<uint32_t>(std::atoi(argv[3])) : std::max(cores, 1u);
+
+  try {
+    VT::FramePacingPolicy pacing = VT::GetFramePacingPolicy(VT::FramePacingMode::Throughput);
+    // a small target, the bench is about the cpu side.
+    bench::BenchRenderer renderer({instances, "sphere", {320, 240}, pacing, frames, false, false});
+
+    bench::TimeStats inline_stats = measure(renderer, nullptr, frames);
+    std::cout << instances << " draws, " << frames << " frames on " << renderer.GetDeviceName() << std::endl;
+    std::cout << "  inline:     p50 " << inline_stats.p50 << " ms, avg " << inline_stats.avg << " ms" << std::endl;
+
+    std::ostringstream json;
+    json << "{\n  \"bench\": \"record\",\n  \"draws\": " << instances << ",\n  \"frames\": " << frames
+         << ",\n  \"inline_ms\": " << bench::to_json(inline_stats) << ",\n  \"threads\": [";
+    for (uint32_t threads = 1; threads <= max_threads; threads *= 2) {
+      bench::TimeStats stats;
+      {
+        auto recorder = renderer.CreateRecorder(threads);
+        stats = measure(renderer, recorder.get(), frames);
+      }
+      std::cout << "  " << threads << (threads < 10 ? " thread(s): " : " threads:   ")
+                << "p50 " << stats.p50 << " ms, avg " << stats.avg << " ms ("
+                << inline_stats.p50 / stats.p50 << "x inline)" << std::endl;
+      json << (threads == 1 ? "\n" : ",\n") << "    {\"threads\": " << threads << ", \"record_ms\": " << bench::to_json(stats) << "}";
+    }
+    json << "\n  ]\n}\n";
+
+    std::ofstream file("record_bench.json", std::ios::trunc);
+    file << json.str();
+    std::cout << "wrote record_bench.json" << std::endl;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,212 @@
+// Renders a fixed scene headlessly for a fixed number of frames and reports
+// cpu frame time, gpu time, draw calls and memory use as JSON, for tracking
+// renderer performance across changes. The scene is a grid of instances of
+// the viking room model or of a generated sphere, seen from a camera that
+// orbits it once over the measured frames, so every run renders the same
+// images. It needs no window and runs on a software implementation:
+//
+//   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./build/renderer_bench --instances=256
+//
+// Run it from the repository root, the texture and model are loaded from
+// build/textures and models like demo_main.
+//
+// usage: renderer_bench [--instances=N] [--mesh=viking|sphere] [--frames=K]
+//                       [--warmup=W] [--size=WxH] [--frames-in-flight=N]
+//                       [--threads=T] [--per-object] [--no-cull] [--gpu-cull] [--occlusion]
+//                       [--sw-occlusion] [--occlusion-queries]
+//                       [--json=results.json]
+#include <fstream>
+
+#include <sys/resource.h>
+
+#include "bench_renderer.h"
+
+namespace {
+
+struct BenchOptions {
+  uint32_t instances = 64;
+  // "viking" or "sphere".
+  std::string mesh = "viking";
+  // measured frames, after the warmup frames.
+  uint32_t frames = 600;
+  uint32_t warmup = 60;
+  VkExtent2D extent = {1280, 720};
+  // record the draws on this many threads, 0 records them inline.
+  uint32_t threads = 0;
+  // a draw per instance instead of one instanced draw, at most 4096 instances.
+  bool per_object = false;
+  // draw every instance instead of only the ones in the view frustum.
+  bool no_cull = false;
+  // cull in a compute shader and draw with indirect draws.
+  bool gpu_cull = false;
+  // and also cull occluded instances against a depth pyramid.
+  bool occlusion = false;
+  // cull occluded instances on the cpu after frustum culling, without --gpu-cull.
+  bool sw_occlusion = false;
+  // skip instances hidden in hardware occlusion queries, without --gpu-cull.
+  bool occlusion_queries = false;
+  // also written here, empty for stdout only.
+  std::string json_path;
+};
+
+BenchOptions parse_options(int argc, char** argv) {
+  const std::string instances_arg = "--instances=";
+  const std::string mesh_arg = "--mesh=";
+  const std::string frames_arg = "--frames=";
+  const std::string warmup_arg = "--warmup=";
+  const std::string size_arg = "--size=";
+  const std::string threads_arg = "--threads=";
+  const std::string json_arg = "--json=";
+
+  BenchOptions options{};
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg.compare(0, instances_arg.size(), instances_arg) == 0) {
+      options.instances = std::max(bench::parse_uint(arg.substr(instances_arg.size())), 1u);
+    } else if (arg.compare(0, mesh_arg.size(), mesh_arg) == 0) {
+      options.mesh = arg.substr(mesh_arg.size());
+      if (options.mesh != "viking" && options.mesh != "sphere") {
+        throw std::runtime_error("unknown mesh " + options.mesh + "!");
+      }
+    } else if (arg.compare(0, frames_arg.size(), frames_arg) == 0) {
+      options.frames = std::max(bench::parse_uint(arg.substr(frames_arg.size())), 1u);
+    } else if (arg.compare(0, warmup_arg.size(), warmup_arg) == 0) {
+      options.warmup = bench::parse_uint(arg.substr(warmup_arg.size()));
+    } else if (arg.compare(0, size_arg.size(), size_arg) == 0) {
+      std::string value = arg.substr(size_arg.size());
+      size_t x = value.find('x');
+      if (x == std::string::npos) {
+        throw std::runtime_error("--size has to be WIDTHxHEIGHT!");
+      }
+      options.extent = {bench::parse_uint(value.substr(0, x)), bench::parse_uint(value.substr(x + 1))};
+      if (options.extent.width == 0 || options.extent.height == 0) {
+        throw std::runtime_error("--size has to be WIDTHxHEIGHT!");
+      }
+    } else if (arg.compare(0, threads_arg.size(), threads_arg) == 0) {
+      options.threads = bench::parse_uint(arg.substr(threads_arg.size()));
+    } else if (arg == "--per-object") {
+      options.per_object = true;
+    } else if (arg == "--no-cull") {
+      options.no_cull = true;
+    } else if (arg == "--gpu-cull") {
+      options.gpu_cull = true;
+    } else if (arg == "--occlusion") {
+      options.gpu_cull = true;
+      options.occlusion = true;
+    } else if (arg == "--sw-occlusion") {
+      options.sw_occlusion = true;
+    } else if (arg == "--occlusion-queries") {
+      options.occlusion_queries = true;
+    } else if (arg.compare(0, json_arg.size(), json_arg) == 0) {
+      options.json_path = arg.substr(json_arg.size());
+    }
+  }
+  return options;
+}
+
+int run(const BenchOptions& options, const VT::FramePacingPolicy& pacing) {
+  // every measured frame is kept, not only the default rolling window.
+  bench::BenchRenderer renderer({options.instances, options.mesh, options.extent, pacing, options.frames, !options.per_object, !options.no_cull, options.gpu_cull, options.occlusion, options.sw_occlusion, options.occlusion_queries});
+  std::unique_ptr<VT::ParallelCommandRecorder> recorder;
+  if (options.threads > 0) {
+    recorder = renderer.CreateRecorder(options.threads);
+  }
+
+  std::vector<double> frame_ms;
+  std::vector<double> cpu_ms;
+  std::vector<double> record_ms;
+  std::vector<double> cull_ms;
+  std::vector<double> occlusion_rasterize_ms;
+  std::vector<double> occlusion_test_ms;
+  for (uint32_t frame = 0; frame < options.warmup + options.frames; frame++) {
+    // the warmup frames orbit too, the measured ones start over.
+    bool measured = frame >= options.warmup;
+    uint32_t path_frame = measured ? frame - options.warmup : frame;
+    bench::FrameTimes times = renderer.RenderFrame(path_frame, options.frames, recorder.get());
+    if (measured) {
+      frame_ms.push_back(times.frame_ms);
+      cpu_ms.push_back(times.cpu_ms);
+      record_ms.push_back(times.record_ms);
+      cull_ms.push_back(times.cull_ms);
+      occlusion_rasterize_ms.push_back(times.occlusion_rasterize_ms);
+      occlusion_test_ms.push_back(times.occlusion_test_ms);
+    }
+  }
+  renderer.WaitIdle();
+
+  const auto& instance = renderer.GetInstance();
+  VT::MemoryAllocatorStats memory = VT::GetMemoryAllocator(instance->GetVkDevice(), instance->GetVkPhysicalDevice()).GetStats();
+  struct rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+
+  std::ostringstream json;
+  json << "{\n"
+       << "  \"bench\": \"renderer\",\n"
+       << "  \"device\": \"" << renderer.GetDeviceName() << "\",\n"
+       << "  \"mesh\": \"" << options.mesh << "\",\n"
+       << "  \"instances\": " << options.instances << ",\n"
+       << "  \"frames\": " << options.frames << ",\n"
+       << "  \"warmup\": " << options.warmup << ",\n"
+       << "  \"width\": " << options.extent.width << ",\n"
+       << "  \"height\": " << options.extent.height << ",\n"
+       << "  \"frames_in_flight\": " << pacing.frames_in_flight << ",\n"
+       << "  \"record_threads\": " << options.threads << ",\n"
+       << "  \"instanced\": " << (options.per_object ? "false" : "true") << ",\n"
+       << "  \"culling\": " << (options.no_cull ? "false" : "true") << ",\n"
+       << "  \"gpu_culling\": " << (options.gpu_cull ? "true" : "false") << ",\n"
+       << "  \"occlusion_culling\": " << (options.occlusion ? "true" : "false") << ",\n"
+       << "  \"software_occlusion\": " << (options.sw_occlusion && !options.gpu_cull ? "true" : "false") << ",\n"
+       << "  \"occlusion_queries\": " << (options.occlusion_queries && !options.gpu_cull ? "true" : "false") << ",\n"
+       << "  \"conditional_rendering\": " << (renderer.UsesConditionalRendering() ? "true" : "false") << ",\n"
+       << "  \"queried\": " << renderer.GetOcclusionQueryStats().queried << ",\n"
+       << "  \"query_hidden\": " << renderer.GetOcclusionQueryStats().hidden << ",\n"
+       << "  \"visible_instances\": " << renderer.GetVisibleCount() << ",\n"
+       << "  \"draw_calls\": " << renderer.GetDrawCount() << ",\n"
+       << "  \"triangles\": " << renderer.GetTriangleCount() << ",\n"
+       << "  \"frustum_culled\": " << renderer.GetGpuCullStats().frustum_culled << ",\n"
+       << "  \"occlusion_culled\": " << renderer.GetGpuCullStats().occlusion_culled << ",\n"
+       << "  \"late_instances\": " << renderer.GetGpuCullStats().late_instances << ",\n"
+       << "  \"frame_ms\": " << bench::to_json(bench::compute_stats(frame_ms)) << ",\n"
+       << "  \"cpu_ms\": " << bench::to_json(bench::compute_stats(cpu_ms)) << ",\n"
+       << "  \"record_ms\": " << bench::to_json(bench::compute_stats(record_ms)) << ",\n"
+       << "  \"cull_ms\": " << bench::to_json(bench::compute_stats(cull_ms)) << ",\n"
+       << "  \"occlusion_rasterize_ms\": " << bench::to_json(bench::compute_stats(occlusion_rasterize_ms)) << ",\n"
+       << "  \"occlusion_test_ms\": " << bench::to_json(bench::compute_stats(occlusion_test_ms)) << ",\n"
+       << "  \"gpu_ms\": {";
+  // the last frames_in_flight frames are never collected.
+  auto gpu_stats = renderer.GetGpuProfiler().GetStats();
+  for (size_t i = 0; i < gpu_stats.size(); i++) {
+    const auto& scope = gpu_stats[i];
+    json << (i == 0 ? "\n" : ",\n")
+         << "    \"" << scope.name << "\": " << bench::to_json(bench::TimeStats{scope.min_ms, scope.avg_ms, scope.p50_ms, scope.p95_ms, scope.p99_ms, scope.max_ms});
+  }
+  json << "\n  },\n"
+       << "  \"memory\": {\"device_bytes_reserved\": " << memory.bytes_reserved
+       << ", \"device_bytes_used\": " << memory.bytes_used
+       << ", \"allocations\": " << memory.allocation_count
+       << ", \"peak_rss_kb\": " << usage.ru_maxrss << "}\n"
+       << "}\n";
+
+  std::cout << json.str();
+  if (!options.json_path.empty()) {
+    std::ofstream file(options.json_path, std::ios::trunc);
+    file << json.str();
+    if (!file) {
+      throw std::runtime_error("failed to write " + options.json_path + "!");
+    }
+  }
+  return EXIT_SUCCESS;
+}
+}
+
+int main(int argc, char** argv) {
+  try {
+    BenchOptions options = parse_options(argc, argv);
+    // --frames-in-flight=N, the pacing mode itself does not matter headless.
+    VT::FramePacingPolicy pacing = VT::ParseFramePacingPolicy(argc, argv);
+    return run(options, pacing);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,141 @@
+// Compares the cpu cost of updating per frame uniform data through the
+// uniform ring buffer against the old path of one buffer and allocation per
+// frame in flight that is mapped, written and unmapped on every update.
+//
+// usage: uniform_bench [frames] [objects_per_frame]
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "../vulkan.h"
+#include "../buffer.h"
+#include "../uniform_buffer_object.h"
+#include "../uniform_ring_buffer.h"
+#include "../window.h"
+
+namespace {
+
+const uint32_t FRAMES_IN_FLIGHT = 2;
+
+double time_ms(const std::chrono::high_resolution_clock::time_point& start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// The update path before the ring buffer: a buffer with its own
+// vkAllocateMemory per frame in flight, mapped and unmapped on every write.
+double run_map_per_update(const std::shared_ptr<VT::Vulkan>& instance, uint32_t frames, uint32_t objects) {
+  VkDevice device = instance->GetVkDevice();
+  VkDeviceSize size = sizeof(VT::UniformBufferObject);
+  std::vector<VkBuffer> buffers(FRAMES_IN_FLIGHT);
+  std::vector<VkDeviceMemory> memory(FRAMES_IN_FLIGHT);
+
+  for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffers[i]) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create buffer!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, buffers[i], &memRequirements);
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = VT::FindMemoryType(memRequirements.memoryTypeBits,
+                                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                   instance->GetVkPhysicalDevice());
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &memory[i]) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate buffer memory!");
+    }
+    vkBindBufferMemory(device, buffers[i], memory[i], 0);
+  }
+
+  VkExtent2D extent{800, 600};
+  auto start = std::chrono::high_resolution_clock::now();
+  for (uint32_t frame = 0; frame < frames; frame++) {
+    uint32_t current = frame % FRAMES_IN_FLIGHT;
+    // with one buffer per frame every object overwrites the same data, this
+    // only measures the cost of the map/unmap path.
+    for (uint32_t object = 0; object < objects; object++) {
+      auto ubo = VT::ComputeUniformBufferObject(extent);
+      void* data;
+      vkMapMemory(device, memory[current], 0, sizeof(ubo), 0, &data);
+      memcpy(data, &ubo, sizeof(ubo));
+      vkUnmapMemory(device, memory[current]);
+    }
+  }
+  double elapsed = time_ms(start);
+
+  for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+    vkDestroyBuffer(device, buffers[i], nullptr);
+    vkFreeMemory(device, memory[i], nullptr);
+  }
+  return elapsed;
+}
+
+double run_ring(const std::shared_ptr<VT::Vulkan>& instance, uint32_t frames, uint32_t objects) {
+  VkPhysicalDeviceProperties properties{};
+  vkGetPhysicalDeviceProperties(instance->GetVkPhysicalDevice(), &properties);
+  VkDeviceSize alignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 1);
+  VkDeviceSize object_size = (sizeof(VT::UniformBufferObject) + alignment - 1) / alignment * alignment;
+
+  VT::UniformRingBuffer ring(instance->GetVkDevice(), instance->GetVkPhysicalDevice(), FRAMES_IN_FLIGHT, object_size * objects);
+
+  VkExtent2D extent{800, 600};
+  uint64_t checksum = 0;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (uint32_t frame = 0; frame < frames; frame++) {
+    ring.BeginFrame(frame % FRAMES_IN_FLIGHT);
+    for (uint32_t object = 0; object < objects; object++) {
+      checksum += VT::UpdateUniformBuffer(ring, extent);
+    }
+  }
+  double elapsed = time_ms(start);
+  // keep the offsets alive so the loop is not optimized away.
+  if (checksum == 1) {
+    std::cout << checksum << std::endl;
+  }
+  return elapsed;
+}
+} // namespace
+
+int main(int argc, char** argv) {
+  uint32_t frames = argc > 1 ? static_cast<uint32_t>(std::atoi(argv[1])) : 10000;
+  uint32_t objects = argc > 2 ? static_cast<uint32_t>(std::atoi(argv[2])) : 64;
+
+  try {
+    WindowOptions window_options{};
+    window_options.width = 800;
+    window_options.height = 600;
+    window_options.title = "uniform_bench";
+    window_options.visible = false;
+    phx::Window window(window_options);
+
+    VT::VulkanOptions options(window.GetGLFWwindow(), "uniform_bench", "townsend engine");
+    std::shared_ptr<VT::Vulkan> instance = VT::CreateInstance(options);
+
+    double updates = static_cast<double>(frames) * objects;
+    double map_ms = run_map_per_update(instance, frames, objects);
+    double ring_ms = run_ring(instance, frames, objects);
+
+    std::cout << frames << " frames x " << objects << " objects" << std::endl;
+    std::cout << "  map/unmap per update: " << map_ms << " ms (" << map_ms * 1e6 / updates << " ns/update)" << std::endl;
+    std::cout << "  uniform ring buffer:  " << ring_ms << " ms (" << ring_ms * 1e6 / updates << " ns/update, "
+              << map_ms / ring_ms << "x)" << std::endl;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
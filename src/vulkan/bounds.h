@@ -0,0 +1,82 @@
+#pragma once
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "vertex.h"
+
+namespace VT {
+
+/**
+ * @brief Model space bounds of a mesh, an axis aligned box and a sphere
+ * around it.
+ */
+struct MeshBounds {
+  glm::vec3 min;
+  glm::vec3 max;
+  // center of the box, the sphere is centered on it too.
+  glm::vec3 center;
+  float radius;
+};
+
+/**
+ * @brief The box is exact, the sphere is centered on the box and just
+ * contains every vertex, which is tighter than the box's circumscribed
+ * sphere for most meshes.
+ */
+MeshBounds ComputeMeshBounds(const Vertex* vertices, size_t vertex_count) {
+  MeshBounds bounds{glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), 0.0f};
+  if (vertex_count == 0) {
+    return bounds;
+  }
+
+  bounds.min = vertices[0].pos;
+  bounds.max = vertices[0].pos;
+  for (size_t i = 1; i < vertex_count; i++) {
+    bounds.min = glm::min(bounds.min, vertices[i].pos);
+    bounds.max = glm::max(bounds.max, vertices[i].pos);
+  }
+  bounds.center = (bounds.min + bounds.max) * 0.5f;
+
+  float radius_squared = 0.0f;
+  for (size_t i = 0; i < vertex_count; i++) {
+    glm::vec3 offset = vertices[i].pos - bounds.center;
+    radius_squared = std::max(radius_squared, glm::dot(offset, offset));
+  }
+  bounds.radius = std::sqrt(radius_squared);
+  return bounds;
+}
+
+/**
+ * @brief World space bounding spheres as a structure of arrays, one float
+ * array per component, so they can be loaded straight into SIMD registers.
+ */
+struct BoundingSpheres {
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<float> radius;
+
+  size_t size() const {
+    return radius.size();
+  }
+
+  void push_back(const glm::vec3& center, float r) {
+    x.push_back(center.x);
+    y.push_back(center.y);
+    z.push_back(center.z);
+    radius.push_back(r);
+  }
+
+  void set(size_t i, const glm::vec3& center, float r) {
+    x[i] = center.x;
+    y[i] = center.y;
+    z[i] = center.z;
+    radius[i] = r;
+  }
+};
+} // VT
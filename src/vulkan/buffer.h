@@ -3,6 +3,7 @@
 #include <GLFW/glfw3.h>
 
 #include "device.h"
+#include "memory_allocator.h"
 
 
 namespace VT {
@@ -12,7 +13,7 @@ namespace VT {
       VkBufferUsageFlags usage,
       VkMemoryPropertyFlags properties,
       VkBuffer& buffer,
-      VkDeviceMemory& bufferMemory,
+      VT::Allocation& bufferMemory,
       VkDevice device,
       VkPhysicalDevice physicalDevice) {
 
@@ -31,17 +32,17 @@ namespace VT {
     VkMemoryRequirements memRequirements;
     vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties, physicalDevice);
-
-    if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-      throw std::runtime_error("failed to allocate buffer memory!");
-    }
+    // The memory comes out of a larger block shared with other resources,
+    // see memory_allocator.h.
+    bufferMemory = VT::GetMemoryAllocator(device, physicalDevice).Allocate(memRequirements, properties, VT::MemoryResourceKind::LINEAR);
 
     // if memory allocation was successful we can associate this memory
-    // with the buffer
-    vkBindBufferMemory(device, buffer, bufferMemory, 0);
+    // with the buffer at the offset of its allocation.
+    vkBindBufferMemory(device, buffer, bufferMemory.memory, bufferMemory.offset);
+  }
+
+  void DestroyBuffer(VkDevice device, VkBuffer buffer, VT::Allocation& bufferMemory) {
+    vkDestroyBuffer(device, buffer, nullptr);
+    VT::FreeMemory(device, bufferMemory);
   }
 } // VT
\ No newline at end of file
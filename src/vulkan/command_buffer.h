@@ -85,7 +85,8 @@ void EndSingleTimeCommands(VkCommandBuffer commandBuffer, VkDevice device, VkCom
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = &commandBuffer;
 
-  // TODO: Create own dedicated queue for copy transfers
+  // resource uploads go through VT::UploadQueue on the transfer queue, this
+  // is only left for one off commands.
   vkQueueSubmit(graphics_queue, 1, &submitInfo, VK_NULL_HANDLE);
   // if multiple transfer can be done concurrently, a fence would allow that
   // instead of executing 1 at a time. Here we only have 1 so we wait
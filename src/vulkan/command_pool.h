@@ -7,6 +7,7 @@
 #include "vulkan.h"
 #include "renderpass.h"
 #include "image.h"
+#include "upload_queue.h"
 
 namespace VT {
 class CommandPool {
@@ -19,6 +20,8 @@ class CommandPool {
   std::vector<VkCommandBuffer> _command_buffers;
   const std::shared_ptr<Vulkan> _instance;
   const int _max_frames_in_flight;
+  // batches all staging uploads (buffers, textures, layout transitions).
+  std::unique_ptr<UploadQueue> _upload_queue;
 
  public:
   CommandPool(const std::shared_ptr<Vulkan>& instance, int max_frames_in_flight):
@@ -26,11 +29,13 @@ class CommandPool {
   _max_frames_in_flight(max_frames_in_flight) {
     init_pool(instance);
     init_command_buffers(instance, max_frames_in_flight);
+    init_upload_queue(instance);
   }
 
   // since we have a shared ptr to the instance of vulkan, this destructor
   // will be called before vulkan is destroyed
   ~CommandPool() {
+    _upload_queue.reset();
     vkDestroyCommandPool(_instance->GetVkDevice(), _command_pool, nullptr);
   }
 
@@ -46,6 +51,10 @@ class CommandPool {
     return _command_buffers[current_frame];
   }
 
+  UploadQueue& GetUploadQueue() {
+    return *_upload_queue;
+  }
+
  private:
   void init_pool(const std::shared_ptr<Vulkan>& instance) {
     VT::QueueFamilyIndices queueFamilyIndices = instance->GetQueueFamilyIndices();
@@ -68,5 +77,18 @@ class CommandPool {
     VT::CreateCommandBuffersOptions options { instance->GetVkDevice(), _command_pool, max_frames_in_flight};
     VT::CreateCommandBuffers(options, _command_buffers);
   }
+
+  void init_upload_queue(const std::shared_ptr<Vulkan>& instance) {
+    VT::UploadQueueOptions options{};
+    options.device = instance->GetVkDevice();
+    options.physical_device = instance->GetVkPhysicalDevice();
+    // uploads run on the transfer queue when the device has one, and are
+    // handed over to the graphics queue that renders with them.
+    options.queue_family_index = instance->GetQueueFamilyIndices().GetTransferFamily();
+    options.queue = instance->GetTransferQueue();
+    options.owner_queue_family_index = instance->GetQueueFamilyIndices().graphicsFamily.value();
+    options.owner_queue = instance->GetGraphicsQueue();
+    _upload_queue = std::make_unique<UploadQueue>(options);
+  }
 };
 }//
\ No newline at end of file
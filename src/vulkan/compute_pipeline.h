@@ -0,0 +1,81 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "graphics_pipeline.h"
+
+namespace VT {
+
+struct ComputePipelineOptions {
+  VkDevice device;
+  // spir-v, relative to the working directory like the graphics shaders.
+  std::string shader_path;
+  VkDescriptorSetLayout descriptor_set_layout;
+  // bytes of push constants the shader reads, 0 for none.
+  uint32_t push_constant_size;
+  VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+};
+
+struct ComputePipelineInfo {
+  VkPipelineLayout pipeline_layout;
+  VkPipeline compute_pipeline;
+};
+
+/**
+ * @brief A compute pipeline with a single descriptor set and push constants
+ * for the compute stage.
+ */
+ComputePipelineInfo CreateComputePipeline(const ComputePipelineOptions& options) {
+  auto shaderCode = read_file(options.shader_path);
+
+  VkShaderModuleCreateInfo moduleInfo{};
+  moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  moduleInfo.codeSize = shaderCode.size();
+  moduleInfo.pCode = reinterpret_cast<const uint32_t*>(shaderCode.data());
+
+  VkShaderModule shaderModule;
+  if (vkCreateShaderModule(options.device, &moduleInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create shader module!");
+  }
+
+  VkPushConstantRange pushConstantRange{};
+  pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  pushConstantRange.offset = 0;
+  pushConstantRange.size = options.push_constant_size;
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 1;
+  pipelineLayoutInfo.pSetLayouts = &options.descriptor_set_layout;
+  pipelineLayoutInfo.pushConstantRangeCount = options.push_constant_size > 0 ? 1 : 0;
+  pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+  VkPipelineLayout pipeline_layout;
+  if (vkCreatePipelineLayout(options.device, &pipelineLayoutInfo, nullptr, &pipeline_layout) != VK_SUCCESS) {
+    vkDestroyShaderModule(options.device, shaderModule, nullptr);
+    throw std::runtime_error("failed to create compute pipeline layout!");
+  }
+
+  VkComputePipelineCreateInfo pipelineInfo{};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipelineInfo.stage.module = shaderModule;
+  pipelineInfo.stage.pName = "main";
+  pipelineInfo.layout = pipeline_layout;
+
+  VkPipeline compute_pipeline;
+  VkResult result = vkCreateComputePipelines(options.device, options.pipeline_cache, 1, &pipelineInfo, nullptr, &compute_pipeline);
+  vkDestroyShaderModule(options.device, shaderModule, nullptr);
+  if (result != VK_SUCCESS) {
+    vkDestroyPipelineLayout(options.device, pipeline_layout, nullptr);
+    throw std::runtime_error("failed to create compute pipeline!");
+  }
+
+  return ComputePipelineInfo{pipeline_layout, compute_pipeline};
+}
+} // VT
@@ -4,5 +4,9 @@
 
 namespace VT {
 const std::string MODEL_PATH = "models/viking_room.obj";
+// deduplicated binary copy of MODEL_PATH, rebuilt whenever the obj changes.
+const std::string MODEL_CACHE_PATH = "models/viking_room.vtmesh";
 const std::string TEXTURE_PATH = "textures/viking_room.png";
+// VkPipelineCache contents, saved on shutdown and loaded on the next start.
+const std::string PIPELINE_CACHE_PATH = "pipeline_cache.bin";
 }
\ No newline at end of file
@@ -0,0 +1,77 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+#include "frame_scheduler.h"
+
+namespace VT {
+
+/**
+ * @brief Defers destruction of gpu resources until the frames that may
+ * still use them have retired.
+ * @details Every entry is tagged with the value of the last frame submitted
+ * when it was pushed, no later frame can reference the resource. The entry
+ * runs once the frame scheduler reports that value as completed.
+ *
+ * Presentation has no fence of its own, like most renderers we treat the
+ * frame's completion as covering the present of that frame.
+ */
+class DeletionQueue {
+  struct Entry {
+    uint64_t frame;
+    std::function<void()> destroy;
+  };
+
+  std::deque<Entry> _entries;
+  FrameScheduler& _frame_scheduler;
+
+public:
+  DeletionQueue(FrameScheduler& frame_scheduler): _frame_scheduler(frame_scheduler) {}
+
+  ~DeletionQueue() {
+    Flush();
+  }
+
+  DeletionQueue(const DeletionQueue&) = delete;
+  DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+  void Push(std::function<void()>&& destroy) {
+    _entries.push_back(Entry{_frame_scheduler.GetSubmittedValue(), std::move(destroy)});
+  }
+
+  /**
+   * @brief Runs every entry whose frames have completed, without blocking.
+   */
+  void Collect() {
+    if (_entries.empty()) {
+      return;
+    }
+    uint64_t completed = _frame_scheduler.GetCompletedValue();
+    while (!_entries.empty() && _entries.front().frame <= completed) {
+      // pop before running so a throwing destroy is not run twice.
+      auto destroy = std::move(_entries.front().destroy);
+      _entries.pop_front();
+      destroy();
+    }
+  }
+
+  /**
+   * @brief Runs everything now, the device has to be idle.
+   */
+  void Flush() {
+    while (!_entries.empty()) {
+      auto destroy = std::move(_entries.front().destroy);
+      _entries.pop_front();
+      destroy();
+    }
+  }
+
+  size_t GetPendingCount() const {
+    return _entries.size();
+  }
+};
+} // VT
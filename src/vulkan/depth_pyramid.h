@@ -0,0 +1,296 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "buffer.h"
+#include "compute_pipeline.h"
+#include "image.h"
+#include "memory_allocator.h"
+#include "vulkan.h"
+
+namespace VT {
+
+const std::string DEPTH_PYRAMID_SHADER_PATH = "/build/shaders/depth_pyramid.comp.spv";
+// local_size_x and local_size_y of depth_pyramid.comp.
+const uint32_t DEPTH_PYRAMID_GROUP_SIZE = 8;
+// enough for a 2^17 pixel wide depth attachment.
+const uint32_t DEPTH_PYRAMID_MAX_LEVELS = 16;
+
+/**
+ * @brief Where a level of the pyramid is in its buffer, in floats.
+ */
+struct DepthPyramidLevel {
+  uint32_t offset;
+  uint32_t width;
+  uint32_t height;
+};
+
+struct DepthPyramidPushConstants {
+  uint32_t source_size[2];
+  uint32_t destination_size[2];
+  uint32_t source_offset;
+  uint32_t destination_offset;
+  uint32_t from_depth;
+};
+
+/**
+ * @brief Hierarchical depth (Hi-Z) of a depth attachment: every level
+ * halves the one below, rounding up, and keeps the farthest depth of the 2x2
+ * texels it covers, so one texel bounds the depth of a whole screen region.
+ * @details Level 0 is half the attachment's size. All levels are packed into
+ * one storage buffer instead of the mips of an image, culling reads four
+ * texels with plain buffer loads and nothing needs image layouts or a
+ * sampler reduction mode. Sized for one attachment, recreated with it.
+ */
+class DepthPyramid {
+  VkExtent2D _extent;
+  std::vector<DepthPyramidLevel> _levels;
+  VkBuffer _buffer;
+  VT::Allocation _buffer_memory;
+
+  VkSampler _sampler;
+  VkDescriptorSetLayout _descriptor_set_layout;
+  VkDescriptorPool _descriptor_pool;
+  VkDescriptorSet _descriptor_set;
+  VT::ComputePipelineInfo _pipeline;
+
+  const std::shared_ptr<VT::Vulkan> _instance;
+
+public:
+  /**
+   * @param depth_view a depth aspect view of an image created with
+   * VK_IMAGE_USAGE_SAMPLED_BIT, see VT::DepthResources.
+   */
+  DepthPyramid(const std::shared_ptr<VT::Vulkan>& instance, VkImageView depth_view, VkExtent2D extent): _extent(extent), _instance(instance) {
+    compute_levels();
+    VkDeviceSize size = sizeof(float) * (_levels.back().offset + _levels.back().width * _levels.back().height);
+    VT::CreateBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _buffer, _buffer_memory, instance->GetVkDevice(), instance->GetVkPhysicalDevice());
+    create_sampler();
+    create_descriptor_set(depth_view);
+    VT::ComputePipelineOptions options{instance->GetVkDevice(), DEPTH_PYRAMID_SHADER_PATH, _descriptor_set_layout, sizeof(DepthPyramidPushConstants), instance->GetPipelineCache()};
+    _pipeline = VT::CreateComputePipeline(options);
+  }
+
+  ~DepthPyramid() {
+    VkDevice device = _instance->GetVkDevice();
+    vkDestroyPipeline(device, _pipeline.compute_pipeline, nullptr);
+    vkDestroyPipelineLayout(device, _pipeline.pipeline_layout, nullptr);
+    vkDestroyDescriptorPool(device, _descriptor_pool, nullptr);
+    vkDestroyDescriptorSetLayout(device, _descriptor_set_layout, nullptr);
+    vkDestroySampler(device, _sampler, nullptr);
+    VT::DestroyBuffer(device, _buffer, _buffer_memory);
+  }
+
+  DepthPyramid(const DepthPyramid&) = delete;
+  DepthPyramid& operator=(const DepthPyramid&) = delete;
+
+  /**
+   * @brief Builds every level from depth_image, outside of a render pass,
+   * after a pass that left it in DEPTH_STENCIL_ATTACHMENT_OPTIMAL and stored
+   * it. The attachment is back in that layout afterwards, and the pyramid
+   * is visible to compute shaders recorded later.
+   */
+  void Record(VkCommandBuffer command_buffer, VkImage depth_image, VkFormat depth_format) {
+    // depth writes of the pass, and reads of the pyramid by the last frame,
+    // before the pyramid is rebuilt.
+    transition_depth(command_buffer, depth_image, depth_format,
+                     VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                     VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline.compute_pipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline.pipeline_layout, 0, 1, &_descriptor_set, 0, nullptr);
+    for (size_t level = 0; level < _levels.size(); level++) {
+      const DepthPyramidLevel& destination = _levels[level];
+      DepthPyramidPushConstants constants{};
+      if (level == 0) {
+        constants.source_size[0] = _extent.width;
+        constants.source_size[1] = _extent.height;
+        constants.from_depth = 1;
+      } else {
+        const DepthPyramidLevel& source = _levels[level - 1];
+        constants.source_size[0] = source.width;
+        constants.source_size[1] = source.height;
+        constants.source_offset = source.offset;
+        constants.from_depth = 0;
+      }
+      constants.destination_size[0] = destination.width;
+      constants.destination_size[1] = destination.height;
+      constants.destination_offset = destination.offset;
+      vkCmdPushConstants(command_buffer, _pipeline.pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+      vkCmdDispatch(command_buffer, group_count(destination.width), group_count(destination.height), 1);
+
+      // each level reads the one before it.
+      VkMemoryBarrier barrier{};
+      barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+      barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+      barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+      vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    transition_depth(command_buffer, depth_image, depth_format,
+                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                     VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                     VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+  }
+
+  VkBuffer GetBuffer() const {
+    return _buffer;
+  }
+
+  // size of the depth attachment the pyramid was built for.
+  VkExtent2D GetExtent() const {
+    return _extent;
+  }
+
+  const std::vector<DepthPyramidLevel>& GetLevels() const {
+    return _levels;
+  }
+
+private:
+  static uint32_t group_count(uint32_t invocations) {
+    return (invocations + DEPTH_PYRAMID_GROUP_SIZE - 1) / DEPTH_PYRAMID_GROUP_SIZE;
+  }
+
+  void compute_levels() {
+    uint32_t width = std::max((_extent.width + 1) / 2, 1u);
+    uint32_t height = std::max((_extent.height + 1) / 2, 1u);
+    uint32_t offset = 0;
+    while (true) {
+      if (_levels.size() == DEPTH_PYRAMID_MAX_LEVELS) {
+        throw std::runtime_error("failed to create depth pyramid, the depth attachment is too large!");
+      }
+      _levels.push_back(DepthPyramidLevel{offset, width, height});
+      offset += width * height;
+      if (width == 1 && height == 1) {
+        break;
+      }
+      width = (width + 1) / 2;
+      height = (height + 1) / 2;
+    }
+  }
+
+  void transition_depth(
+      VkCommandBuffer command_buffer,
+      VkImage depth_image,
+      VkFormat depth_format,
+      VkImageLayout old_layout,
+      VkImageLayout new_layout,
+      VkPipelineStageFlags src_stage,
+      VkAccessFlags src_access,
+      VkPipelineStageFlags dst_stage,
+      VkAccessFlags dst_access) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = new_layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = depth_image;
+    // both aspects of a depth stencil format change layout together.
+    barrier.subresourceRange.aspectMask = VT::GetImageAspectFlags(depth_format);
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = src_access;
+    barrier.dstAccessMask = dst_access;
+    vkCmdPipelineBarrier(command_buffer, src_stage, dst_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+  }
+
+  void create_sampler() {
+    // only read with texelFetch, filtering never applies.
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxLod = 0.0f;
+    if (vkCreateSampler(_instance->GetVkDevice(), &samplerInfo, nullptr, &_sampler) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create depth pyramid sampler!");
+    }
+  }
+
+  void create_descriptor_set(VkImageView depth_view) {
+    VkDevice device = _instance->GetVkDevice();
+
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &_descriptor_set_layout) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create depth pyramid descriptor set layout!");
+    }
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[0].descriptorCount = 1;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = 1;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = 1;
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &_descriptor_pool) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create depth pyramid descriptor pool!");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = _descriptor_pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &_descriptor_set_layout;
+    if (vkAllocateDescriptorSets(device, &allocInfo, &_descriptor_set) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate depth pyramid descriptor set!");
+    }
+
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfo.imageView = depth_view;
+    imageInfo.sampler = _sampler;
+
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = _buffer;
+    bufferInfo.offset = 0;
+    bufferInfo.range = VK_WHOLE_SIZE;
+
+    std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[0].dstSet = _descriptor_set;
+    descriptorWrites[0].dstBinding = 0;
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrites[0].descriptorCount = 1;
+    descriptorWrites[0].pImageInfo = &imageInfo;
+    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[1].dstSet = _descriptor_set;
+    descriptorWrites[1].dstBinding = 1;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrites[1].descriptorCount = 1;
+    descriptorWrites[1].pBufferInfo = &bufferInfo;
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+  }
+};
+} // VT
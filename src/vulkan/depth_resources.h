@@ -12,43 +12,53 @@
 namespace VT {
 class DepthResources { 
  private:
-  const std::shared_ptr<Vulkan>& _instance;
+  // held by value, old depth resources can outlive their swapchain manager
+  // in the deletion queue.
+  const std::shared_ptr<Vulkan> _instance;
 
   VkImage depthImage;
-  VkDeviceMemory depthImageMemory;
+  VT::Allocation depthImageMemory;
   VkImageView depthImageView;
+  VkFormat depthFormat;
 
  public:
   DepthResources(
       const std::shared_ptr<Vulkan>& instance, 
-      const std::unique_ptr<VT::CommandPool>& command_pool,
       VkExtent2D swap_extent): _instance(instance) {
-    create_depth_resources(command_pool, swap_extent);
+    create_depth_resources(swap_extent);
   }
 
   ~DepthResources() {
     auto device = _instance->GetVkDevice();
     vkDestroyImageView(device, depthImageView, nullptr);
-    vkDestroyImage(device, depthImage, nullptr);
-    vkFreeMemory(device, depthImageMemory, nullptr);
+    VT::DestroyImage(device, depthImage, depthImageMemory);
   }
 
   VkImageView& GetDepthImageView() {
     return depthImageView;
   }
 
+  VkImage GetDepthImage() const {
+    return depthImage;
+  }
+
+  VkFormat GetFormat() const {
+    return depthFormat;
+  }
+
  private:
-  void create_depth_resources(const std::unique_ptr<VT::CommandPool>& command_pool, VkExtent2D& swap_extent) {
+  void create_depth_resources(VkExtent2D& swap_extent) {
     // TODO: find_depth_format should probably be initialied before this and renderpass
     // are called.
-    VkFormat depthFormat = VT::find_depth_format(_instance->GetVkPhysicalDevice());
+    depthFormat = VT::find_depth_format(_instance->GetVkPhysicalDevice());
 
     VT::CreateImageOptions imageOptions(
       swap_extent.width,
       swap_extent.height,
       depthFormat,
       VK_IMAGE_TILING_OPTIMAL,
-      VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+      // sampled when building the depth pyramid.
+      VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
       _instance->GetVkDevice(),
       _instance->GetVkPhysicalDevice()
@@ -61,13 +71,9 @@ class DepthResources {
     options.format = depthFormat;
     options.device = _instance.get()->GetVkDevice();
     depthImageView = VT::CreateImageView(options);
-    VT::TransitionImageLayout(_instance->GetVkDevice(),
-                              command_pool->GetCommandPool(),
-                              _instance->GetGraphicsQueue(),
-                              depthImage,
-                              depthFormat,
-                              VK_IMAGE_LAYOUT_UNDEFINED,
-                              VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+    // no explicit layout transition, the render pass takes the depth
+    // attachment from UNDEFINED to DEPTH_STENCIL_ATTACHMENT_OPTIMAL itself.
+    // Depth stages are not supported on the transfer queue uploads run on.
   }
 };
 }
\ No newline at end of file
@@ -9,6 +9,7 @@
 #include "descriptor_set_layout.h"
 #include "texture_image.h"
 #include "uniform_buffer_object.h"
+#include "uniform_ring_buffer.h"
 #include "vulkan.h"
 
 namespace VT {
@@ -20,7 +21,7 @@ struct CreateDescriptorPoolOptions {
 
 void CreateDescriptorPools(CreateDescriptorPoolOptions& options, VkDescriptorPool& descriptor_pool) {
   std::array<VkDescriptorPoolSize, 2> poolSizes{};
-  poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
   poolSizes[0].descriptorCount = static_cast<uint32_t>(options.max_frames_in_flight);
 
   poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
@@ -46,7 +47,7 @@ struct CreateDescriptorSetOptions {
   VkDescriptorPool descriptor_pool;
   VkImageView texture_image_view;
   VkSampler texture_sampler;
-  std::vector<VkBuffer> uniform_buffers;
+  VkBuffer uniform_buffer;
   int max_frames_in_flight;
 };
 
@@ -67,8 +68,10 @@ void CreateDescriptorSets(CreateDescriptorSetOptions& options, std::vector<VkDes
   }
 
   for (size_t i = 0; i < options.max_frames_in_flight; i++) {
+    // every frame uses the same ring buffer, the frame's partition is
+    // selected with the dynamic offset at bind time.
     VkDescriptorBufferInfo bufferInfo{};
-    bufferInfo.buffer = options.uniform_buffers[i];
+    bufferInfo.buffer = options.uniform_buffer;
     bufferInfo.offset = 0;
     bufferInfo.range = sizeof(VT::UniformBufferObject);
 
@@ -82,7 +85,7 @@ void CreateDescriptorSets(CreateDescriptorSetOptions& options, std::vector<VkDes
     descriptorWrites[0].dstSet = descriptor_sets[i];
     descriptorWrites[0].dstBinding = 0;
     descriptorWrites[0].dstArrayElement = 0;
-    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     descriptorWrites[0].descriptorCount = 1;
     descriptorWrites[0].pBufferInfo = &bufferInfo;
 
@@ -99,8 +102,7 @@ void CreateDescriptorSets(CreateDescriptorSetOptions& options, std::vector<VkDes
 }
 
 class DescriptorSets {
-  std::vector<VkBuffer> _uniform_buffers;
-  std::vector<VkDeviceMemory> _uniform_buffers_memory;
+  std::unique_ptr<VT::UniformRingBuffer> _uniform_ring;
 
   VkDescriptorPool _descriptor_pool;
   std::vector<VkDescriptorSet> _descriptor_sets;
@@ -121,20 +123,13 @@ public:
 
   ~DescriptorSets() {
     auto device = this->_instance->GetVkDevice();
-    for (size_t i = 0; i < _max_frames_in_flight; i++) {
-      vkDestroyBuffer(device, _uniform_buffers[i], nullptr);
-      vkFreeMemory(device, _uniform_buffers_memory[i], nullptr);
-    }
+    _uniform_ring.reset();
 
     vkDestroyDescriptorPool(device, _descriptor_pool, nullptr);
   }
 
-  std::vector<VkBuffer>& GetUniformBuffers() {
-    return _uniform_buffers;
-  }
-
-  std::vector<VkDeviceMemory>& GetUniformBufferMemory() {
-    return _uniform_buffers_memory;
+  VT::UniformRingBuffer& GetUniformRing() {
+    return *_uniform_ring;
   }
 
   VkDescriptorPool& GetDescriptorPool() {
@@ -147,8 +142,7 @@ public:
 
 private:
   void create_uniform_buffers() {
-    VT::CreateUniformBufferOptions options {_max_frames_in_flight, _instance->GetVkDevice(), _instance.get()->GetVkPhysicalDevice()};
-    VT::CreateUniformBuffers(options, _uniform_buffers, _uniform_buffers_memory);
+    _uniform_ring = std::make_unique<VT::UniformRingBuffer>(_instance->GetVkDevice(), _instance->GetVkPhysicalDevice(), _max_frames_in_flight);
   }
 
   void create_descriptor_pool() {
@@ -170,7 +164,7 @@ private:
       _descriptor_pool,
       texture_image->GetImageView(),
       texture_image->GetTextureSampler(),
-      _uniform_buffers,
+      _uniform_ring->GetBuffer(),
       _max_frames_in_flight
     };
     VT::CreateDescriptorSets(options, _descriptor_sets);
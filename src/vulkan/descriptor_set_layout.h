@@ -25,7 +25,9 @@ VkDescriptorSetLayout CreateDescriptorSetLayout(DescriptorSetLayoutOptions& opti
   VkDescriptorSetLayoutBinding uboLayoutBinding{};
   uboLayoutBinding.binding = 0;
   uboLayoutBinding.descriptorCount = 1;
-  uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  // dynamic so the same descriptor can point at any offset of the uniform
+  // ring buffer, the offset is given when the set is bound.
+  uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
   // relavant for sampling related descriptors.
   uboLayoutBinding.pImmutableSamplers = nullptr;
   // shader stage the descriptor is referenced.
@@ -31,12 +31,15 @@ uint32_t FindMemoryType(
   throw std::runtime_error("failed to find suitable memory type!");
 }
 
-std::vector<const char*> get_required_extensions(bool enable_validation_layers) {
-  uint32_t glfwExtensionCount = 0;
-  const char** glfwExtensions;
-  glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-  std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+std::vector<const char*> get_required_extensions(bool enable_validation_layers, bool headless = false) {
+  std::vector<const char*> extensions;
+  // headless runs without a window system, glfw is never initialized.
+  if (!headless) {
+    uint32_t glfwExtensionCount = 0;
+    const char** glfwExtensions;
+    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+  }
 
   if (enable_validation_layers) {
     extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -61,20 +64,116 @@ bool CheckDeviceExtensionSupport(VkPhysicalDevice device, const std::vector<cons
   return requiredExtensions.empty();
 }
 
-VT::QueueFamilyIndices IsDeviceSuitable(VkPhysicalDevice device, VkSurfaceKHR surface, const std::vector<const char*>& device_extensions, bool enable_validation_layers) {
-  VT::QueueFamilyIndices indices;
-  VT::FindQueueFamilies(device, surface, indices);
+/**
+ * @brief Highest api version the loader supports, 1.0 loaders do not have
+ * vkEnumerateInstanceVersion.
+ */
+uint32_t GetInstanceApiVersion() {
+  auto enumerate_instance_version = (PFN_vkEnumerateInstanceVersion) vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion");
+  uint32_t version = VK_API_VERSION_1_0;
+  if (enumerate_instance_version == nullptr || enumerate_instance_version(&version) != VK_SUCCESS) {
+    return VK_API_VERSION_1_0;
+  }
+  return version;
+}
+
+/**
+ * @brief vkGetPhysicalDeviceFeatures2, core in 1.1, loaded through the
+ * instance like vkEnumerateInstanceVersion so the tree still links against a
+ * 1.0 loader. Leaves features as it is when the instance lacks it.
+ */
+void GetPhysicalDeviceFeatures2(VkInstance instance, VkPhysicalDevice device, VkPhysicalDeviceFeatures2& features) {
+  auto get_physical_device_features2 = (PFN_vkGetPhysicalDeviceFeatures2) vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2");
+  if (get_physical_device_features2 != nullptr) {
+    get_physical_device_features2(device, &features);
+  }
+}
+
+// samplerAnisotropy is optional, software rasterizers may not have it.
+bool SupportsSamplerAnisotropy(VkPhysicalDevice device) {
+  VkPhysicalDeviceFeatures supportedFeatures;
+  vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
+  return supportedFeatures.samplerAnisotropy == VK_TRUE;
+}
+
+// Timeline semaphores are core (but optional) in 1.2. Both the instance and
+// the device have to be 1.2 for the feature query and vkWaitSemaphores.
+bool SupportsTimelineSemaphores(VkInstance instance, uint32_t instance_api_version, VkPhysicalDevice device) {
+  VkPhysicalDeviceProperties properties{};
+  vkGetPhysicalDeviceProperties(device, &properties);
+  if (instance_api_version < VK_API_VERSION_1_2 || properties.apiVersion < VK_API_VERSION_1_2) {
+    return false;
+  }
 
+  VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+  timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+  VkPhysicalDeviceFeatures2 features{};
+  features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features.pNext = &timelineFeatures;
+  VT::GetPhysicalDeviceFeatures2(instance, device, features);
+  return timelineFeatures.timelineSemaphore == VK_TRUE;
+}
+
+// gpu driven draws (see VT::GpuCuller) issue one indirect draw per mesh in a
+// single call and place each mesh's instances with firstInstance.
+bool SupportsMultiDrawIndirect(VkPhysicalDevice device) {
   VkPhysicalDeviceFeatures supportedFeatures;
   vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
+  return supportedFeatures.multiDrawIndirect == VK_TRUE && supportedFeatures.drawIndirectFirstInstance == VK_TRUE;
+}
+
+// vkCmdDrawIndexedIndirectCount reads the draw count from a buffer, core
+// (but optional) in 1.2 like timeline semaphores.
+bool SupportsDrawIndirectCount(VkInstance instance, uint32_t instance_api_version, VkPhysicalDevice device) {
+  VkPhysicalDeviceProperties properties{};
+  vkGetPhysicalDeviceProperties(device, &properties);
+  if (instance_api_version < VK_API_VERSION_1_2 || properties.apiVersion < VK_API_VERSION_1_2) {
+    return false;
+  }
+
+  VkPhysicalDeviceVulkan12Features vulkan12Features{};
+  vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  VkPhysicalDeviceFeatures2 features{};
+  features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features.pNext = &vulkan12Features;
+  VT::GetPhysicalDeviceFeatures2(instance, device, features);
+  return vulkan12Features.drawIndirectCount == VK_TRUE;
+}
+
+// VK_EXT_conditional_rendering skips draws on a value the gpu wrote (see
+// VT::OcclusionQueries). The feature query needs 1.1.
+bool SupportsConditionalRendering(VkInstance instance, uint32_t instance_api_version, VkPhysicalDevice device) {
+  VkPhysicalDeviceProperties properties{};
+  vkGetPhysicalDeviceProperties(device, &properties);
+  if (instance_api_version < VK_API_VERSION_1_1 || properties.apiVersion < VK_API_VERSION_1_1) {
+    return false;
+  }
+  if (!VT::CheckDeviceExtensionSupport(device, {VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME}, false)) {
+    return false;
+  }
+
+  VkPhysicalDeviceConditionalRenderingFeaturesEXT conditionalRenderingFeatures{};
+  conditionalRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_CONDITIONAL_RENDERING_FEATURES_EXT;
+  VkPhysicalDeviceFeatures2 features{};
+  features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features.pNext = &conditionalRenderingFeatures;
+  VT::GetPhysicalDeviceFeatures2(instance, device, features);
+  return conditionalRenderingFeatures.conditionalRendering == VK_TRUE;
+}
+
+VT::QueueFamilyIndices IsDeviceSuitable(VkPhysicalDevice device, VkSurfaceKHR surface, const std::vector<const char*>& device_extensions, bool enable_validation_layers) {
+  VT::QueueFamilyIndices indices;
+  VT::FindQueueFamilies(device, surface, indices);
 
   bool extensionsSupported = VT::CheckDeviceExtensionSupport(device, device_extensions, enable_validation_layers);
-  bool swapChainAdequate = VT::CheckSwapChainAdequate(extensionsSupported, device, surface);
+  // headless renders offscreen, there is no swapchain to check.
+  bool swapChainAdequate = surface == VK_NULL_HANDLE || VT::CheckSwapChainAdequate(extensionsSupported, device, surface);
 
+  // samplerAnisotropy is optional (software rasterizers may lack it), the
+  // texture sampler only enables it when supported.
   if (indices.IsComplete() && 
       extensionsSupported && 
-      swapChainAdequate && 
-      supportedFeatures.samplerAnisotropy) {
+      swapChainAdequate) {
     return indices;
   } else {
     VT::QueueFamilyIndices incomplete_indices;
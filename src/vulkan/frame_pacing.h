@@ -0,0 +1,249 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "frame_scheduler.h"
+
+namespace VT {
+
+enum class FramePacingMode {
+  // one frame in flight, the cpu samples input as late as possible.
+  LowLatency,
+  // the cpu runs ahead of the gpu and never blocks on the display.
+  Throughput,
+  // fifo presentation, no tearing and no frames rendered for nothing.
+  Vsync,
+};
+
+/**
+ * @brief Frames in flight, swapchain image count and present mode, chosen
+ * together since each one bounds how far ahead of the display the others
+ * can get.
+ */
+struct FramePacingPolicy {
+  FramePacingMode mode = FramePacingMode::Throughput;
+  uint32_t frames_in_flight = 2;
+  // images requested on top of the surface's minImageCount.
+  uint32_t extra_swapchain_images = 1;
+  // first supported mode wins, FIFO is always supported.
+  std::vector<VkPresentModeKHR> present_modes = {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR};
+};
+
+FramePacingPolicy GetFramePacingPolicy(FramePacingMode mode) {
+  FramePacingPolicy policy{};
+  policy.mode = mode;
+  switch (mode) {
+    case FramePacingMode::LowLatency:
+      policy.frames_in_flight = 1;
+      policy.extra_swapchain_images = 1;
+      policy.present_modes = {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_KHR};
+      break;
+    case FramePacingMode::Throughput:
+      policy.frames_in_flight = 2;
+      policy.extra_swapchain_images = 1;
+      policy.present_modes = {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR};
+      break;
+    case FramePacingMode::Vsync:
+      policy.frames_in_flight = 2;
+      policy.extra_swapchain_images = 1;
+      policy.present_modes = {VK_PRESENT_MODE_FIFO_KHR};
+      break;
+  }
+  return policy;
+}
+
+const char* GetFramePacingModeName(FramePacingMode mode) {
+  switch (mode) {
+    case FramePacingMode::LowLatency: return "low-latency";
+    case FramePacingMode::Throughput: return "throughput";
+    case FramePacingMode::Vsync: return "vsync";
+  }
+  return "unknown";
+}
+
+const char* GetPresentModeName(VkPresentModeKHR present_mode) {
+  switch (present_mode) {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo-relaxed";
+    default: return "other";
+  }
+}
+
+/**
+ * @brief Builds the policy from the command line.
+ * @details --pacing=low-latency|throughput|vsync picks the preset and
+ * --frames-in-flight=N overrides its frame count. Unknown arguments are left
+ * for the caller.
+ */
+FramePacingPolicy ParseFramePacingPolicy(int argc, char** argv) {
+  const std::string pacing_arg = "--pacing=";
+  const std::string frames_arg = "--frames-in-flight=";
+
+  FramePacingPolicy policy = GetFramePacingPolicy(FramePacingMode::Throughput);
+  int frames_in_flight = 0;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg.compare(0, pacing_arg.size(), pacing_arg) == 0) {
+      std::string value = arg.substr(pacing_arg.size());
+      if (value == "low-latency") {
+        policy = GetFramePacingPolicy(FramePacingMode::LowLatency);
+      } else if (value == "throughput") {
+        policy = GetFramePacingPolicy(FramePacingMode::Throughput);
+      } else if (value == "vsync") {
+        policy = GetFramePacingPolicy(FramePacingMode::Vsync);
+      } else {
+        throw std::runtime_error("unknown frame pacing mode " + value + "!");
+      }
+    } else if (arg.compare(0, frames_arg.size(), frames_arg) == 0) {
+      frames_in_flight = std::atoi(arg.c_str() + frames_arg.size());
+      if (frames_in_flight < 1) {
+        throw std::runtime_error("frames in flight has to be at least 1!");
+      }
+    }
+  }
+  if (frames_in_flight > 0) {
+    policy.frames_in_flight = static_cast<uint32_t>(frames_in_flight);
+  }
+  return policy;
+}
+
+// Only VK_PRESENT_MODE_FIFO_KHR is guaranteed to be available. Mailbox avoids
+// tearing while still presenting the most recent image at the vertical blank,
+// at the cost of rendering frames that are never shown.
+VkPresentModeKHR ChoosePresentMode(const FramePacingPolicy& policy, const std::vector<VkPresentModeKHR>& available_present_modes) {
+  for (VkPresentModeKHR present_mode : policy.present_modes) {
+    if (std::find(available_present_modes.begin(), available_present_modes.end(), present_mode) != available_present_modes.end()) {
+      return present_mode;
+    }
+  }
+  return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+/**
+ * @brief Enough images that every frame in flight can hold one while the
+ * presentation engine holds the rest.
+ */
+uint32_t ChooseSwapchainImageCount(const FramePacingPolicy& policy, const VkSurfaceCapabilitiesKHR& capabilities) {
+  uint32_t image_count = std::max(capabilities.minImageCount + policy.extra_swapchain_images, policy.frames_in_flight);
+  if (capabilities.maxImageCount > 0) {
+    image_count = std::min(image_count, capabilities.maxImageCount);
+  }
+  return image_count;
+}
+
+// frames between two latency reports.
+const uint32_t FRAME_LATENCY_REPORT_INTERVAL = 600;
+
+/**
+ * @brief Measures how long the cpu blocks waiting for a frame slot and how
+ * old the sampled input is by the time its frame is presented and completed.
+ * @details Input is considered sampled when MarkInput is called right after
+ * polling events. Input to present is measured when vkQueuePresentKHR
+ * returns. Input to complete is measured when the frame's slot is waited on
+ * again frames_in_flight frames later, so it is an upper bound on when the
+ * image reached the presentation engine.
+ */
+class FrameLatencyTracker {
+  using clock = std::chrono::high_resolution_clock;
+
+  struct Stat {
+    double total = 0.0;
+    double max = 0.0;
+    uint32_t count = 0;
+
+    void Add(double ms) {
+      total += ms;
+      max = std::max(max, ms);
+      count++;
+    }
+
+    double Average() const {
+      return count > 0 ? total / count : 0.0;
+    }
+  };
+
+  clock::time_point _input_time;
+  // input time of the frame last submitted in each frame slot.
+  std::vector<clock::time_point> _slot_input_times;
+  std::vector<bool> _slot_pending;
+
+  Stat _fence_wait;
+  Stat _input_to_present;
+  Stat _input_to_complete;
+  uint32_t _frames = 0;
+  uint32_t _report_interval;
+
+public:
+  FrameLatencyTracker(uint32_t frames_in_flight, uint32_t report_interval = FRAME_LATENCY_REPORT_INTERVAL):
+    _slot_input_times(frames_in_flight),
+    _slot_pending(frames_in_flight, false),
+    _report_interval(report_interval) {}
+
+  void MarkInput() {
+    _input_time = clock::now();
+  }
+
+  /**
+   * @brief FrameScheduler::BeginFrame, timing the wait.
+   */
+  void BeginFrame(FrameScheduler& frame_scheduler) {
+    uint32_t slot = frame_scheduler.GetFrameIndex();
+    auto start = clock::now();
+    frame_scheduler.BeginFrame();
+    auto end = clock::now();
+
+    _fence_wait.Add(milliseconds(end - start));
+    if (_slot_pending[slot]) {
+      _input_to_complete.Add(milliseconds(end - _slot_input_times[slot]));
+      _slot_pending[slot] = false;
+    }
+  }
+
+  /**
+   * @brief Call once vkQueuePresentKHR returned for the frame in slot.
+   */
+  void MarkPresent(uint32_t slot) {
+    _input_to_present.Add(milliseconds(clock::now() - _input_time));
+    _slot_input_times[slot] = _input_time;
+    _slot_pending[slot] = true;
+
+    if (++_frames >= _report_interval) {
+      Report();
+    }
+  }
+
+  /**
+   * @brief Prints averages and maxima since the last report and resets them.
+   */
+  void Report() {
+    if (_frames == 0) {
+      return;
+    }
+    std::cout << "frame latency over " << _frames << " frames (avg/max ms):"
+              << " fence wait " << _fence_wait.Average() << "/" << _fence_wait.max
+              << ", input to present " << _input_to_present.Average() << "/" << _input_to_present.max
+              << ", input to complete " << _input_to_complete.Average() << "/" << _input_to_complete.max
+              << std::endl;
+    _fence_wait = Stat{};
+    _input_to_present = Stat{};
+    _input_to_complete = Stat{};
+    _frames = 0;
+  }
+
+private:
+  static double milliseconds(clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+  }
+};
+} // VT
@@ -0,0 +1,254 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "engine/private/profiler.h"
+
+namespace VT {
+
+struct FrameSchedulerOptions {
+  VkDevice device;
+  uint32_t frames_in_flight;
+  // the device was created with the timelineSemaphore feature.
+  bool timeline_semaphores;
+};
+
+/**
+ * @brief Tracks frame completion as a single increasing value.
+ * @details Frame n (starting at 1) signals the value n when its command
+ * buffer has finished executing. Anything tied to a frame (uploads overwriting
+ * data it reads, deferred deletes, readbacks) remembers the frame value and
+ * checks GetCompletedValue() or Wait(value) instead of keeping its own fence.
+ *
+ * With timeline semaphores (Vulkan 1.2) every frame signals one timeline
+ * semaphore, waiting is vkWaitSemaphores and polling is a single
+ * vkGetSemaphoreCounterValue. On older devices each frame slot has a fence
+ * that remembers the frame value it signals; since submissions on a queue
+ * complete in order, a signaled fence also completes every earlier value.
+ *
+ * The binary semaphores for acquire and present are still created per frame
+ * slot, presentation does not accept timeline semaphores.
+ */
+class FrameScheduler {
+  VkDevice _device;
+  uint32_t _frames_in_flight;
+
+  // timeline path.
+  VkSemaphore _timeline = VK_NULL_HANDLE;
+  PFN_vkWaitSemaphores _wait_semaphores = nullptr;
+  PFN_vkGetSemaphoreCounterValue _get_semaphore_counter_value = nullptr;
+
+  // fence fallback, one fence per frame slot and the value it signals.
+  std::vector<VkFence> _fences;
+  std::vector<uint64_t> _fence_values;
+
+  // value the frame being recorded signals.
+  uint64_t _frame = 1;
+  uint64_t _submitted = 0;
+  uint64_t _completed = 0;
+
+public:
+  FrameScheduler(const FrameSchedulerOptions& options):
+    _device(options.device),
+    _frames_in_flight(options.frames_in_flight) {
+    if (options.timeline_semaphores) {
+      // loaded through the device so the fallback still links against a
+      // 1.0 loader.
+      _wait_semaphores = (PFN_vkWaitSemaphores) vkGetDeviceProcAddr(_device, "vkWaitSemaphores");
+      _get_semaphore_counter_value = (PFN_vkGetSemaphoreCounterValue) vkGetDeviceProcAddr(_device, "vkGetSemaphoreCounterValue");
+    }
+
+    if (_wait_semaphores != nullptr && _get_semaphore_counter_value != nullptr) {
+      VkSemaphoreTypeCreateInfo typeInfo{};
+      typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+      typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+      typeInfo.initialValue = 0;
+
+      VkSemaphoreCreateInfo semaphoreInfo{};
+      semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+      semaphoreInfo.pNext = &typeInfo;
+      if (vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &_timeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create frame timeline semaphore!");
+      }
+    } else {
+      _fences.resize(_frames_in_flight);
+      _fence_values.resize(_frames_in_flight, 0);
+
+      VkFenceCreateInfo fenceInfo{};
+      fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+      // signaled, the first wait on each slot must not block.
+      fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+      for (auto& fence : _fences) {
+        if (vkCreateFence(_device, &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+          throw std::runtime_error("failed to create frame fence!");
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief The device has to be idle.
+   */
+  ~FrameScheduler() {
+    if (_timeline != VK_NULL_HANDLE) {
+      vkDestroySemaphore(_device, _timeline, nullptr);
+    }
+    for (VkFence fence : _fences) {
+      vkDestroyFence(_device, fence, nullptr);
+    }
+  }
+
+  FrameScheduler(const FrameScheduler&) = delete;
+  FrameScheduler& operator=(const FrameScheduler&) = delete;
+
+  /**
+   * @brief Blocks until the frame that last used the current frame slot has
+   * completed, after which its per frame resources can be reused.
+   */
+  void BeginFrame() {
+    ENGINE_PROFILE_SCOPE("FrameScheduler::BeginFrame");
+    if (_frame > _frames_in_flight) {
+      Wait(_frame - _frames_in_flight);
+    }
+  }
+
+  /**
+   * @brief Submits the frame's command buffers, signaling the frame value on
+   * top of the semaphores submit_info already signals, and moves on to the
+   * next frame.
+   */
+  VkResult Submit(VkQueue queue, const VkSubmitInfo& submit_info) {
+    VkSubmitInfo submitInfo = submit_info;
+    VkResult result;
+
+    if (UsesTimelineSemaphore()) {
+      // binary semaphores ignore their value, the timeline goes last.
+      std::vector<VkSemaphore> signalSemaphores(submit_info.pSignalSemaphores, submit_info.pSignalSemaphores + submit_info.signalSemaphoreCount);
+      std::vector<uint64_t> signalValues(signalSemaphores.size(), 0);
+      signalSemaphores.push_back(_timeline);
+      signalValues.push_back(_frame);
+
+      VkTimelineSemaphoreSubmitInfo timelineInfo{};
+      timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+      timelineInfo.pNext = submit_info.pNext;
+      timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+      timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+      submitInfo.pNext = &timelineInfo;
+      submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+      submitInfo.pSignalSemaphores = signalSemaphores.data();
+      result = vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+    } else {
+      // the slot's previous frame was waited on in BeginFrame, so nothing
+      // can wait on this fence between the reset and the submit.
+      uint32_t slot = GetFrameIndex();
+      vkResetFences(_device, 1, &_fences[slot]);
+      _fence_values[slot] = _frame;
+      result = vkQueueSubmit(queue, 1, &submitInfo, _fences[slot]);
+    }
+
+    if (result == VK_SUCCESS) {
+      _submitted = _frame;
+      _frame++;
+    }
+    return result;
+  }
+
+  /**
+   * @brief Polls the gpu without blocking.
+   * @return The value of the last frame known to have completed.
+   */
+  uint64_t GetCompletedValue() {
+    if (UsesTimelineSemaphore()) {
+      uint64_t value = 0;
+      if (_get_semaphore_counter_value(_device, _timeline, &value) == VK_SUCCESS) {
+        _completed = std::max(_completed, value);
+      }
+    } else {
+      for (size_t i = 0; i < _fences.size(); i++) {
+        if (_fence_values[i] > _completed && vkGetFenceStatus(_device, _fences[i]) == VK_SUCCESS) {
+          _completed = _fence_values[i];
+        }
+      }
+    }
+    return _completed;
+  }
+
+  bool IsComplete(uint64_t value) {
+    return value <= _completed || value <= GetCompletedValue();
+  }
+
+  /**
+   * @brief Blocks until frame value has completed. The frame has to have
+   * been submitted.
+   */
+  void Wait(uint64_t value) {
+    if (value <= _completed) {
+      return;
+    }
+    if (value > _submitted) {
+      throw std::runtime_error("waiting on a frame that was never submitted!");
+    }
+
+    if (UsesTimelineSemaphore()) {
+      VkSemaphoreWaitInfo waitInfo{};
+      waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+      waitInfo.semaphoreCount = 1;
+      waitInfo.pSemaphores = &_timeline;
+      waitInfo.pValues = &value;
+      if (_wait_semaphores(_device, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+        throw std::runtime_error("failed to wait for frame timeline semaphore!");
+      }
+      _completed = std::max(_completed, value);
+    } else {
+      // the slot has been reused by a later frame at most, which completes
+      // after this one.
+      uint32_t slot = static_cast<uint32_t>((value - 1) % _frames_in_flight);
+      if (vkWaitForFences(_device, 1, &_fences[slot], VK_TRUE, UINT64_MAX) != VK_SUCCESS) {
+        throw std::runtime_error("failed to wait for frame fence!");
+      }
+      _completed = std::max(_completed, _fence_values[slot]);
+    }
+  }
+
+  void WaitIdle() {
+    Wait(_submitted);
+  }
+
+  /**
+   * @brief Index of the frame slot being recorded, selects the per frame
+   * command buffer, semaphores and uniform partition.
+   */
+  uint32_t GetFrameIndex() const {
+    return static_cast<uint32_t>((_frame - 1) % _frames_in_flight);
+  }
+
+  /**
+   * @brief Value the frame being recorded will signal.
+   */
+  uint64_t GetFrameValue() const {
+    return _frame;
+  }
+
+  /**
+   * @brief Value of the last submitted frame, every resource used so far is
+   * free once it completes.
+   */
+  uint64_t GetSubmittedValue() const {
+    return _submitted;
+  }
+
+  uint32_t GetFramesInFlight() const {
+    return _frames_in_flight;
+  }
+
+  bool UsesTimelineSemaphore() const {
+    return _timeline != VK_NULL_HANDLE;
+  }
+};
+} // VT
@@ -0,0 +1,269 @@
+#pragma once
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VT_CULL_X86 1
+#include <immintrin.h>
+#endif
+
+#include "bounds.h"
+#include "engine/private/profiler.h"
+
+namespace VT {
+
+enum class CullPath {
+  Scalar,
+  // 4 wide, two registers per 8 spheres. Always there on x86-64.
+  SSE,
+  // 8 wide, picked at runtime when the cpu has it.
+  AVX2,
+};
+
+const char* GetCullPathName(CullPath path) {
+  switch (path) {
+    case CullPath::Scalar:
+      return "scalar";
+    case CullPath::SSE:
+      return "sse";
+    case CullPath::AVX2:
+      return "avx2";
+  }
+  return "unknown";
+}
+
+bool IsCullPathSupported(CullPath path) {
+  switch (path) {
+    case CullPath::Scalar:
+      return true;
+#ifdef VT_CULL_X86
+    case CullPath::SSE:
+      return true;
+    case CullPath::AVX2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+  }
+}
+
+// the widest path the cpu supports.
+CullPath GetDefaultCullPath() {
+  if (IsCullPathSupported(CullPath::AVX2)) {
+    return CullPath::AVX2;
+  }
+  if (IsCullPathSupported(CullPath::SSE)) {
+    return CullPath::SSE;
+  }
+  return CullPath::Scalar;
+}
+
+/**
+ * @brief The six planes of a view frustum, xyz is the normal pointing into
+ * the frustum and w the distance, so a point p is inside when
+ * dot(xyz, p) + w >= 0 for every plane.
+ */
+struct Frustum {
+  glm::vec4 planes[6];
+};
+
+/**
+ * @brief Extracts the planes from a view projection matrix (Gribb and
+ * Hartmann), in the space the matrix maps from.
+ * @details Clip space is -w <= x, y <= w and, with GLM_FORCE_DEPTH_ZERO_TO_ONE,
+ * 0 <= z <= w, so each plane is a sum or difference of rows of the matrix.
+ * The planes are normalized so plane distances are real distances, which the
+ * sphere test needs.
+ */
+Frustum ExtractFrustum(const glm::mat4& view_proj) {
+  // glm is column major, m[column][row].
+  auto row = [&view_proj](int i) {
+    return glm::vec4(view_proj[0][i], view_proj[1][i], view_proj[2][i], view_proj[3][i]);
+  };
+  glm::vec4 x = row(0), y = row(1), z = row(2), w = row(3);
+
+  Frustum frustum{};
+  frustum.planes[0] = w + x; // left
+  frustum.planes[1] = w - x; // right
+  frustum.planes[2] = w + y; // bottom
+  frustum.planes[3] = w - y; // top
+  frustum.planes[4] = z;     // near
+  frustum.planes[5] = w - z; // far
+  for (auto& plane : frustum.planes) {
+    float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+    if (length > 0.0f) {
+      plane = plane / length;
+    }
+  }
+  return frustum;
+}
+
+/**
+ * @brief Writes the indices of the spheres in [begin, end) that intersect
+ * the frustum to visible. Conservative, a sphere near a frustum corner can
+ * pass while being outside.
+ * @return The number of indices written.
+ */
+size_t cull_spheres_scalar(const Frustum& frustum, const BoundingSpheres& spheres, size_t begin, size_t end, uint32_t* visible) {
+  size_t count = 0;
+  for (size_t i = begin; i < end; i++) {
+    bool inside = true;
+    for (const auto& plane : frustum.planes) {
+      float distance = plane.x * spheres.x[i] + plane.y * spheres.y[i] + plane.z * spheres.z[i] + plane.w;
+      inside &= distance >= -spheres.radius[i];
+    }
+    visible[count] = static_cast<uint32_t>(i);
+    // branchless compaction, the slot is overwritten unless it is kept.
+    count += inside ? 1 : 0;
+  }
+  return count;
+}
+
+#ifdef VT_CULL_X86
+// appends begin + the index of every set bit of mask.
+size_t compact_mask(uint32_t mask, size_t begin, uint32_t* visible) {
+  size_t count = 0;
+  while (mask != 0) {
+    visible[count++] = static_cast<uint32_t>(begin + __builtin_ctz(mask));
+    mask &= mask - 1;
+  }
+  return count;
+}
+
+size_t cull_spheres_sse(const Frustum& frustum, const BoundingSpheres& spheres, size_t count, uint32_t* visible) {
+  // plane components broadcast once, reused for every group.
+  __m128 nx[6], ny[6], nz[6], d[6];
+  for (int p = 0; p < 6; p++) {
+    nx[p] = _mm_set1_ps(frustum.planes[p].x);
+    ny[p] = _mm_set1_ps(frustum.planes[p].y);
+    nz[p] = _mm_set1_ps(frustum.planes[p].z);
+    d[p] = _mm_set1_ps(frustum.planes[p].w);
+  }
+
+  size_t written = 0;
+  size_t i = 0;
+  // 8 spheres per iteration as two halves, the same grouping as AVX2.
+  for (; i + 8 <= count; i += 8) {
+    uint32_t mask = 0;
+    for (int half = 0; half < 2; half++) {
+      size_t j = i + half * 4;
+      __m128 x = _mm_loadu_ps(&spheres.x[j]);
+      __m128 y = _mm_loadu_ps(&spheres.y[j]);
+      __m128 z = _mm_loadu_ps(&spheres.z[j]);
+      __m128 negative_radius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&spheres.radius[j]));
+      __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+      for (int p = 0; p < 6; p++) {
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], x), _mm_mul_ps(ny[p], y)),
+                                                _mm_mul_ps(nz[p], z)),
+                                     d[p]);
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negative_radius));
+      }
+      mask |= static_cast<uint32_t>(_mm_movemask_ps(inside)) << (half * 4);
+    }
+    written += compact_mask(mask, i, visible + written);
+  }
+  return written + cull_spheres_scalar(frustum, spheres, i, count, visible + written);
+}
+
+__attribute__((target("avx2")))
+size_t cull_spheres_avx2(const Frustum& frustum, const BoundingSpheres& spheres, size_t count, uint32_t* visible) {
+  __m256 nx[6], ny[6], nz[6], d[6];
+  for (int p = 0; p < 6; p++) {
+    nx[p] = _mm256_set1_ps(frustum.planes[p].x);
+    ny[p] = _mm256_set1_ps(frustum.planes[p].y);
+    nz[p] = _mm256_set1_ps(frustum.planes[p].z);
+    d[p] = _mm256_set1_ps(frustum.planes[p].w);
+  }
+
+  size_t written = 0;
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256 x = _mm256_loadu_ps(&spheres.x[i]);
+    __m256 y = _mm256_loadu_ps(&spheres.y[i]);
+    __m256 z = _mm256_loadu_ps(&spheres.z[i]);
+    __m256 negative_radius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&spheres.radius[i]));
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (int p = 0; p < 6; p++) {
+      // same operation order as the scalar path, no fma, so every path
+      // keeps exactly the same spheres.
+      __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx[p], x), _mm256_mul_ps(ny[p], y)),
+                                                    _mm256_mul_ps(nz[p], z)),
+                                      d[p]);
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negative_radius, _CMP_GE_OQ));
+    }
+    written += compact_mask(static_cast<uint32_t>(_mm256_movemask_ps(inside)), i, visible + written);
+  }
+  return written + cull_spheres_scalar(frustum, spheres, i, count, visible + written);
+}
+#endif
+
+/**
+ * @brief Tests every sphere against the frustum and writes the indices of
+ * the ones that intersect it to visible (room for spheres.size()), in
+ * increasing order. Every path keeps the same spheres.
+ * @return The number of visible spheres.
+ */
+size_t CullSpheres(const Frustum& frustum, const BoundingSpheres& spheres, uint32_t* visible, CullPath path) {
+  size_t count = spheres.size();
+#ifdef VT_CULL_X86
+  if (path == CullPath::AVX2 && IsCullPathSupported(CullPath::AVX2)) {
+    return cull_spheres_avx2(frustum, spheres, count, visible);
+  }
+  if (path == CullPath::SSE || path == CullPath::AVX2) {
+    return cull_spheres_sse(frustum, spheres, count, visible);
+  }
+#endif
+  return cull_spheres_scalar(frustum, spheres, 0, count, visible);
+}
+
+struct FrustumCullStats {
+  size_t tested;
+  size_t visible;
+  double cull_ms;
+};
+
+/**
+ * @brief Keeps the visible list between frames so culling allocates nothing
+ * once it has seen the largest scene.
+ */
+class FrustumCuller {
+  CullPath _path;
+  std::vector<uint32_t> _visible;
+  FrustumCullStats _stats{0, 0, 0.0};
+
+public:
+  FrustumCuller(CullPath path = GetDefaultCullPath()): _path(path) {}
+
+  /**
+   * @brief view_proj maps the space of the spheres to clip space, for
+   * instances of a VT::Scene that is proj * view * ubo.model.
+   * @return Indices of the visible spheres, valid until the next Cull.
+   */
+  const std::vector<uint32_t>& Cull(const BoundingSpheres& spheres, const glm::mat4& view_proj) {
+    ENGINE_PROFILE_SCOPE("FrustumCuller::Cull");
+    auto start = std::chrono::high_resolution_clock::now();
+    _visible.resize(spheres.size());
+    size_t visible = CullSpheres(ExtractFrustum(view_proj), spheres, _visible.data(), _path);
+    _visible.resize(visible);
+
+    _stats.tested = spheres.size();
+    _stats.visible = visible;
+    _stats.cull_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return _visible;
+  }
+
+  CullPath GetPath() const {
+    return _path;
+  }
+
+  const FrustumCullStats& GetStats() const {
+    return _stats;
+  }
+};
+} // VT
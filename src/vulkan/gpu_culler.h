@@ -0,0 +1,554 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "buffer.h"
+#include "compute_pipeline.h"
+#include "depth_pyramid.h"
+#include "frustum_culling.h"
+#include "memory_allocator.h"
+#include "scene.h"
+#include "upload_queue.h"
+#include "vulkan.h"
+
+namespace VT {
+
+const std::string GPU_CULL_SHADER_PATH = "/build/shaders/cull.comp.spv";
+// local_size_x of cull.comp.
+const uint32_t GPU_CULL_GROUP_SIZE = 64;
+// bindings of cull.comp, all storage buffers but the cull data.
+const uint32_t GPU_CULL_BINDING_COUNT = 9;
+const uint32_t GPU_CULL_DATA_BINDING = 5;
+const uint32_t GPU_CULL_PYRAMID_BINDING = 8;
+
+// an instance as cull.comp reads it (std430).
+struct GpuInstance {
+  glm::mat4 model;
+  // world space bounding sphere, xyz center and w radius.
+  glm::vec4 sphere;
+  MeshHandle mesh;
+  uint32_t padding[3];
+};
+static_assert(sizeof(GpuInstance) == 96, "GpuInstance has to match the std430 layout of cull.comp");
+
+// CullData of cull.comp (std140).
+struct GpuCullData {
+  glm::vec4 planes[6];
+  glm::mat4 view_proj;
+  // depth attachment width and height, pyramid level count and 1 when
+  // culling occluded instances.
+  uint32_t pyramid[4];
+  // offset, width and height of each level.
+  uint32_t levels[DEPTH_PYRAMID_MAX_LEVELS][4];
+};
+static_assert(sizeof(GpuCullData) == 432, "GpuCullData has to match the std140 layout of cull.comp");
+
+struct GpuCullPushConstants {
+  uint32_t instance_count;
+  uint32_t mesh_count;
+  // see cull.comp.
+  uint32_t pass;
+};
+
+// the counters cull.comp writes to its stats buffer.
+struct GpuCullCounters {
+  uint32_t frustum_culled;
+  uint32_t occlusion_culled;
+};
+
+/**
+ * @brief The draws of the early phase come from the instances that were
+ * visible last frame, the late phase draws the ones that became visible
+ * (without occlusion culling everything is drawn in the early phase).
+ */
+enum class GpuCullPhase {
+  Early,
+  Late,
+};
+
+/**
+ * @brief What the gpu did in the last frame recorded for a slot.
+ */
+struct GpuCullStats {
+  uint32_t instances;
+  // outside the view frustum.
+  uint32_t frustum_culled;
+  // in the view frustum but behind the depth pyramid, 0 without occlusion
+  // culling.
+  uint32_t occlusion_culled;
+  // indirect draws with at least one instance, both phases.
+  uint32_t draws;
+  // drawn in both phases. Instances drawn early can turn out occluded.
+  uint64_t visible_instances;
+  // drawn in the late phase, they were hidden in the frame before.
+  uint64_t late_instances;
+  uint64_t triangles;
+};
+
+/**
+ * @brief Culls the instances of a VT::Scene in a compute shader and draws
+ * the visible ones with indirect draws, so recording a frame costs the same
+ * no matter how many instances or meshes the scene has.
+ * @details The instances (model matrix, bounding sphere and mesh) live in a
+ * device local storage buffer uploaded once by UploadScene. Every frame
+ * RecordCull, recorded before the render pass, frustum culls them in
+ * cull.comp: a visible instance takes the next slot of its mesh with an
+ * atomic add on that mesh's instanceCount and writes its model matrix
+ * there, so the instances of a mesh are contiguous in the visible instance
+ * buffer, which is bound as vertex binding 1. A second dispatch appends the
+ * draw of every mesh with instances to the indirect buffer and counts them.
+ * RecordDraws consumes them with vkCmdDrawIndexedIndirectCount, or, when
+ * the device lacks it, draws the uncompacted per mesh draws with
+ * vkCmdDrawIndexedIndirect, where meshes without instances draw nothing.
+ *
+ * Occlusion culling is two phase. Given a depth pyramid, the early phase
+ * only draws the instances that were visible last frame. After the early
+ * render pass the pyramid is built from its depth, then RecordLateCull tests
+ * every instance in the frustum against it: the visible ones the early phase
+ * skipped are drawn by a late render pass on top, and the result is kept for
+ * the next frame's early phase. Instances that come into view are therefore
+ * drawn in the frame they appear, never a frame late.
+ *
+ * The per frame buffers are only written by the gpu, a slot's are reused
+ * once the frame that last used it completed. The per mesh draws and the
+ * counters are copied to host visible memory for ReadStats.
+ */
+class GpuCuller {
+  struct Frame {
+    // one draw per mesh and phase, reset from _draw_template every frame.
+    VkBuffer mesh_draws = VK_NULL_HANDLE;
+    VT::Allocation mesh_draws_memory;
+    VkBuffer visible_instances = VK_NULL_HANDLE;
+    VT::Allocation visible_instances_memory;
+    VkBuffer draws = VK_NULL_HANDLE;
+    VT::Allocation draws_memory;
+    // one count per phase.
+    VkBuffer draw_count = VK_NULL_HANDLE;
+    VT::Allocation draw_count_memory;
+    VkBuffer counters = VK_NULL_HANDLE;
+    VT::Allocation counters_memory;
+    // host visible, written before the frame is recorded.
+    VkBuffer cull_data = VK_NULL_HANDLE;
+    VT::Allocation cull_data_memory;
+    // host visible copy of mesh_draws followed by counters, for ReadStats.
+    VkBuffer readback = VK_NULL_HANDLE;
+    VT::Allocation readback_memory;
+    VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+    bool occlusion = false;
+  };
+
+  VkBuffer _instances = VK_NULL_HANDLE;
+  VT::Allocation _instances_memory;
+  // the per mesh draws of both phases with instanceCount 0, copied over
+  // mesh_draws.
+  VkBuffer _draw_template = VK_NULL_HANDLE;
+  VT::Allocation _draw_template_memory;
+  // one uint per instance, 1 when it was visible in the last late phase.
+  // Shared by all frames, the frames run in submission order.
+  VkBuffer _visibility = VK_NULL_HANDLE;
+  VT::Allocation _visibility_memory;
+  // everything counts as visible after an upload.
+  bool _reset_visibility = true;
+  uint32_t _instance_count = 0;
+  uint32_t _mesh_count = 0;
+
+  std::vector<Frame> _frames;
+  VkDescriptorSetLayout _descriptor_set_layout;
+  VkDescriptorPool _descriptor_pool;
+  VT::ComputePipelineInfo _pipeline;
+  // null without drawIndirectCount.
+  PFN_vkCmdDrawIndexedIndirectCount _draw_indexed_indirect_count = nullptr;
+
+  const std::shared_ptr<VT::Vulkan> _instance;
+
+public:
+  GpuCuller(const std::shared_ptr<VT::Vulkan>& instance, uint32_t frame_count): _frames(frame_count), _instance(instance) {
+    if (!instance->SupportsMultiDrawIndirect()) {
+      throw std::runtime_error("failed to create gpu culler, multiDrawIndirect is not supported!");
+    }
+    if (instance->SupportsDrawIndirectCount()) {
+      _draw_indexed_indirect_count = (PFN_vkCmdDrawIndexedIndirectCount) vkGetDeviceProcAddr(instance->GetVkDevice(), "vkCmdDrawIndexedIndirectCount");
+    }
+    create_descriptor_set_layout();
+    create_descriptor_sets();
+    VT::ComputePipelineOptions options{instance->GetVkDevice(), GPU_CULL_SHADER_PATH, _descriptor_set_layout, sizeof(GpuCullPushConstants), instance->GetPipelineCache()};
+    _pipeline = VT::CreateComputePipeline(options);
+  }
+
+  ~GpuCuller() {
+    VkDevice device = _instance->GetVkDevice();
+    destroy_buffers();
+    vkDestroyPipeline(device, _pipeline.compute_pipeline, nullptr);
+    vkDestroyPipelineLayout(device, _pipeline.pipeline_layout, nullptr);
+    vkDestroyDescriptorPool(device, _descriptor_pool, nullptr);
+    vkDestroyDescriptorSetLayout(device, _descriptor_set_layout, nullptr);
+  }
+
+  GpuCuller(const GpuCuller&) = delete;
+  GpuCuller& operator=(const GpuCuller&) = delete;
+
+  /**
+   * @brief Uploads the instances and meshes of scene, call again whenever
+   * they change. No frame that used the culler may still be in flight, and
+   * the upload queue has to be flushed before the next frame is submitted.
+   */
+  void UploadScene(const VT::Scene& scene, VT::UploadQueue& upload_queue) {
+    ENGINE_PROFILE_SCOPE("GpuCuller::UploadScene");
+    _instance_count = static_cast<uint32_t>(scene.GetInstanceCount());
+    _mesh_count = static_cast<uint32_t>(scene.GetMeshCount());
+
+    const BoundingSpheres& bounds = scene.GetBounds();
+    std::vector<GpuInstance> instances(_instance_count);
+    std::vector<uint32_t> mesh_instances(_mesh_count, 0);
+    for (uint32_t i = 0; i < _instance_count; i++) {
+      MeshHandle mesh = scene.GetInstanceMesh(i);
+      instances[i] = GpuInstance{scene.GetModelMatrix(i), glm::vec4(bounds.x[i], bounds.y[i], bounds.z[i], bounds.radius[i]), mesh, {0, 0, 0}};
+      mesh_instances[mesh]++;
+    }
+
+    // every mesh gets room for all of its instances in each phase, the late
+    // phase's instances follow the early phase's.
+    std::vector<VkDrawIndexedIndirectCommand> draws(2 * _mesh_count);
+    uint32_t first_instance = 0;
+    for (MeshHandle mesh = 0; mesh < _mesh_count; mesh++) {
+      const SceneMesh& scene_mesh = scene.GetMesh(mesh);
+      draws[mesh] = VkDrawIndexedIndirectCommand{scene_mesh.index_count, 0, scene_mesh.first_index, scene_mesh.vertex_offset, first_instance};
+      draws[_mesh_count + mesh] = draws[mesh];
+      draws[_mesh_count + mesh].firstInstance += _instance_count;
+      first_instance += mesh_instances[mesh];
+    }
+
+    destroy_buffers();
+    create_buffers();
+    if (_instance_count > 0) {
+      upload_queue.UploadBuffer(instances.data(), sizeof(GpuInstance) * instances.size(), _instances);
+    }
+    if (_mesh_count > 0) {
+      upload_queue.UploadBuffer(draws.data(), sizeof(VkDrawIndexedIndirectCommand) * draws.size(), _draw_template);
+    }
+    _reset_visibility = true;
+    update_descriptor_sets();
+  }
+
+  /**
+   * @brief Records the early phase of frame's culling against the frustum
+   * of view_proj (as for VT::FrustumCuller::Cull), outside of a render pass.
+   * @param pyramid culls occluded instances when given, the pyramid has to
+   * be rebuilt after the early render pass and before RecordLateCull.
+   */
+  void RecordCull(VkCommandBuffer command_buffer, uint32_t frame, const glm::mat4& view_proj, const VT::DepthPyramid* pyramid = nullptr) {
+    Frame& slot = _frames[frame];
+    slot.occlusion = pyramid != nullptr;
+    write_cull_data(slot, view_proj, pyramid);
+
+    if (_mesh_count > 0) {
+      VkBufferCopy copyRegion{0, 0, sizeof(VkDrawIndexedIndirectCommand) * 2 * _mesh_count};
+      vkCmdCopyBuffer(command_buffer, _draw_template, slot.mesh_draws, 1, &copyRegion);
+    }
+    vkCmdFillBuffer(command_buffer, slot.draw_count, 0, 2 * sizeof(uint32_t), 0);
+    vkCmdFillBuffer(command_buffer, slot.counters, 0, sizeof(GpuCullCounters), 0);
+    if (_reset_visibility && _instance_count > 0) {
+      vkCmdFillBuffer(command_buffer, _visibility, 0, sizeof(uint32_t) * _instance_count, 1);
+      _reset_visibility = false;
+    }
+    // also the visibility the last frame's late phase wrote.
+    memory_barrier(command_buffer,
+                   VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                   VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    record_phase(command_buffer, slot, 0);
+    if (!slot.occlusion) {
+      record_readback(command_buffer, slot);
+    }
+  }
+
+  /**
+   * @brief Records the late phase of frame, after the RecordCull that was
+   * given pyramid and after the pyramid was built from the early phase.
+   */
+  void RecordLateCull(VkCommandBuffer command_buffer, uint32_t frame) {
+    Frame& slot = _frames[frame];
+    if (!slot.occlusion) {
+      throw std::runtime_error("failed to record late cull, the early phase had no depth pyramid!");
+    }
+    record_phase(command_buffer, slot, 2);
+    record_readback(command_buffer, slot);
+  }
+
+  /**
+   * @brief Records the draws phase built for frame, inside a render pass
+   * with the graphics pipeline, index buffer and vertex binding 0 bound and
+   * GetVisibleInstances(frame) at binding 1.
+   */
+  void RecordDraws(VkCommandBuffer command_buffer, uint32_t frame, GpuCullPhase phase = GpuCullPhase::Early) const {
+    if (_mesh_count == 0) {
+      return;
+    }
+    const Frame& slot = _frames[frame];
+    uint32_t index = static_cast<uint32_t>(phase);
+    VkDeviceSize offset = sizeof(VkDrawIndexedIndirectCommand) * index * _mesh_count;
+    if (_draw_indexed_indirect_count != nullptr) {
+      _draw_indexed_indirect_count(command_buffer, slot.draws, offset, slot.draw_count, sizeof(uint32_t) * index, _mesh_count, sizeof(VkDrawIndexedIndirectCommand));
+    } else {
+      vkCmdDrawIndexedIndirect(command_buffer, slot.mesh_draws, offset, _mesh_count, sizeof(VkDrawIndexedIndirectCommand));
+    }
+  }
+
+  // the model matrices of frame's drawn instances, vertex binding 1.
+  VkBuffer GetVisibleInstances(uint32_t frame) const {
+    return _frames[frame].visible_instances;
+  }
+
+  /**
+   * @brief What the last frame recorded for frame culled and drew, frame
+   * has to have completed. Reads two draws per mesh, no instances.
+   */
+  GpuCullStats ReadStats(uint32_t frame) const {
+    GpuCullStats stats{_instance_count, 0, 0, 0, 0, 0, 0};
+    const char* readback = static_cast<const char*>(_frames[frame].readback_memory.mapped);
+    const auto* draws = reinterpret_cast<const VkDrawIndexedIndirectCommand*>(readback);
+    for (uint32_t draw = 0; draw < 2 * _mesh_count; draw++) {
+      if (draws[draw].instanceCount > 0) {
+        stats.draws++;
+        stats.visible_instances += draws[draw].instanceCount;
+        stats.triangles += static_cast<uint64_t>(draws[draw].indexCount / 3) * draws[draw].instanceCount;
+        if (draw >= _mesh_count) {
+          stats.late_instances += draws[draw].instanceCount;
+        }
+      }
+    }
+    GpuCullCounters counters;
+    memcpy(&counters, readback + sizeof(VkDrawIndexedIndirectCommand) * 2 * _mesh_count, sizeof(counters));
+    stats.frustum_culled = counters.frustum_culled;
+    stats.occlusion_culled = counters.occlusion_culled;
+    return stats;
+  }
+
+  bool UsesDrawIndirectCount() const {
+    return _draw_indexed_indirect_count != nullptr;
+  }
+
+private:
+  static uint32_t group_count(uint32_t invocations) {
+    return (invocations + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE;
+  }
+
+  static void memory_barrier(
+      VkCommandBuffer command_buffer,
+      VkPipelineStageFlags src_stage,
+      VkAccessFlags src_access,
+      VkPipelineStageFlags dst_stage,
+      VkAccessFlags dst_access) {
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = src_access;
+    barrier.dstAccessMask = dst_access;
+    vkCmdPipelineBarrier(command_buffer, src_stage, dst_stage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+  }
+
+  void write_cull_data(Frame& slot, const glm::mat4& view_proj, const VT::DepthPyramid* pyramid) {
+    GpuCullData data{};
+    Frustum frustum = ExtractFrustum(view_proj);
+    std::copy(std::begin(frustum.planes), std::end(frustum.planes), data.planes);
+    data.view_proj = view_proj;
+    if (pyramid != nullptr) {
+      const auto& levels = pyramid->GetLevels();
+      data.pyramid[0] = pyramid->GetExtent().width;
+      data.pyramid[1] = pyramid->GetExtent().height;
+      data.pyramid[2] = static_cast<uint32_t>(levels.size());
+      data.pyramid[3] = 1;
+      for (size_t level = 0; level < levels.size(); level++) {
+        data.levels[level][0] = levels[level].offset;
+        data.levels[level][1] = levels[level].width;
+        data.levels[level][2] = levels[level].height;
+      }
+      // the pyramid is recreated with the depth attachment. The slot's last
+      // frame completed, its set is not in use.
+      write_descriptor(slot.descriptor_set, GPU_CULL_PYRAMID_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, pyramid->GetBuffer());
+    }
+    memcpy(slot.cull_data_memory.mapped, &data, sizeof(data));
+  }
+
+  // the cull pass of a phase (0 early, 2 late) and the compaction after it.
+  void record_phase(VkCommandBuffer command_buffer, const Frame& slot, uint32_t pass) {
+    GpuCullPushConstants constants{_instance_count, _mesh_count, pass};
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline.compute_pipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline.pipeline_layout, 0, 1, &slot.descriptor_set, 0, nullptr);
+    vkCmdPushConstants(command_buffer, _pipeline.pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+    vkCmdDispatch(command_buffer, group_count(_instance_count), 1, 1);
+
+    // the instance counts of the cull pass are read by the compaction.
+    memory_barrier(command_buffer,
+                   VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                   VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    constants.pass = pass + 1;
+    vkCmdPushConstants(command_buffer, _pipeline.pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, offsetof(GpuCullPushConstants, pass), sizeof(uint32_t), &constants.pass);
+    vkCmdDispatch(command_buffer, group_count(_mesh_count), 1, 1);
+
+    memory_barrier(command_buffer,
+                   VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                   VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                   VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT);
+  }
+
+  void record_readback(VkCommandBuffer command_buffer, const Frame& slot) {
+    VkDeviceSize drawsSize = sizeof(VkDrawIndexedIndirectCommand) * 2 * _mesh_count;
+    if (_mesh_count > 0) {
+      VkBufferCopy drawsRegion{0, 0, drawsSize};
+      vkCmdCopyBuffer(command_buffer, slot.mesh_draws, slot.readback, 1, &drawsRegion);
+    }
+    VkBufferCopy countersRegion{0, drawsSize, sizeof(GpuCullCounters)};
+    vkCmdCopyBuffer(command_buffer, slot.counters, slot.readback, 1, &countersRegion);
+    memory_barrier(command_buffer,
+                   VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                   VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+  }
+
+  void create_descriptor_set_layout() {
+    std::array<VkDescriptorSetLayoutBinding, GPU_CULL_BINDING_COUNT> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); i++) {
+      bindings[i].binding = i;
+      bindings[i].descriptorType = i == GPU_CULL_DATA_BINDING ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      bindings[i].descriptorCount = 1;
+      bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+    if (vkCreateDescriptorSetLayout(_instance->GetVkDevice(), &layoutInfo, nullptr, &_descriptor_set_layout) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create cull descriptor set layout!");
+    }
+  }
+
+  void create_descriptor_sets() {
+    VkDevice device = _instance->GetVkDevice();
+    uint32_t frame_count = static_cast<uint32_t>(_frames.size());
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[0].descriptorCount = (GPU_CULL_BINDING_COUNT - 1) * frame_count;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[1].descriptorCount = frame_count;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = frame_count;
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &_descriptor_pool) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create cull descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(frame_count, _descriptor_set_layout);
+    std::vector<VkDescriptorSet> sets(frame_count);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = _descriptor_pool;
+    allocInfo.descriptorSetCount = frame_count;
+    allocInfo.pSetLayouts = layouts.data();
+    if (vkAllocateDescriptorSets(device, &allocInfo, sets.data()) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate cull descriptor sets!");
+    }
+    for (uint32_t frame = 0; frame < frame_count; frame++) {
+      _frames[frame].descriptor_set = sets[frame];
+    }
+  }
+
+  // buffers are never empty, so a scene without instances or meshes still
+  // has valid descriptors.
+  void create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VT::Allocation& memory) {
+    VT::CreateBuffer(std::max(size, static_cast<VkDeviceSize>(16)), usage, properties, buffer, memory, _instance->GetVkDevice(), _instance->GetVkPhysicalDevice());
+  }
+
+  void create_buffers() {
+    const VkMemoryPropertyFlags deviceLocal = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    const VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    const VkDeviceSize drawsSize = sizeof(VkDrawIndexedIndirectCommand) * 2 * _mesh_count;
+    create_buffer(sizeof(GpuInstance) * _instance_count, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocal, _instances, _instances_memory);
+    create_buffer(drawsSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocal, _draw_template, _draw_template_memory);
+    create_buffer(sizeof(uint32_t) * _instance_count, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocal, _visibility, _visibility_memory);
+
+    for (Frame& frame : _frames) {
+      create_buffer(drawsSize,
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    deviceLocal, frame.mesh_draws, frame.mesh_draws_memory);
+      create_buffer(sizeof(InstanceData) * 2 * _instance_count, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, deviceLocal, frame.visible_instances, frame.visible_instances_memory);
+      create_buffer(drawsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, deviceLocal, frame.draws, frame.draws_memory);
+      create_buffer(2 * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocal, frame.draw_count, frame.draw_count_memory);
+      create_buffer(sizeof(GpuCullCounters), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocal, frame.counters, frame.counters_memory);
+      create_buffer(sizeof(GpuCullData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, hostVisible, frame.cull_data, frame.cull_data_memory);
+      create_buffer(drawsSize + sizeof(GpuCullCounters), VK_BUFFER_USAGE_TRANSFER_DST_BIT, hostVisible, frame.readback, frame.readback_memory);
+      // nothing was culled yet.
+      memset(frame.readback_memory.mapped, 0, static_cast<size_t>(drawsSize + sizeof(GpuCullCounters)));
+    }
+  }
+
+  void write_descriptor(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, VkBuffer buffer) {
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = buffer;
+    bufferInfo.offset = 0;
+    bufferInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = set;
+    descriptorWrite.dstBinding = binding;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = type;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pBufferInfo = &bufferInfo;
+    vkUpdateDescriptorSets(_instance->GetVkDevice(), 1, &descriptorWrite, 0, nullptr);
+  }
+
+  void update_descriptor_sets() {
+    for (const Frame& frame : _frames) {
+      // the pyramid binding needs a valid buffer until a pyramid is given,
+      // the shader only reads it with occlusion culling.
+      std::array<VkBuffer, GPU_CULL_BINDING_COUNT> buffers = {
+        _instances, frame.mesh_draws, frame.visible_instances, frame.draws, frame.draw_count,
+        frame.cull_data, _visibility, frame.counters, _visibility
+      };
+      for (uint32_t binding = 0; binding < buffers.size(); binding++) {
+        write_descriptor(frame.descriptor_set, binding, binding == GPU_CULL_DATA_BINDING ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, buffers[binding]);
+      }
+    }
+  }
+
+  void destroy_buffers() {
+    VkDevice device = _instance->GetVkDevice();
+    auto destroy = [device](VkBuffer& buffer, VT::Allocation& memory) {
+      if (buffer != VK_NULL_HANDLE) {
+        VT::DestroyBuffer(device, buffer, memory);
+        buffer = VK_NULL_HANDLE;
+      }
+    };
+    destroy(_instances, _instances_memory);
+    destroy(_draw_template, _draw_template_memory);
+    destroy(_visibility, _visibility_memory);
+    for (Frame& frame : _frames) {
+      destroy(frame.mesh_draws, frame.mesh_draws_memory);
+      destroy(frame.visible_instances, frame.visible_instances_memory);
+      destroy(frame.draws, frame.draws_memory);
+      destroy(frame.draw_count, frame.draw_count_memory);
+      destroy(frame.counters, frame.counters_memory);
+      destroy(frame.cull_data, frame.cull_data_memory);
+      destroy(frame.readback, frame.readback_memory);
+    }
+  }
+};
+} // VT
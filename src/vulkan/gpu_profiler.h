@@ -0,0 +1,320 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace VT {
+
+// timestamp pairs one frame can record.
+const uint32_t GPU_PROFILER_MAX_SCOPES = 64;
+// samples per scope the statistics are computed over.
+const size_t GPU_PROFILER_WINDOW = 256;
+
+struct GpuProfilerOptions {
+  VkDevice device;
+  VkPhysicalDevice physical_device;
+  // family of the queue the profiled command buffers are submitted to.
+  uint32_t queue_family_index;
+  uint32_t frames_in_flight;
+  uint32_t max_scopes = GPU_PROFILER_MAX_SCOPES;
+  // samples per scope the statistics are computed over.
+  size_t window = GPU_PROFILER_WINDOW;
+};
+
+/**
+ * @brief --gpu-profile=file writes the per scope statistics there at exit,
+ * as JSON when it ends in .json and CSV otherwise. Empty when not given.
+ */
+std::string ParseGpuProfilePath(int argc, char** argv) {
+  const std::string profile_arg = "--gpu-profile=";
+  std::string path;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg.compare(0, profile_arg.size(), profile_arg) == 0) {
+      path = arg.substr(profile_arg.size());
+    }
+  }
+  return path;
+}
+
+struct GpuScopeStats {
+  std::string name;
+  double min_ms;
+  double avg_ms;
+  double p50_ms;
+  double p95_ms;
+  double p99_ms;
+  double max_ms;
+  size_t samples;
+};
+
+/**
+ * @brief Measures gpu time of named scopes with vkCmdWriteTimestamp pairs.
+ * @details Every frame slot has its own query pool. A slot's results are
+ * read in BeginFrame the next time the slot is recorded, frames_in_flight
+ * frames later. By then the frame scheduler has already waited for that
+ * frame, so results are read without VK_QUERY_RESULT_WAIT_BIT and the
+ * profiler never stalls. A frame whose results are somehow not available
+ * is dropped.
+ *
+ * Ticks are converted with timestampPeriod and masked to the queue family's
+ * timestampValidBits. If the family has no timestamp support, every call is
+ * a no-op.
+ * Not thread safe, record from one thread.
+ */
+class GpuProfiler {
+  struct Frame {
+    VkQueryPool query_pool = VK_NULL_HANDLE;
+    std::vector<std::string> scopes;
+    // the pool was reset and written since it was last read.
+    bool recorded = false;
+  };
+
+  VkDevice _device;
+  uint32_t _max_scopes;
+  size_t _window;
+  double _timestamp_period_ns = 1.0;
+  uint64_t _timestamp_mask = ~0ull;
+  bool _enabled = false;
+
+  std::vector<Frame> _frames;
+  Frame* _recording = nullptr;
+
+  // rolling window of samples in ms per scope name, in first seen order.
+  std::vector<std::string> _scope_order;
+  std::map<std::string, std::deque<double>> _samples;
+
+public:
+  GpuProfiler(const GpuProfilerOptions& options):
+    _device(options.device),
+    _max_scopes(options.max_scopes),
+    _window(options.window),
+    _frames(options.frames_in_flight) {
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(options.physical_device, &properties);
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(options.physical_device, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(options.physical_device, &queueFamilyCount, queueFamilies.data());
+    uint32_t validBits = options.queue_family_index < queueFamilyCount ? queueFamilies[options.queue_family_index].timestampValidBits : 0;
+
+    _enabled = validBits > 0 && properties.limits.timestampPeriod > 0.0f;
+    if (!_enabled) {
+      std::cout << "gpu profiler: queue family has no timestamp support, disabled" << std::endl;
+      return;
+    }
+    _timestamp_period_ns = properties.limits.timestampPeriod;
+    _timestamp_mask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1);
+
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = _max_scopes * 2;
+    for (auto& frame : _frames) {
+      if (vkCreateQueryPool(_device, &queryPoolInfo, nullptr, &frame.query_pool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create timestamp query pool!");
+      }
+    }
+  }
+
+  ~GpuProfiler() {
+    for (auto& frame : _frames) {
+      if (frame.query_pool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(_device, frame.query_pool, nullptr);
+      }
+    }
+  }
+
+  GpuProfiler(const GpuProfiler&) = delete;
+  GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+  bool IsEnabled() const {
+    return _enabled;
+  }
+
+  /**
+   * @brief Collects the slot's previous results and resets its queries.
+   * Record right after vkBeginCommandBuffer, outside any render pass, once
+   * the frame that last used the slot has completed.
+   */
+  void BeginFrame(VkCommandBuffer command_buffer, uint32_t slot) {
+    if (!_enabled) {
+      return;
+    }
+    Frame& frame = _frames[slot];
+    if (frame.recorded) {
+      collect(frame);
+    }
+    frame.scopes.clear();
+    frame.recorded = true;
+    vkCmdResetQueryPool(command_buffer, frame.query_pool, 0, _max_scopes * 2);
+    _recording = &frame;
+  }
+
+  /**
+   * @brief Writes the start timestamp of a scope.
+   * @return The scope's index for EndScope, or -1 if it is not recorded.
+   */
+  int BeginScope(VkCommandBuffer command_buffer, const std::string& name) {
+    if (!_enabled || _recording == nullptr || _recording->scopes.size() >= _max_scopes) {
+      return -1;
+    }
+    int scope = static_cast<int>(_recording->scopes.size());
+    _recording->scopes.push_back(name);
+    // top of pipe: the scope starts once all previous commands have started.
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _recording->query_pool, scope * 2);
+    return scope;
+  }
+
+  void EndScope(VkCommandBuffer command_buffer, int scope) {
+    if (scope < 0 || _recording == nullptr) {
+      return;
+    }
+    // bottom of pipe: written once all previous commands have completed.
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _recording->query_pool, scope * 2 + 1);
+  }
+
+  /**
+   * @brief Rolling min/avg/percentiles of every scope seen so far, in ms.
+   */
+  std::vector<GpuScopeStats> GetStats() const {
+    std::vector<GpuScopeStats> stats;
+    for (const auto& name : _scope_order) {
+      const auto& samples = _samples.at(name);
+      if (samples.empty()) {
+        continue;
+      }
+      std::vector<double> sorted(samples.begin(), samples.end());
+      std::sort(sorted.begin(), sorted.end());
+      double total = 0.0;
+      for (double sample : sorted) {
+        total += sample;
+      }
+      auto percentile = [&sorted](double p) {
+        return sorted[std::min(sorted.size() - 1, static_cast<size_t>(sorted.size() * p))];
+      };
+      stats.push_back(GpuScopeStats{name, sorted.front(), total / sorted.size(), percentile(0.50), percentile(0.95), percentile(0.99), sorted.back(), sorted.size()});
+    }
+    return stats;
+  }
+
+  void WriteCSV(const std::string& path) const {
+    std::ofstream file(path, std::ios::trunc);
+    file << "scope,min_ms,avg_ms,p50_ms,p95_ms,p99_ms,samples\n";
+    for (const auto& scope : GetStats()) {
+      file << scope.name << "," << scope.min_ms << "," << scope.avg_ms << "," << scope.p50_ms << ","
+           << scope.p95_ms << "," << scope.p99_ms << "," << scope.samples << "\n";
+    }
+    if (!file) {
+      throw std::runtime_error("failed to write " + path + "!");
+    }
+  }
+
+  void WriteJSON(const std::string& path) const {
+    std::ofstream file(path, std::ios::trunc);
+    file << "{\n  \"scopes\": [";
+    auto stats = GetStats();
+    for (size_t i = 0; i < stats.size(); i++) {
+      file << (i == 0 ? "\n" : ",\n")
+           << "    {\"name\": \"" << stats[i].name << "\""
+           << ", \"min_ms\": " << stats[i].min_ms
+           << ", \"avg_ms\": " << stats[i].avg_ms
+           << ", \"p50_ms\": " << stats[i].p50_ms
+           << ", \"p95_ms\": " << stats[i].p95_ms
+           << ", \"p99_ms\": " << stats[i].p99_ms
+           << ", \"samples\": " << stats[i].samples << "}";
+    }
+    file << "\n  ]\n}\n";
+    if (!file) {
+      throw std::runtime_error("failed to write " + path + "!");
+    }
+  }
+
+  /**
+   * @brief Writes JSON for paths ending in .json, CSV otherwise.
+   */
+  void Write(const std::string& path) const {
+    const std::string json = ".json";
+    if (path.size() >= json.size() && path.compare(path.size() - json.size(), json.size(), json) == 0) {
+      WriteJSON(path);
+    } else {
+      WriteCSV(path);
+    }
+  }
+
+  void Report() const {
+    for (const auto& scope : GetStats()) {
+      std::cout << "gpu " << scope.name << " (min/avg/p99 ms): "
+                << scope.min_ms << "/" << scope.avg_ms << "/" << scope.p99_ms << std::endl;
+    }
+  }
+
+private:
+  void collect(Frame& frame) {
+    if (frame.scopes.empty()) {
+      return;
+    }
+    uint32_t queryCount = static_cast<uint32_t>(frame.scopes.size() * 2);
+    std::vector<uint64_t> timestamps(queryCount);
+    VkResult result = vkGetQueryPoolResults(_device, frame.query_pool, 0, queryCount,
+                                            timestamps.size() * sizeof(uint64_t), timestamps.data(),
+                                            sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS) {
+      return;
+    }
+
+    for (size_t i = 0; i < frame.scopes.size(); i++) {
+      uint64_t begin = timestamps[i * 2] & _timestamp_mask;
+      uint64_t end = timestamps[i * 2 + 1] & _timestamp_mask;
+      // the counter wrapped around within the scope.
+      uint64_t ticks = end >= begin ? end - begin : end + (_timestamp_mask - begin) + 1;
+      add_sample(frame.scopes[i], ticks * _timestamp_period_ns / 1e6);
+    }
+  }
+
+  void add_sample(const std::string& name, double ms) {
+    auto it = _samples.find(name);
+    if (it == _samples.end()) {
+      _scope_order.push_back(name);
+      it = _samples.emplace(name, std::deque<double>()).first;
+    }
+    it->second.push_back(ms);
+    if (it->second.size() > _window) {
+      it->second.pop_front();
+    }
+  }
+};
+
+/**
+ * @brief Begin and end of a profiler scope tied to a C++ scope.
+ */
+class GpuScope {
+  GpuProfiler* _profiler;
+  VkCommandBuffer _command_buffer;
+  int _scope;
+
+public:
+  GpuScope(GpuProfiler* profiler, VkCommandBuffer command_buffer, const std::string& name):
+    _profiler(profiler),
+    _command_buffer(command_buffer),
+    _scope(profiler != nullptr ? profiler->BeginScope(command_buffer, name) : -1) {}
+
+  ~GpuScope() {
+    if (_profiler != nullptr) {
+      _profiler->EndScope(_command_buffer, _scope);
+    }
+  }
+
+  GpuScope(const GpuScope&) = delete;
+  GpuScope& operator=(const GpuScope&) = delete;
+};
+} // VT
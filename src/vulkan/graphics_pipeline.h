@@ -3,6 +3,7 @@
 #include <GLFW/glfw3.h>
 
 #include <array>
+#include <chrono>
 #include <iostream>
 #include <filesystem>
 #include <fstream>
@@ -28,7 +29,8 @@ struct GraphicsPipelineOptions {
   VkDevice device;
   VkRenderPass render_pass;
   VkDescriptorSetLayout descriptor_set_layout;
-  VkExtent2D swapchain_extent;
+  // VK_NULL_HANDLE compiles every pipeline from scratch.
+  VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
 };
 
 struct GraphicsPipelineInfo {
@@ -40,6 +42,7 @@ std::vector<char> read_file(const std::string& filename);
 VkShaderModule create_shader_module(const std::vector<char>& code, GraphicsPipelineOptions& options);
 GraphicsPipelineInfo create_pipleline_layout(VkPipelineShaderStageCreateInfo shaderStages[], GraphicsPipelineOptions& options);
 GraphicsPipelineInfo CreateGraphicsPipeline(GraphicsPipelineOptions& options);
+GraphicsPipelineInfo CreateOcclusionBoxPipeline(GraphicsPipelineOptions& options);
 
 GraphicsPipelineInfo CreateGraphicsPipeline(GraphicsPipelineOptions& options) {
 
@@ -79,8 +82,15 @@ GraphicsPipelineInfo create_pipleline_layout(VkPipelineShaderStageCreateInfo sha
   VkPipelineLayout pipeline_layout;
   VkPipeline graphics_pipeline;
 
-  auto bindingDescription = VT::Vertex::getBindingDescription();
-  auto attributeDescriptions = VT::Vertex::getAttributeDescriptions();
+  // binding 0 is per vertex, binding 1 per instance (see VT::InstanceData).
+  std::array<VkVertexInputBindingDescription, 2> bindingDescriptions = {
+    VT::MeshVertex::getBindingDescription(),
+    VT::InstanceData::getBindingDescription()
+  };
+  auto vertexAttributes = VT::MeshVertex::getAttributeDescriptions();
+  auto instanceAttributes = VT::InstanceData::getAttributeDescriptions();
+  std::vector<VkVertexInputAttributeDescription> attributeDescriptions(vertexAttributes.begin(), vertexAttributes.end());
+  attributeDescriptions.insert(attributeDescriptions.end(), instanceAttributes.begin(), instanceAttributes.end());
 
   // The VkPipelineVertexInputStateCreateInfo structure describes the format of
   // the vertex data that will be passed to the vertex shader. 
@@ -88,9 +98,9 @@ GraphicsPipelineInfo create_pipleline_layout(VkPipelineShaderStageCreateInfo sha
   vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
   // Because we're hard coding the vertex data directly in the vertex shader, we'll
   // fill in this structure to specify that there is no vertex data to load for now
-  vertexInputInfo.vertexBindingDescriptionCount = 1;
+  vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
   vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-  vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+  vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
   vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
   // The VkPipelineInputAssemblyStateCreateInfo struct describes two things: what kind of geometry
@@ -100,31 +110,23 @@ GraphicsPipelineInfo create_pipleline_layout(VkPipelineShaderStageCreateInfo sha
   inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
   inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-  // A viewport basically describes the region of the framebuffer that the output will be rendered to. 
-  VkViewport viewport{};
-  viewport.x = 0.0f;
-  viewport.y = 0.0f;
-  viewport.width = (float) options.swapchain_extent.width;
-  viewport.height = (float) options.swapchain_extent.height;
-  viewport.minDepth = 0.0f;
-  viewport.maxDepth = 1.0f;
-
-  // In this tutorial we simply want to draw to the entire framebuffer,
-  // so we'll specify a scissor rectangle that covers it entirely:
-  VkRect2D scissor{};
-  scissor.offset = {0, 0};
-  scissor.extent = options.swapchain_extent;
-
-  // Now this viewport and scissor rectangle need to be combined into a viewport state
-  // using the VkPipelineViewportStateCreateInfo struct. It is possible to use multiple
-  // viewports and scissor rectangles on some graphics cards, so its members reference
-  // an array of them.
+  // The viewport (region of the framebuffer that the output will be rendered to)
+  // and the scissor rectangle are dynamic state, set when recording the command
+  // buffer with the current swapchain extent. Only their count is part of the
+  // pipeline, so the pipeline survives window resizes.
   VkPipelineViewportStateCreateInfo viewportState{};
   viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
   viewportState.viewportCount = 1;
-  viewportState.pViewports = &viewport;
   viewportState.scissorCount = 1;
-  viewportState.pScissors = &scissor;
+
+  std::array<VkDynamicState, 2> dynamicStates = {
+    VK_DYNAMIC_STATE_VIEWPORT,
+    VK_DYNAMIC_STATE_SCISSOR
+  };
+  VkPipelineDynamicStateCreateInfo dynamicState{};
+  dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+  dynamicState.pDynamicStates = dynamicStates.data();
 
 
   // The rasterizer takes the geometry that is shaped by the vertices from the vertex shader and turns
@@ -210,19 +212,148 @@ GraphicsPipelineInfo create_pipleline_layout(VkPipelineShaderStageCreateInfo sha
   pipelineInfo.pRasterizationState = &rasterizer;
   pipelineInfo.pMultisampleState = &multisampling;
   pipelineInfo.pColorBlendState = &colorBlending;
+  pipelineInfo.pDynamicState = &dynamicState;
   pipelineInfo.layout = pipeline_layout;
   pipelineInfo.renderPass = options.render_pass;
   pipelineInfo.subpass = 0;
   pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
   pipelineInfo.pDepthStencilState = &depthStencil;
 
-  if (vkCreateGraphicsPipelines(options.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphics_pipeline) != VK_SUCCESS) {
+  // the logged time is warm when the cache already holds data, loaded from
+  // disk or left by an earlier creation such as the one before a resize.
+  bool warm = options.pipeline_cache != VK_NULL_HANDLE && VT::IsPipelineCacheWarm(options.device, options.pipeline_cache);
+
+  auto start = std::chrono::high_resolution_clock::now();
+  if (vkCreateGraphicsPipelines(options.device, options.pipeline_cache, 1, &pipelineInfo, nullptr, &graphics_pipeline) != VK_SUCCESS) {
     throw std::runtime_error("failed to create graphics pipeline!");
   }
+  std::cout << "Created graphics pipeline ("
+            << (warm ? "warm" : "cold") << " pipeline cache): "
+            << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count()
+            << " ms" << std::endl;
 
   return GraphicsPipelineInfo { pipeline_layout, graphics_pipeline };
 }
 
+/**
+ * @brief The pipeline VT::OcclusionQueries draws its proxy boxes with: a
+ * cube from -1 to 1 generated in the vertex shader and placed by a mat4 push
+ * constant, depth tested against what was drawn but writing neither depth
+ * nor color. There is no fragment shader, the query only counts samples.
+ * options.descriptor_set_layout is not used.
+ */
+GraphicsPipelineInfo CreateOcclusionBoxPipeline(GraphicsPipelineOptions& options) {
+  auto vertShaderCode = read_file("/build/shaders/occlusion_box.vert.spv");
+  VkShaderModule vertShaderModule = create_shader_module(vertShaderCode, options);
+
+  VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+  vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+  vertShaderStageInfo.module = vertShaderModule;
+  vertShaderStageInfo.pName = "main";
+
+  // the cube's corners come from gl_VertexIndex, no vertex buffers.
+  VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+  vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+  VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+  inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+  // dynamic like the main pipeline's, so the state set for the draws carries over.
+  VkPipelineViewportStateCreateInfo viewportState{};
+  viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewportState.viewportCount = 1;
+  viewportState.scissorCount = 1;
+
+  std::array<VkDynamicState, 2> dynamicStates = {
+    VK_DYNAMIC_STATE_VIEWPORT,
+    VK_DYNAMIC_STATE_SCISSOR
+  };
+  VkPipelineDynamicStateCreateInfo dynamicState{};
+  dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+  dynamicState.pDynamicStates = dynamicStates.data();
+
+  // both sides, a box seen from inside still covers its mesh.
+  VkPipelineRasterizationStateCreateInfo rasterizer{};
+  rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  rasterizer.depthClampEnable = VK_FALSE;
+  rasterizer.rasterizerDiscardEnable = VK_FALSE;
+  rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+  rasterizer.lineWidth = 1.0f;
+  rasterizer.cullMode = VK_CULL_MODE_NONE;
+  rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  rasterizer.depthBiasEnable = VK_FALSE;
+
+  VkPipelineMultisampleStateCreateInfo multisampling{};
+  multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  multisampling.sampleShadingEnable = VK_FALSE;
+  multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+  // the color attachment is left untouched.
+  VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+  colorBlendAttachment.colorWriteMask = 0;
+  colorBlendAttachment.blendEnable = VK_FALSE;
+
+  VkPipelineColorBlendStateCreateInfo colorBlending{};
+  colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  colorBlending.logicOpEnable = VK_FALSE;
+  colorBlending.attachmentCount = 1;
+  colorBlending.pAttachments = &colorBlendAttachment;
+
+  // a box touching the surface it encloses still counts as visible.
+  VkPipelineDepthStencilStateCreateInfo depthStencil{};
+  depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  depthStencil.depthTestEnable = VK_TRUE;
+  depthStencil.depthWriteEnable = VK_FALSE;
+  depthStencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+  depthStencil.depthBoundsTestEnable = VK_FALSE;
+  depthStencil.stencilTestEnable = VK_FALSE;
+
+  VkPushConstantRange pushConstantRange{};
+  pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  pushConstantRange.offset = 0;
+  pushConstantRange.size = sizeof(glm::mat4);
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.pushConstantRangeCount = 1;
+  pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+  VkPipelineLayout pipeline_layout;
+  if (vkCreatePipelineLayout(options.device, &pipelineLayoutInfo, nullptr, &pipeline_layout) != VK_SUCCESS) {
+    vkDestroyShaderModule(options.device, vertShaderModule, nullptr);
+    throw std::runtime_error("failed to create occlusion box pipeline layout!");
+  }
+
+  VkGraphicsPipelineCreateInfo pipelineInfo{};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipelineInfo.stageCount = 1;
+  pipelineInfo.pStages = &vertShaderStageInfo;
+  pipelineInfo.pVertexInputState = &vertexInputInfo;
+  pipelineInfo.pInputAssemblyState = &inputAssembly;
+  pipelineInfo.pViewportState = &viewportState;
+  pipelineInfo.pRasterizationState = &rasterizer;
+  pipelineInfo.pMultisampleState = &multisampling;
+  pipelineInfo.pDepthStencilState = &depthStencil;
+  pipelineInfo.pColorBlendState = &colorBlending;
+  pipelineInfo.pDynamicState = &dynamicState;
+  pipelineInfo.layout = pipeline_layout;
+  pipelineInfo.renderPass = options.render_pass;
+  pipelineInfo.subpass = 0;
+
+  VkPipeline pipeline;
+  VkResult result = vkCreateGraphicsPipelines(options.device, options.pipeline_cache, 1, &pipelineInfo, nullptr, &pipeline);
+  vkDestroyShaderModule(options.device, vertShaderModule, nullptr);
+  if (result != VK_SUCCESS) {
+    vkDestroyPipelineLayout(options.device, pipeline_layout, nullptr);
+    throw std::runtime_error("failed to create occlusion box pipeline!");
+  }
+  return GraphicsPipelineInfo { pipeline_layout, pipeline };
+}
+
 VkShaderModule create_shader_module(const std::vector<char>& code, GraphicsPipelineOptions& options) {
   VkShaderModuleCreateInfo createInfo{};
   createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
@@ -270,8 +401,15 @@ std::vector<char> read_file(const std::string& filename) {
 
 class GraphicsPipeline {
   VkRenderPass _render_pass;
+  // the two passes of a frame with occlusion culling, compatible with
+  // _render_pass: the first stores depth for the depth pyramid and the
+  // second draws on top of it.
+  VkRenderPass _early_render_pass;
+  VkRenderPass _late_render_pass;
   VkPipelineLayout _graphics_pipeline_layout;
   VkPipeline _graphics_pipeline;
+  // created by the first GetOcclusionBoxPipeline.
+  GraphicsPipelineInfo _occlusion_box_pipeline{VK_NULL_HANDLE, VK_NULL_HANDLE};
 
   const std::shared_ptr<VT::Vulkan> _instance;
 
@@ -281,13 +419,19 @@ public:
       const std::unique_ptr<VT::Swapchain>& swapchain,
       const std::unique_ptr<VT::DescriptorSetLayout>& descriptor_set_layout):_instance(instance) {
     create_render_pass(swapchain);
-    create_graphics_pipeline(swapchain, descriptor_set_layout);
+    create_graphics_pipeline(descriptor_set_layout);
   }
 
   ~GraphicsPipeline() {
     auto device = _instance->GetVkDevice();
+    if (_occlusion_box_pipeline.graphics_pipeline != VK_NULL_HANDLE) {
+      vkDestroyPipeline(device, _occlusion_box_pipeline.graphics_pipeline, nullptr);
+      vkDestroyPipelineLayout(device, _occlusion_box_pipeline.pipeline_layout, nullptr);
+    }
     vkDestroyPipeline(device, _graphics_pipeline, nullptr);
     vkDestroyPipelineLayout(device, _graphics_pipeline_layout, nullptr);
+    vkDestroyRenderPass(device, _late_render_pass, nullptr);
+    vkDestroyRenderPass(device, _early_render_pass, nullptr);
     vkDestroyRenderPass(device, _render_pass, nullptr);
   }
 
@@ -295,6 +439,14 @@ public:
     return _render_pass;
   }
 
+  VkRenderPass GetEarlyRenderPass() const {
+    return _early_render_pass;
+  }
+
+  VkRenderPass GetLateRenderPass() const {
+    return _late_render_pass;
+  }
+
   VkPipelineLayout& GetPipelineLayout() {
     return _graphics_pipeline_layout;
   }
@@ -303,25 +455,47 @@ public:
     return _graphics_pipeline;
   }
 
+  // see CreateOcclusionBoxPipeline, for the render pass of GetRenderPass.
+  const GraphicsPipelineInfo& GetOcclusionBoxPipeline() {
+    if (_occlusion_box_pipeline.graphics_pipeline == VK_NULL_HANDLE) {
+      VT::GraphicsPipelineOptions options {
+        _instance->GetVkDevice(),
+        _render_pass,
+        VK_NULL_HANDLE,
+        _instance->GetPipelineCache()
+      };
+      _occlusion_box_pipeline = VT::CreateOcclusionBoxPipeline(options);
+    }
+    return _occlusion_box_pipeline;
+  }
+
 private:
   void create_render_pass(
       const std::unique_ptr<VT::Swapchain>& swapchain) {
     VT::RenderPassOptions options{
       swapchain->GetImageFormat(),
       _instance->GetVkDevice(),
-      _instance->GetVkPhysicalDevice()
+      _instance->GetVkPhysicalDevice(),
+      swapchain->GetFinalLayout()
     };
     _render_pass = VT::CreateRenderPass(options);
+
+    VT::RenderPassOptions earlyOptions = options;
+    earlyOptions.final_layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    earlyOptions.store_depth = true;
+    _early_render_pass = VT::CreateRenderPass(earlyOptions);
+
+    VT::RenderPassOptions lateOptions = options;
+    lateOptions.load_attachments = true;
+    _late_render_pass = VT::CreateRenderPass(lateOptions);
   }
 
-  void create_graphics_pipeline(
-      const std::unique_ptr<VT::Swapchain>& swapchain,
-      const std::unique_ptr<VT::DescriptorSetLayout>& descriptor_set_layout) {
+  void create_graphics_pipeline(const std::unique_ptr<VT::DescriptorSetLayout>& descriptor_set_layout) {
     VT::GraphicsPipelineOptions options {
       _instance->GetVkDevice(),
       _render_pass,
       descriptor_set_layout->GetLayout(),
-      swapchain->GetExtent()
+      _instance->GetPipelineCache()
     };
     auto result = VT::CreateGraphicsPipeline(options);
     _graphics_pipeline = result.graphics_pipeline;
@@ -0,0 +1,204 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "buffer.h"
+#include "frame_scheduler.h"
+#include "memory_allocator.h"
+
+namespace VT {
+
+/**
+ * @brief Rendering without a window: offscreen color and depth images, no
+ * surface or swapchain, so it runs on a software implementation (lavapipe)
+ * on machines without a gpu or display.
+ */
+struct HeadlessOptions {
+  bool enabled = false;
+  VkExtent2D extent = {800, 600};
+  // frames rendered before exiting.
+  uint32_t frame_count = 300;
+  // the last frame is written here as a binary ppm, empty for none.
+  std::string output_path;
+};
+
+/**
+ * @brief --headless enables it, --frames=N, --size=WxH and --output=file.ppm
+ * configure it. Unknown arguments are left for the caller.
+ */
+HeadlessOptions ParseHeadlessOptions(int argc, char** argv) {
+  const std::string frames_arg = "--frames=";
+  const std::string size_arg = "--size=";
+  const std::string output_arg = "--output=";
+
+  HeadlessOptions options{};
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--headless") {
+      options.enabled = true;
+    } else if (arg.compare(0, frames_arg.size(), frames_arg) == 0) {
+      options.frame_count = static_cast<uint32_t>(std::strtoul(arg.c_str() + frames_arg.size(), nullptr, 10));
+    } else if (arg.compare(0, size_arg.size(), size_arg) == 0) {
+      std::string value = arg.substr(size_arg.size());
+      size_t x = value.find('x');
+      if (x == std::string::npos) {
+        throw std::runtime_error("--size has to be WIDTHxHEIGHT!");
+      }
+      options.extent.width = static_cast<uint32_t>(std::strtoul(value.substr(0, x).c_str(), nullptr, 10));
+      options.extent.height = static_cast<uint32_t>(std::strtoul(value.substr(x + 1).c_str(), nullptr, 10));
+      if (options.extent.width == 0 || options.extent.height == 0) {
+        throw std::runtime_error("--size has to be WIDTHxHEIGHT!");
+      }
+    } else if (arg.compare(0, output_arg.size(), output_arg) == 0) {
+      options.output_path = arg.substr(output_arg.size());
+    }
+  }
+  return options;
+}
+
+/**
+ * @brief Copies rendered RGBA8 frames into host memory, one buffer per frame
+ * slot.
+ * @details The copy is recorded into the frame's command buffer after the
+ * render pass, which leaves the image in TRANSFER_SRC_OPTIMAL. The buffer of
+ * a slot is valid once the frame scheduler reports the frame that recorded
+ * the copy as completed, and until the slot records its next frame.
+ */
+class FrameReadback {
+  VkDevice _device;
+  VkExtent2D _extent;
+  VkDeviceSize _frame_size;
+  std::vector<VkBuffer> _buffers;
+  std::vector<VT::Allocation> _memory;
+  // frame value whose image each buffer holds, 0 for none.
+  std::vector<uint64_t> _frame_values;
+
+public:
+  FrameReadback(VkDevice device, VkPhysicalDevice physical_device, VkExtent2D extent, uint32_t frames_in_flight):
+    _device(device),
+    _extent(extent),
+    _frame_size(static_cast<VkDeviceSize>(extent.width) * extent.height * 4),
+    _buffers(frames_in_flight),
+    _memory(frames_in_flight),
+    _frame_values(frames_in_flight, 0) {
+    for (uint32_t i = 0; i < frames_in_flight; i++) {
+      VT::CreateBuffer(_frame_size,
+                       VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                       _buffers[i],
+                       _memory[i],
+                       device,
+                       physical_device);
+    }
+  }
+
+  ~FrameReadback() {
+    for (size_t i = 0; i < _buffers.size(); i++) {
+      VT::DestroyBuffer(_device, _buffers[i], _memory[i]);
+    }
+  }
+
+  FrameReadback(const FrameReadback&) = delete;
+  FrameReadback& operator=(const FrameReadback&) = delete;
+
+  /**
+   * @brief Records the copy of image into the slot's buffer, after the render
+   * pass that wrote it.
+   */
+  void RecordCopy(VkCommandBuffer command_buffer, VkImage image, uint32_t slot, uint64_t frame_value) {
+    VkBufferImageCopy region{};
+    region.bufferOffset = 0;
+    // tightly packed.
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = {0, 0, 0};
+    region.imageExtent = {_extent.width, _extent.height, 1};
+    vkCmdCopyImageToBuffer(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, _buffers[slot], 1, &region);
+
+    // waiting on the frame on the host does not make device writes visible
+    // to the host by itself.
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = _buffers[slot];
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(command_buffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+                         0,
+                         0, nullptr,
+                         1, &barrier,
+                         0, nullptr);
+
+    _frame_values[slot] = frame_value;
+  }
+
+  /**
+   * @brief Waits for the frame last copied into slot and returns its RGBA8
+   * pixels, rows top to bottom.
+   */
+  const uint8_t* Read(VT::FrameScheduler& frame_scheduler, uint32_t slot) {
+    if (_frame_values[slot] == 0) {
+      throw std::runtime_error("no frame was read back into this slot!");
+    }
+    frame_scheduler.Wait(_frame_values[slot]);
+    return static_cast<const uint8_t*>(_memory[slot].mapped);
+  }
+
+  /**
+   * @brief FNV-1a of the frame's pixels, for comparing runs.
+   */
+  uint64_t Hash(VT::FrameScheduler& frame_scheduler, uint32_t slot) {
+    const uint8_t* pixels = Read(frame_scheduler, slot);
+    uint64_t hash = 14695981039346656037ull;
+    for (VkDeviceSize i = 0; i < _frame_size; i++) {
+      hash = (hash ^ pixels[i]) * 1099511628211ull;
+    }
+    return hash;
+  }
+
+  /**
+   * @brief Writes the frame as a binary ppm, dropping alpha.
+   */
+  void WritePPM(VT::FrameScheduler& frame_scheduler, uint32_t slot, const std::string& path) {
+    const uint8_t* pixels = Read(frame_scheduler, slot);
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << "P6\n" << _extent.width << " " << _extent.height << "\n255\n";
+    std::vector<char> row(static_cast<size_t>(_extent.width) * 3);
+    for (uint32_t y = 0; y < _extent.height; y++) {
+      const uint8_t* src = pixels + static_cast<size_t>(y) * _extent.width * 4;
+      for (uint32_t x = 0; x < _extent.width; x++) {
+        row[x * 3 + 0] = static_cast<char>(src[x * 4 + 0]);
+        row[x * 3 + 1] = static_cast<char>(src[x * 4 + 1]);
+        row[x * 3 + 2] = static_cast<char>(src[x * 4 + 2]);
+      }
+      file.write(row.data(), static_cast<std::streamsize>(row.size()));
+    }
+    if (!file) {
+      throw std::runtime_error("failed to write " + path + "!");
+    }
+  }
+
+  uint64_t GetFrameValue(uint32_t slot) const {
+    return _frame_values[slot];
+  }
+
+  VkExtent2D GetExtent() const {
+    return _extent;
+  }
+};
+} // VT
@@ -7,6 +7,7 @@
 
 #include "device.h"
 #include "command_buffer.h"
+#include "memory_allocator.h"
 
 namespace VT {
 
@@ -40,7 +41,7 @@ struct CreateImageOptions {
 };
 
 // TODO: pass by reference works but not having them doesn't look into it.
-void CreateImage(const CreateImageOptions& options, VkImage& image, VkDeviceMemory& imageMemory) {
+void CreateImage(const CreateImageOptions& options, VkImage& image, VT::Allocation& imageMemory) {
   VkImageCreateInfo imageInfo{};
   imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
   imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -63,15 +64,17 @@ void CreateImage(const CreateImageOptions& options, VkImage& image, VkDeviceMemo
   VkMemoryRequirements memRequirements;
   vkGetImageMemoryRequirements(options.device, image, &memRequirements);
 
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex = VT::FindMemoryType(memRequirements.memoryTypeBits, options.properties, options.physical_device);
+  // optimally tiled images get blocks of their own so they never share a
+  // page with buffers (bufferImageGranularity). Large images get a dedicated
+  // allocation.
+  auto kind = options.tiling == VK_IMAGE_TILING_OPTIMAL ? VT::MemoryResourceKind::OPTIMAL : VT::MemoryResourceKind::LINEAR;
+  imageMemory = VT::GetMemoryAllocator(options.device, options.physical_device).Allocate(memRequirements, options.properties, kind);
+  vkBindImageMemory(options.device, image, imageMemory.memory, imageMemory.offset);
+}
 
-  if (vkAllocateMemory(options.device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate image memory!");
-  }
-  vkBindImageMemory(options.device, image, imageMemory, 0);
+void DestroyImage(VkDevice device, VkImage image, VT::Allocation& imageMemory) {
+  vkDestroyImage(device, image, nullptr);
+  VT::FreeMemory(device, imageMemory);
 }
 
 struct ImageViewOptions {
@@ -113,9 +116,22 @@ VkImageView CreateImageView(ImageViewOptions& options) {
   return imageView;
 }
 
-void TransitionImageLayout(VkDevice device, VkCommandPool commandPool, VkQueue graphicsQueue, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
-  VkCommandBuffer commandBuffer = VT::BeginSingleTimeCommands(device, commandPool);
+VkImageAspectFlags GetImageAspectFlags(VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_D32_SFLOAT:
+      return VK_IMAGE_ASPECT_DEPTH_BIT;
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+      return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+    default:
+      return VK_IMAGE_ASPECT_COLOR_BIT;
+  }
+}
 
+/**
+ * @brief Records the barrier for a layout transition into commandBuffer.
+ */
+void RecordImageLayoutTransition(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
   // Use a barrier to make sure transition completes
   VkImageMemoryBarrier barrier{};
   barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -130,7 +146,7 @@ void TransitionImageLayout(VkDevice device, VkCommandPool commandPool, VkQueue g
   barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 
   barrier.image = image;
-  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.aspectMask = GetImageAspectFlags(format);
   barrier.subresourceRange.baseMipLevel = 0;
   barrier.subresourceRange.levelCount = 1;
   barrier.subresourceRange.baseArrayLayer = 0;
@@ -179,16 +195,21 @@ void TransitionImageLayout(VkDevice device, VkCommandPool commandPool, VkQueue g
       0, nullptr,
       1, &barrier
   );
-
-
-  VT::EndSingleTimeCommands(commandBuffer, device, commandPool, graphicsQueue);
 }
 
-void CopyBufferToImage(VkDevice device, VkCommandPool commandPool, VkQueue graphicsQueue, VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
+void TransitionImageLayout(VkDevice device, VkCommandPool commandPool, VkQueue graphicsQueue, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
   VkCommandBuffer commandBuffer = VT::BeginSingleTimeCommands(device, commandPool);
+  RecordImageLayoutTransition(commandBuffer, image, format, oldLayout, newLayout);
+  VT::EndSingleTimeCommands(commandBuffer, device, commandPool, graphicsQueue);
+}
 
+/**
+ * @brief Records a copy of tightly packed pixels at bufferOffset into the
+ * first mip level of image, which has to be in TRANSFER_DST_OPTIMAL.
+ */
+void RecordCopyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height) {
   VkBufferImageCopy region{};
-  region.bufferOffset = 0;
+  region.bufferOffset = bufferOffset;
   // Specifying 0 for both indicates that the pixels are simply
   // tightly packed like they are in our case
   region.bufferRowLength = 0;
@@ -208,8 +229,11 @@ void CopyBufferToImage(VkDevice device, VkCommandPool commandPool, VkQueue graph
   };
 
   vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+}
 
-
+void CopyBufferToImage(VkDevice device, VkCommandPool commandPool, VkQueue graphicsQueue, VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
+  VkCommandBuffer commandBuffer = VT::BeginSingleTimeCommands(device, commandPool);
+  RecordCopyBufferToImage(commandBuffer, buffer, 0, image, width, height);
   VT::EndSingleTimeCommands(commandBuffer, device, commandPool, graphicsQueue);
 }
 } // VT
\ No newline at end of file
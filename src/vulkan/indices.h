@@ -7,41 +7,75 @@
 
 #include "buffer.h"
 #include "command_buffer.h"
+#include "upload_queue.h"
 
 namespace VT {
 struct CreateIndexBufferOptions {
   VkDevice device;
   VkPhysicalDevice physical_device;
-  VkCommandPool command_pool;
-  VkQueue graphics_queue;
+  VT::UploadQueue* upload_queue;
 };
 
-void CreateIndexBuffer(CreateIndexBufferOptions& options, std::vector<uint32_t>& indices, VkBuffer& indexBuffer, VkDeviceMemory& indexBufferMemory) {
-  VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+/**
+ * @brief An index buffer together with how to bind and draw it.
+ */
+struct IndexBuffer {
+  VkBuffer buffer;
+  VT::Allocation memory;
+  VkIndexType index_type;
+  uint32_t index_count;
+};
 
-  VkBuffer stagingBuffer;
-  VkDeviceMemory stagingBufferMemory;
-  VT::CreateBuffer(bufferSize,
-                  VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                  stagingBuffer,
-                  stagingBufferMemory, options.device, options.physical_device);
+/**
+ * @brief Picks the smallest index type able to address every vertex.
+ * @details 16 bit indices go up to 65535, so meshes with at most 65536
+ * vertices fit. This halves index memory and bandwidth for most meshes.
+ */
+VkIndexType ChooseIndexType(size_t vertex_count) {
+  return vertex_count <= 65536 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+}
+
+VkDeviceSize GetIndexSize(VkIndexType index_type) {
+  return index_type == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+/**
+ * @brief Writes indices to dst narrowed to index_type.
+ */
+void WriteIndices(const uint32_t* indices, size_t index_count, VkIndexType index_type, void* dst) {
+  if (index_type == VK_INDEX_TYPE_UINT16) {
+    uint16_t* narrow = static_cast<uint16_t*>(dst);
+    for (size_t i = 0; i < index_count; i++) {
+      narrow[i] = static_cast<uint16_t>(indices[i]);
+    }
+  } else {
+    memcpy(dst, indices, sizeof(uint32_t) * index_count);
+  }
+}
 
-  void* data;
-  vkMapMemory(options.device, stagingBufferMemory, 0, bufferSize, 0, &data);
-  memcpy(data, indices.data(), (size_t) bufferSize);
-  vkUnmapMemory(options.device, stagingBufferMemory);
+/**
+ * @brief Creates the device local index buffer and records its upload.
+ * @return The upload queue ticket after which the buffer holds the indices.
+ */
+uint64_t CreateIndexBuffer(
+    CreateIndexBufferOptions& options,
+    const uint32_t* indices,
+    size_t index_count,
+    size_t vertex_count,
+    IndexBuffer& index_buffer) {
+  index_buffer.index_type = ChooseIndexType(vertex_count);
+  index_buffer.index_count = static_cast<uint32_t>(index_count);
+  VkDeviceSize bufferSize = GetIndexSize(index_buffer.index_type) * index_count;
 
   VT::CreateBuffer(bufferSize,
                       // use index bit instead of vertex bit
                       VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                      indexBuffer,
-                      indexBufferMemory, options.device, options.physical_device);
-  VT::CopyBufferOptions copy_buffer_options {options.device, options.command_pool, options.graphics_queue};
-  VT::CopyBuffer(copy_buffer_options, stagingBuffer, indexBuffer, bufferSize);
+                      index_buffer.buffer,
+                      index_buffer.memory, options.device, options.physical_device);
 
-  vkDestroyBuffer(options.device, stagingBuffer, nullptr);
-  vkFreeMemory(options.device, stagingBufferMemory, nullptr);
+  VT::StagingRegion staging = options.upload_queue->Stage(bufferSize);
+  WriteIndices(indices, index_count, index_buffer.index_type, staging.mapped);
+  return options.upload_queue->CopyBuffer(staging, index_buffer.buffer, bufferSize);
 }
 } // VT
\ No newline at end of file
@@ -0,0 +1,95 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "buffer.h"
+#include "memory_allocator.h"
+#include "vertex.h"
+
+namespace VT {
+
+// instances each frame slot has room for before its buffer first grows.
+const size_t INSTANCE_BUFFER_INITIAL_CAPACITY = 1024;
+
+/**
+ * @brief Persistently mapped per instance vertex buffers, one per frame in
+ * flight, bound at binding 1.
+ * @details The instance data is rewritten every frame, so it stays in host
+ * visible memory and is read by the gpu from there, like the uniform ring.
+ * A slot's buffer is only written once the frame that last used it has
+ * completed, which also makes it safe to replace it when it is too small.
+ */
+class InstanceBuffer {
+  VkDevice _device;
+  VkPhysicalDevice _physical_device;
+  std::vector<VkBuffer> _buffers;
+  std::vector<VT::Allocation> _memory;
+  std::vector<size_t> _capacity;
+
+public:
+  InstanceBuffer(VkDevice device, VkPhysicalDevice physical_device, uint32_t frame_count):
+    _device(device),
+    _physical_device(physical_device),
+    _buffers(frame_count, VK_NULL_HANDLE),
+    _memory(frame_count),
+    _capacity(frame_count, 0) {
+    for (uint32_t slot = 0; slot < frame_count; slot++) {
+      reserve(slot, INSTANCE_BUFFER_INITIAL_CAPACITY);
+    }
+  }
+
+  ~InstanceBuffer() {
+    for (size_t slot = 0; slot < _buffers.size(); slot++) {
+      VT::DestroyBuffer(_device, _buffers[slot], _memory[slot]);
+    }
+  }
+
+  InstanceBuffer(const InstanceBuffer&) = delete;
+  InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+  /**
+   * @brief Replaces the instances of slot, growing its buffer if needed.
+   * The frame that last used slot has to be complete.
+   */
+  void Write(uint32_t slot, const InstanceData* instances, size_t count) {
+    reserve(slot, count);
+    memcpy(_memory[slot].mapped, instances, sizeof(InstanceData) * count);
+  }
+
+  /**
+   * @brief Room for count instances in slot without copying anything, for
+   * callers that build the instances in place. Invalidated by Write.
+   */
+  InstanceData* Map(uint32_t slot, size_t count) {
+    reserve(slot, count);
+    return static_cast<InstanceData*>(_memory[slot].mapped);
+  }
+
+  VkBuffer GetBuffer(uint32_t slot) const {
+    return _buffers[slot];
+  }
+
+private:
+  void reserve(uint32_t slot, size_t count) {
+    if (count <= _capacity[slot]) {
+      return;
+    }
+    size_t capacity = std::max(_capacity[slot] * 2, std::max(count, INSTANCE_BUFFER_INITIAL_CAPACITY));
+    if (_buffers[slot] != VK_NULL_HANDLE) {
+      VT::DestroyBuffer(_device, _buffers[slot], _memory[slot]);
+    }
+    VT::CreateBuffer(sizeof(InstanceData) * capacity,
+                     VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                     _buffers[slot],
+                     _memory[slot],
+                     _device,
+                     _physical_device);
+    _capacity[slot] = capacity;
+  }
+};
+} // VT
@@ -12,16 +12,31 @@
 
 namespace VT {
 
+  // optional features, each only enabled when the device supports it.
+  struct LogicalDeviceFeatures {
+    bool sampler_anisotropy;
+    bool timeline_semaphores;
+    bool multi_draw_indirect;
+    bool draw_indirect_count;
+    bool conditional_rendering;
+  };
+
   VkDevice* CreateLogicalDevice(
       const VT::QueueFamilyIndices& indices,
       const VkPhysicalDevice& physical_device,
       const std::vector<const char*>& validation_layers,
       bool enable_validation_layers,
       const std::vector<const char*>& device_extensions,
+      const LogicalDeviceFeatures& features,
       VkDevice* device) {
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+    std::set<uint32_t> uniqueQueueFamilies = {
+      indices.graphicsFamily.value(),
+      indices.presentFamily.value(),
+      indices.GetTransferFamily(),
+      indices.GetComputeFamily()
+    };
 
     float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -34,7 +49,9 @@ namespace VT {
     }
 
     VkPhysicalDeviceFeatures deviceFeatures{};
-    deviceFeatures.samplerAnisotropy = VK_TRUE;
+    deviceFeatures.samplerAnisotropy = features.sampler_anisotropy ? VK_TRUE : VK_FALSE;
+    deviceFeatures.multiDrawIndirect = features.multi_draw_indirect ? VK_TRUE : VK_FALSE;
+    deviceFeatures.drawIndirectFirstInstance = features.multi_draw_indirect ? VK_TRUE : VK_FALSE;
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -44,8 +61,30 @@ namespace VT {
 
     createInfo.pEnabledFeatures = &deviceFeatures;
 
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(device_extensions.size());
-    createInfo.ppEnabledExtensionNames = device_extensions.data();
+    // frame completion is tracked on a timeline semaphore when available.
+    // Both 1.2 features go in one VkPhysicalDeviceVulkan12Features, it may
+    // not be chained together with the per feature structs.
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12Features.timelineSemaphore = features.timeline_semaphores ? VK_TRUE : VK_FALSE;
+    vulkan12Features.drawIndirectCount = features.draw_indirect_count ? VK_TRUE : VK_FALSE;
+    if (features.timeline_semaphores || features.draw_indirect_count) {
+      createInfo.pNext = &vulkan12Features;
+    }
+
+    // conditional rendering is an extension, enabled on top of the required ones.
+    std::vector<const char*> extensions = device_extensions;
+    VkPhysicalDeviceConditionalRenderingFeaturesEXT conditionalRenderingFeatures{};
+    conditionalRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_CONDITIONAL_RENDERING_FEATURES_EXT;
+    if (features.conditional_rendering) {
+      extensions.push_back(VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME);
+      conditionalRenderingFeatures.conditionalRendering = VK_TRUE;
+      conditionalRenderingFeatures.pNext = const_cast<void*>(createInfo.pNext);
+      createInfo.pNext = &conditionalRenderingFeatures;
+    }
+
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    createInfo.ppEnabledExtensionNames = extensions.data();
 
     if (enable_validation_layers) {
       createInfo.enabledLayerCount = static_cast<uint32_t>(validation_layers.size());
@@ -44,16 +44,29 @@
 #include "synchronization.h"
 #include "indices.h"
 #include "command_pool.h"
+#include "deletion_queue.h"
 #include "depth_resources.h"
+#include "frame_pacing.h"
+#include "frame_scheduler.h"
+#include "gpu_profiler.h"
+#include "frustum_culling.h"
+#include "headless.h"
+#include "scene.h"
+#include "engine/private/profiler.h"
 #include "swapchain_manager.h"
 
-// number of frames to be processed concurrently.
-const int MAX_FRAMES_IN_FLIGHT = 2;
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
 class HelloTriangleApplication {
 public:
+  HelloTriangleApplication(const VT::FramePacingPolicy& pacing,
+                           const VT::HeadlessOptions& headless,
+                           const std::string& gpu_profile_path): _pacing(pacing),
+                                                                 _headless(headless),
+                                                                 _gpu_profile_path(gpu_profile_path),
+                                                                 _latency(pacing.frames_in_flight) {}
+
   void Run() {
     init_window();
     init_vulkan();
@@ -62,41 +75,84 @@ public:
   }
 
 private:
+  // frames processed concurrently, swapchain image count and present mode.
+  const VT::FramePacingPolicy _pacing;
+  // render offscreen without a window, see VT::HeadlessOptions.
+  const VT::HeadlessOptions _headless;
+  // gpu scope statistics are written here at exit, empty for none.
+  const std::string _gpu_profile_path;
+  VT::FrameLatencyTracker _latency;
+
   std::unique_ptr<phx::Window> _window;
   std::shared_ptr<VT::Vulkan> _instance;
+  // frame completion as one increasing value, see VT::FrameScheduler.
+  std::unique_ptr<VT::FrameScheduler> _frame_scheduler;
+  // destroys resources replaced at runtime (e.g. on swapchain recreation)
+  // once the frames using them have retired.
+  std::unique_ptr<VT::DeletionQueue> _deletion_queue;
+  // gpu time of the frame's passes, read back frames_in_flight frames late.
+  std::unique_ptr<VT::GpuProfiler> _gpu_profiler;
 
   std::unique_ptr<VT::CommandPool> _command_pool;
   std::unique_ptr<VT::TextureView> _texture_image;
 
   std::unique_ptr<VT::SwapchainManager> _swapchain_manager;
+  // headless only, rendered frames copied to host memory.
+  std::unique_ptr<VT::FrameReadback> _readback;
 
-  std::vector<VT::Vertex> vertices;
-  std::vector<uint32_t> indices;
+  std::unique_ptr<VT::Model> _model;
+  // maps vertex buffer positions to model space when they are quantized.
+  glm::mat4 _mesh_transform;
   VkBuffer vertexBuffer;
-  VkDeviceMemory vertexBufferMemory;
-  VkBuffer indexBuffer;
-  VkDeviceMemory indexBufferMemory;
-
+  VT::Allocation vertexBufferMemory;
+  VT::IndexBuffer _index_buffer;
+  // the model as a single instance at the origin.
+  std::unique_ptr<VT::Scene> _scene;
+  // only the instances in view are drawn.
+  VT::FrustumCuller _frustum_culler;
 
   std::vector<VkSemaphore> imageAvailableSemaphores;
   std::vector<VkSemaphore> renderFinishedSemaphores;
-  std::vector<VkFence> inFlightFences;
 
+  // frame slot being recorded, from _frame_scheduler.
   uint32_t currentFrame = 0;
 
   void init_vulkan() {
     create_instance();
+    VT::FrameSchedulerOptions scheduler_options{_instance->GetVkDevice(), _pacing.frames_in_flight, _instance->SupportsTimelineSemaphores()};
+    _frame_scheduler = std::make_unique<VT::FrameScheduler>(scheduler_options);
+    _deletion_queue = std::make_unique<VT::DeletionQueue>(*_frame_scheduler);
+    VT::GpuProfilerOptions profiler_options{_instance->GetVkDevice(), _instance->GetVkPhysicalDevice(), _instance->GetQueueFamilyIndices().graphicsFamily.value(), _pacing.frames_in_flight};
+    _gpu_profiler = std::make_unique<VT::GpuProfiler>(profiler_options);
     create_command_pool();
     create_texture_image();
     create_swapchain_manager();
+    std::cout << "frame pacing: " << VT::GetFramePacingModeName(_pacing.mode) << ", "
+              << _pacing.frames_in_flight << " frames in flight";
+    if (!_headless.enabled) {
+      std::cout << ", " << _swapchain_manager->GetImageCount() << " swapchain images, "
+                << VT::GetPresentModeName(_swapchain_manager->GetPresentMode()) << " present mode";
+    }
+    std::cout << std::endl;
+    if (_headless.enabled) {
+      _readback = std::make_unique<VT::FrameReadback>(_instance->GetVkDevice(), _instance->GetVkPhysicalDevice(), _headless.extent, _pacing.frames_in_flight);
+    }
     load_model();
     create_vertex_buffer();
     create_index_buffer();
+    create_scene();
+    // everything above only recorded its uploads, submit them as one batch
+    // without waiting for it. The first frame is submitted after it on the
+    // same queue.
+    _command_pool->GetUploadQueue().Flush();
 
     create_sync_objects();
   }
 
   void init_window() {
+    if (_headless.enabled) {
+      return;
+    }
     WindowOptions window_options{};
     window_options.height = 600;
     window_options.width = 800;
@@ -105,48 +161,88 @@ private:
   }
 
   void main_loop() {
+    if (_headless.enabled) {
+      headless_loop();
+      return;
+    }
     while (!_window->WindowShouldClose()) {
       glfwPollEvents();
+      _latency.MarkInput();
       draw_frame();
     }
     this->_instance.get()->DeviceWaitIdle();
+    _latency.Report();
+    report_gpu_profile();
+  }
+
+  void headless_loop() {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < _headless.frame_count; i++) {
+      _latency.MarkInput();
+      draw_headless_frame();
+    }
+    _frame_scheduler->WaitIdle();
+    double total = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout << "headless: " << _headless.frame_count << " frames in " << total << " ms, "
+              << (_headless.frame_count > 0 ? total / _headless.frame_count : 0.0) << " ms/frame" << std::endl;
+
+    if (_headless.frame_count > 0) {
+      // slot of the last submitted frame.
+      uint32_t slot = static_cast<uint32_t>((_frame_scheduler->GetSubmittedValue() - 1) % _pacing.frames_in_flight);
+      std::cout << "headless: last frame hash " << std::hex << _readback->Hash(*_frame_scheduler, slot) << std::dec << std::endl;
+      if (!_headless.output_path.empty()) {
+        _readback->WritePPM(*_frame_scheduler, slot, _headless.output_path);
+        std::cout << "headless: wrote " << _headless.output_path << std::endl;
+      }
+    }
+    this->_instance.get()->DeviceWaitIdle();
+    _latency.Report();
+    report_gpu_profile();
+  }
+
+  void report_gpu_profile() {
+    _gpu_profiler->Report();
+    if (!_gpu_profile_path.empty()) {
+      _gpu_profiler->Write(_gpu_profile_path);
+      std::cout << "gpu profile: wrote " << _gpu_profile_path << std::endl;
+    }
   }
 
   void cleanup() {
     auto instance = this->_instance->GetVkInstance();
     auto device = this->_instance->GetVkDevice();
 
+    // the device is idle, see main_loop.
+    _deletion_queue->Flush();
+
     // check to see if unique_ptr_handles this
     // otherwise
     // delete swapchain_manager.release();
     // this->cleanup_swap_chain();
 
     // desstroy descriptor set layout
-    vkDestroyBuffer(device, indexBuffer, nullptr);
-    vkFreeMemory(device, indexBufferMemory, nullptr);
+    VT::DestroyBuffer(device, _index_buffer.buffer, _index_buffer.memory);
 
     // should be available for use in rednering commands until the end
     // of the program.
-    vkDestroyBuffer(device, vertexBuffer, nullptr);
-    vkFreeMemory(device, vertexBufferMemory, nullptr);
+    VT::DestroyBuffer(device, vertexBuffer, vertexBufferMemory);
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    for (size_t i = 0; i < _pacing.frames_in_flight; i++) {
       vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
       vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-      vkDestroyFence(device, inFlightFences[i], nullptr);
     }
   }
 
   void create_instance() {
     const char* application_name = "vulkan_demo";
     const char* engine_name= "townsend engine";
-    auto window = this->_window->GetGLFWwindow();
-    VT::VulkanOptions options(window, application_name, engine_name);
+    auto window = _headless.enabled ? nullptr : this->_window->GetGLFWwindow();
+    VT::VulkanOptions options(window, application_name, engine_name, _headless.enabled);
     _instance = VT::CreateInstance(options);
   }
 
   void create_command_pool() {
-    _command_pool = std::make_unique<VT::CommandPool>(_instance, MAX_FRAMES_IN_FLIGHT);
+    _command_pool = std::make_unique<VT::CommandPool>(_instance, _pacing.frames_in_flight);
   }
 
   void create_texture_image() {
@@ -154,38 +250,62 @@ private:
   }
 
   void create_swapchain_manager() {
-    _swapchain_manager = std::make_unique<VT::SwapchainManager>(_instance, _command_pool, _texture_image, _window, MAX_FRAMES_IN_FLIGHT);
+    _swapchain_manager = std::make_unique<VT::SwapchainManager>(_instance, _texture_image, _window, _pacing, _headless.extent);
   }
 
   void load_model() {
-    VT::LoadModel(vertices, indices, VT::MODEL_PATH.c_str());
+    VT::LoadModelOptions options{VT::MODEL_PATH, VT::MODEL_CACHE_PATH};
+    _model = VT::LoadModel(options);
   }
 
   void create_vertex_buffer() {
-    VT::CreateVertexBufferOptions options{this->_instance.get()->GetVkDevice(), this->_instance.get()->GetVkPhysicalDevice(), _command_pool->GetCommandPool(), this->_instance->GetGraphicsQueue(), vertices};
+    auto quantization = VT::ComputeMeshQuantization(_model->GetVertices(), _model->GetVertexCount());
+    _mesh_transform = VT::GetMeshVertexTransform(quantization);
+    VT::CreateVertexBufferOptions options{this->_instance.get()->GetVkDevice(), this->_instance.get()->GetVkPhysicalDevice(), &_command_pool->GetUploadQueue(), _model->GetVertices(), _model->GetVertexCount(), quantization};
     VT::CreateVertexBuffer(options, vertexBuffer, vertexBufferMemory);
   }
 
   void create_index_buffer() {
-    VT::CreateIndexBufferOptions options{this->_instance.get()->GetVkDevice(), this->_instance.get()->GetVkPhysicalDevice(),  _command_pool->GetCommandPool(), this->_instance->GetGraphicsQueue() };
-    VT::CreateIndexBuffer(options, indices, indexBuffer, indexBufferMemory);
+    VT::CreateIndexBufferOptions options{this->_instance.get()->GetVkDevice(), this->_instance.get()->GetVkPhysicalDevice(), &_command_pool->GetUploadQueue() };
+    VT::CreateIndexBuffer(options, _model->GetIndices(), _model->GetIndexCount(), _model->GetVertexCount(), _index_buffer);
+  }
+
+  void create_scene() {
+    _scene = std::make_unique<VT::Scene>();
+    VT::MeshHandle mesh = _scene->AddMesh(VT::SceneMesh{0, _index_buffer.index_count, 0, _mesh_transform, _model->GetBounds()});
+    _scene->AddInstance(mesh, glm::vec3(0.0f));
+  }
+
+  // culls the scene against this frame's camera and uploads what is left.
+  void update_scene() {
+    VT::UniformBufferObject ubo = VT::ComputeUniformBufferObject(_swapchain_manager->GetExtent());
+    const auto& visible = _frustum_culler.Cull(_scene->GetBounds(), ubo.proj * ubo.view * ubo.model);
+    _swapchain_manager->UpdateScene(currentFrame, ubo, *_scene, &visible);
   }
 
   void create_sync_objects() {
-    VT::CreateSyncObjectsOptions options { this->_instance.get()->GetVkDevice(), MAX_FRAMES_IN_FLIGHT };
-    VT::CreateSyncObjects(options, imageAvailableSemaphores, renderFinishedSemaphores, inFlightFences);
+    VT::CreateSyncObjectsOptions options { this->_instance.get()->GetVkDevice(), static_cast<int>(_pacing.frames_in_flight) };
+    VT::CreateSyncObjects(options, imageAvailableSemaphores, renderFinishedSemaphores);
   }
 
   void draw_frame() {
+    ENGINE_PROFILE_SCOPE("HelloTriangleApplication::draw_frame");
     uint32_t imageIndex;
 
-    vkWaitForFences(_instance->GetVkDevice(), 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    // waits for the frame that last used this slot, timed, this is where the
+    // cpu blocks when it runs too far ahead of the gpu.
+    currentFrame = _frame_scheduler->GetFrameIndex();
+    _latency.BeginFrame(*_frame_scheduler);
+    // reclaim staging memory of uploads that have finished and destroy
+    // resources no frame in flight uses anymore.
+    _command_pool->GetUploadQueue().Collect();
+    _deletion_queue->Collect();
     VkResult result = _swapchain_manager->AcquireNextImage(imageAvailableSemaphores, currentFrame, imageIndex);
 
     if (result == VK_ERROR_OUT_OF_DATE_KHR) {
       // swap chain has become incompatiable with surface and can no longer be used for rendering
       // (e.g window resize)
-      _swapchain_manager->RecreateSwapchain(_window, _command_pool, _texture_image);
+      _swapchain_manager->RecreateSwapchain(_window, *_deletion_queue);
       return;
     } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
       // swap chain can be used to successufly present to surface but surface properties no
@@ -193,14 +313,7 @@ private:
       throw std::runtime_error("failed to acquire swap chain image");
     }
 
-    _swapchain_manager->UpdateUnfiformBuffer(currentFrame);
-
-    // delay resetting fence until after we know for sure we will be submitting work with it.
-    // in the case of recreating swap chain:
-    //   the current frame's fence was waited upon and reset. Since we returned immediately,
-    //   no work is submitted for execution and the fence will never be signalled causing to 
-    //   wait forever.
-    vkResetFences(_instance->GetVkDevice(), 1, &inFlightFences[currentFrame]);
+    update_scene();
 
     // call on command buffer to make sure it is able to be recorded.
     auto command_buffer = _command_pool->GetCommandBuffer(currentFrame);
@@ -226,11 +339,16 @@ private:
     submitInfo.signalSemaphoreCount = 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
-    if (vkQueueSubmit(_instance->GetGraphicsQueue(), 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+    // uploads recorded since the last frame (e.g. the depth image of a
+    // recreated swapchain) have to be submitted before the frame using them.
+    _command_pool->GetUploadQueue().Flush();
+    // also signals the frame value, which moves the scheduler to the next frame.
+    if (_frame_scheduler->Submit(_instance->GetGraphicsQueue(), submitInfo) != VK_SUCCESS) {
       throw std::runtime_error("failed to submit draw command buffer!");
     }
     // submitting the result back to the swap chain to have it eventually show up on the screen
     VkResult queueResult = _swapchain_manager->QueuePresentKHR(signalSemaphores, imageIndex);
+    _latency.MarkPresent(currentFrame);
 
     if (queueResult == VK_ERROR_OUT_OF_DATE_KHR ||
         queueResult == VK_SUBOPTIMAL_KHR ||
@@ -238,15 +356,42 @@ private:
       // make sure to do this after queuepresentKHR to make sure semaphores are in consistent
       // state, otherwise a signalled semaphore may never be properly waited upon.
       _window->ResetFrameBuffer();
-      _swapchain_manager->RecreateSwapchain(_window, _command_pool, _texture_image);
+      _swapchain_manager->RecreateSwapchain(_window, *_deletion_queue);
     } else if (queueResult != VK_SUCCESS) {
       throw std::runtime_error("failed to present swap chain image!");
     }
+  }
+
+  // Same as draw_frame without a swapchain: frame slot i renders into offscreen
+  // image i, so there is nothing to acquire, no semaphores and no present.
+  void draw_headless_frame() {
+    ENGINE_PROFILE_SCOPE("HelloTriangleApplication::draw_headless_frame");
+    currentFrame = _frame_scheduler->GetFrameIndex();
+    _latency.BeginFrame(*_frame_scheduler);
+    _command_pool->GetUploadQueue().Collect();
+    _deletion_queue->Collect();
+
+    uint32_t imageIndex = currentFrame;
+    update_scene();
+
+    auto command_buffer = _command_pool->GetCommandBuffer(currentFrame);
+    vkResetCommandBuffer(command_buffer, 0);
+    record_command_buffer(command_buffer, imageIndex);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &command_buffer;
 
-    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    _command_pool->GetUploadQueue().Flush();
+    if (_frame_scheduler->Submit(_instance->GetGraphicsQueue(), submitInfo) != VK_SUCCESS) {
+      throw std::runtime_error("failed to submit draw command buffer!");
+    }
+    _latency.MarkPresent(currentFrame);
   }
 
   void record_command_buffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    ENGINE_PROFILE_SCOPE("HelloTriangleApplication::record_command_buffer");
     VkCommandBufferBeginInfo beginInfo{};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     // The flags parameter specifies how we're going to use the command buffer. The following values are available:
@@ -259,12 +404,22 @@ private:
     if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
         throw std::runtime_error("failed to begin recording command buffer!");
     }
+    // the slot's previous frame has completed, its timestamps are collected
+    // before the queries are reset.
+    _gpu_profiler->BeginFrame(commandBuffer, currentFrame);
+    int frameScope = _gpu_profiler->BeginScope(commandBuffer, "frame");
 
     // TODO Consider Render Pass to be a part of the swapchain manager
     // The first parameters are the render pass itself and the attachments to bind. We created a framebuffer for
     // each swap chain image where it is specified as a color attachment.
     // Thus we need to bind the framebuffer for the swapchain image we want to draw to. 
-    _swapchain_manager->CompleteRenderPass(commandBuffer, imageIndex, currentFrame, vertexBuffer, indexBuffer, indices);
+    _swapchain_manager->CompleteRenderPass(commandBuffer, imageIndex, currentFrame, vertexBuffer, _index_buffer, _gpu_profiler.get());
+    if (_readback) {
+      VT::GpuScope readbackScope(_gpu_profiler.get(), commandBuffer, "readback");
+      // the render pass left the image in TRANSFER_SRC_OPTIMAL.
+      _readback->RecordCopy(commandBuffer, _swapchain_manager->GetImage(imageIndex), currentFrame, _frame_scheduler->GetFrameValue());
+    }
+    _gpu_profiler->EndScope(commandBuffer, frameScope);
 
     if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
       throw std::runtime_error("failed to record command buffer!");
@@ -277,11 +432,35 @@ private:
   }
 };
 
-int main() {
-  HelloTriangleApplication app;
+/**
+ * @brief --cpu-trace=trace.json writes the cpu zones as a Chrome trace at
+ * exit. Zones are compiled out of release builds, see ENGINE_PROFILE.
+ */
+std::string parse_cpu_trace_path(int argc, char** argv) {
+  const std::string trace_arg = "--cpu-trace=";
+  std::string path;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg.compare(0, trace_arg.size(), trace_arg) == 0) {
+      path = arg.substr(trace_arg.size());
+    }
+  }
+  return path;
+}
 
+int main(int argc, char** argv) {
   try {
+    std::string cpu_trace_path = parse_cpu_trace_path(argc, argv);
+    ENGINE_PROFILE_THREAD("main");
+    HelloTriangleApplication app(VT::ParseFramePacingPolicy(argc, argv), VT::ParseHeadlessOptions(argc, argv), VT::ParseGpuProfilePath(argc, argv));
     app.Run();
+    if (!cpu_trace_path.empty()) {
+      if (ENGINE_PROFILE_WRITE(cpu_trace_path)) {
+        std::cout << "cpu trace: wrote " << cpu_trace_path << std::endl;
+      } else {
+        std::cout << "cpu trace: not written, profiling is compiled out or the file failed" << std::endl;
+      }
+    }
   } catch (const std::exception& e) {
     std::cerr << e.what() << std::endl;
     return EXIT_FAILURE;
@@ -0,0 +1,486 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+namespace VT {
+
+const VkDeviceSize DEFAULT_MEMORY_BLOCK_SIZE = 64ull * 1024 * 1024;
+// smallest piece a block is split into, smaller requests are rounded up.
+const VkDeviceSize MIN_MEMORY_ALLOCATION_SIZE = 256;
+
+/**
+ * @brief What the allocator needs from a device.
+ * @details Kept behind an interface so the allocator can run against a fake
+ * device without a gpu.
+ */
+class DeviceMemoryBackend {
+public:
+  virtual ~DeviceMemoryBackend() = default;
+  virtual VkResult Allocate(uint32_t memory_type_index, VkDeviceSize size, VkDeviceMemory& memory) = 0;
+  virtual void Free(VkDeviceMemory memory) = 0;
+  // maps the whole memory object.
+  virtual VkResult Map(VkDeviceMemory memory, void** data) = 0;
+  virtual void Unmap(VkDeviceMemory memory) = 0;
+};
+
+class VulkanMemoryBackend : public DeviceMemoryBackend {
+  VkDevice _device;
+
+public:
+  VulkanMemoryBackend(VkDevice device): _device(device) {}
+
+  VkResult Allocate(uint32_t memory_type_index, VkDeviceSize size, VkDeviceMemory& memory) override {
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memory_type_index;
+    return vkAllocateMemory(_device, &allocInfo, nullptr, &memory);
+  }
+
+  void Free(VkDeviceMemory memory) override {
+    vkFreeMemory(_device, memory, nullptr);
+  }
+
+  VkResult Map(VkDeviceMemory memory, void** data) override {
+    return vkMapMemory(_device, memory, 0, VK_WHOLE_SIZE, 0, data);
+  }
+
+  void Unmap(VkDeviceMemory memory) override {
+    vkUnmapMemory(_device, memory);
+  }
+};
+
+/**
+ * @brief Buffers and linear images vs optimally tiled images.
+ * @details Vulkan requires linear and non-linear resources sharing a memory
+ * object to be bufferImageGranularity apart. Giving each kind its own blocks
+ * sidesteps that requirement entirely.
+ */
+enum class MemoryResourceKind {
+  LINEAR = 0,
+  OPTIMAL = 1,
+};
+
+class MemoryBlock;
+
+/**
+ * @brief A piece of device memory handed out by the MemoryAllocator.
+ * @details Resources have to be bound at offset, not at 0, since the memory
+ * object is usually shared with other resources.
+ */
+struct Allocation {
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0;
+  // host pointer to offset when the memory is host visible, nullptr otherwise.
+  // Blocks stay mapped for their whole lifetime so callers must not call
+  // vkMapMemory on memory themselves.
+  void* mapped = nullptr;
+
+  // bookkeeping for MemoryAllocator::Free. block is nullptr for dedicated
+  // allocations.
+  MemoryBlock* block = nullptr;
+  uint32_t order = 0;
+};
+
+uint32_t ceil_log2(VkDeviceSize value) {
+  uint32_t order = 0;
+  while ((VkDeviceSize(1) << order) < value) {
+    order++;
+  }
+  return order;
+}
+
+/**
+ * @brief One vkAllocateMemory sub-allocated with a buddy allocator.
+ * @details The block size is a power of two and every allocation is rounded
+ * up to a power of two (of at least its alignment), which makes every
+ * allocation naturally aligned to its own size. Freed buddies are merged
+ * back together.
+ */
+class MemoryBlock {
+  VkDeviceMemory _memory;
+  void* _mapped;
+  uint32_t _min_order;
+  uint32_t _max_order;
+  // free offsets per order, starting at _min_order.
+  std::vector<std::set<VkDeviceSize>> _free;
+  VkDeviceSize _used = 0;
+
+public:
+  MemoryBlock(VkDeviceMemory memory, void* mapped, VkDeviceSize size):
+    _memory(memory),
+    _mapped(mapped),
+    _min_order(ceil_log2(MIN_MEMORY_ALLOCATION_SIZE)),
+    _max_order(ceil_log2(size)) {
+    _free.resize(_max_order - _min_order + 1);
+    _free.back().insert(0);
+  }
+
+  bool Allocate(VkDeviceSize size, VkDeviceSize alignment, Allocation& allocation) {
+    uint32_t order = std::max(_min_order, ceil_log2(std::max(size, alignment)));
+    if (order > _max_order) {
+      return false;
+    }
+
+    uint32_t available = order;
+    while (available <= _max_order && free_list(available).empty()) {
+      available++;
+    }
+    if (available > _max_order) {
+      return false;
+    }
+
+    VkDeviceSize offset = *free_list(available).begin();
+    free_list(available).erase(free_list(available).begin());
+    // split until the piece is just big enough, the upper halves stay free.
+    while (available > order) {
+      available--;
+      free_list(available).insert(offset + (VkDeviceSize(1) << available));
+    }
+
+    _used += VkDeviceSize(1) << order;
+    allocation.memory = _memory;
+    allocation.offset = offset;
+    allocation.size = size;
+    allocation.mapped = _mapped ? static_cast<char*>(_mapped) + offset : nullptr;
+    allocation.block = this;
+    allocation.order = order;
+    return true;
+  }
+
+  void Free(const Allocation& allocation) {
+    VkDeviceSize offset = allocation.offset;
+    uint32_t order = allocation.order;
+    _used -= VkDeviceSize(1) << order;
+
+    while (order < _max_order) {
+      VkDeviceSize buddy = offset ^ (VkDeviceSize(1) << order);
+      auto found = free_list(order).find(buddy);
+      if (found == free_list(order).end()) {
+        break;
+      }
+      free_list(order).erase(found);
+      offset = std::min(offset, buddy);
+      order++;
+    }
+    free_list(order).insert(offset);
+  }
+
+  bool Empty() const {
+    return _used == 0;
+  }
+
+  VkDeviceMemory GetMemory() const {
+    return _memory;
+  }
+
+  void* GetMapped() const {
+    return _mapped;
+  }
+
+  VkDeviceSize GetSize() const {
+    return VkDeviceSize(1) << _max_order;
+  }
+
+  VkDeviceSize GetUsed() const {
+    return _used;
+  }
+
+private:
+  std::set<VkDeviceSize>& free_list(uint32_t order) {
+    return _free[order - _min_order];
+  }
+};
+
+struct MemoryAllocatorOptions {
+  VkPhysicalDeviceMemoryProperties memory_properties;
+  // rounded down to a power of two and capped to an eighth of the heap.
+  VkDeviceSize block_size = DEFAULT_MEMORY_BLOCK_SIZE;
+  // requests at least this big get their own VkDeviceMemory instead of
+  // taking a large part of a shared block, as do the ones that do not fit in
+  // a block of their memory type.
+  VkDeviceSize dedicated_threshold = DEFAULT_MEMORY_BLOCK_SIZE / 4;
+};
+
+struct MemoryAllocatorStats {
+  size_t block_count;
+  size_t dedicated_count;
+  size_t allocation_count;
+  // total size of every VkDeviceMemory that is alive.
+  VkDeviceSize bytes_reserved;
+  // bytes handed out to allocations, including buddy rounding.
+  VkDeviceSize bytes_used;
+};
+
+/**
+ * @brief Sub-allocates resources out of a few large VkDeviceMemory blocks.
+ * @details Drivers limit the number of live allocations
+ * (maxMemoryAllocationCount can be as low as 4096) and vkAllocateMemory is
+ * slow, so memory is allocated in blocks per memory type and resource kind
+ * and split up with a buddy allocator. Host visible blocks are mapped once
+ * when they are created.
+ */
+class MemoryAllocator {
+  std::unique_ptr<DeviceMemoryBackend> _backend;
+  MemoryAllocatorOptions _options;
+  // pools[memory_type * 2 + kind]
+  std::vector<std::vector<std::unique_ptr<MemoryBlock>>> _pools;
+  // dedicated memory and its mapping, freed with the allocator if the
+  // resources using it are still around.
+  std::map<VkDeviceMemory, void*> _dedicated;
+  size_t _allocation_count = 0;
+  VkDeviceSize _dedicated_bytes = 0;
+  std::mutex _mutex;
+
+public:
+  MemoryAllocator(std::unique_ptr<DeviceMemoryBackend> backend, const MemoryAllocatorOptions& options):
+    _backend(std::move(backend)),
+    _options(options),
+    _pools(options.memory_properties.memoryTypeCount * 2) {}
+
+  ~MemoryAllocator() {
+    if (_allocation_count != 0) {
+      std::cout << "memory allocator destroyed with " << _allocation_count << " live allocations" << std::endl;
+    }
+    for (auto& dedicated : _dedicated) {
+      release_memory(dedicated.first, dedicated.second);
+    }
+    for (auto& pool : _pools) {
+      for (auto& block : pool) {
+        release_memory(block->GetMemory(), block->GetMapped());
+      }
+    }
+  }
+
+  MemoryAllocator(const MemoryAllocator&) = delete;
+  MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
+  Allocation Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, MemoryResourceKind kind) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint32_t memory_type = find_memory_type(requirements.memoryTypeBits, properties);
+    Allocation allocation{};
+
+    // blocks are capped to an eighth of the heap, on small heaps that is
+    // below the threshold. A power of two block fits the request when it
+    // fits its size and alignment, see MemoryBlock::Allocate.
+    VkDeviceSize footprint = std::max(requirements.size, requirements.alignment);
+    if (requirements.size >= _options.dedicated_threshold || footprint > block_size_for(memory_type)) {
+      allocate_dedicated(memory_type, requirements.size, allocation);
+      _allocation_count++;
+      return allocation;
+    }
+
+    auto& pool = _pools[memory_type * 2 + static_cast<uint32_t>(kind)];
+    for (auto& block : pool) {
+      if (block->Allocate(requirements.size, requirements.alignment, allocation)) {
+        _allocation_count++;
+        return allocation;
+      }
+    }
+
+    pool.push_back(create_block(memory_type));
+    if (!pool.back()->Allocate(requirements.size, requirements.alignment, allocation)) {
+      throw std::runtime_error("failed to allocate memory from a new block!");
+    }
+    _allocation_count++;
+    return allocation;
+  }
+
+  void Free(Allocation& allocation) {
+    if (allocation.memory == VK_NULL_HANDLE) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    _allocation_count--;
+
+    if (allocation.block == nullptr) {
+      release_memory(allocation.memory, allocation.mapped);
+      _dedicated.erase(allocation.memory);
+      _dedicated_bytes -= allocation.size;
+      allocation = Allocation{};
+      return;
+    }
+
+    MemoryBlock* block = allocation.block;
+    block->Free(allocation);
+    allocation = Allocation{};
+    if (block->Empty()) {
+      release_empty_block(block);
+    }
+  }
+
+  MemoryAllocatorStats GetStats() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    MemoryAllocatorStats stats{};
+    stats.dedicated_count = _dedicated.size();
+    stats.allocation_count = _allocation_count;
+    stats.bytes_reserved = _dedicated_bytes;
+    stats.bytes_used = _dedicated_bytes;
+    for (auto& pool : _pools) {
+      for (auto& block : pool) {
+        stats.block_count++;
+        stats.bytes_reserved += block->GetSize();
+        stats.bytes_used += block->GetUsed();
+      }
+    }
+    return stats;
+  }
+
+private:
+  uint32_t find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) {
+    const auto& memory_properties = _options.memory_properties;
+    for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+      if ((type_filter & (1 << i)) && (memory_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+        return i;
+      }
+    }
+    throw std::runtime_error("failed to find suitable memory type!");
+  }
+
+  bool is_host_visible(uint32_t memory_type) {
+    return _options.memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+  }
+
+  VkDeviceSize block_size_for(uint32_t memory_type) {
+    const auto& memory_properties = _options.memory_properties;
+    VkDeviceSize heap_size = memory_properties.memoryHeaps[memory_properties.memoryTypes[memory_type].heapIndex].size;
+    VkDeviceSize size = std::min(_options.block_size, std::max(heap_size / 8, MIN_MEMORY_ALLOCATION_SIZE));
+    // round down to a power of two for the buddy allocator.
+    return VkDeviceSize(1) << (ceil_log2(size + 1) - 1);
+  }
+
+  void* map_memory(uint32_t memory_type, VkDeviceMemory memory) {
+    if (!is_host_visible(memory_type)) {
+      return nullptr;
+    }
+    void* data = nullptr;
+    if (_backend->Map(memory, &data) != VK_SUCCESS) {
+      _backend->Free(memory);
+      throw std::runtime_error("failed to map memory!");
+    }
+    return data;
+  }
+
+  void release_memory(VkDeviceMemory memory, void* mapped) {
+    if (mapped) {
+      _backend->Unmap(memory);
+    }
+    _backend->Free(memory);
+  }
+
+  std::unique_ptr<MemoryBlock> create_block(uint32_t memory_type) {
+    VkDeviceSize size = block_size_for(memory_type);
+    VkDeviceMemory memory;
+    if (_backend->Allocate(memory_type, size, memory) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate memory block!");
+    }
+    return std::make_unique<MemoryBlock>(memory, map_memory(memory_type, memory), size);
+  }
+
+  void allocate_dedicated(uint32_t memory_type, VkDeviceSize size, Allocation& allocation) {
+    if (_backend->Allocate(memory_type, size, allocation.memory) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate dedicated memory!");
+    }
+    allocation.offset = 0;
+    allocation.size = size;
+    allocation.mapped = map_memory(memory_type, allocation.memory);
+    _dedicated[allocation.memory] = allocation.mapped;
+    _dedicated_bytes += size;
+  }
+
+  // keeps the last block of a pool around so a pool that repeatedly goes
+  // empty does not allocate and free a block every time.
+  void release_empty_block(MemoryBlock* block) {
+    for (auto& pool : _pools) {
+      auto found = std::find_if(pool.begin(), pool.end(), [block](const std::unique_ptr<MemoryBlock>& candidate) {
+        return candidate.get() == block;
+      });
+      if (found == pool.end()) {
+        continue;
+      }
+      if (pool.size() > 1) {
+        release_memory(block->GetMemory(), block->GetMapped());
+        pool.erase(found);
+      }
+      return;
+    }
+  }
+};
+
+struct MemoryAllocatorRegistry {
+  std::map<VkDevice, std::unique_ptr<MemoryAllocator>> allocators;
+
+  // runs at static destruction, after every device is gone. An allocator
+  // still here missed DestroyMemoryAllocator and freeing its memory now
+  // would use a destroyed device, so it is reported and left alone.
+  ~MemoryAllocatorRegistry() {
+    for (auto& entry : allocators) {
+      std::cout << "memory allocator outlived its device, call DestroyMemoryAllocator before vkDestroyDevice" << std::endl;
+      entry.second.release();
+    }
+  }
+};
+
+std::map<VkDevice, std::unique_ptr<MemoryAllocator>>& memory_allocators() {
+  static MemoryAllocatorRegistry registry;
+  return registry.allocators;
+}
+
+std::mutex& memory_allocators_mutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+/**
+ * @brief The allocator for device, created on first use.
+ */
+MemoryAllocator& GetMemoryAllocator(VkDevice device, VkPhysicalDevice physical_device) {
+  std::lock_guard<std::mutex> lock(memory_allocators_mutex());
+  auto& allocators = memory_allocators();
+  auto found = allocators.find(device);
+  if (found != allocators.end()) {
+    return *found->second;
+  }
+
+  MemoryAllocatorOptions options{};
+  vkGetPhysicalDeviceMemoryProperties(physical_device, &options.memory_properties);
+  auto allocator = std::make_unique<MemoryAllocator>(std::make_unique<VulkanMemoryBackend>(device), options);
+  return *(allocators[device] = std::move(allocator));
+}
+
+/**
+ * @brief Returns allocation to the allocator of device.
+ */
+void FreeMemory(VkDevice device, Allocation& allocation) {
+  MemoryAllocator* allocator;
+  {
+    std::lock_guard<std::mutex> lock(memory_allocators_mutex());
+    auto found = memory_allocators().find(device);
+    if (found == memory_allocators().end()) {
+      throw std::runtime_error("no memory allocator for device!");
+    }
+    allocator = found->second.get();
+  }
+  allocator->Free(allocation);
+}
+
+/**
+ * @brief Releases every block and dedicated allocation of device's
+ * allocator, call before the device is destroyed.
+ */
+void DestroyMemoryAllocator(VkDevice device) {
+  std::lock_guard<std::mutex> lock(memory_allocators_mutex());
+  memory_allocators().erase(device);
+}
+} // VT
@@ -0,0 +1,283 @@
+#pragma once
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "vertex.h"
+
+namespace VT {
+
+// "VTMC" in little endian.
+const uint32_t MESH_CACHE_MAGIC = 0x434d5456;
+// Bump whenever the header or the layout of VT::Vertex changes so stale
+// caches get rebuilt instead of being misread.
+const uint32_t MESH_CACHE_VERSION = 2;
+// Vertex and index arrays start on this boundary inside the file so the
+// mapped pointers can be handed to memcpy / the staging buffer as is.
+const uint64_t MESH_CACHE_ALIGNMENT = 16;
+
+// The cached mesh went through VT::OptimizeMesh.
+const uint32_t MESH_CACHE_FLAG_OPTIMIZED = 1 << 0;
+
+/**
+ * @brief Identifies the source file a cache was built from.
+ * @details Size and mtime are cheap to query and are checked first. The
+ * content hash is only computed when they disagree, so that a touched but
+ * unchanged file (e.g. after a git checkout) still hits the cache. The new
+ * mtime is then written back so later runs skip the hash.
+ */
+struct MeshCacheKey {
+  uint64_t source_size;
+  int64_t source_mtime_ns;
+  uint64_t source_hash;
+};
+
+struct MeshCacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t vertex_stride;
+  uint32_t index_stride;
+  // MESH_CACHE_FLAG_* the cache was built with. A cache is only reused when
+  // the caller asks for the same flags.
+  uint32_t flags;
+  uint32_t reserved;
+  MeshCacheKey key;
+  uint64_t vertex_count;
+  uint64_t index_count;
+  uint64_t vertex_offset;
+  uint64_t index_offset;
+};
+
+uint64_t align_mesh_cache_offset(uint64_t offset) {
+  return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(MESH_CACHE_ALIGNMENT - 1);
+}
+
+// 64 bit FNV-1a. Not cryptographic, we only need to notice content changes.
+uint64_t HashBytes(const void* data, size_t size) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+bool stat_mesh_source(const std::string& source_path, MeshCacheKey& key) {
+  struct stat st;
+  if (stat(source_path.c_str(), &st) != 0) {
+    return false;
+  }
+  key.source_size = static_cast<uint64_t>(st.st_size);
+  key.source_mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000ll + st.st_mtim.tv_nsec;
+  key.source_hash = 0;
+  return true;
+}
+
+bool hash_mesh_source(const std::string& source_path, MeshCacheKey& key) {
+  int fd = open(source_path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  if (key.source_size == 0) {
+    close(fd);
+    key.source_hash = HashBytes(nullptr, 0);
+    return true;
+  }
+  void* data = mmap(nullptr, key.source_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  key.source_hash = HashBytes(data, key.source_size);
+  munmap(data, key.source_size);
+  return true;
+}
+
+/**
+ * @brief Builds the full key (size, mtime and content hash) for a source file.
+ */
+bool ComputeMeshCacheKey(const std::string& source_path, MeshCacheKey& key) {
+  return stat_mesh_source(source_path, key) && hash_mesh_source(source_path, key);
+}
+
+/**
+ * @brief Read only view of a mesh cache file mapped into memory.
+ * @details The vertex and index pointers point directly into the mapping,
+ * nothing is copied until the data is written into a staging buffer.
+ */
+class MappedMeshCache {
+  void* _data;
+  size_t _size;
+  const MeshCacheHeader* _header;
+
+public:
+  MappedMeshCache(void* data, size_t size):
+    _data(data),
+    _size(size),
+    _header(static_cast<const MeshCacheHeader*>(data)) {}
+
+  ~MappedMeshCache() {
+    munmap(_data, _size);
+  }
+
+  MappedMeshCache(const MappedMeshCache&) = delete;
+  MappedMeshCache& operator=(const MappedMeshCache&) = delete;
+
+  const MeshCacheHeader& GetHeader() const {
+    return *_header;
+  }
+
+  const Vertex* GetVertices() const {
+    return reinterpret_cast<const Vertex*>(static_cast<const char*>(_data) + _header->vertex_offset);
+  }
+
+  size_t GetVertexCount() const {
+    return static_cast<size_t>(_header->vertex_count);
+  }
+
+  const uint32_t* GetIndices() const {
+    return reinterpret_cast<const uint32_t*>(static_cast<const char*>(_data) + _header->index_offset);
+  }
+
+  size_t GetIndexCount() const {
+    return static_cast<size_t>(_header->index_count);
+  }
+};
+
+// count elements of stride bytes starting at offset end at or before end.
+// Compared by division so a corrupt count cannot wrap around.
+bool mesh_cache_array_fits(uint64_t offset, uint64_t count, uint64_t stride, uint64_t end) {
+  return offset <= end && count <= (end - offset) / stride;
+}
+
+bool mesh_cache_layout_valid(const MeshCacheHeader& header, size_t file_size) {
+  if (file_size < sizeof(MeshCacheHeader) ||
+      header.magic != MESH_CACHE_MAGIC ||
+      header.version != MESH_CACHE_VERSION ||
+      header.vertex_stride != sizeof(Vertex) ||
+      header.index_stride != sizeof(uint32_t)) {
+    return false;
+  }
+  return header.vertex_offset >= sizeof(MeshCacheHeader) &&
+         mesh_cache_array_fits(header.index_offset, header.index_count, header.index_stride, file_size) &&
+         mesh_cache_array_fits(header.vertex_offset, header.vertex_count, header.vertex_stride, header.index_offset);
+}
+
+// Stores the source's new mtime in the cache header, so the next open
+// matches on size and mtime again instead of hashing the source. Failing
+// only costs that hash.
+void update_mesh_cache_mtime(const std::string& cache_path, int64_t source_mtime_ns) {
+  int fd = open(cache_path.c_str(), O_WRONLY);
+  if (fd < 0) {
+    return;
+  }
+  off_t offset = offsetof(MeshCacheHeader, key) + offsetof(MeshCacheKey, source_mtime_ns);
+  if (pwrite(fd, &source_mtime_ns, sizeof(source_mtime_ns), offset) != static_cast<ssize_t>(sizeof(source_mtime_ns))) {
+    std::cout << "failed to update mesh cache " << cache_path << std::endl;
+  }
+  close(fd);
+}
+
+/**
+ * @brief Maps the cache at cache_path if it was built from the current
+ * contents of source_path with the same flags.
+ *
+ * @return The mapped cache or nullptr when it is missing or stale.
+ */
+std::unique_ptr<MappedMeshCache> OpenMeshCache(const std::string& cache_path, const std::string& source_path, uint32_t flags = 0) {
+  MeshCacheKey current{};
+  if (!stat_mesh_source(source_path, current)) {
+    return nullptr;
+  }
+
+  int fd = open(cache_path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(MeshCacheHeader))) {
+    close(fd);
+    return nullptr;
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return nullptr;
+  }
+
+  auto cache = std::make_unique<MappedMeshCache>(data, size);
+  const MeshCacheHeader& header = cache->GetHeader();
+  if (!mesh_cache_layout_valid(header, size) ||
+      header.flags != flags ||
+      header.key.source_size != current.source_size) {
+    return nullptr;
+  }
+  if (header.key.source_mtime_ns != current.source_mtime_ns) {
+    // same size but a different timestamp, fall back to comparing contents.
+    if (!hash_mesh_source(source_path, current) || current.source_hash != header.key.source_hash) {
+      return nullptr;
+    }
+    update_mesh_cache_mtime(cache_path, current.source_mtime_ns);
+  }
+  return cache;
+}
+
+/**
+ * @brief Writes the deduplicated vertex and index arrays to cache_path.
+ * @details The file is written next to the destination and renamed into
+ * place so a crash mid write never leaves a truncated cache behind.
+ */
+bool WriteMeshCache(
+    const std::string& cache_path,
+    const MeshCacheKey& key,
+    const Vertex* vertices,
+    size_t vertex_count,
+    const uint32_t* indices,
+    size_t index_count,
+    uint32_t flags = 0) {
+  MeshCacheHeader header{};
+  header.magic = MESH_CACHE_MAGIC;
+  header.version = MESH_CACHE_VERSION;
+  header.vertex_stride = sizeof(Vertex);
+  header.index_stride = sizeof(uint32_t);
+  header.flags = flags;
+  header.key = key;
+  header.vertex_count = vertex_count;
+  header.index_count = index_count;
+  header.vertex_offset = align_mesh_cache_offset(sizeof(MeshCacheHeader));
+  header.index_offset = align_mesh_cache_offset(header.vertex_offset + vertex_count * sizeof(Vertex));
+
+  std::string temp_path = cache_path + ".tmp";
+  std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  const char padding[MESH_CACHE_ALIGNMENT] = {};
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(padding, header.vertex_offset - sizeof(header));
+  file.write(reinterpret_cast<const char*>(vertices), vertex_count * sizeof(Vertex));
+  file.write(padding, header.index_offset - (header.vertex_offset + vertex_count * sizeof(Vertex)));
+  file.write(reinterpret_cast<const char*>(indices), index_count * sizeof(uint32_t));
+  file.close();
+
+  if (!file) {
+    std::remove(temp_path.c_str());
+    return false;
+  }
+  return std::rename(temp_path.c_str(), cache_path.c_str()) == 0;
+}
+} // VT
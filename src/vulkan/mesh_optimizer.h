@@ -0,0 +1,246 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "vertex.h"
+
+namespace VT {
+
+/**
+ * @brief Post transform vertex cache statistics for an index buffer.
+ * @details acmr is the average number of vertices transformed per triangle
+ * (0.5 is the best possible for a regular grid, 3.0 means no reuse at all).
+ * atvr is transformed vertices over unique vertices, 1.0 means every vertex
+ * was shaded exactly once.
+ */
+struct VertexCacheStats {
+  size_t vertices_transformed;
+  float acmr;
+  float atvr;
+};
+
+/**
+ * @brief Simulates a FIFO post transform cache over the index buffer.
+ */
+VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t index_count, size_t vertex_count, uint32_t cache_size = 16) {
+  // a vertex is in the cache if fewer than cache_size misses happened since
+  // it was last inserted. The clock starts past cache_size so that the zero
+  // initialized timestamps all read as misses.
+  std::vector<size_t> inserted_at(vertex_count, 0);
+  size_t clock = cache_size + 1;
+  size_t misses = 0;
+
+  for (size_t i = 0; i < index_count; i++) {
+    uint32_t vertex = indices[i];
+    if (clock - inserted_at[vertex] > cache_size) {
+      inserted_at[vertex] = clock++;
+      misses++;
+    }
+  }
+
+  VertexCacheStats stats{};
+  stats.vertices_transformed = misses;
+  stats.acmr = index_count == 0 ? 0.0f : static_cast<float>(misses) / (index_count / 3);
+  stats.atvr = vertex_count == 0 ? 0.0f : static_cast<float>(misses) / vertex_count;
+  return stats;
+}
+
+// Tuning values from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+const uint32_t FORSYTH_CACHE_SIZE = 32;
+const float FORSYTH_CACHE_DECAY_POWER = 1.5f;
+const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+const float FORSYTH_VALENCE_BOOST_SCALE = 2.0f;
+const float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+const uint32_t FORSYTH_MAX_VALENCE = 64;
+
+float forsyth_vertex_score(int cache_position, uint32_t remaining_triangles) {
+  if (remaining_triangles == 0) {
+    // no triangle needs this vertex anymore.
+    return -1.0f;
+  }
+
+  float score = 0.0f;
+  if (cache_position >= 0) {
+    if (cache_position < 3) {
+      // used by the triangle that was just emitted. A fixed score so that
+      // the next triangle does not strongly prefer any of its edges.
+      score = FORSYTH_LAST_TRIANGLE_SCORE;
+    } else {
+      float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+      score = std::pow(1.0f - (cache_position - 3) * scaler, FORSYTH_CACHE_DECAY_POWER);
+    }
+  }
+
+  // boost vertices with few triangles left so lone triangles get finished
+  // off instead of being left behind.
+  uint32_t valence = std::min(remaining_triangles, FORSYTH_MAX_VALENCE);
+  score += FORSYTH_VALENCE_BOOST_SCALE * std::pow(static_cast<float>(valence), -FORSYTH_VALENCE_BOOST_POWER);
+  return score;
+}
+
+/**
+ * @brief Reorders triangles to maximize post transform vertex cache hits.
+ * @details Greedy Forsyth ordering: every vertex gets a score from its
+ * position in a simulated LRU cache and its number of remaining triangles,
+ * and the next triangle emitted is the highest scoring one adjacent to the
+ * cache. Only the triangle order changes, the vertices are untouched.
+ */
+void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertex_count) {
+  const size_t triangle_count = indices.size() / 3;
+  if (triangle_count == 0) {
+    return;
+  }
+
+  // vertex -> adjacent triangles, laid out as one flat array.
+  std::vector<uint32_t> remaining(vertex_count, 0);
+  for (uint32_t index : indices) {
+    remaining[index]++;
+  }
+  std::vector<uint32_t> adjacency_offset(vertex_count + 1, 0);
+  for (size_t v = 0; v < vertex_count; v++) {
+    adjacency_offset[v + 1] = adjacency_offset[v] + remaining[v];
+  }
+  std::vector<uint32_t> adjacency(indices.size());
+  {
+    std::vector<uint32_t> fill(adjacency_offset.begin(), adjacency_offset.end() - 1);
+    for (size_t t = 0; t < triangle_count; t++) {
+      for (size_t k = 0; k < 3; k++) {
+        adjacency[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+      }
+    }
+  }
+
+  std::vector<int> cache_position(vertex_count, -1);
+  std::vector<float> vertex_score(vertex_count);
+  for (size_t v = 0; v < vertex_count; v++) {
+    vertex_score[v] = forsyth_vertex_score(-1, remaining[v]);
+  }
+
+  std::vector<float> triangle_score(triangle_count);
+  std::vector<bool> emitted(triangle_count, false);
+  for (size_t t = 0; t < triangle_count; t++) {
+    triangle_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+  }
+
+  std::vector<uint32_t> output;
+  output.reserve(indices.size());
+  // the three vertices of the new triangle are pushed in front before the
+  // overflow is trimmed, hence the extra slots.
+  std::vector<uint32_t> cache, next_cache;
+  cache.reserve(FORSYTH_CACHE_SIZE + 3);
+  next_cache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+  size_t best_triangle = 0;
+  size_t scan_cursor = 0;
+  for (size_t emitted_count = 0; emitted_count < triangle_count; emitted_count++) {
+    if (best_triangle == SIZE_MAX) {
+      // nothing adjacent to the cache is left, start from the next triangle
+      // that has not been emitted yet.
+      while (emitted[scan_cursor]) {
+        scan_cursor++;
+      }
+      best_triangle = scan_cursor;
+    }
+
+    const uint32_t* triangle = &indices[best_triangle * 3];
+    output.insert(output.end(), triangle, triangle + 3);
+    emitted[best_triangle] = true;
+
+    next_cache.assign(triangle, triangle + 3);
+    for (uint32_t vertex : cache) {
+      if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2]) {
+        next_cache.push_back(vertex);
+      }
+    }
+
+    // drop the emitted triangle from the adjacency of its vertices.
+    for (size_t k = 0; k < 3; k++) {
+      uint32_t vertex = triangle[k];
+      uint32_t* begin = &adjacency[adjacency_offset[vertex]];
+      uint32_t* end = begin + remaining[vertex];
+      uint32_t* found = std::find(begin, end, static_cast<uint32_t>(best_triangle));
+      if (found != end) {
+        std::swap(*found, *(end - 1));
+        remaining[vertex]--;
+      }
+    }
+
+    // rescore everything that moved in or out of the cache, then pick the
+    // best triangle touching it once all the scores are final.
+    for (size_t i = 0; i < next_cache.size(); i++) {
+      uint32_t vertex = next_cache[i];
+      cache_position[vertex] = i < FORSYTH_CACHE_SIZE ? static_cast<int>(i) : -1;
+    }
+    for (uint32_t vertex : next_cache) {
+      float score = forsyth_vertex_score(cache_position[vertex], remaining[vertex]);
+      float delta = score - vertex_score[vertex];
+      vertex_score[vertex] = score;
+
+      const uint32_t* begin = &adjacency[adjacency_offset[vertex]];
+      for (const uint32_t* t = begin; t != begin + remaining[vertex]; t++) {
+        triangle_score[*t] += delta;
+      }
+    }
+    best_triangle = SIZE_MAX;
+    float best_score = -1.0f;
+    for (uint32_t vertex : next_cache) {
+      const uint32_t* begin = &adjacency[adjacency_offset[vertex]];
+      for (const uint32_t* t = begin; t != begin + remaining[vertex]; t++) {
+        if (triangle_score[*t] > best_score) {
+          best_score = triangle_score[*t];
+          best_triangle = *t;
+        }
+      }
+    }
+
+    if (next_cache.size() > FORSYTH_CACHE_SIZE) {
+      next_cache.resize(FORSYTH_CACHE_SIZE);
+    }
+    std::swap(cache, next_cache);
+  }
+
+  indices.swap(output);
+}
+
+/**
+ * @brief Reorders vertices in the order the index buffer first references
+ * them so vertex fetch walks memory mostly linearly, and remaps the indices.
+ * @details Unreferenced vertices are kept and moved to the end.
+ */
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+  const uint32_t UNUSED = UINT32_MAX;
+  std::vector<uint32_t> remap(vertices.size(), UNUSED);
+  uint32_t next = 0;
+
+  for (uint32_t& index : indices) {
+    if (remap[index] == UNUSED) {
+      remap[index] = next++;
+    }
+    index = remap[index];
+  }
+  for (uint32_t& target : remap) {
+    if (target == UNUSED) {
+      target = next++;
+    }
+  }
+
+  std::vector<Vertex> reordered(vertices.size());
+  for (size_t v = 0; v < vertices.size(); v++) {
+    reordered[remap[v]] = vertices[v];
+  }
+  vertices.swap(reordered);
+}
+
+/**
+ * @brief Runs the vertex cache and then the vertex fetch optimization.
+ */
+void OptimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+  OptimizeVertexCache(indices, vertices.size());
+  OptimizeVertexFetch(vertices, indices);
+}
+} // VT
@@ -5,15 +5,93 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <string>
 #include <vector>
 #include <stdexcept>
 
+#include "bounds.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
 #include "vertex.h"
+#include "vertex_dedup.h"
 
 namespace VT {
 
-void LoadModel(std::vector<VT::Vertex>& vertices, std::vector<uint32_t>& indices, const char* model_path) {
+/**
+ * @brief Deduplicated vertex and index data for a single mesh.
+ * @details The data either lives in vectors owned by the model (after
+ * parsing the obj) or in a memory mapped mesh cache. Callers only see the
+ * raw pointers so they do not care which one it is. The bounds are computed
+ * once when the model is created.
+ */
+class Model {
+  std::vector<Vertex> _vertices;
+  std::vector<uint32_t> _indices;
+  std::unique_ptr<MappedMeshCache> _cache;
+  MeshBounds _bounds;
+
+public:
+  Model(std::vector<Vertex>&& vertices, std::vector<uint32_t>&& indices):
+    _vertices(std::move(vertices)),
+    _indices(std::move(indices)),
+    _bounds(ComputeMeshBounds(_vertices.data(), _vertices.size())) {}
+
+  Model(std::unique_ptr<MappedMeshCache> cache):
+    _cache(std::move(cache)),
+    _bounds(ComputeMeshBounds(_cache->GetVertices(), _cache->GetVertexCount())) {}
+
+  const Vertex* GetVertices() const {
+    return _cache ? _cache->GetVertices() : _vertices.data();
+  }
+
+  size_t GetVertexCount() const {
+    return _cache ? _cache->GetVertexCount() : _vertices.size();
+  }
+
+  const uint32_t* GetIndices() const {
+    return _cache ? _cache->GetIndices() : _indices.data();
+  }
+
+  size_t GetIndexCount() const {
+    return _cache ? _cache->GetIndexCount() : _indices.size();
+  }
+
+  const MeshBounds& GetBounds() const {
+    return _bounds;
+  }
+
+  bool IsCached() const {
+    return _cache != nullptr;
+  }
+};
+
+struct LoadModelOptions {
+  std::string model_path;
+  // where the binary mesh cache is read from / written to. Leave empty to
+  // always parse the obj file.
+  std::string cache_path;
+  // deduplicate vertices on all cores, the output is identical to the
+  // serial path.
+  bool parallel_dedup = true;
+  // 0 uses std::thread::hardware_concurrency.
+  unsigned thread_count = 0;
+  // reorder triangles for the post transform cache and vertices for fetch
+  // locality. Optimized meshes are cached separately from unoptimized ones.
+  bool optimize = true;
+};
+
+void print_vertex_cache_stats(const char* label, const VertexCacheStats& stats) {
+  std::cout << "  " << label << " ACMR " << stats.acmr << ", ATVR " << stats.atvr << std::endl;
+}
+
+/**
+ * @brief Parses an obj file into one vertex per index (corner), before
+ * any deduplication.
+ */
+void LoadObjCorners(std::vector<VT::Vertex>& corners, const char* model_path) {
   tinyobj::attrib_t attrib;
   std::vector<tinyobj::shape_t> shapes;
   std::vector<tinyobj::material_t> materials;
@@ -26,7 +104,11 @@ void LoadModel(std::vector<VT::Vertex>& vertices, std::vector<uint32_t>& indices
     throw std::runtime_error(warn + err);
   }
 
-  std::unordered_map<VT::Vertex, uint32_t> uniqueVertices{};
+  size_t corner_count = 0;
+  for (const auto& shape : shapes) {
+    corner_count += shape.mesh.indices.size();
+  }
+  corners.reserve(corners.size() + corner_count);
 
   for (const auto& shape : shapes) {
     for (const auto& index: shape.mesh.indices) {
@@ -45,13 +127,76 @@ void LoadModel(std::vector<VT::Vertex>& vertices, std::vector<uint32_t>& indices
 
       vertex.color = { 1.0f, 1.0f, 1.0f };
 
-      if (uniqueVertices.count(vertex) == 0) {
-        uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-        vertices.push_back(vertex);
-      }
+      corners.push_back(vertex);
+    }
+  }
+}
+
+void LoadModel(
+    std::vector<VT::Vertex>& vertices,
+    std::vector<uint32_t>& indices,
+    const char* model_path,
+    bool parallel_dedup = false,
+    unsigned thread_count = 0) {
+  std::vector<VT::Vertex> corners;
+  LoadObjCorners(corners, model_path);
+
+  if (parallel_dedup) {
+    VT::DedupVerticesParallel(corners, vertices, indices, thread_count == 0 ? VT::DefaultThreadCount() : thread_count);
+  } else {
+    VT::DedupVertices(corners, vertices, indices);
+  }
+}
+
+/**
+ * @brief Loads a model, going through the binary mesh cache when possible.
+ * @details On a warm start the cache is mapped and nothing is parsed. On a
+ * cold start (no cache, or the obj changed since it was written) the obj is
+ * parsed, deduplicated and optionally optimized, and the result is written
+ * to the cache for next time.
+ */
+std::unique_ptr<Model> LoadModel(LoadModelOptions& options) {
+  auto start = std::chrono::high_resolution_clock::now();
+  auto elapsed_ms = [&start]() {
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+  };
+
+  uint32_t cache_flags = options.optimize ? MESH_CACHE_FLAG_OPTIMIZED : 0;
+  if (!options.cache_path.empty()) {
+    auto cache = OpenMeshCache(options.cache_path, options.model_path, cache_flags);
+    if (cache) {
+      auto model = std::make_unique<Model>(std::move(cache));
+      std::cout << "Loaded model " << options.model_path << " (warm, mesh cache): "
+                << elapsed_ms() << " ms" << std::endl;
+      return model;
+    }
+  }
+
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+  LoadModel(vertices, indices, options.model_path.c_str(), options.parallel_dedup, options.thread_count);
+
+  if (options.optimize) {
+    auto optimize_start = std::chrono::high_resolution_clock::now();
+    auto before = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+    OptimizeMesh(vertices, indices);
+    auto after = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+    std::cout << "Optimized mesh in "
+              << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - optimize_start).count()
+              << " ms" << std::endl;
+    print_vertex_cache_stats("before:", before);
+    print_vertex_cache_stats("after: ", after);
+  }
+  std::cout << "Loaded model " << options.model_path << " (cold, obj parse): "
+            << elapsed_ms() << " ms" << std::endl;
 
-      indices.push_back(uniqueVertices[vertex]);
+  if (!options.cache_path.empty()) {
+    MeshCacheKey key{};
+    if (!ComputeMeshCacheKey(options.model_path, key) ||
+        !WriteMeshCache(options.cache_path, key, vertices.data(), vertices.size(), indices.data(), indices.size(), cache_flags)) {
+      std::cout << "failed to write mesh cache " << options.cache_path << std::endl;
     }
   }
+  return std::make_unique<Model>(std::move(vertices), std::move(indices));
 }
 }
@@ -0,0 +1,351 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "buffer.h"
+#include "frame_scheduler.h"
+#include "graphics_pipeline.h"
+#include "memory_allocator.h"
+#include "scene.h"
+#include "vulkan.h"
+#include "engine/private/profiler.h"
+
+namespace VT {
+
+/**
+ * @brief What the queries did for the last Update.
+ */
+struct OcclusionQueryStats {
+  // candidates that got a box and a query this frame.
+  uint32_t queried;
+  // candidates whose latest available result had no samples. Their draws are
+  // skipped on the cpu, or with conditional rendering by the gpu, which uses
+  // newer results and may disagree.
+  uint32_t hidden;
+};
+
+/**
+ * @brief Hardware occlusion queries on proxy boxes, for scenes with a few
+ * big occluders where a depth pyramid or a software rasterizer does not pay
+ * off.
+ * @details Every frame, after the real draws and in the same render pass,
+ * the bounding sphere of every candidate instance is drawn as a box with a
+ * VK_QUERY_TYPE_OCCLUSION query, depth tested against the frame's depth
+ * without writing anything. Query q of a frame's pool is the one of scene
+ * instance q. The results decide which instances the following frames draw:
+ *
+ * - With VK_EXT_conditional_rendering, RecordBegin copies the results of the
+ *   frame recorded last into a per frame predicate buffer on the gpu and
+ *   every instance is drawn on its own inside
+ *   vkCmdBeginConditionalRenderingEXT, so the gpu skips the ones whose box
+ *   had no samples one frame later.
+ * - Otherwise Update reads the results on the cpu with vkGetQueryPoolResults,
+ *   never with VK_QUERY_RESULT_WAIT_BIT: the last frame's results when
+ *   VT::FrameScheduler reports it complete, else only those of the frame
+ *   that last used the slot, which completed before the slot was handed
+ *   out. The hidden instances are removed before the draws are built.
+ *
+ * Instances without a result (never queried, or their box crosses the near
+ * plane and is not queried) are drawn. Update, RecordBegin and
+ * RecordQueries go together and every frame they record has to be
+ * submitted, the next one's copy waits for its queries on the gpu. The pools
+ * hold as many queries as the scene has instances, when it gains instances
+ * no frame that used the queries may still be in flight.
+ */
+class OcclusionQueries {
+  struct Frame {
+    // one query per scene instance.
+    VkQueryPool query_pool = VK_NULL_HANDLE;
+    // with conditional rendering, one uint per scene instance, non zero to draw.
+    VkBuffer predicates = VK_NULL_HANDLE;
+    VT::Allocation predicates_memory;
+    // the instances queried by the frame, in candidate order, and their boxes.
+    std::vector<uint32_t> queried;
+    std::vector<glm::mat4> boxes;
+    // the FrameScheduler value the frame signals, 0 before the first use.
+    uint64_t frame_value = 0;
+    // the pool of the frame recorded before this one and its runs of
+    // queried instances (first, count), copied into predicates. Kept apart
+    // from that frame's queried, which is this frame's with one frame in
+    // flight.
+    VkQueryPool previous_pool = VK_NULL_HANDLE;
+    std::vector<std::pair<uint32_t, uint32_t>> previous_runs;
+  };
+
+  std::vector<Frame> _frames;
+  // queries per pool.
+  uint32_t _capacity = 0;
+  int32_t _last_frame = -1;
+  // one per scene instance, rebuilt by every Update.
+  std::vector<uint8_t> _hidden;
+  std::vector<uint32_t> _visible;
+  std::vector<uint32_t> _results;
+  OcclusionQueryStats _stats{0, 0};
+  // null without conditional rendering.
+  PFN_vkCmdBeginConditionalRenderingEXT _begin_conditional_rendering = nullptr;
+  PFN_vkCmdEndConditionalRenderingEXT _end_conditional_rendering = nullptr;
+
+  const std::shared_ptr<VT::Vulkan> _instance;
+
+public:
+  OcclusionQueries(const std::shared_ptr<VT::Vulkan>& instance, uint32_t frame_count): _frames(frame_count), _instance(instance) {
+    if (instance->SupportsConditionalRendering()) {
+      _begin_conditional_rendering = (PFN_vkCmdBeginConditionalRenderingEXT) vkGetDeviceProcAddr(instance->GetVkDevice(), "vkCmdBeginConditionalRenderingEXT");
+      _end_conditional_rendering = (PFN_vkCmdEndConditionalRenderingEXT) vkGetDeviceProcAddr(instance->GetVkDevice(), "vkCmdEndConditionalRenderingEXT");
+    }
+  }
+
+  ~OcclusionQueries() {
+    for (Frame& frame : _frames) {
+      destroy_frame(frame);
+    }
+  }
+
+  OcclusionQueries(const OcclusionQueries&) = delete;
+  OcclusionQueries& operator=(const OcclusionQueries&) = delete;
+
+  bool UsesConditionalRendering() const {
+    return _begin_conditional_rendering != nullptr;
+  }
+
+  /**
+   * @brief Starts the frame frame_scheduler is recording: reads the
+   * available results and sets up a box for every candidate, view_proj maps
+   * world space to clip space as for VT::FrustumCuller::Cull. Call after
+   * FrameScheduler::BeginFrame, the slot's last use has to have completed.
+   * @return The candidates to draw, in the same order, valid until the next
+   * Update: all of them with conditional rendering, else the ones not hidden.
+   */
+  const std::vector<uint32_t>& Update(VT::FrameScheduler& frame_scheduler, const Scene& scene, const glm::mat4& view_proj, const std::vector<uint32_t>& candidates) {
+    ENGINE_PROFILE_SCOPE("OcclusionQueries::Update");
+    uint32_t frame = frame_scheduler.GetFrameIndex();
+    Frame& slot = _frames[frame];
+    uint32_t instance_count = static_cast<uint32_t>(scene.GetInstanceCount());
+    if (instance_count > _capacity) {
+      // no frame that used the pools is in flight, see above.
+      for (Frame& other : _frames) {
+        destroy_frame(other);
+        create_frame(other, instance_count);
+      }
+      _capacity = instance_count;
+      _last_frame = -1;
+    }
+
+    // the slot's frame completed, its results are all there. Newer ones of
+    // the last frame override them once it completed too: before its reset
+    // ran on the gpu its pool still holds older results marked available.
+    _hidden.assign(instance_count, 0);
+    read_results(slot);
+    slot.previous_pool = VK_NULL_HANDLE;
+    slot.previous_runs.clear();
+    if (_last_frame >= 0) {
+      const Frame& previous = _frames[_last_frame];
+      if (_last_frame != static_cast<int32_t>(frame) && frame_scheduler.IsComplete(previous.frame_value)) {
+        read_results(previous);
+      }
+      slot.previous_pool = previous.query_pool;
+      for_each_run(previous, [&](uint32_t first, uint32_t count) {
+        slot.previous_runs.push_back({first, count});
+      });
+    }
+
+    const BoundingSpheres& bounds = scene.GetBounds();
+    slot.queried.clear();
+    slot.boxes.clear();
+    for (uint32_t instance : candidates) {
+      float radius = bounds.radius[instance];
+      glm::vec4 center = view_proj * glm::vec4(bounds.x[instance], bounds.y[instance], bounds.z[instance], 1.0f);
+      // the nearest clip z of the box, below 0 it crosses the near plane and
+      // may be seen from inside, where its far side can be hidden behind
+      // the mesh itself.
+      float extent_z = radius * (std::abs(view_proj[0][2]) + std::abs(view_proj[1][2]) + std::abs(view_proj[2][2]));
+      if (center.z - extent_z <= 0.0f) {
+        continue;
+      }
+      slot.queried.push_back(instance);
+      slot.boxes.push_back(glm::mat4(view_proj[0] * radius, view_proj[1] * radius, view_proj[2] * radius, center));
+    }
+
+    _visible.clear();
+    _stats.hidden = 0;
+    for (uint32_t instance : candidates) {
+      if (_hidden[instance] != 0) {
+        _stats.hidden++;
+        if (!UsesConditionalRendering()) {
+          continue;
+        }
+      }
+      _visible.push_back(instance);
+    }
+    _stats.queried = static_cast<uint32_t>(slot.queried.size());
+    slot.frame_value = frame_scheduler.GetFrameValue();
+    _last_frame = static_cast<int32_t>(frame);
+    return _visible;
+  }
+
+  /**
+   * @brief Records what frame needs before its render pass: the reset of
+   * its queries and, with conditional rendering, the predicates from the
+   * previous frame's queries.
+   */
+  void RecordBegin(VkCommandBuffer command_buffer, uint32_t frame) {
+    const Frame& slot = _frames[frame];
+    if (_capacity == 0) {
+      return;
+    }
+    if (UsesConditionalRendering()) {
+      // draw everything without a result, then copy the previous frame's.
+      vkCmdFillBuffer(command_buffer, slot.predicates, 0, sizeof(uint32_t) * _capacity, 1);
+      memory_barrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+      // the wait is on the gpu, for queries submitted earlier on this queue.
+      for (const auto& run : slot.previous_runs) {
+        vkCmdCopyQueryPoolResults(command_buffer, slot.previous_pool, run.first, run.second, slot.predicates, sizeof(uint32_t) * run.first, sizeof(uint32_t), VK_QUERY_RESULT_WAIT_BIT);
+      }
+      // the copy may read this frame's own pool (one frame in flight).
+      memory_barrier(command_buffer,
+                     VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+                     VK_PIPELINE_STAGE_CONDITIONAL_RENDERING_BIT_EXT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_CONDITIONAL_RENDERING_READ_BIT_EXT | VK_ACCESS_TRANSFER_WRITE_BIT);
+    }
+    vkCmdResetQueryPool(command_buffer, slot.query_pool, 0, _capacity);
+  }
+
+  /**
+   * @brief Records the draw of instance (vkCmdDrawIndexed and the like)
+   * that draw records, inside a render pass, so the gpu skips it when its
+   * box had no samples last frame. Without conditional rendering it is
+   * always recorded.
+   */
+  template<typename Draw>
+  void RecordConditional(VkCommandBuffer command_buffer, uint32_t frame, uint32_t instance, Draw draw) const {
+    if (!UsesConditionalRendering()) {
+      draw();
+      return;
+    }
+    VkConditionalRenderingBeginInfoEXT beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_CONDITIONAL_RENDERING_BEGIN_INFO_EXT;
+    beginInfo.buffer = _frames[frame].predicates;
+    beginInfo.offset = sizeof(uint32_t) * instance;
+    _begin_conditional_rendering(command_buffer, &beginInfo);
+    draw();
+    _end_conditional_rendering(command_buffer);
+  }
+
+  /**
+   * @brief Records the boxes of frame's candidates with their queries,
+   * inside the render pass after the draws, with viewport and scissor set.
+   * @param pipeline see VT::CreateOcclusionBoxPipeline.
+   */
+  void RecordQueries(VkCommandBuffer command_buffer, uint32_t frame, const VT::GraphicsPipelineInfo& pipeline) const {
+    const Frame& slot = _frames[frame];
+    if (slot.queried.empty()) {
+      return;
+    }
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.graphics_pipeline);
+    for (size_t i = 0; i < slot.queried.size(); i++) {
+      // not precise, any sample passing is enough.
+      vkCmdBeginQuery(command_buffer, slot.query_pool, slot.queried[i], 0);
+      vkCmdPushConstants(command_buffer, pipeline.pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &slot.boxes[i]);
+      vkCmdDraw(command_buffer, 36, 1, 0, 0);
+      vkCmdEndQuery(command_buffer, slot.query_pool, slot.queried[i]);
+    }
+  }
+
+  const OcclusionQueryStats& GetStats() const {
+    return _stats;
+  }
+
+private:
+  static void memory_barrier(
+      VkCommandBuffer command_buffer,
+      VkPipelineStageFlags src_stage,
+      VkAccessFlags src_access,
+      VkPipelineStageFlags dst_stage,
+      VkAccessFlags dst_access) {
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = src_access;
+    barrier.dstAccessMask = dst_access;
+    vkCmdPipelineBarrier(command_buffer, src_stage, dst_stage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+  }
+
+  // calls fn(first, count) for every run of consecutive instances frame queried.
+  template<typename Fn>
+  static void for_each_run(const Frame& frame, Fn fn) {
+    size_t i = 0;
+    while (i < frame.queried.size()) {
+      uint32_t first = frame.queried[i];
+      uint32_t count = 1;
+      while (i + count < frame.queried.size() && frame.queried[i + count] == first + count) {
+        count++;
+      }
+      fn(first, count);
+      i += count;
+    }
+  }
+
+  // marks the instances frame queried as hidden or not, where the gpu has
+  // their results. Never waits.
+  void read_results(const Frame& frame) {
+    for_each_run(frame, [&](uint32_t first, uint32_t count) {
+      // the sample count and its availability per query.
+      _results.resize(2 * count);
+      VkResult result = vkGetQueryPoolResults(_instance->GetVkDevice(), frame.query_pool, first, count,
+                                              sizeof(uint32_t) * _results.size(), _results.data(),
+                                              2 * sizeof(uint32_t), VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+      if (result != VK_SUCCESS && result != VK_NOT_READY) {
+        throw std::runtime_error("failed to read occlusion query results!");
+      }
+      for (uint32_t q = 0; q < count; q++) {
+        // the scene may have lost instances since.
+        if (_results[2 * q + 1] != 0 && first + q < _hidden.size()) {
+          _hidden[first + q] = _results[2 * q] == 0 ? 1 : 0;
+        }
+      }
+    });
+  }
+
+  void create_frame(Frame& frame, uint32_t capacity) {
+    VkDevice device = _instance->GetVkDevice();
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_OCCLUSION;
+    queryPoolInfo.queryCount = capacity;
+    if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, &frame.query_pool) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create occlusion query pool!");
+    }
+    if (UsesConditionalRendering()) {
+      VT::CreateBuffer(sizeof(uint32_t) * capacity, VK_BUFFER_USAGE_CONDITIONAL_RENDERING_BIT_EXT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.predicates, frame.predicates_memory, device, _instance->GetVkPhysicalDevice());
+    }
+  }
+
+  // also forgets what the frame queried, its results are gone.
+  void destroy_frame(Frame& frame) {
+    VkDevice device = _instance->GetVkDevice();
+    if (frame.query_pool != VK_NULL_HANDLE) {
+      vkDestroyQueryPool(device, frame.query_pool, nullptr);
+      frame.query_pool = VK_NULL_HANDLE;
+    }
+    if (frame.predicates != VK_NULL_HANDLE) {
+      VT::DestroyBuffer(device, frame.predicates, frame.predicates_memory);
+      frame.predicates = VK_NULL_HANDLE;
+    }
+    frame.queried.clear();
+    frame.boxes.clear();
+    frame.frame_value = 0;
+    frame.previous_pool = VK_NULL_HANDLE;
+    frame.previous_runs.clear();
+  }
+};
+} // VT
@@ -0,0 +1,155 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include "thread_pool.h"
+#include "engine/private/profiler.h"
+
+namespace VT {
+
+struct ParallelRecorderOptions {
+  VkDevice device;
+  // family of the queue the primary command buffers are submitted to.
+  uint32_t queue_family_index;
+  uint32_t frames_in_flight;
+  unsigned thread_count;
+};
+
+/**
+ * @brief Records the draws of a render pass on a pool of worker threads into
+ * secondary command buffers, which the primary command buffer executes.
+ * @details Command pools are externally synchronized, so every worker has
+ * its own pool per frame slot and records one secondary command buffer from
+ * it. BeginFrame resets the pools of a slot in one call instead of resetting
+ * buffers one by one, once the frame that last used the slot has completed.
+ * One Record per frame.
+ */
+class ParallelCommandRecorder {
+  VkDevice _device;
+  ThreadPool _thread_pool;
+  // [slot][worker]
+  std::vector<std::vector<VkCommandPool>> _command_pools;
+  std::vector<std::vector<VkCommandBuffer>> _command_buffers;
+  // the non-empty secondary command buffers of the last Record, in draw order.
+  std::vector<VkCommandBuffer> _recorded;
+  std::vector<uint8_t> _worker_recorded;
+
+public:
+  using RecordFn = std::function<void(VkCommandBuffer, size_t, size_t)>;
+
+  ParallelCommandRecorder(const ParallelRecorderOptions& options):
+    _device(options.device),
+    _thread_pool(options.thread_count),
+    _command_pools(options.frames_in_flight),
+    _command_buffers(options.frames_in_flight) {
+    unsigned thread_count = _thread_pool.GetThreadCount();
+    _worker_recorded.resize(thread_count);
+    for (uint32_t slot = 0; slot < options.frames_in_flight; slot++) {
+      _command_pools[slot].resize(thread_count);
+      _command_buffers[slot].resize(thread_count);
+      for (unsigned worker = 0; worker < thread_count; worker++) {
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        // the whole pool is reset every frame.
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = options.queue_family_index;
+        if (vkCreateCommandPool(_device, &poolInfo, nullptr, &_command_pools[slot][worker]) != VK_SUCCESS) {
+          throw std::runtime_error("failed to create command pool!");
+        }
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = _command_pools[slot][worker];
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(_device, &allocInfo, &_command_buffers[slot][worker]) != VK_SUCCESS) {
+          throw std::runtime_error("failed to allocate command buffers!");
+        }
+      }
+    }
+  }
+
+  ~ParallelCommandRecorder() {
+    for (auto& pools : _command_pools) {
+      for (auto pool : pools) {
+        vkDestroyCommandPool(_device, pool, nullptr);
+      }
+    }
+  }
+
+  ParallelCommandRecorder(const ParallelCommandRecorder&) = delete;
+  ParallelCommandRecorder& operator=(const ParallelCommandRecorder&) = delete;
+
+  unsigned GetThreadCount() const {
+    return _thread_pool.GetThreadCount();
+  }
+
+  /**
+   * @brief Resets the command pools of slot, the frame that last used it
+   * has to be complete.
+   */
+  void BeginFrame(uint32_t slot) {
+    for (auto pool : _command_pools[slot]) {
+      vkResetCommandPool(_device, pool, 0);
+    }
+  }
+
+  /**
+   * @brief Splits [0, draw_count) over the workers, each one records its
+   * range with record(command_buffer, begin, end) into a secondary command
+   * buffer that continues subpass 0 of render_pass.
+   * @details Nothing is inherited but the render pass, so record has to bind
+   * the pipeline, dynamic state, buffers and descriptor sets itself.
+   * @return The secondary command buffers for vkCmdExecuteCommands, in draw
+   * order.
+   */
+  const std::vector<VkCommandBuffer>& Record(
+      uint32_t slot,
+      VkRenderPass render_pass,
+      VkFramebuffer framebuffer,
+      size_t draw_count,
+      const RecordFn& record) {
+    ENGINE_PROFILE_SCOPE("ParallelCommandRecorder::Record");
+    auto& command_buffers = _command_buffers[slot];
+    _thread_pool.ParallelFor(draw_count, [&](size_t begin, size_t end, unsigned worker) {
+      _worker_recorded[worker] = begin < end;
+      if (begin == end) {
+        return;
+      }
+      ENGINE_PROFILE_SCOPE("record secondary command buffer");
+      VkCommandBufferInheritanceInfo inheritanceInfo{};
+      inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+      inheritanceInfo.renderPass = render_pass;
+      inheritanceInfo.subpass = 0;
+      // optional, lets the driver know the exact attachments.
+      inheritanceInfo.framebuffer = framebuffer;
+
+      VkCommandBufferBeginInfo beginInfo{};
+      beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+      beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+      VkCommandBuffer command_buffer = command_buffers[worker];
+      if (vkBeginCommandBuffer(command_buffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("failed to begin recording secondary command buffer!");
+      }
+      record(command_buffer, begin, end);
+      if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record secondary command buffer!");
+      }
+    });
+
+    _recorded.clear();
+    for (unsigned worker = 0; worker < command_buffers.size(); worker++) {
+      if (_worker_recorded[worker]) {
+        _recorded.push_back(command_buffers[worker]);
+      }
+    }
+    return _recorded;
+  }
+};
+} // VT
@@ -0,0 +1,143 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace VT {
+
+// vkGetPipelineCacheData always starts with a VkPipelineCacheHeaderVersionOne,
+// 32 bytes: header size, header version, vendor id, device id and uuid.
+const size_t PIPELINE_CACHE_HEADER_SIZE = 16 + VK_UUID_SIZE;
+
+/**
+ * @brief Checks that cache data was written by this driver and device.
+ * @details Drivers are required to reject incompatible data themselves, but
+ * some crash or silently misbehave on it, so we never hand them a cache from
+ * another gpu or driver version.
+ */
+bool IsPipelineCacheCompatible(const std::vector<char>& data, const VkPhysicalDeviceProperties& properties) {
+  if (data.size() < PIPELINE_CACHE_HEADER_SIZE) {
+    return false;
+  }
+
+  uint32_t header[4];
+  memcpy(header, data.data(), sizeof(header));
+  const uint32_t header_size = header[0];
+  const uint32_t header_version = header[1];
+  const uint32_t vendor_id = header[2];
+  const uint32_t device_id = header[3];
+
+  return header_size >= PIPELINE_CACHE_HEADER_SIZE &&
+         header_size <= data.size() &&
+         header_version == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         vendor_id == properties.vendorID &&
+         device_id == properties.deviceID &&
+         memcmp(data.data() + 16, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+/**
+ * @brief Whether cache already holds pipeline data, from disk or an earlier
+ * creation in this run: anything it would save beyond the header.
+ */
+bool IsPipelineCacheWarm(VkDevice device, VkPipelineCache cache) {
+  size_t size = 0;
+  vkGetPipelineCacheData(device, cache, &size, nullptr);
+  return size > PIPELINE_CACHE_HEADER_SIZE;
+}
+
+/**
+ * @brief A VkPipelineCache shared by every pipeline creation, loaded from
+ * disk on construction and written back on destruction.
+ * @details Data from another device or driver version is discarded and the
+ * cache starts empty. The file is written to a temporary path and renamed
+ * so a crash while saving never leaves a truncated cache behind.
+ */
+class PipelineCache {
+  VkDevice _device;
+  VkPipelineCache _cache;
+  std::string _path;
+
+public:
+  PipelineCache(VkDevice device, VkPhysicalDevice physical_device, const std::string& path):
+    _device(device),
+    _path(path) {
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+    std::vector<char> data = read_cache_file();
+    if (!data.empty() && !IsPipelineCacheCompatible(data, properties)) {
+      std::cout << "pipeline cache " << _path << " is from another device or driver, starting empty" << std::endl;
+      data.clear();
+    }
+
+    VkPipelineCacheCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+    if (vkCreatePipelineCache(_device, &createInfo, nullptr, &_cache) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create pipeline cache!");
+    }
+    std::cout << "pipeline cache " << _path << ": " << data.size() << " bytes loaded" << std::endl;
+  }
+
+  ~PipelineCache() {
+    Save();
+    vkDestroyPipelineCache(_device, _cache, nullptr);
+  }
+
+  PipelineCache(const PipelineCache&) = delete;
+  PipelineCache& operator=(const PipelineCache&) = delete;
+
+  VkPipelineCache GetPipelineCache() const {
+    return _cache;
+  }
+
+  bool Save() const {
+    size_t size = 0;
+    if (vkGetPipelineCacheData(_device, _cache, &size, nullptr) != VK_SUCCESS || size == 0) {
+      return false;
+    }
+    std::vector<char> data(size);
+    if (vkGetPipelineCacheData(_device, _cache, &size, data.data()) != VK_SUCCESS) {
+      return false;
+    }
+
+    std::string tmp_path = _path + ".tmp";
+    {
+      std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+      if (!file.write(data.data(), static_cast<std::streamsize>(size))) {
+        std::cout << "failed to write pipeline cache " << _path << std::endl;
+        return false;
+      }
+    }
+    if (std::rename(tmp_path.c_str(), _path.c_str()) != 0) {
+      std::remove(tmp_path.c_str());
+      std::cout << "failed to write pipeline cache " << _path << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+private:
+  std::vector<char> read_cache_file() const {
+    std::ifstream file(_path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+      return {};
+    }
+    std::vector<char> data(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    if (!file.read(data.data(), static_cast<std::streamsize>(data.size()))) {
+      return {};
+    }
+    return data;
+  }
+};
+} // VT
@@ -10,10 +10,24 @@ namespace VT {
 struct QueueFamilyIndices {
   std::optional<uint32_t> graphicsFamily;
   std::optional<uint32_t> presentFamily;
+  // a family without graphics that can copy, ideally transfer only (the dma
+  // engine). Uploads run here so streaming does not compete with rendering.
+  std::optional<uint32_t> transferFamily;
+  // a compute family without graphics for async compute.
+  std::optional<uint32_t> computeFamily;
 
+  // transfer and compute are optional, the graphics queue can do both.
   bool IsComplete() {
     return graphicsFamily.has_value() && presentFamily.has_value();
   }
+
+  uint32_t GetTransferFamily() const {
+    return transferFamily.value_or(graphicsFamily.value());
+  }
+
+  uint32_t GetComputeFamily() const {
+    return computeFamily.value_or(graphicsFamily.value());
+  }
 };
 
 QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device, VkSurfaceKHR surface, QueueFamilyIndices& indices) {
@@ -24,26 +38,49 @@ QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device, VkSurfaceKHR surfa
   std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
   vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
-  int i = 0;
+  // every family has to be looked at to find the dedicated ones, so the
+  // first graphics and present families found are kept.
+  std::optional<uint32_t> transferWithCompute;
+  uint32_t i = 0;
   for (const auto& queueFamily : queueFamilies) {
-    if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+    const VkQueueFlags flags = queueFamily.queueFlags;
+    if ((flags & VK_QUEUE_GRAPHICS_BIT) && !indices.graphicsFamily.has_value()) {
       indices.graphicsFamily = i;
     }
 
+    // headless (no surface): nothing is presented, the graphics queue
+    // stands in for the present queue.
     VkBool32 presentSupport = false;
-    vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+    if (surface != VK_NULL_HANDLE) {
+      vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+    } else {
+      presentSupport = (flags & VK_QUEUE_GRAPHICS_BIT) != 0;
+    }
 
-    if (presentSupport) {
+    if (presentSupport && !indices.presentFamily.has_value()) {
       indices.presentFamily = i;
     }
 
-    if (indices.IsComplete()) {
-      break;
+    if (!(flags & VK_QUEUE_GRAPHICS_BIT)) {
+      // graphics and compute queues support transfers implicitly, the
+      // transfer bit is only required on transfer only families.
+      if ((flags & VK_QUEUE_COMPUTE_BIT) && !indices.computeFamily.has_value()) {
+        indices.computeFamily = i;
+        transferWithCompute = i;
+      } else if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & VK_QUEUE_COMPUTE_BIT) && !indices.transferFamily.has_value()) {
+        indices.transferFamily = i;
+      }
     }
 
     i++;
   }
 
+  // no transfer only family, an async compute family still takes the
+  // uploads off the graphics queue.
+  if (!indices.transferFamily.has_value()) {
+    indices.transferFamily = transferWithCompute;
+  }
+
   return indices;
 }
 
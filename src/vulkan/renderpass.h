@@ -11,6 +11,15 @@ struct RenderPassOptions {
   VkFormat swapchain_image_format;
   VkDevice device;
   VkPhysicalDevice physical_device;
+  // layout the color attachment is left in, TRANSFER_SRC_OPTIMAL when it is
+  // read back instead of presented.
+  VkImageLayout final_layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  // keeps the depth attachment after the pass, to be read by compute.
+  bool store_depth = false;
+  // continues the color and depth of a pass that left them in
+  // COLOR_ATTACHMENT_OPTIMAL and DEPTH_STENCIL_ATTACHMENT_OPTIMAL instead of
+  // clearing them.
+  bool load_attachments = false;
 };
 
 VkFormat find_depth_format(VkPhysicalDevice physical_device);
@@ -37,11 +46,14 @@ VkRenderPass CreateRenderPass(RenderPassOptions& options) {
   colorAttachment.format = options.swapchain_image_format;
   colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
   // The loadOp and storeOp determine what to do with the data in the attachment
-  // before rendering and after rendering.
+  // before rendering and after rendering. Clearing keeps the contents of an image whose
+  // previous layout is UNDEFINED well defined (read back frames are compared).
+  colorAttachment.loadOp = options.load_attachments ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+  colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
   colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  colorAttachment.initialLayout = options.load_attachments ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+  colorAttachment.finalLayout = options.final_layout;
 
   VkAttachmentReference colorAttachmentRef{};
   // which attachment to reference by its index in the attachment descriptions array.
@@ -54,11 +66,11 @@ VkRenderPass CreateRenderPass(RenderPassOptions& options) {
   VkAttachmentDescription depthAttachment{};
   depthAttachment.format = find_depth_format(options.physical_device);
   depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-  depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-  depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  depthAttachment.loadOp = options.load_attachments ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+  depthAttachment.storeOp = options.store_depth ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
   depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  depthAttachment.initialLayout = options.load_attachments ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
   depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
   VkAttachmentReference depthAttachmentRef{};
@@ -92,7 +104,27 @@ VkRenderPass CreateRenderPass(RenderPassOptions& options) {
   // (and allowed): when we want to start writing colors to it.
   dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
   dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  if (options.load_attachments) {
+    // the attachments written by the pass before are read and written again.
+    dependency.srcStageMask |= VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependency.dstStageMask |= VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependency.dstAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+  }
+
+
+  // A color attachment that is copied out after the render pass needs its writes (and
+  // the transition to the final layout) to be visible to the transfer that reads it.
+  VkSubpassDependency readbackDependency{};
+  readbackDependency.srcSubpass = 0;
+  readbackDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+  readbackDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  readbackDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  readbackDependency.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+  readbackDependency.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
 
+  std::array<VkSubpassDependency, 2> dependencies = {dependency, readbackDependency};
+  const uint32_t dependencyCount = options.final_layout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL ? 2 : 1;
 
   // A subpass can only use a single depth stencil attchment
   std::array<VkAttachmentDescription, 2> attachments = {colorAttachment, depthAttachment};
@@ -103,8 +135,8 @@ VkRenderPass CreateRenderPass(RenderPassOptions& options) {
   render_pass_info.pAttachments = attachments.data();
   render_pass_info.subpassCount = 1;
   render_pass_info.pSubpasses = &subpass;
-  render_pass_info.dependencyCount = 1;
-  render_pass_info.pDependencies = &dependency;
+  render_pass_info.dependencyCount = dependencyCount;
+  render_pass_info.pDependencies = dependencies.data();
 
 
   if (vkCreateRenderPass(options.device, &render_pass_info, nullptr, &render_pass) != VK_SUCCESS) {
@@ -119,7 +151,8 @@ VkFormat find_depth_format(const VkPhysicalDevice physical_device) {
     physical_device,
     {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
     VK_IMAGE_TILING_OPTIMAL,
-    VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
+    // sampled by the depth pyramid.
+    VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT
   );
 }
 
@@ -0,0 +1,226 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "bounds.h"
+#include "vertex.h"
+
+namespace VT {
+
+// index into the meshes of a VT::Scene.
+using MeshHandle = uint32_t;
+
+/**
+ * @brief A mesh as a range of the shared vertex and index buffers.
+ */
+struct SceneMesh {
+  uint32_t first_index;
+  uint32_t index_count;
+  // added to every index, where the mesh's vertices start in the vertex buffer.
+  int32_t vertex_offset;
+  // takes positions as read from the vertex buffer to model space, see
+  // GetMeshVertexTransform.
+  glm::mat4 vertex_transform;
+  // model space, see Model::GetBounds.
+  MeshBounds bounds;
+};
+
+/**
+ * @brief The instances of one mesh, contiguous in the instance buffer.
+ */
+struct DrawBatch {
+  MeshHandle mesh;
+  uint32_t first_instance;
+  uint32_t instance_count;
+};
+
+/**
+ * @brief The arguments of one vkCmdDrawIndexed and the dynamic offset of its
+ * uniform data.
+ */
+struct DrawCommand {
+  uint32_t index_count;
+  uint32_t instance_count;
+  uint32_t first_index;
+  int32_t vertex_offset;
+  uint32_t first_instance;
+  uint32_t uniform_offset;
+};
+
+/**
+ * @brief Meshes and the instances placed in the world.
+ * @details Instance transforms are kept as a structure of arrays (one array
+ * per field instead of one struct per instance), so passes that only need
+ * positions, e.g. culling, stream through exactly the data they read. The
+ * model matrices are only assembled in BuildBatches, straight into the
+ * instance buffer, with the instances of a mesh next to each other so each
+ * mesh is a single instanced draw no matter how many instances it has.
+ * Every instance also has a world space bounding sphere, kept up to date as
+ * the instance moves, for culling (see VT::FrustumCuller).
+ */
+class Scene {
+  std::vector<SceneMesh> _meshes;
+
+  // one element per instance in each array.
+  std::vector<MeshHandle> _instance_mesh;
+  std::vector<glm::vec3> _positions;
+  std::vector<glm::quat> _rotations;
+  std::vector<glm::vec3> _scales;
+  BoundingSpheres _bounds;
+
+public:
+  MeshHandle AddMesh(const SceneMesh& mesh) {
+    _meshes.push_back(mesh);
+    return static_cast<MeshHandle>(_meshes.size() - 1);
+  }
+
+  /**
+   * @return The index of the instance, stable for the lifetime of the scene.
+   */
+  uint32_t AddInstance(
+      MeshHandle mesh,
+      const glm::vec3& position,
+      const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+      const glm::vec3& scale = glm::vec3(1.0f)) {
+    if (mesh >= _meshes.size()) {
+      throw std::runtime_error("failed to add instance, unknown mesh!");
+    }
+    _instance_mesh.push_back(mesh);
+    _positions.push_back(position);
+    _rotations.push_back(rotation);
+    _scales.push_back(scale);
+    _bounds.push_back(glm::vec3(0.0f), 0.0f);
+    uint32_t instance = static_cast<uint32_t>(_instance_mesh.size() - 1);
+    update_bounds(instance);
+    return instance;
+  }
+
+  void SetPosition(uint32_t instance, const glm::vec3& position) {
+    _positions[instance] = position;
+    update_bounds(instance);
+  }
+
+  void SetRotation(uint32_t instance, const glm::quat& rotation) {
+    _rotations[instance] = rotation;
+    update_bounds(instance);
+  }
+
+  void SetScale(uint32_t instance, const glm::vec3& scale) {
+    _scales[instance] = scale;
+    update_bounds(instance);
+  }
+
+  size_t GetMeshCount() const {
+    return _meshes.size();
+  }
+
+  const SceneMesh& GetMesh(MeshHandle mesh) const {
+    return _meshes[mesh];
+  }
+
+  size_t GetInstanceCount() const {
+    return _instance_mesh.size();
+  }
+
+  MeshHandle GetInstanceMesh(uint32_t instance) const {
+    return _instance_mesh[instance];
+  }
+
+  const glm::vec3* GetPositions() const {
+    return _positions.data();
+  }
+
+  const glm::quat* GetRotations() const {
+    return _rotations.data();
+  }
+
+  const glm::vec3* GetScales() const {
+    return _scales.data();
+  }
+
+  // world space bounding sphere of every instance, indexed by instance.
+  const BoundingSpheres& GetBounds() const {
+    return _bounds;
+  }
+
+  // translation * rotation * scale, takes model space to world space.
+  glm::mat4 GetInstanceTransform(uint32_t instance) const {
+    glm::mat3 rotation = glm::mat3_cast(_rotations[instance]);
+    const glm::vec3& scale = _scales[instance];
+    glm::mat4 transform(1.0f);
+    transform[0] = glm::vec4(rotation[0] * scale.x, 0.0f);
+    transform[1] = glm::vec4(rotation[1] * scale.y, 0.0f);
+    transform[2] = glm::vec4(rotation[2] * scale.z, 0.0f);
+    transform[3] = glm::vec4(_positions[instance], 1.0f);
+    return transform;
+  }
+
+  // the instance transform * the mesh's vertex transform.
+  glm::mat4 GetModelMatrix(uint32_t instance) const {
+    return GetInstanceTransform(instance) * _meshes[_instance_mesh[instance]].vertex_transform;
+  }
+
+  /**
+   * @brief Writes the model matrix of every instance, or only of the
+   * instances listed in visible, to instances (room for as many) grouped by
+   * mesh, and one batch per mesh that has instances.
+   * @details A counting sort: one pass counts the instances of each mesh,
+   * which gives every mesh its first instance, a second pass writes each
+   * instance to the next free slot of its mesh. Linear in the instances and
+   * keeps their relative order within a mesh.
+   * @param instance_ids when given (room for as many), receives the index of
+   * the scene instance written to each slot of instances.
+   */
+  void BuildBatches(InstanceData* instances, std::vector<DrawBatch>& batches, const std::vector<uint32_t>* visible = nullptr, uint32_t* instance_ids = nullptr) const {
+    std::vector<uint32_t> next(_meshes.size(), 0);
+    size_t count = visible ? visible->size() : _instance_mesh.size();
+    auto instance_at = [visible](size_t i) {
+      return visible ? (*visible)[i] : static_cast<uint32_t>(i);
+    };
+    for (size_t i = 0; i < count; i++) {
+      next[_instance_mesh[instance_at(i)]]++;
+    }
+
+    batches.clear();
+    uint32_t first_instance = 0;
+    for (MeshHandle mesh = 0; mesh < _meshes.size(); mesh++) {
+      uint32_t mesh_instances = next[mesh];
+      next[mesh] = first_instance;
+      if (mesh_instances > 0) {
+        batches.push_back(DrawBatch{mesh, first_instance, mesh_instances});
+      }
+      first_instance += mesh_instances;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+      uint32_t instance = instance_at(i);
+      uint32_t slot = next[_instance_mesh[instance]]++;
+      instances[slot].model = GetModelMatrix(instance);
+      if (instance_ids != nullptr) {
+        instance_ids[slot] = instance;
+      }
+    }
+  }
+
+private:
+  // the mesh's sphere moved by the instance transform, the radius grows with
+  // the largest scale so the sphere stays conservative under non uniform scale.
+  void update_bounds(uint32_t instance) {
+    const MeshBounds& mesh_bounds = _meshes[_instance_mesh[instance]].bounds;
+    const glm::vec3& scale = _scales[instance];
+    glm::vec3 center = glm::mat3_cast(_rotations[instance]) * (mesh_bounds.center * scale) + _positions[instance];
+    float max_scale = std::max(std::fabs(scale.x), std::max(std::fabs(scale.y), std::fabs(scale.z)));
+    _bounds.set(instance, center, mesh_bounds.radius * max_scale);
+  }
+};
+} // VT
@@ -0,0 +1,585 @@
+#pragma once
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "frustum_culling.h"
+#include "scene.h"
+#include "thread_pool.h"
+#include "vertex.h"
+#include "vertex_dedup.h"
+#include "engine/private/profiler.h"
+
+namespace VT {
+
+// pixels of a tile of the occlusion buffer, a row of a tile is one AVX2
+// register (two SSE ones).
+const uint32_t OCCLUSION_TILE_WIDTH = 8;
+const uint32_t OCCLUSION_TILE_HEIGHT = 4;
+const uint32_t OCCLUSION_TILE_SIZE = OCCLUSION_TILE_WIDTH * OCCLUSION_TILE_HEIGHT;
+
+/**
+ * @brief A low poly stand in for a mesh when it occludes others, in model
+ * space.
+ */
+struct OccluderProxy {
+  std::vector<glm::vec3> positions;
+  std::vector<uint32_t> indices;
+};
+
+/**
+ * @brief Keeps the max_triangles largest triangles of a mesh, e.g. the
+ * output of LoadModel, as its occluder proxy.
+ * @details Every triangle of the proxy is a triangle of the mesh, so the
+ * proxy never hides anything the mesh would not. A few large triangles
+ * (walls, floors, the big faces of a building) do most of the occluding at a
+ * fraction of the cost. Degenerate triangles are dropped, on equal areas the
+ * earlier triangle is kept, and the kept ones stay in mesh order.
+ */
+OccluderProxy BuildOccluderProxy(const Vertex* vertices, size_t vertex_count, const uint32_t* indices, size_t index_count, size_t max_triangles) {
+  // twice the area squared, only compared.
+  std::vector<std::pair<float, uint32_t>> triangles;
+  for (size_t t = 0; t + 2 < index_count; t += 3) {
+    const glm::vec3& a = vertices[indices[t]].pos;
+    glm::vec3 normal = glm::cross(vertices[indices[t + 1]].pos - a, vertices[indices[t + 2]].pos - a);
+    float area = glm::dot(normal, normal);
+    if (area > 0.0f) {
+      triangles.push_back({area, static_cast<uint32_t>(t / 3)});
+    }
+  }
+  std::sort(triangles.begin(), triangles.end(), [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) {
+    return a.first != b.first ? a.first > b.first : a.second < b.second;
+  });
+  triangles.resize(std::min(triangles.size(), max_triangles));
+  std::sort(triangles.begin(), triangles.end(), [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) {
+    return a.second < b.second;
+  });
+
+  OccluderProxy proxy;
+  std::vector<uint32_t> remap(vertex_count, std::numeric_limits<uint32_t>::max());
+  for (const auto& triangle : triangles) {
+    for (uint32_t corner = 0; corner < 3; corner++) {
+      uint32_t vertex = indices[triangle.second * 3 + corner];
+      if (remap[vertex] == std::numeric_limits<uint32_t>::max()) {
+        remap[vertex] = static_cast<uint32_t>(proxy.positions.size());
+        proxy.positions.push_back(vertices[vertex].pos);
+      }
+      proxy.indices.push_back(remap[vertex]);
+    }
+  }
+  return proxy;
+}
+
+/**
+ * @brief A triangle of an occluder in occlusion buffer pixels, counter
+ * clockwise in the buffer, set up for the rasterizer.
+ */
+struct OccluderTriangle {
+  // the pixels to visit, [min, max).
+  int32_t min_x;
+  int32_t min_y;
+  int32_t max_x;
+  int32_t max_y;
+  // edge i goes from vertex i to vertex i + 1. A pixel center p is covered
+  // when edge_a[i] * (p.y - y[i]) - edge_b[i] * (p.x - x[i]) > 0 for every
+  // edge, pixels on an edge are not, which leaves the triangle conservative.
+  float x[3];
+  float y[3];
+  float edge_a[3];
+  float edge_b[3];
+  // the depth at p is z0 + (dzdx * (p.x - x[0]) + dzdy * (p.y - y[0])).
+  float z0;
+  float dzdx;
+  float dzdy;
+};
+
+/**
+ * @brief A low resolution depth buffer that occluders are rasterized into
+ * on the cpu and occludee bounds are tested against.
+ * @details The pixels are stored in tiles of 8x4, a tile row is one SIMD
+ * register, and every tile also keeps the farthest depth of its pixels, so
+ * a test reads one value per tile instead of 32 pixels. A pixel no occluder
+ * covers stays at the far plane (1), so occludees are only culled behind
+ * pixels that are really covered. The rasterizer evaluates the edge
+ * functions and the depth plane for a whole tile row at once and keeps the
+ * nearer depth where the coverage mask is set, with the same operations in
+ * the scalar, SSE and AVX2 paths so all three produce the same buffer.
+ *
+ * RasterizeTriangle and UpdateTileMax only touch the given rows of tiles,
+ * threads working on different rows need no locking.
+ */
+class OcclusionBuffer {
+  uint32_t _width;
+  uint32_t _height;
+  uint32_t _tiles_x;
+  uint32_t _tiles_y;
+  CullPath _path;
+  // OCCLUSION_TILE_SIZE floats per tile, row major tiles.
+  std::vector<float> _depth;
+  std::vector<float> _tile_max;
+
+public:
+  OcclusionBuffer(uint32_t width, uint32_t height, CullPath path = GetDefaultCullPath()): _width(width), _height(height), _path(path) {
+    if (width == 0 || height == 0 || width % OCCLUSION_TILE_WIDTH != 0 || height % OCCLUSION_TILE_HEIGHT != 0) {
+      throw std::runtime_error("failed to create occlusion buffer, its size has to be a multiple of the tile size!");
+    }
+    _tiles_x = width / OCCLUSION_TILE_WIDTH;
+    _tiles_y = height / OCCLUSION_TILE_HEIGHT;
+    _depth.assign(static_cast<size_t>(_tiles_x) * _tiles_y * OCCLUSION_TILE_SIZE, 1.0f);
+    _tile_max.assign(static_cast<size_t>(_tiles_x) * _tiles_y, 1.0f);
+  }
+
+  uint32_t GetWidth() const {
+    return _width;
+  }
+
+  uint32_t GetHeight() const {
+    return _height;
+  }
+
+  uint32_t GetTilesY() const {
+    return _tiles_y;
+  }
+
+  CullPath GetPath() const {
+    return _path;
+  }
+
+  float GetDepth(uint32_t x, uint32_t y) const {
+    size_t tile = static_cast<size_t>(y / OCCLUSION_TILE_HEIGHT) * _tiles_x + x / OCCLUSION_TILE_WIDTH;
+    return _depth[tile * OCCLUSION_TILE_SIZE + (y % OCCLUSION_TILE_HEIGHT) * OCCLUSION_TILE_WIDTH + x % OCCLUSION_TILE_WIDTH];
+  }
+
+  /**
+   * @brief Projects a triangle given in clip space (as for VT::ExtractFrustum)
+   * into the buffer.
+   * @return False when there is nothing to rasterize: the triangle is
+   * degenerate, outside the buffer or crosses the near plane. Dropping the
+   * latter only loses occlusion, it never hides anything.
+   */
+  bool SetupTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c, OccluderTriangle& triangle) const {
+    const glm::vec4* clip[3] = {&a, &b, &c};
+    float x[3], y[3], z[3];
+    for (int i = 0; i < 3; i++) {
+      if (!(clip[i]->w > 0.0f) || clip[i]->z < 0.0f) {
+        return false;
+      }
+      float inverse_w = 1.0f / clip[i]->w;
+      x[i] = (clip[i]->x * inverse_w * 0.5f + 0.5f) * _width;
+      y[i] = (clip[i]->y * inverse_w * 0.5f + 0.5f) * _height;
+      z[i] = clip[i]->z * inverse_w;
+    }
+
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+    if (!std::isfinite(area) || area == 0.0f) {
+      return false;
+    }
+    if (area < 0.0f) {
+      std::swap(x[1], x[2]);
+      std::swap(y[1], y[2]);
+      std::swap(z[1], z[2]);
+      area = -area;
+    }
+
+    float min_x = std::max(0.0f, std::floor(std::min(x[0], std::min(x[1], x[2]))));
+    float min_y = std::max(0.0f, std::floor(std::min(y[0], std::min(y[1], y[2]))));
+    float max_x = std::min(static_cast<float>(_width), std::ceil(std::max(x[0], std::max(x[1], x[2]))));
+    float max_y = std::min(static_cast<float>(_height), std::ceil(std::max(y[0], std::max(y[1], y[2]))));
+    if (min_x >= max_x || min_y >= max_y) {
+      return false;
+    }
+    triangle.min_x = static_cast<int32_t>(min_x);
+    triangle.min_y = static_cast<int32_t>(min_y);
+    triangle.max_x = static_cast<int32_t>(max_x);
+    triangle.max_y = static_cast<int32_t>(max_y);
+
+    for (int i = 0; i < 3; i++) {
+      int next = (i + 1) % 3;
+      triangle.x[i] = x[i];
+      triangle.y[i] = y[i];
+      triangle.edge_a[i] = x[next] - x[i];
+      triangle.edge_b[i] = y[next] - y[i];
+    }
+    float dx1 = x[1] - x[0], dy1 = y[1] - y[0], dz1 = z[1] - z[0];
+    float dx2 = x[2] - x[0], dy2 = y[2] - y[0], dz2 = z[2] - z[0];
+    triangle.z0 = z[0];
+    triangle.dzdx = (dz1 * dy2 - dz2 * dy1) / area;
+    triangle.dzdy = (dx1 * dz2 - dx2 * dz1) / area;
+    return true;
+  }
+
+  // resets the pixels of tile rows [tile_row_begin, tile_row_end) to the far plane.
+  void ClearTileRows(uint32_t tile_row_begin, uint32_t tile_row_end) {
+    std::fill(_depth.begin() + static_cast<size_t>(tile_row_begin) * _tiles_x * OCCLUSION_TILE_SIZE,
+              _depth.begin() + static_cast<size_t>(tile_row_end) * _tiles_x * OCCLUSION_TILE_SIZE, 1.0f);
+  }
+
+  // rasterizes the part of triangle in tile rows [tile_row_begin, tile_row_end).
+  void RasterizeTriangle(const OccluderTriangle& triangle, uint32_t tile_row_begin, uint32_t tile_row_end) {
+    uint32_t first_row = std::max(tile_row_begin, static_cast<uint32_t>(triangle.min_y) / OCCLUSION_TILE_HEIGHT);
+    uint32_t last_row = std::min(tile_row_end, static_cast<uint32_t>(triangle.max_y - 1) / OCCLUSION_TILE_HEIGHT + 1);
+    uint32_t first_column = static_cast<uint32_t>(triangle.min_x) / OCCLUSION_TILE_WIDTH;
+    uint32_t last_column = static_cast<uint32_t>(triangle.max_x - 1) / OCCLUSION_TILE_WIDTH + 1;
+    if (first_row >= last_row) {
+      return;
+    }
+#ifdef VT_CULL_X86
+    if (_path == CullPath::AVX2 && IsCullPathSupported(CullPath::AVX2)) {
+      rasterize_avx2(triangle, first_row, last_row, first_column, last_column);
+      return;
+    }
+    if (_path == CullPath::SSE || _path == CullPath::AVX2) {
+      rasterize_sse(triangle, first_row, last_row, first_column, last_column);
+      return;
+    }
+#endif
+    rasterize_scalar(triangle, first_row, last_row, first_column, last_column);
+  }
+
+  // the farthest depth of every tile in rows [tile_row_begin, tile_row_end),
+  // after the rows were rasterized.
+  void UpdateTileMax(uint32_t tile_row_begin, uint32_t tile_row_end) {
+    for (size_t tile = static_cast<size_t>(tile_row_begin) * _tiles_x; tile < static_cast<size_t>(tile_row_end) * _tiles_x; tile++) {
+      const float* depth = &_depth[tile * OCCLUSION_TILE_SIZE];
+      _tile_max[tile] = *std::max_element(depth, depth + OCCLUSION_TILE_SIZE);
+    }
+  }
+
+  /**
+   * @brief Tests the cube around a bounding sphere (world space, view_proj
+   * as for VT::ExtractFrustum) against the farthest depth of every tile
+   * under its screen rectangle.
+   * @return False only when every tile is nearer than the cube's nearest
+   * point. Cubes that cross the near plane or lie off screen are visible,
+   * the latter are the frustum culler's.
+   */
+  bool IsVisible(const glm::vec3& center, float radius, const glm::mat4& view_proj) const {
+    glm::vec2 lo(std::numeric_limits<float>::max());
+    glm::vec2 hi(-std::numeric_limits<float>::max());
+    float nearest = std::numeric_limits<float>::max();
+    for (int i = 0; i < 8; i++) {
+      glm::vec3 corner = center + radius * glm::vec3((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f);
+      glm::vec4 clip = view_proj * glm::vec4(corner, 1.0f);
+      if (!(clip.w > 0.0f) || clip.z < 0.0f) {
+        return true;
+      }
+      glm::vec3 ndc = glm::vec3(clip) / clip.w;
+      lo = glm::min(lo, glm::vec2(ndc));
+      hi = glm::max(hi, glm::vec2(ndc));
+      nearest = std::min(nearest, ndc.z);
+    }
+    if (hi.x < -1.0f || lo.x > 1.0f || hi.y < -1.0f || lo.y > 1.0f) {
+      return true;
+    }
+
+    auto to_pixel = [](float ndc, uint32_t size) {
+      float pixel = std::floor((ndc * 0.5f + 0.5f) * size);
+      return static_cast<uint32_t>(std::min(std::max(pixel, 0.0f), static_cast<float>(size - 1)));
+    };
+    uint32_t first_column = to_pixel(lo.x, _width) / OCCLUSION_TILE_WIDTH;
+    uint32_t last_column = to_pixel(hi.x, _width) / OCCLUSION_TILE_WIDTH;
+    uint32_t first_row = to_pixel(lo.y, _height) / OCCLUSION_TILE_HEIGHT;
+    uint32_t last_row = to_pixel(hi.y, _height) / OCCLUSION_TILE_HEIGHT;
+    for (uint32_t row = first_row; row <= last_row; row++) {
+      for (uint32_t column = first_column; column <= last_column; column++) {
+        if (_tile_max[static_cast<size_t>(row) * _tiles_x + column] >= nearest) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+private:
+  float* tile_depth(uint32_t row, uint32_t column) {
+    return &_depth[(static_cast<size_t>(row) * _tiles_x + column) * OCCLUSION_TILE_SIZE];
+  }
+
+  void rasterize_scalar(const OccluderTriangle& triangle, uint32_t first_row, uint32_t last_row, uint32_t first_column, uint32_t last_column) {
+    for (uint32_t row = first_row; row < last_row; row++) {
+      for (uint32_t column = first_column; column < last_column; column++) {
+        float* depth = tile_depth(row, column);
+        for (uint32_t y = 0; y < OCCLUSION_TILE_HEIGHT; y++) {
+          float py = static_cast<float>(row * OCCLUSION_TILE_HEIGHT + y) + 0.5f;
+          for (uint32_t x = 0; x < OCCLUSION_TILE_WIDTH; x++) {
+            float px = static_cast<float>(column * OCCLUSION_TILE_WIDTH) + (static_cast<float>(x) + 0.5f);
+            bool covered = true;
+            for (int e = 0; e < 3; e++) {
+              covered &= triangle.edge_a[e] * (py - triangle.y[e]) - triangle.edge_b[e] * (px - triangle.x[e]) > 0.0f;
+            }
+            float z = triangle.z0 + (triangle.dzdx * (px - triangle.x[0]) + triangle.dzdy * (py - triangle.y[0]));
+            float& pixel = depth[y * OCCLUSION_TILE_WIDTH + x];
+            if (covered && z < pixel) {
+              pixel = z;
+            }
+          }
+        }
+      }
+    }
+  }
+
+#ifdef VT_CULL_X86
+  void rasterize_sse(const OccluderTriangle& triangle, uint32_t first_row, uint32_t last_row, uint32_t first_column, uint32_t last_column) {
+    __m128 a[3], b[3], x[3], y[3];
+    for (int e = 0; e < 3; e++) {
+      a[e] = _mm_set1_ps(triangle.edge_a[e]);
+      b[e] = _mm_set1_ps(triangle.edge_b[e]);
+      x[e] = _mm_set1_ps(triangle.x[e]);
+      y[e] = _mm_set1_ps(triangle.y[e]);
+    }
+    const __m128 z0 = _mm_set1_ps(triangle.z0);
+    const __m128 dzdx = _mm_set1_ps(triangle.dzdx);
+    const __m128 dzdy = _mm_set1_ps(triangle.dzdy);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 offsets[2] = {_mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f), _mm_setr_ps(4.5f, 5.5f, 6.5f, 7.5f)};
+
+    for (uint32_t row = first_row; row < last_row; row++) {
+      for (uint32_t ty = 0; ty < OCCLUSION_TILE_HEIGHT; ty++) {
+        __m128 py = _mm_set1_ps(static_cast<float>(row * OCCLUSION_TILE_HEIGHT + ty) + 0.5f);
+        // the terms that only depend on the row.
+        __m128 edge_row[3];
+        for (int e = 0; e < 3; e++) {
+          edge_row[e] = _mm_mul_ps(a[e], _mm_sub_ps(py, y[e]));
+        }
+        __m128 z_row = _mm_mul_ps(dzdy, _mm_sub_ps(py, y[0]));
+
+        for (uint32_t column = first_column; column < last_column; column++) {
+          float* depth = tile_depth(row, column) + ty * OCCLUSION_TILE_WIDTH;
+          __m128 column_x = _mm_set1_ps(static_cast<float>(column * OCCLUSION_TILE_WIDTH));
+          for (int half = 0; half < 2; half++) {
+            __m128 px = _mm_add_ps(column_x, offsets[half]);
+            __m128 covered = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int e = 0; e < 3; e++) {
+              __m128 edge = _mm_sub_ps(edge_row[e], _mm_mul_ps(b[e], _mm_sub_ps(px, x[e])));
+              covered = _mm_and_ps(covered, _mm_cmpgt_ps(edge, zero));
+            }
+            __m128 z = _mm_add_ps(z0, _mm_add_ps(_mm_mul_ps(dzdx, _mm_sub_ps(px, x[0])), z_row));
+            __m128 pixels = _mm_loadu_ps(depth + half * 4);
+            __m128 nearer = _mm_and_ps(covered, _mm_cmplt_ps(z, pixels));
+            // no blendv before SSE4.1.
+            _mm_storeu_ps(depth + half * 4, _mm_or_ps(_mm_and_ps(nearer, z), _mm_andnot_ps(nearer, pixels)));
+          }
+        }
+      }
+    }
+  }
+
+  __attribute__((target("avx2")))
+  void rasterize_avx2(const OccluderTriangle& triangle, uint32_t first_row, uint32_t last_row, uint32_t first_column, uint32_t last_column) {
+    __m256 a[3], b[3], x[3], y[3];
+    for (int e = 0; e < 3; e++) {
+      a[e] = _mm256_set1_ps(triangle.edge_a[e]);
+      b[e] = _mm256_set1_ps(triangle.edge_b[e]);
+      x[e] = _mm256_set1_ps(triangle.x[e]);
+      y[e] = _mm256_set1_ps(triangle.y[e]);
+    }
+    const __m256 z0 = _mm256_set1_ps(triangle.z0);
+    const __m256 dzdx = _mm256_set1_ps(triangle.dzdx);
+    const __m256 dzdy = _mm256_set1_ps(triangle.dzdy);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 offsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+
+    for (uint32_t row = first_row; row < last_row; row++) {
+      for (uint32_t ty = 0; ty < OCCLUSION_TILE_HEIGHT; ty++) {
+        __m256 py = _mm256_set1_ps(static_cast<float>(row * OCCLUSION_TILE_HEIGHT + ty) + 0.5f);
+        __m256 edge_row[3];
+        for (int e = 0; e < 3; e++) {
+          edge_row[e] = _mm256_mul_ps(a[e], _mm256_sub_ps(py, y[e]));
+        }
+        __m256 z_row = _mm256_mul_ps(dzdy, _mm256_sub_ps(py, y[0]));
+
+        for (uint32_t column = first_column; column < last_column; column++) {
+          float* depth = tile_depth(row, column) + ty * OCCLUSION_TILE_WIDTH;
+          __m256 px = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(column * OCCLUSION_TILE_WIDTH)), offsets);
+          __m256 covered = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+          for (int e = 0; e < 3; e++) {
+            // same operation order as the scalar path, no fma.
+            __m256 edge = _mm256_sub_ps(edge_row[e], _mm256_mul_ps(b[e], _mm256_sub_ps(px, x[e])));
+            covered = _mm256_and_ps(covered, _mm256_cmp_ps(edge, zero, _CMP_GT_OQ));
+          }
+          __m256 z = _mm256_add_ps(z0, _mm256_add_ps(_mm256_mul_ps(dzdx, _mm256_sub_ps(px, x[0])), z_row));
+          __m256 pixels = _mm256_loadu_ps(depth);
+          __m256 nearer = _mm256_and_ps(covered, _mm256_cmp_ps(z, pixels, _CMP_LT_OQ));
+          _mm256_storeu_ps(depth, _mm256_blendv_ps(pixels, z, nearer));
+        }
+      }
+    }
+  }
+#endif
+};
+
+struct SoftwareOcclusionOptions {
+  // size of the occlusion buffer, multiples of 8x4.
+  uint32_t width = 320;
+  uint32_t height = 192;
+  // 0 uses every core.
+  unsigned thread_count = 0;
+  CullPath path = GetDefaultCullPath();
+};
+
+struct SoftwareOcclusionStats {
+  // occluder instances and their triangles that reached the buffer.
+  size_t occluders;
+  size_t triangles;
+  size_t tested;
+  size_t occluded;
+  double rasterize_ms;
+  double test_ms;
+};
+
+/**
+ * @brief Removes the instances of a VT::Scene that are hidden behind
+ * occluders before their draws are built, on the cpu, so they never reach
+ * the command buffer.
+ * @details Meshes are made occluders with SetOccluder. Every frame Cull
+ * rasterizes all instances of occluder meshes into an VT::OcclusionBuffer,
+ * then tests the bounding sphere of every candidate (usually what a
+ * VT::FrustumCuller kept) against it. Both steps run on the culler's worker
+ * threads: the occluder triangles are set up in parallel over instances,
+ * then every worker rasterizes all of them into its own rows of tiles, and
+ * the candidates are tested in parallel. The result does not depend on the
+ * number of threads.
+ */
+class SoftwareOcclusionCuller {
+  OcclusionBuffer _buffer;
+  ThreadPool _thread_pool;
+  // by mesh, meshes without triangles are no occluders.
+  std::vector<OccluderProxy> _proxies;
+  // per worker, reused every frame.
+  std::vector<std::vector<glm::vec4>> _clip_positions;
+  std::vector<std::vector<OccluderTriangle>> _triangles;
+  std::vector<size_t> _occluders;
+  // one per candidate, not a vector<bool> so workers can write their own.
+  std::vector<uint8_t> _visible_flags;
+  std::vector<uint32_t> _visible;
+  SoftwareOcclusionStats _stats{0, 0, 0, 0, 0.0, 0.0};
+
+public:
+  SoftwareOcclusionCuller(const SoftwareOcclusionOptions& options = {}):
+    _buffer(options.width, options.height, options.path),
+    _thread_pool(options.thread_count == 0 ? DefaultThreadCount() : options.thread_count),
+    _clip_positions(_thread_pool.GetThreadCount()),
+    _triangles(_thread_pool.GetThreadCount()),
+    _occluders(_thread_pool.GetThreadCount(), 0) {}
+
+  // every instance of mesh is rasterized into the buffer with proxy's triangles.
+  void SetOccluder(MeshHandle mesh, OccluderProxy proxy) {
+    if (mesh >= _proxies.size()) {
+      _proxies.resize(mesh + 1);
+    }
+    _proxies[mesh] = std::move(proxy);
+  }
+
+  /**
+   * @brief view_proj maps world space to clip space, as for
+   * VT::FrustumCuller::Cull.
+   * @param candidates the instances to test, not the result of a previous Cull.
+   * @return The candidates that are not occluded, in the same order, valid
+   * until the next Cull.
+   */
+  const std::vector<uint32_t>& Cull(const Scene& scene, const glm::mat4& view_proj, const std::vector<uint32_t>& candidates) {
+    ENGINE_PROFILE_SCOPE("SoftwareOcclusionCuller::Cull");
+    auto start = std::chrono::high_resolution_clock::now();
+    rasterize_occluders(scene, view_proj);
+    auto test_start = std::chrono::high_resolution_clock::now();
+    _stats.rasterize_ms = std::chrono::duration<double, std::milli>(test_start - start).count();
+
+    const BoundingSpheres& bounds = scene.GetBounds();
+    _visible_flags.resize(candidates.size());
+    _thread_pool.ParallelFor(candidates.size(), [&](size_t begin, size_t end, unsigned) {
+      for (size_t i = begin; i < end; i++) {
+        uint32_t instance = candidates[i];
+        glm::vec3 center(bounds.x[instance], bounds.y[instance], bounds.z[instance]);
+        _visible_flags[i] = _buffer.IsVisible(center, bounds.radius[instance], view_proj) ? 1 : 0;
+      }
+    });
+    _visible.clear();
+    for (size_t i = 0; i < candidates.size(); i++) {
+      if (_visible_flags[i] != 0) {
+        _visible.push_back(candidates[i]);
+      }
+    }
+
+    _stats.tested = candidates.size();
+    _stats.occluded = candidates.size() - _visible.size();
+    _stats.test_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - test_start).count();
+    return _visible;
+  }
+
+  // the buffer as the last Cull left it.
+  const OcclusionBuffer& GetBuffer() const {
+    return _buffer;
+  }
+
+  const SoftwareOcclusionStats& GetStats() const {
+    return _stats;
+  }
+
+  unsigned GetThreadCount() const {
+    return _thread_pool.GetThreadCount();
+  }
+
+private:
+  void rasterize_occluders(const Scene& scene, const glm::mat4& view_proj) {
+    _thread_pool.ParallelFor(scene.GetInstanceCount(), [&](size_t begin, size_t end, unsigned worker) {
+      auto& clip = _clip_positions[worker];
+      auto& triangles = _triangles[worker];
+      triangles.clear();
+      _occluders[worker] = 0;
+      for (size_t i = begin; i < end; i++) {
+        uint32_t instance = static_cast<uint32_t>(i);
+        MeshHandle mesh = scene.GetInstanceMesh(instance);
+        if (mesh >= _proxies.size() || _proxies[mesh].indices.empty()) {
+          continue;
+        }
+        const OccluderProxy& proxy = _proxies[mesh];
+        glm::mat4 transform = view_proj * scene.GetInstanceTransform(instance);
+        clip.resize(proxy.positions.size());
+        for (size_t v = 0; v < proxy.positions.size(); v++) {
+          clip[v] = transform * glm::vec4(proxy.positions[v], 1.0f);
+        }
+        size_t triangle_count = triangles.size();
+        for (size_t t = 0; t + 2 < proxy.indices.size(); t += 3) {
+          OccluderTriangle triangle;
+          if (_buffer.SetupTriangle(clip[proxy.indices[t]], clip[proxy.indices[t + 1]], clip[proxy.indices[t + 2]], triangle)) {
+            triangles.push_back(triangle);
+          }
+        }
+        _occluders[worker] += triangles.size() > triangle_count ? 1 : 0;
+      }
+    });
+
+    // every worker rasterizes all triangles into its own rows of tiles.
+    _thread_pool.ParallelFor(_buffer.GetTilesY(), [&](size_t begin, size_t end, unsigned) {
+      uint32_t first_row = static_cast<uint32_t>(begin);
+      uint32_t last_row = static_cast<uint32_t>(end);
+      if (first_row == last_row) {
+        return;
+      }
+      _buffer.ClearTileRows(first_row, last_row);
+      for (const auto& triangles : _triangles) {
+        for (const OccluderTriangle& triangle : triangles) {
+          _buffer.RasterizeTriangle(triangle, first_row, last_row);
+        }
+      }
+      _buffer.UpdateTileMax(first_row, last_row);
+    });
+
+    _stats.occluders = 0;
+    _stats.triangles = 0;
+    for (size_t worker = 0; worker < _triangles.size(); worker++) {
+      _stats.occluders += _occluders[worker];
+      _stats.triangles += _triangles[worker].size();
+    }
+  }
+};
+} // VT
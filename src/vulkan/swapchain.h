@@ -6,6 +6,7 @@
 #include <vector>
 #include <memory>
 
+#include "frame_pacing.h"
 #include "image.h"
 #include "swapchain_utils.h"
 #include "vulkan.h"
@@ -13,19 +14,42 @@
 
 namespace VT {
 
+// color format of headless images, RGBA so read back frames can be written
+// out without swizzling.
+const VkFormat HEADLESS_IMAGE_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+
 class Swapchain {
-  VkSwapchainKHR _swapchain;
+  VkSwapchainKHR _swapchain = VK_NULL_HANDLE;
   std::vector<VkImage> _swapchain_images;
   std::vector<VkImageView> _swapchain_image_views;
   VkFormat _swapchain_image_format;
   VkExtent2D _swapchain_extent;
+  // VK_PRESENT_MODE_MAX_ENUM_KHR when headless.
+  VkPresentModeKHR _present_mode = VK_PRESENT_MODE_MAX_ENUM_KHR;
+  // headless: offscreen images owned by us instead of a VkSwapchainKHR.
+  std::vector<VT::Allocation> _offscreen_memory;
 
   const std::shared_ptr<VT::Vulkan> _instance;
 public:
   Swapchain(
       const std::shared_ptr<VT::Vulkan>& instance,
-      const std::unique_ptr<phx::Window>& window): _instance(instance) {
-    create_swapchain(window);
+      const std::unique_ptr<phx::Window>& window,
+      const VT::FramePacingPolicy& pacing,
+      VkSwapchainKHR old_swapchain = VK_NULL_HANDLE): _instance(instance) {
+    create_swapchain(window, pacing, old_swapchain);
+    create_image_views();
+  }
+
+  /**
+   * @brief Offscreen color images in place of a swapchain, for headless
+   * rendering. Nothing is acquired or presented, the caller picks the image
+   * and reads it back from TRANSFER_SRC_OPTIMAL after the render pass.
+   */
+  Swapchain(
+      const std::shared_ptr<VT::Vulkan>& instance,
+      VkExtent2D extent,
+      uint32_t image_count): _instance(instance) {
+    create_offscreen_images(extent, image_count);
     create_image_views();
   }
 
@@ -33,6 +57,17 @@ public:
     cleanup_swap_chain();
   }
 
+  bool IsHeadless() const {
+    return _swapchain == VK_NULL_HANDLE;
+  }
+
+  /**
+   * @brief Layout images are left in by the render pass.
+   */
+  VkImageLayout GetFinalLayout() const {
+    return IsHeadless() ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  }
+
   VkSwapchainKHR& GetSwapchain() {
     return _swapchain;
   }
@@ -53,21 +88,49 @@ public:
     return _swapchain_extent;
   }
 
+  VkPresentModeKHR GetPresentMode() const {
+    return _present_mode;
+  }
+
 private:
-  void create_swapchain(const std::unique_ptr<phx::Window>& window) {
+  void create_swapchain(const std::unique_ptr<phx::Window>& window, const VT::FramePacingPolicy& pacing, VkSwapchainKHR old_swapchain) {
     VT::Vulkan* instance = _instance.get();
     VT::SwapChainOptions options{
       instance->GetVkInstance(),
       instance->GetVkSurfaceKHR(),
       instance->GetVkPhysicalDevice(),
       instance->GetVkDevice(),
-      window->GetGLFWwindow()
+      window->GetGLFWwindow(),
+      old_swapchain,
+      pacing
     };
     auto swapchainInfo = VT::CreateSwapchain(options);
     _swapchain = swapchainInfo.swapchain;
     _swapchain_images = swapchainInfo.swapchain_images;
     _swapchain_image_format = swapchainInfo.swapchain_image_format;
     _swapchain_extent = swapchainInfo.swapchain_extent;
+    _present_mode = swapchainInfo.present_mode;
+  }
+
+  void create_offscreen_images(VkExtent2D extent, uint32_t image_count) {
+    _swapchain_image_format = HEADLESS_IMAGE_FORMAT;
+    _swapchain_extent = extent;
+    _swapchain_images.resize(image_count);
+    _offscreen_memory.resize(image_count);
+
+    for (uint32_t i = 0; i < image_count; i++) {
+      VT::CreateImageOptions imageOptions(
+        extent.width,
+        extent.height,
+        _swapchain_image_format,
+        VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _instance->GetVkDevice(),
+        _instance->GetVkPhysicalDevice()
+      );
+      VT::CreateImage(imageOptions, _swapchain_images[i], _offscreen_memory[i]);
+    }
   }
 
   void create_image_views() {
@@ -89,7 +152,13 @@ private:
     for (size_t i = 0; i < _swapchain_image_views.size(); i++) {
       vkDestroyImageView(device, _swapchain_image_views[i], nullptr);
     }
-    vkDestroySwapchainKHR(device, _swapchain, nullptr);
+    if (IsHeadless()) {
+      for (size_t i = 0; i < _swapchain_images.size(); i++) {
+        VT::DestroyImage(device, _swapchain_images[i], _offscreen_memory[i]);
+      }
+    } else {
+      vkDestroySwapchainKHR(device, _swapchain, nullptr);
+    }
   }
 };
 } // VT
\ No newline at end of file
@@ -2,16 +2,29 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include <chrono>
+#include <iostream>
 #include <stdexcept>
 #include <memory>
 
 #include "swapchain.h"
 #include "depth_resources.h"
 #include "descriptor_set_layout.h"
+#include "deletion_queue.h"
+#include "depth_pyramid.h"
 #include "descriptor.h"
+#include "frame_pacing.h"
+#include "gpu_culler.h"
+#include "gpu_profiler.h"
+#include "parallel_recorder.h"
 #include "graphics_pipeline.h"
+#include "indices.h"
+#include "instance_buffer.h"
+#include "occlusion_queries.h"
+#include "scene.h"
 #include "vulkan.h"
 #include "window.h"
+#include "engine/private/profiler.h"
 
 namespace VT {
 
@@ -20,30 +33,57 @@ class SwapchainManager {
   std::unique_ptr<VT::DescriptorSetLayout> _descriptor_set_layout;
   std::unique_ptr<VT::GraphicsPipeline> _graphics_pipeline;
   std::unique_ptr<VT::DepthResources> _depth_resources;
+  // built from the depth attachment for occlusion culling, created by the
+  // first GetDepthPyramid.
+  std::unique_ptr<VT::DepthPyramid> _depth_pyramid;
+  // created by the first GetOcclusionQueries.
+  std::unique_ptr<VT::OcclusionQueries> _occlusion_queries;
+  // the render pass (and so the pipeline) only depends on the swapchain
+  // format, which almost never changes when the swapchain is recreated.
+  VkFormat _image_format;
 
   std::vector<VkFramebuffer> swapChainFramebuffers;
   std::unique_ptr<VT::DescriptorSets> _descriptor_sets;
+  // per instance model matrices of each frame, vertex binding 1.
+  std::unique_ptr<VT::InstanceBuffer> _instance_buffer;
+  // the draws of each frame, recorded by CompleteRenderPass.
+  std::vector<std::vector<VT::DrawCommand>> _draws;
+  std::vector<VT::DrawBatch> _batches;
+  // the uniform data of each frame's indirect draws, see UpdateUniformBuffer.
+  std::vector<uint32_t> _uniform_offsets;
+  // the scene instance in each slot of each frame's instance buffer, only
+  // kept for occlusion queries with conditional rendering.
+  std::vector<std::vector<uint32_t>> _draw_instances;
 
   const std::shared_ptr<VT::Vulkan> _instance;
+  const VT::FramePacingPolicy _pacing;
   int _max_frames_in_flight;
+  // size of the offscreen images when there is no window.
+  VkExtent2D _headless_extent;
 
 public:
   SwapchainManager(
       const std::shared_ptr<VT::Vulkan>& instance,
-      const std::unique_ptr<VT::CommandPool>& command_pool,
       const std::unique_ptr<VT::TextureView>& texture_image,
       const std::unique_ptr<phx::Window>& window,
-      int max_frames_in_flight): _instance(instance),
-                                 _max_frames_in_flight(max_frames_in_flight) {
+      const VT::FramePacingPolicy& pacing,
+      VkExtent2D headless_extent = {0, 0}): _draws(pacing.frames_in_flight),
+                                            _uniform_offsets(pacing.frames_in_flight, 0),
+                                            _draw_instances(pacing.frames_in_flight),
+                                            _instance(instance),
+                                            _pacing(pacing),
+                                            _max_frames_in_flight(pacing.frames_in_flight),
+                                            _headless_extent(headless_extent) {
     create_swapchain(window);
     create_descriptor_set_layout();
     create_graphics_pipeline();
-    create_depth_resources(command_pool);
+    create_depth_resources();
 
     // moving frame buffers to make sure it is called after the depth image
     // view has ben created
     create_frame_buffers();
     create_descriptor_sets(texture_image);
+    create_instance_buffer();
   }
 
   ~SwapchainManager() {
@@ -52,7 +92,45 @@ public:
     this->cleanup_swap_chain();
   }
 
+  // headless when created without a window.
+  bool IsHeadless() const {
+    return _swapchain->IsHeadless();
+  }
+
+  VkImage GetImage(uint32_t image_index) {
+    return _swapchain->GetSwapChainImages()[image_index];
+  }
+
+  VkExtent2D GetExtent() {
+    return _swapchain->GetExtent();
+  }
+
+  VkPresentModeKHR GetPresentMode() const {
+    return _swapchain->GetPresentMode();
+  }
+
+  size_t GetImageCount() const {
+    return _swapchain->GetSwapChainImages().size();
+  }
+
+  // the depth pyramid of the depth attachment, see CompleteRenderPassOcclusion.
+  VT::DepthPyramid& GetDepthPyramid() {
+    if (!_depth_pyramid) {
+      _depth_pyramid = std::make_unique<VT::DepthPyramid>(_instance, _depth_resources->GetDepthImageView(), _swapchain->GetExtent());
+    }
+    return *_depth_pyramid;
+  }
+
+  // the occlusion queries of CompleteRenderPassQueries.
+  VT::OcclusionQueries& GetOcclusionQueries() {
+    if (!_occlusion_queries) {
+      _occlusion_queries = std::make_unique<VT::OcclusionQueries>(_instance, static_cast<uint32_t>(_max_frames_in_flight));
+    }
+    return *_occlusion_queries;
+  }
+
   VkResult AcquireNextImage(std::vector<VkSemaphore>& image_available_semaphores, uint32_t current_frame, uint32_t& image_index) {
+    ENGINE_PROFILE_SCOPE("SwapchainManager::AcquireNextImage");
     return vkAcquireNextImageKHR(
         _instance->GetVkDevice(),
         _swapchain->GetSwapchain(),
@@ -63,6 +141,7 @@ public:
   }
 
   VkResult QueuePresentKHR(VkSemaphore signal_semaphores[], uint32_t image_index) {
+    ENGINE_PROFILE_SCOPE("SwapchainManager::QueuePresentKHR");
     VkSwapchainKHR swapChains[] = {_swapchain->GetSwapchain()};
 
     VkPresentInfoKHR presentInfo{};
@@ -83,8 +162,82 @@ public:
     return vkQueuePresentKHR(_instance->GetPresentQueue(), &presentInfo);
   }
 
-  void UpdateUnfiformBuffer(uint32_t current_frame) {
-    VT::UpdateUniformBuffer(_instance->GetVkDevice(), _descriptor_sets->GetUniformBufferMemory(), _swapchain->GetExtent(), current_frame);
+  /**
+   * @brief Uploads the frame's transformations and the model matrices of the
+   * scene's instances, or only of the visible ones (e.g. from a
+   * VT::FrustumCuller), each mesh of the scene becomes one instanced draw.
+   * @details ubo.model is applied on top of every instance's model matrix.
+   */
+  void UpdateScene(
+      uint32_t current_frame,
+      const VT::UniformBufferObject& ubo,
+      const VT::Scene& scene,
+      const std::vector<uint32_t>* visible = nullptr) {
+    ENGINE_PROFILE_SCOPE("SwapchainManager::UpdateScene");
+    auto& uniform_ring = _descriptor_sets->GetUniformRing();
+    uniform_ring.BeginFrame(current_frame);
+    uint32_t uniform_offset = uniform_ring.Push(ubo);
+
+    // the model matrices are written straight into the mapped instance buffer.
+    size_t instance_count = visible ? visible->size() : scene.GetInstanceCount();
+    VT::InstanceData* instances = _instance_buffer->Map(current_frame, instance_count);
+    uint32_t* instance_ids = nullptr;
+    if (_occlusion_queries && _occlusion_queries->UsesConditionalRendering()) {
+      _draw_instances[current_frame].resize(instance_count);
+      instance_ids = _draw_instances[current_frame].data();
+    }
+    scene.BuildBatches(instances, _batches, visible, instance_ids);
+
+    auto& draws = _draws[current_frame];
+    draws.clear();
+    for (const auto& batch : _batches) {
+      const VT::SceneMesh& mesh = scene.GetMesh(batch.mesh);
+      draws.push_back(VT::DrawCommand{mesh.index_count, batch.instance_count, mesh.first_index, mesh.vertex_offset, batch.first_instance, uniform_offset});
+    }
+  }
+
+  /**
+   * @brief Uploads one set of transformations per draw, mesh is drawn once
+   * for each of them without instancing.
+   */
+  void UpdateUniformBuffers(uint32_t current_frame, const std::vector<VT::UniformBufferObject>& objects, const VT::SceneMesh& mesh) {
+    ENGINE_PROFILE_SCOPE("SwapchainManager::UpdateUniformBuffers");
+    auto& uniform_ring = _descriptor_sets->GetUniformRing();
+    uniform_ring.BeginFrame(current_frame);
+    // every draw uses instance 0, whose model matrix is the identity.
+    VT::InstanceData identity{glm::mat4(1.0f)};
+    _instance_buffer->Write(current_frame, &identity, 1);
+
+    auto& draws = _draws[current_frame];
+    draws.clear();
+    for (const auto& object : objects) {
+      draws.push_back(VT::DrawCommand{mesh.index_count, 1, mesh.first_index, mesh.vertex_offset, 0, uniform_ring.Push(object)});
+    }
+  }
+
+  /**
+   * @brief Uploads only the frame's transformations, for
+   * CompleteRenderPassIndirect where the draws are built on the gpu.
+   */
+  void UpdateUniformBuffer(uint32_t current_frame, const VT::UniformBufferObject& ubo) {
+    ENGINE_PROFILE_SCOPE("SwapchainManager::UpdateUniformBuffer");
+    auto& uniform_ring = _descriptor_sets->GetUniformRing();
+    uniform_ring.BeginFrame(current_frame);
+    _uniform_offsets[current_frame] = uniform_ring.Push(ubo);
+    _draws[current_frame].clear();
+  }
+
+  // draw calls CompleteRenderPass records for the frame.
+  uint32_t GetDrawCount(uint32_t current_frame) const {
+    return static_cast<uint32_t>(_draws[current_frame].size());
+  }
+
+  uint64_t GetTriangleCount(uint32_t current_frame) const {
+    uint64_t triangles = 0;
+    for (const auto& draw : _draws[current_frame]) {
+      triangles += static_cast<uint64_t>(draw.index_count / 3) * draw.instance_count;
+    }
+    return triangles;
   }
 
   void CompleteRenderPass(
@@ -92,14 +245,210 @@ public:
       uint32_t image_index,
       uint32_t current_frame,
       VkBuffer vertex_buffer,
-      VkBuffer index_buffer,
-      std::vector<uint32_t>& indices) {
+      const VT::IndexBuffer& index_buffer,
+      VT::GpuProfiler* profiler = nullptr) {
+    VT::GpuScope passScope(profiler, command_buffer, "main_pass");
+    begin_render_pass(command_buffer, image_index, _graphics_pipeline->GetRenderPass(), VK_SUBPASS_CONTENTS_INLINE);
+    {
+      VT::GpuScope drawScope(profiler, command_buffer, "draw");
+      record_draws(command_buffer, current_frame, vertex_buffer, index_buffer, 0, _draws[current_frame].size());
+    }
+    vkCmdEndRenderPass(command_buffer);
+  }
+
+  /**
+   * @brief CompleteRenderPass with the draws split over the recorder's
+   * workers into secondary command buffers. The frame slot has to be free
+   * (its frame completed), the recorder's pools of it are reset.
+   * @details Timestamps can not be written inside a render pass whose
+   * contents are secondary command buffers, so there is no "draw" scope.
+   */
+  void CompleteRenderPassParallel(
+      VkCommandBuffer command_buffer,
+      uint32_t image_index,
+      uint32_t current_frame,
+      VkBuffer vertex_buffer,
+      const VT::IndexBuffer& index_buffer,
+      VT::ParallelCommandRecorder& recorder,
+      VT::GpuProfiler* profiler = nullptr) {
+    recorder.BeginFrame(current_frame);
+    const auto& secondaries = recorder.Record(
+        current_frame,
+        _graphics_pipeline->GetRenderPass(),
+        swapChainFramebuffers[image_index],
+        _draws[current_frame].size(),
+        [&](VkCommandBuffer secondary, size_t begin, size_t end) {
+          record_draws(secondary, current_frame, vertex_buffer, index_buffer, begin, end);
+        });
+
+    VT::GpuScope passScope(profiler, command_buffer, "main_pass");
+    begin_render_pass(command_buffer, image_index, _graphics_pipeline->GetRenderPass(), VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    if (!secondaries.empty()) {
+      vkCmdExecuteCommands(command_buffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+    }
+    vkCmdEndRenderPass(command_buffer);
+  }
+
+  /**
+   * @brief CompleteRenderPass with hardware occlusion queries, after
+   * GetOcclusionQueries().Update for the frame and UpdateScene with the
+   * instances it returned. Draws the instances (each on its own, skipped by
+   * the gpu when hidden, with conditional rendering), then the query boxes.
+   */
+  void CompleteRenderPassQueries(
+      VkCommandBuffer command_buffer,
+      uint32_t image_index,
+      uint32_t current_frame,
+      VkBuffer vertex_buffer,
+      const VT::IndexBuffer& index_buffer,
+      VT::GpuProfiler* profiler = nullptr) {
+    if (!_occlusion_queries) {
+      throw std::runtime_error("failed to record occlusion queries, they were never updated!");
+    }
+    _occlusion_queries->RecordBegin(command_buffer, current_frame);
+
+    VT::GpuScope passScope(profiler, command_buffer, "main_pass");
+    begin_render_pass(command_buffer, image_index, _graphics_pipeline->GetRenderPass(), VK_SUBPASS_CONTENTS_INLINE);
+    {
+      VT::GpuScope drawScope(profiler, command_buffer, "draw");
+      if (_occlusion_queries->UsesConditionalRendering()) {
+        record_conditional_draws(command_buffer, current_frame, vertex_buffer, index_buffer);
+      } else {
+        record_draws(command_buffer, current_frame, vertex_buffer, index_buffer, 0, _draws[current_frame].size());
+      }
+    }
+    {
+      VT::GpuScope queryScope(profiler, command_buffer, "occlusion_queries");
+      _occlusion_queries->RecordQueries(command_buffer, current_frame, _graphics_pipeline->GetOcclusionBoxPipeline());
+    }
+    vkCmdEndRenderPass(command_buffer);
+  }
+
+  /**
+   * @brief CompleteRenderPass with the draws the culler's RecordCull built
+   * for the frame, recorded earlier in command_buffer. Records the same
+   * handful of commands whatever the number of instances.
+   */
+  void CompleteRenderPassIndirect(
+      VkCommandBuffer command_buffer,
+      uint32_t image_index,
+      uint32_t current_frame,
+      VkBuffer vertex_buffer,
+      const VT::IndexBuffer& index_buffer,
+      const VT::GpuCuller& culler,
+      VT::GpuProfiler* profiler = nullptr) {
+    VT::GpuScope passScope(profiler, command_buffer, "main_pass");
+    begin_render_pass(command_buffer, image_index, _graphics_pipeline->GetRenderPass(), VK_SUBPASS_CONTENTS_INLINE);
+    {
+      VT::GpuScope drawScope(profiler, command_buffer, "draw");
+      record_indirect_draws(command_buffer, current_frame, vertex_buffer, index_buffer, culler, VT::GpuCullPhase::Early);
+    }
+    vkCmdEndRenderPass(command_buffer);
+  }
+
+  /**
+   * @brief CompleteRenderPassIndirect with occlusion culling, after a
+   * RecordCull of the culler that was given GetDepthPyramid(). Draws the
+   * early phase, builds the depth pyramid from its depth, culls again
+   * against it and draws the instances the early phase missed on top.
+   */
+  void CompleteRenderPassOcclusion(
+      VkCommandBuffer command_buffer,
+      uint32_t image_index,
+      uint32_t current_frame,
+      VkBuffer vertex_buffer,
+      const VT::IndexBuffer& index_buffer,
+      VT::GpuCuller& culler,
+      VT::GpuProfiler* profiler = nullptr) {
+    VT::GpuScope passScope(profiler, command_buffer, "main_pass");
+    begin_render_pass(command_buffer, image_index, _graphics_pipeline->GetEarlyRenderPass(), VK_SUBPASS_CONTENTS_INLINE);
+    {
+      VT::GpuScope drawScope(profiler, command_buffer, "draw");
+      record_indirect_draws(command_buffer, current_frame, vertex_buffer, index_buffer, culler, VT::GpuCullPhase::Early);
+    }
+    vkCmdEndRenderPass(command_buffer);
+
+    {
+      VT::GpuScope pyramidScope(profiler, command_buffer, "depth_pyramid");
+      GetDepthPyramid().Record(command_buffer, _depth_resources->GetDepthImage(), _depth_resources->GetFormat());
+    }
+    {
+      VT::GpuScope cullScope(profiler, command_buffer, "late_cull");
+      culler.RecordLateCull(command_buffer, current_frame);
+    }
+
+    begin_render_pass(command_buffer, image_index, _graphics_pipeline->GetLateRenderPass(), VK_SUBPASS_CONTENTS_INLINE);
+    {
+      VT::GpuScope drawScope(profiler, command_buffer, "late_draw");
+      record_indirect_draws(command_buffer, current_frame, vertex_buffer, index_buffer, culler, VT::GpuCullPhase::Late);
+    }
+    vkCmdEndRenderPass(command_buffer);
+  }
+
+  // The new swap chain is created while drawing commands on images from the old one are
+  // still in-flight: the previous swap chain is passed as oldSwapchain and everything that
+  // depends on it (image views, framebuffers, depth image, and the pipeline if the format
+  // changed) goes into the deletion queue, which destroys it once the frames using it have
+  // retired. Nothing waits for the device to go idle.
+  void RecreateSwapchain(
+      const std::unique_ptr<phx::Window>& window,
+      VT::DeletionQueue& deletion_queue) {
+    std::cout << "Recreating swapshain" << std::endl;
+    window->HandleMinimization();
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::shared_ptr<VT::Swapchain> old_swapchain(std::move(_swapchain));
+    std::shared_ptr<VT::DepthResources> old_depth_resources(std::move(_depth_resources));
+    // recreated for the new depth attachment by the next GetDepthPyramid.
+    std::shared_ptr<VT::DepthPyramid> old_depth_pyramid(std::move(_depth_pyramid));
+    std::shared_ptr<VT::GraphicsPipeline> old_graphics_pipeline;
+    std::vector<VkFramebuffer> old_framebuffers;
+    old_framebuffers.swap(swapChainFramebuffers);
+
+    // Note that in chooseSwapExtent we already query the new window resolution to make sure
+    // that the swap chain images have the (new) right size, so there's no need to modify
+    // chooseSwapExtent (remember that we already had to use glfwGetFramebufferSize get the
+    // resolution of the surface in pixels when creating the swap chain).
+    //
+    // Viewport and scissor are dynamic, so only the swapchain, depth image and
+    // framebuffers depend on the extent. The pipeline, descriptor sets and
+    // command buffers are kept.
+    create_swapchain(window, old_swapchain->GetSwapchain());
+    if (_swapchain->GetImageFormat() != _image_format) {
+      old_graphics_pipeline = std::move(_graphics_pipeline);
+      create_graphics_pipeline();
+    }
+    create_depth_resources();
+    create_frame_buffers();
+
+    VkDevice device = _instance->GetVkDevice();
+    deletion_queue.Push([device, old_framebuffers, old_depth_pyramid, old_depth_resources, old_swapchain, old_graphics_pipeline]() mutable {
+      // framebuffers first, they reference the depth view, the swapchain
+      // image views and the render pass.
+      for (VkFramebuffer framebuffer : old_framebuffers) {
+        vkDestroyFramebuffer(device, framebuffer, nullptr);
+      }
+      // the pyramid samples the old depth image.
+      old_depth_pyramid.reset();
+      old_depth_resources.reset();
+      old_swapchain.reset();
+      old_graphics_pipeline.reset();
+    });
+
+    std::cout << "Recreated swapchain in "
+              << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count()
+              << " ms" << std::endl;
+  }
+
+private:
+  // render_pass is _graphics_pipeline's or one compatible with it.
+  void begin_render_pass(VkCommandBuffer command_buffer, uint32_t image_index, VkRenderPass render_pass, VkSubpassContents contents) {
     // The first parameters are the render pass itself and the attachments to bind. We created a framebuffer for
     // each swap chain image where it is specified as a color attachment.
     // Thus we need to bind the framebuffer for the swapchain image we want to draw to. 
     VkRenderPassBeginInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = _graphics_pipeline->GetRenderPass();
+    renderPassInfo.renderPass = render_pass;
     renderPassInfo.framebuffer = swapChainFramebuffers[image_index];
     // The render area defines where shader loads and stores will take place.
     // The pixels outside this region will have undefined values.
@@ -119,61 +468,113 @@ public:
     // command to. The second parameter specifies the details of the render pass we've
     // just provided. The final parameter controls how the drawing commands within the render
     // pass will be provided. 
-    vkCmdBeginRenderPass(command_buffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _graphics_pipeline->GetPipeline());
-
-    // bind vertex buffer during rendering operations
-    VkBuffer vertexBuffers[] = {vertex_buffer};
-    VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(command_buffer, 0, 1, vertexBuffers, offsets);
-
-    vkCmdBindIndexBuffer(command_buffer, index_buffer, 0, VK_INDEX_TYPE_UINT32);
-
-    // Descriptor sets can be used in graphics or compute pipelines so we need to specify
-    // which one to use.
-    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _graphics_pipeline->GetPipelineLayout(), 0, 1, &_descriptor_sets->GetDescriptorSets()[current_frame], 0, nullptr);
-
-    // vertexCount: Even though we don't have a vertex buffer, we technically still have 3 vertices to draw.
-    // instanceCount: Used for instanced rendering, use 1 if you're not doing that.
-    // firstVertex: Used as an offset into the vertex buffer, defines the lowest value of gl_VertexIndex.
-    // firstInstance: Used as an offset for instanced rendering, defines the lowest value of gl_InstanceIndex
-    vkCmdDrawIndexed(command_buffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
-    vkCmdEndRenderPass(command_buffer);
+    vkCmdBeginRenderPass(command_buffer, &renderPassInfo, contents);
   }
 
-  // However, the disadvantage of this approach is that we need to stop all rendering before
-  // creating the new swap chain. It is possible to create a new swap chain while drawing
-  // commands on an image from the old swap chain are still in-flight. You need to pass the
-  // previous swap chain to the oldSwapChain field in the VkSwapchainCreateInfoKHR struct
-  // and destroy the old swap chain as soon as you've finished using it.
-  void RecreateSwapchain(
-      const std::unique_ptr<phx::Window>& window,
-      const std::unique_ptr<VT::CommandPool>& command_pool,
-      const std::unique_ptr<VT::TextureView>& texture_image) {
-    std::cout << "Recreating swapshain" << std::endl;
-    window->HandleMinimization();
+  // binds the pipeline, viewport, scissor, vertex and index buffers.
+  void bind_draw_state(
+      VkCommandBuffer command_buffer,
+      VkBuffer vertex_buffer,
+      VkBuffer instance_buffer,
+      const VT::IndexBuffer& index_buffer) {
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _graphics_pipeline->GetPipeline());
 
-    // don't touch resources still in use
-    vkDeviceWaitIdle(_instance->GetVkDevice());
+    // viewport and scissor are dynamic state, they cover the whole framebuffer.
+    VkExtent2D extent = _swapchain->GetExtent();
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = (float) extent.width;
+    viewport.height = (float) extent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = extent;
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+    // bind vertex buffer during rendering operations, binding 0 per vertex
+    // and binding 1 per instance.
+    VkBuffer vertexBuffers[] = {vertex_buffer, instance_buffer};
+    VkDeviceSize offsets[] = {0, 0};
+    vkCmdBindVertexBuffers(command_buffer, 0, 2, vertexBuffers, offsets);
+
+    vkCmdBindIndexBuffer(command_buffer, index_buffer.buffer, 0, index_buffer.index_type);
+  }
 
-    cleanup_swap_chain();
+  // binds everything the culler's draws of phase need and records them.
+  void record_indirect_draws(
+      VkCommandBuffer command_buffer,
+      uint32_t current_frame,
+      VkBuffer vertex_buffer,
+      const VT::IndexBuffer& index_buffer,
+      const VT::GpuCuller& culler,
+      VT::GpuCullPhase phase) {
+    bind_draw_state(command_buffer, vertex_buffer, culler.GetVisibleInstances(current_frame), index_buffer);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _graphics_pipeline->GetPipelineLayout(), 0, 1, &_descriptor_sets->GetDescriptorSets()[current_frame], 1, &_uniform_offsets[current_frame]);
+    culler.RecordDraws(command_buffer, current_frame, phase);
+  }
 
-    // Note that in chooseSwapExtent we already query the new window resolution to make sure
-    // that the swap chain images have the (new) right size, so there's no need to modify
-    // chooseSwapExtent (remember that we already had to use glfwGetFramebufferSize get the
-    // resolution of the surface in pixels when creating the swap chain).
-    create_swapchain(window);
-    create_graphics_pipeline();
-    create_depth_resources(command_pool);
-    create_frame_buffers();
-    create_descriptor_sets(texture_image);
-    // TODO: consider reseting command pool after swapchain recreation.
-    command_pool->ResetCommandBuffers();
+  // binds everything a draw needs and records draws [begin, end) of the
+  // frame, inline or into a secondary command buffer (which inherits no state).
+  void record_draws(
+      VkCommandBuffer command_buffer,
+      uint32_t current_frame,
+      VkBuffer vertex_buffer,
+      const VT::IndexBuffer& index_buffer,
+      size_t begin,
+      size_t end) {
+    bind_draw_state(command_buffer, vertex_buffer, _instance_buffer->GetBuffer(current_frame), index_buffer);
+
+    const auto& draws = _draws[current_frame];
+    for (size_t i = begin; i < end; i++) {
+      const VT::DrawCommand& draw = draws[i];
+      // Descriptor sets can be used in graphics or compute pipelines so we need to specify
+      // which one to use. The dynamic offset selects this draw's uniform data, instanced
+      // draws share it so it is only bound again when it changes.
+      if (i == begin || draw.uniform_offset != draws[i - 1].uniform_offset) {
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _graphics_pipeline->GetPipelineLayout(), 0, 1, &_descriptor_sets->GetDescriptorSets()[current_frame], 1, &draw.uniform_offset);
+      }
+
+      // instanceCount: Used for instanced rendering, the batch's instances.
+      // firstIndex / vertexOffset: where the mesh starts in the shared index and vertex buffers.
+      // firstInstance: Used as an offset for instanced rendering, defines the lowest value of gl_InstanceIndex
+      vkCmdDrawIndexed(command_buffer, draw.index_count, draw.instance_count, draw.first_index, draw.vertex_offset, draw.first_instance);
+    }
+  }
+  // record_draws with every instance of an instanced draw drawn on its own,
+  // under the occlusion queries' conditional rendering.
+  void record_conditional_draws(
+      VkCommandBuffer command_buffer,
+      uint32_t current_frame,
+      VkBuffer vertex_buffer,
+      const VT::IndexBuffer& index_buffer) {
+    bind_draw_state(command_buffer, vertex_buffer, _instance_buffer->GetBuffer(current_frame), index_buffer);
+
+    const auto& draws = _draws[current_frame];
+    const auto& draw_instances = _draw_instances[current_frame];
+    for (size_t i = 0; i < draws.size(); i++) {
+      const VT::DrawCommand& draw = draws[i];
+      if (i == 0 || draw.uniform_offset != draws[i - 1].uniform_offset) {
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _graphics_pipeline->GetPipelineLayout(), 0, 1, &_descriptor_sets->GetDescriptorSets()[current_frame], 1, &draw.uniform_offset);
+      }
+      for (uint32_t slot = draw.first_instance; slot < draw.first_instance + draw.instance_count; slot++) {
+        _occlusion_queries->RecordConditional(command_buffer, current_frame, draw_instances[slot], [&]() {
+          vkCmdDrawIndexed(command_buffer, draw.index_count, 1, draw.first_index, draw.vertex_offset, slot);
+        });
+      }
+    }
   }
 
-private:
-  void create_swapchain(const std::unique_ptr<phx::Window>& window) {
-    _swapchain = std::make_unique<VT::Swapchain>(_instance, window);
+  void create_swapchain(const std::unique_ptr<phx::Window>& window, VkSwapchainKHR old_swapchain = VK_NULL_HANDLE) {
+    if (!window) {
+      // one image per frame in flight, a frame slot always renders to its own image.
+      _swapchain = std::make_unique<VT::Swapchain>(_instance, _headless_extent, static_cast<uint32_t>(_max_frames_in_flight));
+      return;
+    }
+    _swapchain = std::make_unique<VT::Swapchain>(_instance, window, _pacing, old_swapchain);
   }
 
   void create_descriptor_set_layout() {
@@ -182,10 +583,11 @@ private:
 
   void create_graphics_pipeline() {
     _graphics_pipeline = std::make_unique<VT::GraphicsPipeline>(_instance, _swapchain, _descriptor_set_layout);
+    _image_format = _swapchain->GetImageFormat();
   }
 
-  void create_depth_resources(const std::unique_ptr<VT::CommandPool>& command_pool) {
-    _depth_resources = std::make_unique<VT::DepthResources>(_instance, command_pool, _swapchain->GetExtent());
+  void create_depth_resources() {
+    _depth_resources = std::make_unique<VT::DepthResources>(_instance, _swapchain->GetExtent());
   }
 
   void create_frame_buffers() {
@@ -197,9 +599,14 @@ private:
     _descriptor_sets = std::make_unique<VT::DescriptorSets>(_instance, _descriptor_set_layout, texture_image, _max_frames_in_flight);
   }
 
+  void create_instance_buffer() {
+    _instance_buffer = std::make_unique<VT::InstanceBuffer>(_instance->GetVkDevice(), _instance->GetVkPhysicalDevice(), static_cast<uint32_t>(_max_frames_in_flight));
+  }
+
   void cleanup_swap_chain() {
     auto device = this->_instance.get()->GetVkDevice();
 
+    _depth_pyramid.reset();
     delete _depth_resources.release();
 
     for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
@@ -6,6 +6,7 @@
 #include <vector>
 #include <algorithm>
 
+#include "frame_pacing.h"
 #include "swapchain_support.h"
 #include "queue_families.h"
 
@@ -16,6 +17,11 @@ struct SwapChainOptions {
   const VkPhysicalDevice physical_device;
   const VkDevice device;
   GLFWwindow* window;
+  // the swapchain being replaced, lets the driver reuse its resources and
+  // keep presenting its images while the new one is created.
+  VkSwapchainKHR old_swapchain = VK_NULL_HANDLE;
+  // picks the present mode and image count.
+  FramePacingPolicy pacing{};
 };
 
 struct SwapchainInfo {
@@ -23,12 +29,12 @@ struct SwapchainInfo {
   std::vector<VkImage> swapchain_images;
   VkFormat swapchain_image_format;
   VkExtent2D swapchain_extent;
+  VkPresentModeKHR present_mode;
 };
 
 SwapchainInfo CreateSwapchain(SwapChainOptions& options);
 bool CheckSwapChainAdequate(bool extensionsSupported, const VkPhysicalDevice device, const VkSurfaceKHR surface);
 VkSurfaceFormatKHR choose_swap_surface_format(const std::vector<VkSurfaceFormatKHR>& availableFormats);
-VkPresentModeKHR choose_swap_present_mode(const std::vector<VkPresentModeKHR>& availablePresentModes);
 VkExtent2D choose_swap_extent(const VkSurfaceCapabilitiesKHR& capabilities, GLFWwindow* window);
 SwapChainSupportDetails query_swap_chain_support_details(const VkPhysicalDevice device, const VkSurfaceKHR surface);
 
@@ -42,16 +48,13 @@ SwapchainInfo CreateSwapchain(SwapChainOptions& options) {
     options.surface);
 
   VkSurfaceFormatKHR surfaceFormat = choose_swap_surface_format(swapChainSupport.formats);
-  VkPresentModeKHR presentMode = choose_swap_present_mode(swapChainSupport.presentModes);
+  VkPresentModeKHR presentMode = VT::ChoosePresentMode(options.pacing, swapChainSupport.presentModes);
   VkExtent2D extent = choose_swap_extent(swapChainSupport.capabilities, options.window);
   // Simply sticking to this minimum means that we may sometimes have to wait on the driver
   // to complete internal operations before we can acquire another image to render to.
-  // Therefore it is recommended to request at least one more image than the minimum:
-  uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
-
-  if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) {
-    imageCount = swapChainSupport.capabilities.maxImageCount;
-  }
+  // The pacing policy requests at least one more image than the minimum, and no fewer
+  // than the frames in flight.
+  uint32_t imageCount = VT::ChooseSwapchainImageCount(options.pacing, swapChainSupport.capabilities);
 
   VkSwapchainCreateInfoKHR createInfo{};
   createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -101,8 +104,9 @@ SwapchainInfo CreateSwapchain(SwapChainOptions& options) {
   // them.
   createInfo.clipped = VK_TRUE;
 
-  // For now assume we will have one swap chain
-  createInfo.oldSwapchain = VK_NULL_HANDLE;
+  // the old swapchain is retired by this call, images already acquired from
+  // it can still be presented but no new ones can be acquired.
+  createInfo.oldSwapchain = options.old_swapchain;
 
   if (vkCreateSwapchainKHR(options.device, &createInfo, nullptr, &swapchain) != VK_SUCCESS) {
     throw std::runtime_error("failed to create swap chain!");
@@ -118,7 +122,8 @@ SwapchainInfo CreateSwapchain(SwapChainOptions& options) {
     swapchain,
     swapchain_images,
     swapchain_image_format,
-    swapchain_extent
+    swapchain_extent,
+    presentMode
   };
 }
 
@@ -178,18 +183,6 @@ VkSurfaceFormatKHR choose_swap_surface_format(const std::vector<VkSurfaceFormatK
   return availableFormats[0];
 }
 
-// VK_PRESENT_MODE_MAILBOX_KHR is a very nice trade-off if energy usage is not a concern.
-// It allows us to avoid tearing while still maintaining a fairly low latency by rendering new images that are as up-to-date as possible right until the vertical blank. On mobile devices, where energy usage is more important, you will probably want to use VK_PRESENT_MODE_FIFO_KHR instead. 
-// Only the VK_PRESENT_MODE_FIFO_KHR mode is guaranteed to be available, so we'll again have to write a function that looks for the best mode that is available:
-VkPresentModeKHR choose_swap_present_mode(const std::vector<VkPresentModeKHR>& availablePresentModes) {
-  for (const auto& availablePresentMode : availablePresentModes) {
-    if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-      return availablePresentMode;
-    }
-  }
-  return VK_PRESENT_MODE_FIFO_KHR;
-}
-
 VkExtent2D choose_swap_extent(const VkSurfaceCapabilitiesKHR& capabilities, GLFWwindow* window) {
   if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
       return capabilities.currentExtent;
@@ -29,8 +29,7 @@ namespace VT {
 struct CreateTextureImageOptions {
   VkDevice device;
   VkPhysicalDevice physical_device;
-  VkCommandPool command_pool;
-  VkQueue graphics_queue;
+  VT::UploadQueue* upload_queue;
 };
 
 struct TextureImage {
@@ -38,7 +37,12 @@ struct TextureImage {
   VkDeviceMemory texture_image_memory;
 };
 
-void CreateTextureImage(CreateTextureImageOptions& options, VkImage& texture_image, VkDeviceMemory& texture_image_memory) {
+/**
+ * @brief Loads the texture and records its upload: both layout transitions
+ * and the copy go into the upload queue's open batch.
+ * @return The upload queue ticket after which the image can be sampled.
+ */
+uint64_t CreateTextureImage(CreateTextureImageOptions& options, VkImage& texture_image, VT::Allocation& texture_image_memory) {
   int texWidth, texHeight, texChannels;
   char buff[FILENAME_MAX]; //create string buffer to hold path
   char* cwd = GetCurrentDir( buff, FILENAME_MAX );
@@ -54,28 +58,6 @@ void CreateTextureImage(CreateTextureImageOptions& options, VkImage& texture_ima
     throw std::runtime_error("failed to load texture image!");
   }
 
-  // Create a buffer in host visible memory so that we can use
-  // vkMapMemory and copy pixels to it.
-  // Buffer should be in host visible memory so we can map it and
-  // should be usable as a transfer source so we can copy it
-  // to an image later on.
-  VkBuffer stagingBuffer;
-  VkDeviceMemory stagingBufferMemory;
-
-  VT::CreateBuffer(imageSize,
-                    VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                    stagingBuffer,
-                    stagingBufferMemory,
-                    options.device,
-                    options.physical_device);
-  void *data;
-  vkMapMemory(options.device, stagingBufferMemory, 0, imageSize, 0, &data);
-  memcpy(data, pixels, static_cast<size_t>(imageSize));
-  vkUnmapMemory(options.device, stagingBufferMemory);
-
-  stbi_image_free(pixels);
-
   VT::CreateImageOptions image_options(
     texWidth,
     texHeight,
@@ -87,12 +69,16 @@ void CreateTextureImage(CreateTextureImageOptions& options, VkImage& texture_ima
     options.physical_device);
   VT::CreateImage(image_options, texture_image, texture_image_memory);
 
-  VT::TransitionImageLayout(options.device, options.command_pool, options.graphics_queue, texture_image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-  VT::CopyBufferToImage(options.device, options.command_pool, options.graphics_queue, stagingBuffer, texture_image, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
-  VT::TransitionImageLayout(options.device, options.command_pool, options.graphics_queue, texture_image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  // The pixels go to host visible staging memory that is usable as a
+  // transfer source so we can copy it to the image later on.
+  VT::UploadQueue& upload_queue = *options.upload_queue;
+  upload_queue.TransitionImageLayout(texture_image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+  VT::StagingRegion staging = upload_queue.Stage(imageSize);
+  memcpy(staging.mapped, pixels, static_cast<size_t>(imageSize));
+  stbi_image_free(pixels);
 
-  vkDestroyBuffer(options.device, stagingBuffer, nullptr);
-  vkFreeMemory(options.device, stagingBufferMemory, nullptr);
+  upload_queue.CopyBufferToImage(staging, texture_image, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
+  return upload_queue.TransitionImageLayout(texture_image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 }
 void CreateTextureImageView() {
 }
@@ -100,6 +86,8 @@ void CreateTextureImageView() {
 struct CreateTextureSamplerOptions {
   VkDevice device;
   VkPhysicalDevice physical_device;
+  // the samplerAnisotropy feature was enabled on the device.
+  bool anisotropy;
 
 };
 
@@ -118,11 +106,11 @@ VkSampler CreateTextureImageSampler(CreateTextureSamplerOptions& options) {
   samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
   samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
   samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-  samplerInfo.anisotropyEnable = VK_TRUE;
+  samplerInfo.anisotropyEnable = options.anisotropy ? VK_TRUE : VK_FALSE;
   // limits the amount of samples that can be used to calculate the final
   // color a lower value result in beteter performance and lower quality
   // results. We can retrieve properties of physical device
-  samplerInfo.maxAnisotropy = properties.limits.maxSamplerAnisotropy;
+  samplerInfo.maxAnisotropy = options.anisotropy ? properties.limits.maxSamplerAnisotropy : 1.0f;
   samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
   // specifies which coordinate system you want to use to address
   // texels in an image.
@@ -145,7 +133,7 @@ VkSampler CreateTextureImageSampler(CreateTextureSamplerOptions& options) {
 
 class TextureView {
   VkImage textureImage;
-  VkDeviceMemory textureImageMemory;
+  VT::Allocation textureImageMemory;
   VkImageView textureImageView;
   VkSampler textureSampler;
 
@@ -165,8 +153,7 @@ public:
     vkDestroySampler(device, textureSampler, nullptr);
     vkDestroyImageView(device, textureImageView, nullptr);
 
-    vkDestroyImage(device, textureImage, nullptr);
-    vkFreeMemory(device, textureImageMemory, nullptr);
+    VT::DestroyImage(device, textureImage, textureImageMemory);
   }
 
   VkImageView& GetImageView() {
@@ -182,8 +169,7 @@ private:
     VT::CreateTextureImageOptions options{
       _instance->GetVkDevice(),
       _instance->GetVkPhysicalDevice(),
-      command_pool->GetCommandPool(),
-      _instance->GetGraphicsQueue()
+      &command_pool->GetUploadQueue()
     };
     VT::CreateTextureImage(options, textureImage, textureImageMemory);
   }
@@ -198,7 +184,7 @@ private:
   }
 
   void create_texture_sampler() {
-    VT::CreateTextureSamplerOptions options { _instance->GetVkDevice(), _instance->GetVkPhysicalDevice() };
+    VT::CreateTextureSamplerOptions options { _instance->GetVkDevice(), _instance->GetVkPhysicalDevice(), _instance->SupportsSamplerAnisotropy() };
     textureSampler = VT::CreateTextureImageSampler(options);
   }
 
@@ -0,0 +1,124 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "engine/private/profiler.h"
+
+namespace VT {
+
+/**
+ * @brief A fixed set of worker threads that run one ParallelFor at a time.
+ * @details Unlike VT::ParallelFor, which starts and joins a thread per call,
+ * the workers live as long as the pool, so it is cheap enough to use every
+ * frame. Worker t always runs range t, which lets callers keep per worker
+ * state (e.g. a command pool) without locking.
+ */
+class ThreadPool {
+  std::vector<std::thread> _workers;
+  std::mutex _mutex;
+  std::condition_variable _start;
+  std::condition_variable _done;
+
+  // the running job, called once per worker with its index.
+  std::function<void(unsigned)> _job;
+  uint64_t _generation = 0;
+  unsigned _remaining = 0;
+  std::exception_ptr _error;
+  bool _stop = false;
+
+public:
+  ThreadPool(unsigned thread_count) {
+    thread_count = std::max(1u, thread_count);
+    _workers.reserve(thread_count);
+    for (unsigned t = 0; t < thread_count; t++) {
+      _workers.emplace_back([this, t]() { work(t); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _start.notify_all();
+    for (auto& worker : _workers) {
+      worker.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  unsigned GetThreadCount() const {
+    return static_cast<unsigned>(_workers.size());
+  }
+
+  /**
+   * @brief Runs fn(begin, end, worker) over [0, count) split into one
+   * contiguous range per worker and waits for all of them. Ranges can be
+   * empty. The first exception thrown by fn is rethrown here.
+   */
+  template<typename Fn>
+  void ParallelFor(size_t count, Fn fn) {
+    size_t thread_count = _workers.size();
+    size_t chunk = (count + thread_count - 1) / thread_count;
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _job = [count, chunk, &fn](unsigned t) {
+      size_t begin = std::min(count, t * chunk);
+      size_t end = std::min(count, begin + chunk);
+      fn(begin, end, t);
+    };
+    _remaining = static_cast<unsigned>(thread_count);
+    _error = nullptr;
+    _generation++;
+    _start.notify_all();
+    _done.wait(lock, [this]() { return _remaining == 0; });
+
+    _job = nullptr;
+    if (_error) {
+      std::rethrow_exception(_error);
+    }
+  }
+
+private:
+  void work(unsigned t) {
+    ENGINE_PROFILE_THREAD("worker " + std::to_string(t));
+    uint64_t generation = 0;
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+      _start.wait(lock, [this, generation]() { return _stop || _generation != generation; });
+      if (_stop) {
+        return;
+      }
+      generation = _generation;
+
+      lock.unlock();
+      std::exception_ptr error;
+      try {
+        _job(t);
+      } catch (...) {
+        error = std::current_exception();
+      }
+      lock.lock();
+
+      if (error && !_error) {
+        _error = error;
+      }
+      if (--_remaining == 0) {
+        _done.notify_one();
+      }
+    }
+  }
+};
+} // VT
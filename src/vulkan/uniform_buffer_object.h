@@ -12,8 +12,7 @@
 # define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/hash.hpp>
 
-#include "buffer.h"
-#include "command_buffer.h"
+#include "uniform_ring_buffer.h"
 
 namespace VT {
 struct UniformBufferObject {
@@ -22,42 +21,10 @@ struct UniformBufferObject {
   alignas(16) glm::mat4 proj;
 };
 
-struct CreateUniformBufferOptions {
-  int max_frames_in_flight;
-  VkDevice device;
-  VkPhysicalDevice physical_device;
-  
-};
-
-struct UnformBufferInfo {
-  std::vector<VkBuffer> uniform_buffers;
-  std::vector<VkDeviceMemory> uniform_buffers_memory;
-};
-
-void CreateUniformBuffers(
-    CreateUniformBufferOptions& options, 
-    std::vector<VkBuffer>& uniform_buffers,
-    std::vector<VkDeviceMemory>& uniform_buffers_memory) {
-  VkDeviceSize bufferSize = sizeof(VT::UniformBufferObject);
-
-  uniform_buffers.resize(options.max_frames_in_flight);
-  uniform_buffers_memory.resize(options.max_frames_in_flight);
-
-  for (size_t i = 0; i < options.max_frames_in_flight; i++) {
-    VT::CreateBuffer(bufferSize,
-                      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                      uniform_buffers[i],
-                      uniform_buffers_memory[i],
-                      options.device,
-                      options.physical_device);
-  }
-}
-
-
 // generate a new transformation every frame to make the geometry
-// spin around
-void UpdateUniformBuffer(VkDevice device, std::vector<VkDeviceMemory>& uniform_buffers_memory, VkExtent2D swap_chain_extent, uint32_t currentImage) {
+// spin around. mesh_transform is applied first, it maps the positions stored
+// in the vertex buffer to model space (identity unless they are quantized).
+UniformBufferObject ComputeUniformBufferObject(VkExtent2D swap_chain_extent, const glm::mat4& mesh_transform = glm::mat4(1.0f)) {
   static auto startTime = std::chrono::high_resolution_clock::now();
 
   auto currentTime = std::chrono::high_resolution_clock::now();
@@ -68,7 +35,7 @@ void UpdateUniformBuffer(VkDevice device, std::vector<VkDeviceMemory>& uniform_b
   auto rotation_angle =  time * glm::radians(90.0f);
   ubo.model = glm::rotate(glm::mat4(1.0f), 
                           rotation_angle,
-                          glm::vec3(0.0f, 0.0f, 1.0f));
+                          glm::vec3(0.0f, 0.0f, 1.0f)) * mesh_transform;
   ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f),
                           glm::vec3(0.0f, 0.0f, 0.0f),
                           glm::vec3(0.0f, 0.0f, 1.0f));
@@ -86,9 +53,19 @@ void UpdateUniformBuffer(VkDevice device, std::vector<VkDeviceMemory>& uniform_b
   // matrix
   ubo.proj[1][1] *= -1;
 
-  void* data;
-  vkMapMemory(device, uniform_buffers_memory[currentImage], 0, sizeof(ubo), 0, &data);
-  memcpy(data, &ubo, sizeof(ubo));
-  vkUnmapMemory(device, uniform_buffers_memory[currentImage]);
+  return ubo;
+}
+
+/**
+ * @brief Writes this frame's transformations into the uniform ring buffer.
+ * @details The ring must already be on the current frame's partition.
+ *
+ * @return The dynamic offset to bind the descriptor set with.
+ */
+uint32_t UpdateUniformBuffer(
+    VT::UniformRingBuffer& uniform_ring,
+    VkExtent2D swap_chain_extent,
+    const glm::mat4& mesh_transform = glm::mat4(1.0f)) {
+  return uniform_ring.Push(ComputeUniformBufferObject(swap_chain_extent, mesh_transform));
 }
 } // VT
\ No newline at end of file
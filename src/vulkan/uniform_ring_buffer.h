@@ -0,0 +1,112 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "buffer.h"
+#include "memory_allocator.h"
+
+namespace VT {
+
+// room for per frame and per object constants of one frame, 4096 objects
+// at the common 256 byte offset alignment.
+const VkDeviceSize UNIFORM_RING_FRAME_SIZE = 1024 * 1024;
+
+/**
+ * @brief One persistently mapped uniform buffer split into a partition per
+ * frame in flight.
+ * @details Uniform data is bump allocated from the partition of the current
+ * frame and bound with a dynamic offset (VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC),
+ * so there is a single buffer and allocation and no map/unmap per update.
+ * A partition is only reused once the fence of the frame that last used it
+ * has been waited on, so the cpu never overwrites data the gpu still reads.
+ */
+class UniformRingBuffer {
+  VkDevice _device;
+  VkBuffer _buffer;
+  VT::Allocation _memory;
+
+  VkDeviceSize _alignment;
+  VkDeviceSize _frame_size;
+  uint32_t _frame_count;
+
+  VkDeviceSize _frame_begin = 0;
+  VkDeviceSize _head = 0;
+
+public:
+  UniformRingBuffer(
+      VkDevice device,
+      VkPhysicalDevice physical_device,
+      uint32_t frame_count,
+      VkDeviceSize frame_size = UNIFORM_RING_FRAME_SIZE): _device(device), _frame_count(frame_count) {
+    // dynamic offsets have to be multiples of minUniformBufferOffsetAlignment.
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    _alignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 1);
+    _frame_size = align(frame_size);
+
+    VT::CreateBuffer(_frame_size * frame_count,
+                     VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                     _buffer,
+                     _memory,
+                     device,
+                     physical_device);
+  }
+
+  ~UniformRingBuffer() {
+    VT::DestroyBuffer(_device, _buffer, _memory);
+  }
+
+  UniformRingBuffer(const UniformRingBuffer&) = delete;
+  UniformRingBuffer& operator=(const UniformRingBuffer&) = delete;
+
+  /**
+   * @brief Starts allocating from the partition of frame, dropping
+   * everything pushed the last time this frame was used.
+   */
+  void BeginFrame(uint32_t frame) {
+    _frame_begin = _frame_size * (frame % _frame_count);
+    _head = _frame_begin;
+  }
+
+  /**
+   * @brief Copies data into the current frame's partition.
+   * @return The dynamic offset to bind the data with.
+   */
+  uint32_t Push(const void* data, VkDeviceSize size) {
+    VkDeviceSize offset = _head;
+    if (offset + size > _frame_begin + _frame_size) {
+      throw std::runtime_error("uniform ring buffer frame partition is full!");
+    }
+    memcpy(static_cast<char*>(_memory.mapped) + offset, data, static_cast<size_t>(size));
+    _head = align(offset + size);
+    return static_cast<uint32_t>(offset);
+  }
+
+  template<typename T>
+  uint32_t Push(const T& data) {
+    return Push(&data, sizeof(T));
+  }
+
+  VkBuffer GetBuffer() const {
+    return _buffer;
+  }
+
+  VkDeviceSize GetAlignment() const {
+    return _alignment;
+  }
+
+  VkDeviceSize GetFrameSize() const {
+    return _frame_size;
+  }
+
+private:
+  VkDeviceSize align(VkDeviceSize value) const {
+    return (value + _alignment - 1) / _alignment * _alignment;
+  }
+};
+} // VT
@@ -0,0 +1,576 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <vector>
+
+#include "buffer.h"
+#include "image.h"
+#include "memory_allocator.h"
+
+namespace VT {
+
+// size of the shared staging ring. Uploads larger than this get a staging
+// buffer of their own that is freed once their batch completes.
+const VkDeviceSize UPLOAD_STAGING_SIZE = 32 * 1024 * 1024;
+// offsets into the staging ring are aligned to this, which covers the texel
+// size of every format we upload and optimalBufferCopyOffsetAlignment.
+const VkDeviceSize UPLOAD_STAGING_ALIGNMENT = 256;
+
+struct UploadQueueOptions {
+  VkDevice device;
+  VkPhysicalDevice physical_device;
+  // the queue uploads are recorded for, usually the transfer queue.
+  uint32_t queue_family_index;
+  VkQueue queue;
+  // the queue that uses the uploaded resources (graphics). When its family
+  // differs from queue_family_index, resources are released to it at the end
+  // of every batch.
+  uint32_t owner_queue_family_index;
+  VkQueue owner_queue;
+  VkDeviceSize staging_size = UPLOAD_STAGING_SIZE;
+};
+
+/**
+ * @brief Host visible memory for one upload, filled in by the caller before
+ * the batch it belongs to is flushed.
+ */
+struct StagingRegion {
+  VkBuffer buffer;
+  VkDeviceSize offset;
+  void* mapped;
+};
+
+/**
+ * @brief Batches buffer copies, buffer to image copies and layout
+ * transitions into one command buffer per flush.
+ * @details Data is staged in a persistently mapped ring buffer. Every
+ * recorded command belongs to the batch that is currently open, identified
+ * by a ticket. Flush() submits that batch with a fence and opens the next
+ * one; nothing ever waits on the queue, callers poll IsComplete(ticket) or
+ * block in Wait(ticket) only when they really need the data. Staging space
+ * of a batch is reclaimed once its fence has signaled.
+ *
+ * Uploads on the same queue as rendering are ordered before any later
+ * submission by the memory barrier at the end of every batch, so the
+ * renderer only needs pending uploads to be flushed before its own submit.
+ *
+ * On a dedicated transfer family, buffers and images are created with
+ * exclusive sharing, so every copied buffer and every image transitioned out
+ * of TRANSFER_DST_OPTIMAL is released by the transfer batch and acquired on
+ * the owner queue by a small command buffer that waits on the batch's
+ * semaphore. The fence of a batch signals once the acquire has executed, and
+ * renders submitted to the owner queue afterwards see the data.
+ * Not thread safe, record from one thread.
+ */
+class UploadQueue {
+  struct Batch {
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    uint64_t ticket = 0;
+    // staging ring head once the batch was recorded, the ring tail moves
+    // here when the batch completes.
+    VkDeviceSize staging_end = 0;
+    // oversized uploads that did not fit in the ring.
+    std::vector<VkBuffer> dedicated_buffers;
+    std::vector<VT::Allocation> dedicated_memory;
+
+    // only used when ownership is transferred to the owner queue.
+    VkCommandBuffer acquire_command_buffer = VK_NULL_HANDLE;
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    std::vector<VkBufferMemoryBarrier> buffer_acquires;
+    std::vector<VkImageMemoryBarrier> image_acquires;
+  };
+
+  VkDevice _device;
+  VkPhysicalDevice _physical_device;
+  VkQueue _queue;
+  VkCommandPool _command_pool;
+  uint32_t _queue_family_index;
+  uint32_t _owner_queue_family_index;
+  VkQueue _owner_queue;
+  VkCommandPool _owner_command_pool = VK_NULL_HANDLE;
+
+  VkBuffer _staging_buffer;
+  VT::Allocation _staging_memory;
+  VkDeviceSize _staging_size;
+  // [_tail, _head) is in use, wrapping around the end of the ring.
+  // _head == _tail means the ring is empty.
+  VkDeviceSize _head = 0;
+  VkDeviceSize _tail = 0;
+
+  Batch _recording;
+  bool _recording_empty = true;
+  std::deque<Batch> _in_flight;
+  std::vector<Batch> _free_batches;
+
+  uint64_t _next_ticket = 1;
+  uint64_t _completed_ticket = 0;
+
+public:
+  UploadQueue(const UploadQueueOptions& options):
+    _device(options.device),
+    _physical_device(options.physical_device),
+    _queue(options.queue),
+    _queue_family_index(options.queue_family_index),
+    _owner_queue_family_index(options.owner_queue_family_index),
+    _owner_queue(options.owner_queue),
+    _staging_size(options.staging_size) {
+    _command_pool = create_command_pool(_queue_family_index);
+    if (transfers_ownership()) {
+      _owner_command_pool = create_command_pool(_owner_queue_family_index);
+    }
+
+    VT::CreateBuffer(_staging_size,
+                     VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                     _staging_buffer,
+                     _staging_memory,
+                     _device,
+                     _physical_device);
+
+    _recording = acquire_batch();
+    _recording.ticket = _next_ticket++;
+  }
+
+  ~UploadQueue() {
+    WaitIdle();
+    // the open batch was never submitted, its dedicated buffers are unused.
+    release_batch_resources(_recording);
+    destroy_batch(_recording);
+    for (auto& batch : _free_batches) {
+      destroy_batch(batch);
+    }
+    VT::DestroyBuffer(_device, _staging_buffer, _staging_memory);
+    vkDestroyCommandPool(_device, _command_pool, nullptr);
+    if (_owner_command_pool != VK_NULL_HANDLE) {
+      vkDestroyCommandPool(_device, _owner_command_pool, nullptr);
+    }
+  }
+
+  UploadQueue(const UploadQueue&) = delete;
+  UploadQueue& operator=(const UploadQueue&) = delete;
+
+  /**
+   * @brief Reserves size bytes of staging memory for the open batch.
+   * @details When the ring is full the open batch is flushed and the oldest
+   * batches are waited on until there is room, so the copy reading a region
+   * has to be recorded before the next region is staged.
+   */
+  StagingRegion Stage(VkDeviceSize size) {
+    if (size > _staging_size) {
+      return stage_dedicated(size);
+    }
+
+    VkDeviceSize offset;
+    while (!try_allocate(size, offset)) {
+      if (!_recording_empty) {
+        Flush();
+      } else if (!_in_flight.empty()) {
+        wait_batch(_in_flight.front());
+        retire_completed();
+      } else {
+        // nothing is in use, so the ring has been reset to empty and any
+        // size up to _staging_size fits. Reaching this is a bug.
+        throw std::runtime_error("failed to allocate upload staging memory!");
+      }
+    }
+    return StagingRegion{_staging_buffer, offset, static_cast<char*>(_staging_memory.mapped) + offset};
+  }
+
+  /**
+   * @brief Copies data into staging memory and records a copy to dst.
+   * @return The ticket of the batch the copy belongs to.
+   */
+  uint64_t UploadBuffer(const void* data, VkDeviceSize size, VkBuffer dst, VkDeviceSize dst_offset = 0) {
+    StagingRegion region = Stage(size);
+    memcpy(region.mapped, data, static_cast<size_t>(size));
+    return CopyBuffer(region, dst, size, dst_offset);
+  }
+
+  uint64_t CopyBuffer(const StagingRegion& src, VkBuffer dst, VkDeviceSize size, VkDeviceSize dst_offset = 0) {
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = src.offset;
+    copyRegion.dstOffset = dst_offset;
+    copyRegion.size = size;
+    VkCommandBuffer commandBuffer = begin_recording();
+    vkCmdCopyBuffer(commandBuffer, src.buffer, dst, 1, &copyRegion);
+
+    if (transfers_ownership()) {
+      VkBufferMemoryBarrier barrier{};
+      barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+      barrier.srcQueueFamilyIndex = _queue_family_index;
+      barrier.dstQueueFamilyIndex = _owner_queue_family_index;
+      barrier.buffer = dst;
+      barrier.offset = dst_offset;
+      barrier.size = size;
+
+      // release: only the source half of the barrier is executed here.
+      barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      barrier.dstAccessMask = 0;
+      vkCmdPipelineBarrier(commandBuffer,
+                           VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                           0,
+                           0, nullptr,
+                           1, &barrier,
+                           0, nullptr);
+
+      // acquire: the destination half, executed on the owner queue.
+      barrier.srcAccessMask = 0;
+      barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+      _recording.buffer_acquires.push_back(barrier);
+    }
+    return _recording.ticket;
+  }
+
+  uint64_t CopyBufferToImage(const StagingRegion& src, VkImage image, uint32_t width, uint32_t height) {
+    VT::RecordCopyBufferToImage(begin_recording(), src.buffer, src.offset, image, width, height);
+    return _recording.ticket;
+  }
+
+  /**
+   * @brief Records a layout transition.
+   * @details With ownership transfer only transitions into
+   * TRANSFER_DST_OPTIMAL happen on the upload queue, any other layout is the
+   * image being handed to the owner queue: the transition is done by the
+   * release/acquire barrier pair.
+   */
+  uint64_t TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout) {
+    if (!transfers_ownership() || new_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+      VT::RecordImageLayoutTransition(begin_recording(), image, format, old_layout, new_layout);
+      return _recording.ticket;
+    }
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = new_layout;
+    barrier.srcQueueFamilyIndex = _queue_family_index;
+    barrier.dstQueueFamilyIndex = _owner_queue_family_index;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VT::GetImageAspectFlags(format);
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(begin_recording(),
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         0,
+                         0, nullptr,
+                         0, nullptr,
+                         1, &barrier);
+
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL ? VK_ACCESS_SHADER_READ_BIT : VK_ACCESS_MEMORY_READ_BIT;
+    _recording.image_acquires.push_back(barrier);
+    return _recording.ticket;
+  }
+
+  /**
+   * @brief Submits the open batch, if it recorded anything.
+   * @return The ticket of the submitted batch, or of the last submitted one
+   * when there was nothing to submit.
+   */
+  uint64_t Flush() {
+    if (_recording_empty) {
+      return _recording.ticket - 1;
+    }
+
+    if (transfers_ownership()) {
+      submit_with_ownership_transfer();
+    } else {
+      submit();
+    }
+
+    uint64_t ticket = _recording.ticket;
+    _recording.staging_end = _head;
+    _in_flight.push_back(std::move(_recording));
+
+    _recording = acquire_batch();
+    _recording.ticket = _next_ticket++;
+    _recording_empty = true;
+    return ticket;
+  }
+
+  /**
+   * @brief Polls the fences of submitted batches without blocking.
+   * @return true if the batch with this ticket has finished on the gpu.
+   */
+  bool IsComplete(uint64_t ticket) {
+    retire_completed();
+    return ticket <= _completed_ticket;
+  }
+
+  /**
+   * @brief Blocks until the batch with this ticket has finished, flushing
+   * it first if it is still open.
+   */
+  void Wait(uint64_t ticket) {
+    if (ticket >= _recording.ticket) {
+      Flush();
+    }
+    while (!_in_flight.empty() && _in_flight.front().ticket <= ticket) {
+      wait_batch(_in_flight.front());
+      retire_completed();
+    }
+  }
+
+  void WaitIdle() {
+    Wait(_recording.ticket);
+  }
+
+  /**
+   * @brief Reclaims staging memory of every batch that has completed.
+   * Cheap, meant to be called once per frame.
+   */
+  void Collect() {
+    retire_completed();
+  }
+
+  uint64_t GetCompletedTicket() const {
+    return _completed_ticket;
+  }
+
+private:
+  bool transfers_ownership() const {
+    return _queue_family_index != _owner_queue_family_index;
+  }
+
+  VkCommandPool create_command_pool(uint32_t queue_family_index) {
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    // batch command buffers are short lived and reset individually when the
+    // batch is reused.
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = queue_family_index;
+
+    VkCommandPool command_pool;
+    if (vkCreateCommandPool(_device, &poolInfo, nullptr, &command_pool) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create upload command pool!");
+    }
+    return command_pool;
+  }
+
+  VkCommandBuffer allocate_command_buffer(VkCommandPool command_pool) {
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = command_pool;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer command_buffer;
+    if (vkAllocateCommandBuffers(_device, &allocInfo, &command_buffer) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate upload command buffer!");
+    }
+    return command_buffer;
+  }
+
+  // same queue: a memory barrier makes the transfer writes available to
+  // everything submitted after this batch (vertex fetch, index fetch, shader
+  // reads).
+  void submit() {
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    vkCmdPipelineBarrier(_recording.command_buffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                         0,
+                         1, &barrier,
+                         0, nullptr,
+                         0, nullptr);
+
+    if (vkEndCommandBuffer(_recording.command_buffer) != VK_SUCCESS) {
+      throw std::runtime_error("failed to record upload command buffer!");
+    }
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &_recording.command_buffer;
+    if (vkQueueSubmit(_queue, 1, &submitInfo, _recording.fence) != VK_SUCCESS) {
+      throw std::runtime_error("failed to submit upload command buffer!");
+    }
+  }
+
+  // dedicated transfer queue: the batch signals a semaphore, the acquire
+  // command buffer waits on it on the owner queue and signals the fence.
+  void submit_with_ownership_transfer() {
+    if (vkEndCommandBuffer(_recording.command_buffer) != VK_SUCCESS) {
+      throw std::runtime_error("failed to record upload command buffer!");
+    }
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &_recording.command_buffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &_recording.semaphore;
+    if (vkQueueSubmit(_queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+      throw std::runtime_error("failed to submit upload command buffer!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (vkBeginCommandBuffer(_recording.acquire_command_buffer, &beginInfo) != VK_SUCCESS) {
+      throw std::runtime_error("failed to begin recording acquire command buffer!");
+    }
+    if (!_recording.buffer_acquires.empty() || !_recording.image_acquires.empty()) {
+      vkCmdPipelineBarrier(_recording.acquire_command_buffer,
+                           VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                           0,
+                           0, nullptr,
+                           static_cast<uint32_t>(_recording.buffer_acquires.size()), _recording.buffer_acquires.data(),
+                           static_cast<uint32_t>(_recording.image_acquires.size()), _recording.image_acquires.data());
+    }
+    if (vkEndCommandBuffer(_recording.acquire_command_buffer) != VK_SUCCESS) {
+      throw std::runtime_error("failed to record acquire command buffer!");
+    }
+
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    VkSubmitInfo acquireInfo{};
+    acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    acquireInfo.waitSemaphoreCount = 1;
+    acquireInfo.pWaitSemaphores = &_recording.semaphore;
+    acquireInfo.pWaitDstStageMask = &waitStage;
+    acquireInfo.commandBufferCount = 1;
+    acquireInfo.pCommandBuffers = &_recording.acquire_command_buffer;
+    if (vkQueueSubmit(_owner_queue, 1, &acquireInfo, _recording.fence) != VK_SUCCESS) {
+      throw std::runtime_error("failed to submit acquire command buffer!");
+    }
+
+    _recording.buffer_acquires.clear();
+    _recording.image_acquires.clear();
+  }
+
+  Batch acquire_batch() {
+    if (!_free_batches.empty()) {
+      Batch batch = std::move(_free_batches.back());
+      _free_batches.pop_back();
+      vkResetFences(_device, 1, &batch.fence);
+      vkResetCommandBuffer(batch.command_buffer, 0);
+      if (batch.acquire_command_buffer != VK_NULL_HANDLE) {
+        vkResetCommandBuffer(batch.acquire_command_buffer, 0);
+      }
+      return batch;
+    }
+
+    Batch batch{};
+    batch.command_buffer = allocate_command_buffer(_command_pool);
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if (vkCreateFence(_device, &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create upload fence!");
+    }
+
+    if (transfers_ownership()) {
+      batch.acquire_command_buffer = allocate_command_buffer(_owner_command_pool);
+
+      // waited on by the acquire submission, so it is unsignaled again by
+      // the time the batch fence signals and the batch is reused.
+      VkSemaphoreCreateInfo semaphoreInfo{};
+      semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+      if (vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &batch.semaphore) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create upload semaphore!");
+      }
+    }
+    return batch;
+  }
+
+  void destroy_batch(Batch& batch) {
+    vkDestroyFence(_device, batch.fence, nullptr);
+    vkFreeCommandBuffers(_device, _command_pool, 1, &batch.command_buffer);
+    if (batch.acquire_command_buffer != VK_NULL_HANDLE) {
+      vkFreeCommandBuffers(_device, _owner_command_pool, 1, &batch.acquire_command_buffer);
+      vkDestroySemaphore(_device, batch.semaphore, nullptr);
+    }
+  }
+
+  void release_batch_resources(Batch& batch) {
+    for (size_t i = 0; i < batch.dedicated_buffers.size(); i++) {
+      VT::DestroyBuffer(_device, batch.dedicated_buffers[i], batch.dedicated_memory[i]);
+    }
+    batch.dedicated_buffers.clear();
+    batch.dedicated_memory.clear();
+  }
+
+  VkCommandBuffer begin_recording() {
+    if (_recording_empty) {
+      VkCommandBufferBeginInfo beginInfo{};
+      beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+      if (vkBeginCommandBuffer(_recording.command_buffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("failed to begin recording upload command buffer!");
+      }
+      _recording_empty = false;
+    }
+    return _recording.command_buffer;
+  }
+
+  void wait_batch(const Batch& batch) {
+    vkWaitForFences(_device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+  }
+
+  void retire_completed() {
+    // batch fences are all signaled on one queue and complete in order.
+    while (!_in_flight.empty() && vkGetFenceStatus(_device, _in_flight.front().fence) == VK_SUCCESS) {
+      Batch batch = std::move(_in_flight.front());
+      _in_flight.pop_front();
+      _tail = batch.staging_end;
+      _completed_ticket = batch.ticket;
+      release_batch_resources(batch);
+      _free_batches.push_back(std::move(batch));
+    }
+    if (_in_flight.empty() && _recording_empty) {
+      _head = 0;
+      _tail = 0;
+    }
+  }
+
+  bool try_allocate(VkDeviceSize size, VkDeviceSize& offset) {
+    VkDeviceSize start = (_head + UPLOAD_STAGING_ALIGNMENT - 1) / UPLOAD_STAGING_ALIGNMENT * UPLOAD_STAGING_ALIGNMENT;
+    if (_head >= _tail) {
+      // free space is [_head, end) and [0, _tail). The wrapped case must not
+      // catch up with _tail exactly, that would read as an empty ring.
+      if (start + size <= _staging_size) {
+        offset = start;
+      } else if (size < _tail) {
+        offset = 0;
+      } else {
+        return false;
+      }
+    } else if (start + size < _tail) {
+      offset = start;
+    } else {
+      return false;
+    }
+    _head = offset + size;
+    return true;
+  }
+
+  StagingRegion stage_dedicated(VkDeviceSize size) {
+    VkBuffer buffer;
+    VT::Allocation memory;
+    VT::CreateBuffer(size,
+                     VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                     buffer,
+                     memory,
+                     _device,
+                     _physical_device);
+    _recording.dedicated_buffers.push_back(buffer);
+    _recording.dedicated_memory.push_back(memory);
+    return StagingRegion{buffer, 0, memory.mapped};
+  }
+};
+} // VT
@@ -6,13 +6,18 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
+#include <algorithm>
 #include <array>
+#include <cmath>
+#include <cstring>
 
 # define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/hash.hpp>
 
 #include "command_buffer.h"
+#include "upload_queue.h"
 
 namespace VT {
 struct Vertex {
@@ -84,32 +89,203 @@ struct Vertex {
   }
 };
 
+/**
+ * @brief 16 byte vertex, half the size of VT::Vertex.
+ * @details
+ *  - pos is quantized to 16 bit unorm inside the mesh bounding box. The
+ *    shader reads it as a vec3 in [0, 1] and the model matrix maps it back
+ *    to model space (see GetMeshVertexTransform). The fourth component is
+ *    padding so the attribute stays 4 byte aligned.
+ *  - texCoord is stored as half floats.
+ *  - color is stored as rgba8 unorm.
+ */
+struct PackedVertex {
+  uint16_t pos[4];
+  uint16_t texCoord[2];
+  uint8_t color[4];
+
+  static VkVertexInputBindingDescription getBindingDescription() {
+    VkVertexInputBindingDescription bindingDescription{};
+    bindingDescription.binding = 0;
+    bindingDescription.stride = sizeof(PackedVertex);
+    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    return bindingDescription;
+  }
+
+  // same locations as VT::Vertex so the shaders work with either layout. The
+  // formats are converted to floats by the vertex input stage.
+  static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() {
+    std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{};
+
+    attributeDescriptions[0].binding = 0;
+    attributeDescriptions[0].location = 0;
+    attributeDescriptions[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+    attributeDescriptions[0].offset = offsetof(PackedVertex, pos);
+
+    attributeDescriptions[1].binding = 0;
+    attributeDescriptions[1].location = 1;
+    attributeDescriptions[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+    attributeDescriptions[1].offset = offsetof(PackedVertex, color);
+
+    attributeDescriptions[2].binding = 0;
+    attributeDescriptions[2].location = 2;
+    attributeDescriptions[2].format = VK_FORMAT_R16G16_SFLOAT;
+    attributeDescriptions[2].offset = offsetof(PackedVertex, texCoord);
+
+    return attributeDescriptions;
+  }
+};
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex is expected to be 16 bytes");
+
+// The vertex layout uploaded to the gpu, selected at compile time with
+// VT_PACKED_VERTICES.
+#ifdef VT_PACKED_VERTICES
+using MeshVertex = PackedVertex;
+#else
+using MeshVertex = Vertex;
+#endif
+
+/**
+ * @brief Per instance vertex input, the second vertex binding.
+ * @details Advanced once per instance instead of once per vertex, so one
+ * indexed draw renders instance_count copies of a mesh each with its own
+ * model matrix. A mat4 attribute takes one location per column, 3 to 6.
+ */
+struct InstanceData {
+  glm::mat4 model;
+
+  static VkVertexInputBindingDescription getBindingDescription() {
+    VkVertexInputBindingDescription bindingDescription{};
+    bindingDescription.binding = 1;
+    bindingDescription.stride = sizeof(InstanceData);
+    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+    return bindingDescription;
+  }
+
+  static std::array<VkVertexInputAttributeDescription, 4> getAttributeDescriptions() {
+    std::array<VkVertexInputAttributeDescription, 4> attributeDescriptions{};
+    for (uint32_t column = 0; column < 4; column++) {
+      attributeDescriptions[column].binding = 1;
+      attributeDescriptions[column].location = 3 + column;
+      attributeDescriptions[column].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+      attributeDescriptions[column].offset = static_cast<uint32_t>(offsetof(InstanceData, model) + sizeof(glm::vec4) * column);
+    }
+    return attributeDescriptions;
+  }
+};
+static_assert(sizeof(InstanceData) == 64, "InstanceData is expected to be a tightly packed mat4");
+
+/**
+ * @brief Bounding box positions are quantized against.
+ */
+struct MeshQuantization {
+  glm::vec3 offset;
+  // size of the box, never zero so decoding a flat mesh does not divide by it.
+  glm::vec3 scale;
+};
+
+MeshQuantization ComputeMeshQuantization(const Vertex* vertices, size_t vertex_count) {
+  MeshQuantization quantization{glm::vec3(0.0f), glm::vec3(1.0f)};
+  if (vertex_count == 0) {
+    return quantization;
+  }
+
+  glm::vec3 min = vertices[0].pos;
+  glm::vec3 max = vertices[0].pos;
+  for (size_t i = 1; i < vertex_count; i++) {
+    min = glm::min(min, vertices[i].pos);
+    max = glm::max(max, vertices[i].pos);
+  }
+  quantization.offset = min;
+  quantization.scale = max - min;
+  for (int axis = 0; axis < 3; axis++) {
+    if (quantization.scale[axis] <= 0.0f) {
+      quantization.scale[axis] = 1.0f;
+    }
+  }
+  return quantization;
+}
+
+/**
+ * @brief Matrix that takes positions as read from a MeshVertex to model
+ * space, meant to be folded into the model matrix.
+ */
+glm::mat4 GetMeshVertexTransform([[maybe_unused]] const MeshQuantization& quantization) {
+#ifdef VT_PACKED_VERTICES
+  return glm::scale(glm::translate(glm::mat4(1.0f), quantization.offset), quantization.scale);
+#else
+  return glm::mat4(1.0f);
+#endif
+}
+
+uint16_t quantize_unorm16(float value) {
+  return static_cast<uint16_t>(std::lround(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f));
+}
+
+uint8_t quantize_unorm8(float value) {
+  return static_cast<uint8_t>(std::lround(std::min(std::max(value, 0.0f), 1.0f) * 255.0f));
+}
+
+PackedVertex EncodePackedVertex(const Vertex& vertex, const MeshQuantization& quantization) {
+  PackedVertex packed{};
+  glm::vec3 normalized = (vertex.pos - quantization.offset) / quantization.scale;
+  packed.pos[0] = quantize_unorm16(normalized.x);
+  packed.pos[1] = quantize_unorm16(normalized.y);
+  packed.pos[2] = quantize_unorm16(normalized.z);
+  packed.pos[3] = 0;
+  packed.texCoord[0] = glm::packHalf1x16(vertex.texCoord.x);
+  packed.texCoord[1] = glm::packHalf1x16(vertex.texCoord.y);
+  packed.color[0] = quantize_unorm8(vertex.color.x);
+  packed.color[1] = quantize_unorm8(vertex.color.y);
+  packed.color[2] = quantize_unorm8(vertex.color.z);
+  packed.color[3] = 255;
+  return packed;
+}
+
+/**
+ * @brief Cpu side inverse of EncodePackedVertex, matching what the vertex
+ * input stage and GetMeshVertexTransform do on the gpu.
+ */
+Vertex DecodePackedVertex(const PackedVertex& packed, const MeshQuantization& quantization) {
+  Vertex vertex{};
+  glm::vec3 normalized(packed.pos[0] / 65535.0f, packed.pos[1] / 65535.0f, packed.pos[2] / 65535.0f);
+  vertex.pos = quantization.offset + normalized * quantization.scale;
+  vertex.texCoord = glm::vec2(glm::unpackHalf1x16(packed.texCoord[0]), glm::unpackHalf1x16(packed.texCoord[1]));
+  vertex.color = glm::vec3(packed.color[0] / 255.0f, packed.color[1] / 255.0f, packed.color[2] / 255.0f);
+  return vertex;
+}
+
+/**
+ * @brief Writes vertices in the MeshVertex layout to dst, which has room
+ * for vertex_count MeshVertex.
+ */
+void WriteMeshVertices(const Vertex* vertices, size_t vertex_count, [[maybe_unused]] const MeshQuantization& quantization, void* dst) {
+#ifdef VT_PACKED_VERTICES
+  PackedVertex* packed = static_cast<PackedVertex*>(dst);
+  for (size_t i = 0; i < vertex_count; i++) {
+    packed[i] = EncodePackedVertex(vertices[i], quantization);
+  }
+#else
+  memcpy(dst, vertices, sizeof(Vertex) * vertex_count);
+#endif
+}
+
 struct CreateVertexBufferOptions {
   VkDevice device;
   VkPhysicalDevice physical_device;
-  VkCommandPool command_pool;
-  VkQueue graphics_queue;
-  std::vector<Vertex>& vertices;
+  VT::UploadQueue* upload_queue;
+  const Vertex* vertices;
+  size_t vertex_count;
+  // only used when the vertices are packed.
+  MeshQuantization quantization;
 };
 
-void CreateVertexBuffer(CreateVertexBufferOptions& options, VkBuffer& vertexBuffer, VkDeviceMemory& vertexBufferMemory) {
-  VkDeviceSize bufferSize = sizeof(options.vertices[0]) * options.vertices.size();
-
-  VkBuffer stagingBuffer;
-  VkDeviceMemory stagingBufferMemory;
-  VT::CreateBuffer(bufferSize,
-                  VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                  stagingBuffer,
-                  stagingBufferMemory,
-                  options.device,
-                  options.physical_device);
-  // copy data to vertex buffer.
-  // mapping buffer memory into the cpu accessible memory with vkMapMemory
-  void* data;
-  vkMapMemory(options.device, stagingBufferMemory, 0, bufferSize, 0, &data);
-  memcpy(data, options.vertices.data(), (size_t) bufferSize);
-  vkUnmapMemory(options.device, stagingBufferMemory);
+/**
+ * @brief Creates the device local vertex buffer and records its upload.
+ * @return The upload queue ticket after which the buffer holds the vertices.
+ */
+uint64_t CreateVertexBuffer(CreateVertexBufferOptions& options, VkBuffer& vertexBuffer, VT::Allocation& vertexBufferMemory) {
+  VkDeviceSize bufferSize = sizeof(MeshVertex) * options.vertex_count;
 
   // The most optimal memory has the VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT flag
   // and is usually not accessible by the CPU on dedicated graphics cards.
@@ -123,10 +299,13 @@ void CreateVertexBuffer(CreateVertexBufferOptions& options, VkBuffer& vertexBuff
                     vertexBufferMemory,
                     options.device,
                     options.physical_device);
-  VT::CopyBufferOptions copy_buffer_options {options.device, options.command_pool, options.graphics_queue};
-  VT::CopyBuffer(copy_buffer_options, stagingBuffer, vertexBuffer, bufferSize);
-  vkDestroyBuffer(options.device, stagingBuffer, nullptr);
-  vkFreeMemory(options.device, stagingBufferMemory, nullptr);
+
+  // copy data to vertex buffer.
+  // staging memory comes from the upload queue's mapped ring, packed vertices
+  // are encoded straight into it.
+  VT::StagingRegion staging = options.upload_queue->Stage(bufferSize);
+  VT::WriteMeshVertices(options.vertices, options.vertex_count, options.quantization, staging.mapped);
+  return options.upload_queue->CopyBuffer(staging, vertexBuffer, bufferSize);
 }
 }
 
@@ -0,0 +1,211 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "vertex.h"
+
+namespace VT {
+
+/**
+ * @brief Runs fn(begin, end, worker) over [0, count) split into one
+ * contiguous range per worker and waits for all of them.
+ */
+template<typename Fn>
+void ParallelFor(size_t count, unsigned thread_count, Fn fn) {
+  thread_count = std::max(1u, thread_count);
+  size_t chunk = (count + thread_count - 1) / thread_count;
+
+  std::vector<std::thread> workers;
+  workers.reserve(thread_count);
+  for (unsigned t = 0; t < thread_count; t++) {
+    size_t begin = std::min(count, t * chunk);
+    size_t end = std::min(count, begin + chunk);
+    workers.emplace_back(fn, begin, end, t);
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+unsigned DefaultThreadCount() {
+  unsigned count = std::thread::hardware_concurrency();
+  return count == 0 ? 1 : count;
+}
+
+uint64_t mix_vertex_hash(uint64_t hash, float value) {
+  // -0.0f == 0.0f, so both have to land in the same bucket.
+  if (value == 0.0f) {
+    value = 0.0f;
+  }
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  hash ^= bits;
+  hash *= 0x9e3779b97f4a7c15ull;
+  return (hash << 31) | (hash >> 33);
+}
+
+/**
+ * @brief 64 bit hash over every component of the vertex.
+ * @details Unlike the xor-shift std::hash<VT::Vertex>, which cancels out on
+ * grid aligned positions, every float is folded in with a multiply and
+ * rotate and the result goes through the splitmix64 finalizer.
+ */
+uint64_t HashVertex(const Vertex& vertex) {
+  uint64_t hash = 0;
+  hash = mix_vertex_hash(hash, vertex.pos.x);
+  hash = mix_vertex_hash(hash, vertex.pos.y);
+  hash = mix_vertex_hash(hash, vertex.pos.z);
+  hash = mix_vertex_hash(hash, vertex.color.x);
+  hash = mix_vertex_hash(hash, vertex.color.y);
+  hash = mix_vertex_hash(hash, vertex.color.z);
+  hash = mix_vertex_hash(hash, vertex.texCoord.x);
+  hash = mix_vertex_hash(hash, vertex.texCoord.y);
+
+  hash ^= hash >> 30;
+  hash *= 0xbf58476d1ce4e5b9ull;
+  hash ^= hash >> 27;
+  hash *= 0x94d049bb133111ebull;
+  hash ^= hash >> 31;
+  return hash;
+}
+
+/**
+ * @brief Single threaded deduplication of one vertex per index (corner).
+ * @details Unique vertices are emitted in order of first occurrence, which
+ * is the order the parallel path has to reproduce.
+ */
+void DedupVertices(const std::vector<Vertex>& corners, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+  std::unordered_map<VT::Vertex, uint32_t> uniqueVertices{};
+  indices.reserve(indices.size() + corners.size());
+
+  for (const auto& vertex : corners) {
+    if (uniqueVertices.count(vertex) == 0) {
+      uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
+      vertices.push_back(vertex);
+    }
+    indices.push_back(uniqueVertices[vertex]);
+  }
+}
+
+/**
+ * @brief Multi threaded deduplication, produces the same output as
+ * DedupVertices.
+ * @details
+ *  1. the corners are hashed in parallel and every worker buckets its
+ *     contiguous range by the top bits of the hash into partitions.
+ *  2. each partition is deduplicated independently with a linear probing
+ *     table. Walking the buckets of worker 0, then 1, ... keeps the corners
+ *     in their original order, so the first occurrence wins just like in the
+ *     serial path.
+ *  3. a prefix sum over the first occurrences numbers the unique vertices
+ *     in corner order and the indices are resolved from it.
+ */
+void DedupVerticesParallel(
+    const std::vector<Vertex>& corners,
+    std::vector<Vertex>& vertices,
+    std::vector<uint32_t>& indices,
+    unsigned thread_count) {
+  const size_t corner_count = corners.size();
+  const uint32_t EMPTY = UINT32_MAX;
+  thread_count = std::max(1u, std::min<unsigned>(thread_count, static_cast<unsigned>(corner_count / 4096 + 1)));
+
+  // a few partitions per worker so an unlucky one does not stall the rest.
+  uint32_t partition_bits = 0;
+  while ((1u << partition_bits) < thread_count * 4) {
+    partition_bits++;
+  }
+  const uint32_t partition_count = 1u << partition_bits;
+
+  std::vector<uint64_t> hashes(corner_count);
+  // buckets[worker * partition_count + partition] = corner indices
+  std::vector<std::vector<uint32_t>> buckets(thread_count * partition_count);
+  ParallelFor(corner_count, thread_count, [&](size_t begin, size_t end, unsigned worker) {
+    std::vector<uint32_t>* worker_buckets = &buckets[worker * partition_count];
+    for (size_t i = begin; i < end; i++) {
+      hashes[i] = HashVertex(corners[i]);
+      uint32_t partition = partition_bits == 0 ? 0 : static_cast<uint32_t>(hashes[i] >> (64 - partition_bits));
+      worker_buckets[partition].push_back(static_cast<uint32_t>(i));
+    }
+  });
+
+  // first[i] is the corner index of the first corner equal to corner i.
+  std::vector<uint32_t> first(corner_count);
+  ParallelFor(partition_count, thread_count, [&](size_t begin, size_t end, unsigned) {
+    std::vector<uint32_t> table;
+    for (size_t partition = begin; partition < end; partition++) {
+      size_t count = 0;
+      for (unsigned worker = 0; worker < thread_count; worker++) {
+        count += buckets[worker * partition_count + partition].size();
+      }
+      size_t capacity = 16;
+      while (capacity < count * 2) {
+        capacity <<= 1;
+      }
+      const size_t mask = capacity - 1;
+      table.assign(capacity, EMPTY);
+
+      for (unsigned worker = 0; worker < thread_count; worker++) {
+        for (uint32_t corner : buckets[worker * partition_count + partition]) {
+          size_t slot = static_cast<size_t>(hashes[corner]) & mask;
+          while (true) {
+            uint32_t candidate = table[slot];
+            if (candidate == EMPTY) {
+              table[slot] = corner;
+              first[corner] = corner;
+              break;
+            }
+            if (hashes[candidate] == hashes[corner] && corners[candidate] == corners[corner]) {
+              first[corner] = candidate;
+              break;
+            }
+            slot = (slot + 1) & mask;
+          }
+        }
+      }
+    }
+  });
+
+  std::vector<uint32_t> unique_per_worker(thread_count + 1, 0);
+  ParallelFor(corner_count, thread_count, [&](size_t begin, size_t end, unsigned worker) {
+    uint32_t count = 0;
+    for (size_t i = begin; i < end; i++) {
+      count += first[i] == i;
+    }
+    unique_per_worker[worker + 1] = count;
+  });
+  for (unsigned worker = 0; worker < thread_count; worker++) {
+    unique_per_worker[worker + 1] += unique_per_worker[worker];
+  }
+
+  const size_t vertex_base = vertices.size();
+  const size_t index_base = indices.size();
+  vertices.resize(vertex_base + unique_per_worker[thread_count]);
+  indices.resize(index_base + corner_count);
+
+  // vertex_ids is only filled in for first occurrences, every other corner
+  // looks its id up through first[].
+  std::vector<uint32_t> vertex_ids(corner_count);
+  ParallelFor(corner_count, thread_count, [&](size_t begin, size_t end, unsigned worker) {
+    uint32_t next = unique_per_worker[worker];
+    for (size_t i = begin; i < end; i++) {
+      if (first[i] == i) {
+        vertex_ids[i] = static_cast<uint32_t>(vertex_base + next);
+        vertices[vertex_base + next] = corners[i];
+        next++;
+      }
+    }
+  });
+  ParallelFor(corner_count, thread_count, [&](size_t begin, size_t end, unsigned) {
+    for (size_t i = begin; i < end; i++) {
+      indices[index_base + i] = vertex_ids[first[i]];
+    }
+  });
+}
+} // VT
@@ -3,12 +3,17 @@
 #include <GLFW/glfw3.h>
 
 #include <string.h>
+#include <algorithm>
+#include <iostream>
 #include <stdexcept>
 #include <memory>
 #include <vector>
 
+#include "constants.h"
 #include "device.h"
 #include "logical_device.h"
+#include "memory_allocator.h"
+#include "pipeline_cache.h"
 #include "queue_families.h"
 #include "surface.h"
 #include "vulkan_debug.h"
@@ -39,27 +44,43 @@ struct VulkanInstanceInfo {
   VT::QueueFamilyIndices queue_family_indices;
   VkQueue graphics_queue;
   VkQueue present_queue;
+  // the graphics queue when the device has no dedicated family.
+  VkQueue transfer_queue;
+  VkQueue compute_queue;
+  // api version the instance was created with.
+  uint32_t api_version;
+  bool timeline_semaphores;
+  bool sampler_anisotropy;
+  bool multi_draw_indirect;
+  bool draw_indirect_count;
+  bool conditional_rendering;
 };
 
 struct VulkanOptions {
   GLFWwindow* window;
   const char* application_name;
   const char* engine_name;
+  // no window, surface or swapchain: window is null and the device only
+  // needs a graphics queue, e.g. a software implementation in ci.
+  bool headless;
   // const std::vector<const char*> extensions_array;
   // uint32_t extension_count;
 
   VulkanOptions(
       GLFWwindow* window,
       const char* application_name,
-      const char* engine_name) :window(window),
-                                 application_name(application_name),
-                                 engine_name(engine_name) {}
+      const char* engine_name,
+      bool headless = false) :window(window),
+                              application_name(application_name),
+                              engine_name(engine_name),
+                              headless(headless) {}
 
   VulkanOptions operator=(const VulkanOptions& other) const {
     return VulkanOptions {
       other.window,
       other.application_name,
       other.engine_name,
+      other.headless,
     };
   }
 };
@@ -68,6 +89,8 @@ class Vulkan {
  private:
   std::unique_ptr<VulkanInstanceInfo> _instance_info;
   std::unique_ptr<VulkanOptions> _options;
+  // shared by every pipeline created on the device.
+  std::unique_ptr<PipelineCache> _pipeline_cache;
   // bool _frame_buffer_resized = false;
 
   // Vulkan(std::unique_ptr<VulkanOptions>& options, std::unique_ptr<VulkanInstanceInfo>& instance_info):
@@ -83,13 +106,19 @@ public:
 
   ~Vulkan() {
     auto info = *_instance_info.get();
+    // saves the cache to disk, needs the device.
+    _pipeline_cache.reset();
+    // every block has to be returned before the device goes away.
+    VT::DestroyMemoryAllocator(info.device);
     vkDestroyDevice(info.device, nullptr);
 
     if (ENABLE_VALIDATION_LAYERS) {
       DestroyDebugUtilsMessengerEXT(info.instance, info.debug_messenger, nullptr);
     }
 
-    vkDestroySurfaceKHR(info.instance, info.surface, nullptr);
+    if (info.surface != VK_NULL_HANDLE) {
+      vkDestroySurfaceKHR(info.instance, info.surface, nullptr);
+    }
     vkDestroyInstance(info.instance, nullptr);
 
   }
@@ -129,33 +158,112 @@ public:
     return this->_instance_info->present_queue;
   }
 
+  const VkPipelineCache GetPipelineCache() {
+    return _pipeline_cache->GetPipelineCache();
+  }
+
+  const VkQueue GetTransferQueue() {
+    return this->_instance_info->transfer_queue;
+  }
+
+  const VkQueue GetComputeQueue() {
+    return this->_instance_info->compute_queue;
+  }
+
+  bool SupportsTimelineSemaphores() {
+    return this->_instance_info->timeline_semaphores;
+  }
+
+  bool SupportsSamplerAnisotropy() {
+    return this->_instance_info->sampler_anisotropy;
+  }
+
+  bool SupportsMultiDrawIndirect() {
+    return this->_instance_info->multi_draw_indirect;
+  }
+
+  bool SupportsDrawIndirectCount() {
+    return this->_instance_info->draw_indirect_count;
+  }
+
+  bool SupportsConditionalRendering() {
+    return this->_instance_info->conditional_rendering;
+  }
+
+  bool IsHeadless() {
+    return this->_options->headless;
+  }
+
 private:
   std::unique_ptr<VulkanInstanceInfo> initalize_instance_info() {
     return std::make_unique<VulkanInstanceInfo>(VulkanInstanceInfo{});
   }
 
   void fill_instance(const VulkanOptions& options, std::unique_ptr<VulkanInstanceInfo>& info) {
-    CreateVkInstance(options, &info->instance);
+    // 1.2 when the loader has it, for timeline semaphores and indirect count.
+    info->api_version = std::min(VT::GetInstanceApiVersion(), static_cast<uint32_t>(VK_API_VERSION_1_2));
+    CreateVkInstance(options, info->api_version, &info->instance);
 
     setup_debug_messenger(info->instance, ENABLE_VALIDATION_LAYERS, &info->debug_messenger);
 
-    VulkanSurfaceOptions surface_options {
-      info->instance,
-      options.window
-    };
-    VulkanSurface::CreateSurface(surface_options, &info->surface);
+    // headless has no surface and needs no swapchain extension.
+    info->surface = VK_NULL_HANDLE;
+    const std::vector<const char*> device_extensions = options.headless ? std::vector<const char*>{} : DEVICE_EXTENSIONS;
+    if (!options.headless) {
+      VulkanSurfaceOptions surface_options {
+        info->instance,
+        options.window
+      };
+      VulkanSurface::CreateSurface(surface_options, &info->surface);
+    }
 
-    auto queue_family_indices = VT::PickPhysicalDevice(info->instance, info->surface, DEVICE_EXTENSIONS, ENABLE_VALIDATION_LAYERS, info->physical_device);
+    auto queue_family_indices = VT::PickPhysicalDevice(info->instance, info->surface, device_extensions, ENABLE_VALIDATION_LAYERS, info->physical_device);
     info->queue_family_indices = queue_family_indices;
 
-    VT::CreateLogicalDevice(queue_family_indices, info->physical_device, VALIDATION_LAYERS, ENABLE_VALIDATION_LAYERS, DEVICE_EXTENSIONS, &info->device);
+    info->timeline_semaphores = VT::SupportsTimelineSemaphores(info->instance, info->api_version, info->physical_device);
+    info->sampler_anisotropy = VT::SupportsSamplerAnisotropy(info->physical_device);
+    info->multi_draw_indirect = VT::SupportsMultiDrawIndirect(info->physical_device);
+    info->draw_indirect_count = VT::SupportsDrawIndirectCount(info->instance, info->api_version, info->physical_device);
+    info->conditional_rendering = VT::SupportsConditionalRendering(info->instance, info->api_version, info->physical_device);
+    VT::LogicalDeviceFeatures features{info->sampler_anisotropy, info->timeline_semaphores, info->multi_draw_indirect, info->draw_indirect_count, info->conditional_rendering};
+    VT::CreateLogicalDevice(queue_family_indices, info->physical_device, VALIDATION_LAYERS, ENABLE_VALIDATION_LAYERS, device_extensions, features, &info->device);
 
     VT::GetDeviceQueue(info->device, queue_family_indices.graphicsFamily.value(), &info->graphics_queue);
     VT::GetDeviceQueue(info->device, queue_family_indices.presentFamily.value() , &info->present_queue);
+    VT::GetDeviceQueue(info->device, queue_family_indices.GetTransferFamily(), &info->transfer_queue);
+    VT::GetDeviceQueue(info->device, queue_family_indices.GetComputeFamily(), &info->compute_queue);
+
+    print_device_summary(*info);
+
+    _pipeline_cache = std::make_unique<PipelineCache>(info->device, info->physical_device, VT::PIPELINE_CACHE_PATH);
+  }
+
+  // one line for the device and the optional features the renderer picked up.
+  static void print_device_summary(const VulkanInstanceInfo& info) {
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(info.physical_device, &properties);
+    std::cout << "device: " << properties.deviceName
+              << ", queue families graphics " << info.queue_family_indices.graphicsFamily.value()
+              << " transfer " << info.queue_family_indices.GetTransferFamily()
+              << " compute " << info.queue_family_indices.GetComputeFamily()
+              << ", " << (info.timeline_semaphores ? "timeline semaphore" : "fence") << " frame sync";
+    if (info.sampler_anisotropy) {
+      std::cout << ", anisotropy";
+    }
+    if (info.multi_draw_indirect) {
+      std::cout << ", multi draw indirect";
+    }
+    if (info.draw_indirect_count) {
+      std::cout << ", indirect count";
+    }
+    if (info.conditional_rendering) {
+      std::cout << ", conditional rendering";
+    }
+    std::cout << std::endl;
   }
 
-  static void CreateVkInstance(const VulkanOptions& options, VkInstance* instance) {
-    auto extensions = VT::get_required_extensions(ENABLE_VALIDATION_LAYERS);
+  static void CreateVkInstance(const VulkanOptions& options, uint32_t api_version, VkInstance* instance) {
+    auto extensions = VT::get_required_extensions(ENABLE_VALIDATION_LAYERS, options.headless);
 
     if (ENABLE_VALIDATION_LAYERS && !CheckValidationLayerSupport(VALIDATION_LAYERS)) {
       throw std::runtime_error("validation layers requested, but not available!");
@@ -167,7 +275,7 @@ private:
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = options.engine_name;
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    appInfo.apiVersion = api_version;
 
     VkInstanceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
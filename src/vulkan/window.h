@@ -7,6 +7,8 @@ struct WindowOptions {
   const char* title;
   void* user_pointer;
   GLFWframebuffersizefun framebuffer_resize_callback;
+  // benchmarks create the window hidden, they only need its surface.
+  bool visible = true;
   WindowOptions(){}
   WindowOptions(WindowOptions& other) {
     *this = other;
@@ -18,6 +20,7 @@ GLFWwindow* CreateWindow(WindowOptions& options) {
   glfwInit();
   glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
   glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+  glfwWindowHint(GLFW_VISIBLE, options.visible ? GLFW_TRUE : GLFW_FALSE);
 
   window = glfwCreateWindow(options.width, options.height, options.title, nullptr, nullptr);
   glfwSetWindowUserPointer(window, options.user_pointer);